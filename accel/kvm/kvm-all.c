@@ -47,6 +47,7 @@
 #include "kvm-cpus.h"
 
 #include "hw/boards.h"
+#include "qapi/qapi-commands-machine.h"
 
 /* This check must be after config-host.h is included */
 #ifdef CONFIG_EVENTFD
@@ -87,15 +88,40 @@ enum KVMDirtyRingReaperState {
     KVM_DIRTY_RING_REAPER_REAPING,
 };
 
+/* Bounds of the adaptive reaping interval */
+#define KVM_DIRTY_RING_REAP_MIN_MS      10
+#define KVM_DIRTY_RING_REAP_MAX_MS      1000
+
 /*
  * KVM reaper instance, responsible for collecting the KVM dirty bits
- * via the dirty ring.
+ * via the dirty rings of a group of vCPUs.
  */
 struct KVMDirtyRingReaper {
     /* The reaper thread */
     QemuThread reaper_thr;
     volatile uint64_t reaper_iteration; /* iteration number of reaper thr */
     volatile enum KVMDirtyRingReaperState reaper_state; /* reap thr state */
+    /* Wakes the thread up before the interval is over */
+    QemuSemaphore kick;
+    /*
+     * Protects the rings of @cpus and everything below.  Taken before
+     * the slots lock.
+     */
+    QemuMutex lock;
+    GPtrArray *cpus;
+    /* Dirty GFNs collected, published once the rings are reset */
+    GArray *gfns;
+    unsigned interval_ms;
+    /* Most entries found in one ring during the last reap */
+    uint32_t max_fill;
+    /* When the thread last reaped all rings, in ms */
+    int64_t last_reap_ms;
+    /* Statistics */
+    uint64_t reaps;
+    uint64_t pages;
+    uint64_t ring_full_exits;
+    uint64_t reap_ns;
+    uint64_t reap_ns_max;
 };
 
 struct KVMState
@@ -148,7 +174,8 @@ struct KVMState
     } *as;
     uint64_t kvm_dirty_ring_bytes;  /* Size of the per-vcpu dirty ring */
     uint32_t kvm_dirty_ring_size;   /* Number of dirty GFNs per ring */
-    struct KVMDirtyRingReaper reaper;
+    uint32_t kvm_dirty_ring_reapers; /* Number of reaper threads */
+    struct KVMDirtyRingReaper *reapers;
 };
 
 KVMState *kvm_state;
@@ -384,6 +411,56 @@ err:
     return ret;
 }
 
+/*
+ * Pick the reaper of @cpu.  The reapers are split between NUMA nodes,
+ * so that each one only walks the rings of vCPUs of the same node.
+ */
+static struct KVMDirtyRingReaper *kvm_dirty_ring_reaper_of(KVMState *s,
+                                                           CPUState *cpu)
+{
+    MachineState *ms = current_machine;
+    MachineClass *mc = MACHINE_GET_CLASS(ms);
+    uint32_t n = s->kvm_dirty_ring_reapers;
+    uint32_t index = cpu->cpu_index % n;
+
+    if (ms->numa_state && ms->numa_state->num_nodes > 1 &&
+        mc->cpu_index_to_instance_props) {
+        CpuInstanceProperties props =
+            mc->cpu_index_to_instance_props(ms, cpu->cpu_index);
+        uint32_t nodes = ms->numa_state->num_nodes;
+
+        if (props.has_node_id) {
+            uint32_t first = props.node_id * n / nodes;
+            uint32_t count = MAX((props.node_id + 1) * n / nodes - first, 1);
+
+            index = (first + cpu->cpu_index % count) % n;
+        }
+    }
+
+    return &s->reapers[index];
+}
+
+static void kvm_dirty_ring_reaper_add_cpu(KVMState *s, CPUState *cpu)
+{
+    struct KVMDirtyRingReaper *r = kvm_dirty_ring_reaper_of(s, cpu);
+
+    qemu_mutex_lock(&r->lock);
+    g_ptr_array_add(r->cpus, cpu);
+    cpu->kvm_dirty_ring_reaper = r;
+    qemu_mutex_unlock(&r->lock);
+}
+
+/* Called before unmapping the ring, which the reaper may be walking */
+static void kvm_dirty_ring_reaper_del_cpu(CPUState *cpu)
+{
+    struct KVMDirtyRingReaper *r = cpu->kvm_dirty_ring_reaper;
+
+    qemu_mutex_lock(&r->lock);
+    g_ptr_array_remove(r->cpus, cpu);
+    cpu->kvm_dirty_ring_reaper = NULL;
+    qemu_mutex_unlock(&r->lock);
+}
+
 static int do_kvm_destroy_vcpu(CPUState *cpu)
 {
     KVMState *s = kvm_state;
@@ -411,6 +488,7 @@ static int do_kvm_destroy_vcpu(CPUState *cpu)
     }
 
     if (cpu->kvm_dirty_gfns) {
+        kvm_dirty_ring_reaper_del_cpu(cpu);
         ret = munmap(cpu->kvm_dirty_gfns, s->kvm_dirty_ring_bytes);
         if (ret < 0) {
             goto err;
@@ -505,6 +583,7 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
             DPRINTF("mmap'ing vcpu dirty gfns failed: %d\n", ret);
             goto err;
         }
+        kvm_dirty_ring_reaper_add_cpu(s, cpu);
     }
 
     ret = kvm_arch_init_vcpu(cpu);
@@ -625,11 +704,6 @@ static void kvm_slot_sync_dirty_pages(KVMSlot *slot)
     cpu_physical_memory_set_dirty_lebitmap(slot->dirty_bmap, start, pages);
 }
 
-static void kvm_slot_reset_dirty_pages(KVMSlot *slot)
-{
-    memset(slot->dirty_bmap, 0, slot->dirty_bmap_size);
-}
-
 #define ALIGN(x, y)  (((x)+(y)-1) & ~((y)-1))
 
 /* Allocate the dirty bitmap for a slot  */
@@ -639,6 +713,11 @@ static void kvm_slot_init_dirty_bitmap(KVMSlot *mem)
         return;
     }
 
+    /* The dirty ring is harvested directly into the RAM dirty bitmaps */
+    if (kvm_state->kvm_dirty_ring_size) {
+        return;
+    }
+
     /*
      * XXX bad kernel interface alert
      * For dirty bitmap, kernel allocates array of size aligned to
@@ -686,26 +765,43 @@ static bool kvm_slot_get_dirty_log(KVMState *s, KVMSlot *slot)
     return ret == 0;
 }
 
-/* Should be with all slots_lock held for the address spaces. */
-static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
-                                     uint32_t slot_id, uint64_t offset)
+/*
+ * Publish the collected GFNs straight into the RAM dirty bitmaps, which
+ * saves scanning per-slot bitmaps as large as guest memory at each
+ * sync.  Must be with slots_lock held, after the rings were reset.
+ */
+static void kvm_dirty_ring_publish(KVMState *s, GArray *gfns)
 {
-    KVMMemoryListener *kml;
-    KVMSlot *mem;
+    uint8_t clients = DIRTY_CLIENTS_NOCODE;
+    guint i;
 
-    if (as_id >= s->nr_as) {
-        return;
+    if (!global_dirty_tracking) {
+        clients &= ~(1 << DIRTY_MEMORY_MIGRATION);
     }
 
-    kml = s->as[as_id].ml;
-    mem = &kml->slots[slot_id];
+    for (i = 0; i < gfns->len; i++) {
+        struct kvm_dirty_gfn *gfn = &g_array_index(gfns, struct kvm_dirty_gfn,
+                                                   i);
+        uint32_t as_id = gfn->slot >> 16;
+        uint32_t slot_id = gfn->slot & 0xffff;
+        KVMSlot *mem;
 
-    if (!mem->memory_size || offset >=
-        (mem->memory_size / qemu_real_host_page_size)) {
-        return;
-    }
+        if (as_id >= s->nr_as || slot_id >= s->nr_slots) {
+            continue;
+        }
 
-    set_bit(offset, mem->dirty_bmap);
+        mem = &s->as[as_id].ml->slots[slot_id];
+        if (!mem->memory_size || gfn->offset >=
+            (mem->memory_size / qemu_real_host_page_size)) {
+            continue;
+        }
+
+        cpu_physical_memory_set_dirty_range(mem->ram_start_offset +
+                                            gfn->offset *
+                                            qemu_real_host_page_size,
+                                            qemu_real_host_page_size,
+                                            clients);
+    }
 }
 
 static bool dirty_gfn_is_dirtied(struct kvm_dirty_gfn *gfn)
@@ -719,11 +815,12 @@ static void dirty_gfn_set_collected(struct kvm_dirty_gfn *gfn)
 }
 
 /*
- * Should be with all slots_lock held for the address spaces.  It returns the
+ * Should be with the reaper lock of the vCPU held.  It returns the
  * dirty page we've collected on this dirty ring.
  */
 static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
 {
+    struct KVMDirtyRingReaper *r = cpu->kvm_dirty_ring_reaper;
     struct kvm_dirty_gfn *dirty_gfns = cpu->kvm_dirty_gfns, *cur;
     uint32_t ring_size = s->kvm_dirty_ring_size;
     uint32_t count = 0, fetch = cpu->kvm_fetch_index;
@@ -736,8 +833,7 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
         if (!dirty_gfn_is_dirtied(cur)) {
             break;
         }
-        kvm_dirty_ring_mark_page(s, cur->slot >> 16, cur->slot & 0xffff,
-                                 cur->offset);
+        g_array_append_val(r->gfns, *cur);
         dirty_gfn_set_collected(cur);
         trace_kvm_dirty_ring_page(cpu->cpu_index, fetch, cur->offset);
         fetch++;
@@ -749,28 +845,57 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
     return count;
 }
 
-/* Must be with slots_lock held */
-static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
+/*
+ * Reap the rings of the vCPUs of @r, or only the ring of @cpu if not
+ * NULL.  Must be with r->lock held, and not the slots lock.
+ */
+static uint64_t kvm_dirty_ring_reap_locked(KVMState *s,
+                                           struct KVMDirtyRingReaper *r,
+                                           CPUState *cpu)
 {
     int ret;
-    CPUState *cpu;
     uint64_t total = 0;
+    uint32_t count;
     int64_t stamp;
+    guint i;
 
     stamp = get_clock();
 
-    CPU_FOREACH(cpu) {
-        total += kvm_dirty_ring_reap_one(s, cpu);
+    r->max_fill = 0;
+    for (i = 0; i < r->cpus->len; i++) {
+        CPUState *c = g_ptr_array_index(r->cpus, i);
+
+        if (!cpu || c == cpu) {
+            count = kvm_dirty_ring_reap_one(s, c);
+            r->max_fill = MAX(r->max_fill, count);
+            total += count;
+        }
     }
 
     if (total) {
+        /*
+         * We must _NOT_ publish dirty bits to the other threads (e.g.,
+         * the migration thread) before correctly re-protect those
+         * dirtied pages.  Otherwise we can have potential risk of data
+         * corruption if the page data is read in the other thread
+         * before we do the reset.  The reset also covers the entries
+         * other reapers collected, so it may return less than @total.
+         */
+        kvm_slots_lock();
         ret = kvm_vm_ioctl(s, KVM_RESET_DIRTY_RINGS);
-        assert(ret == total);
+        assert(ret >= 0);
+        kvm_dirty_ring_publish(s, r->gfns);
+        kvm_slots_unlock();
+        g_array_set_size(r->gfns, 0);
     }
 
     stamp = get_clock() - stamp;
 
     if (total) {
+        r->reaps++;
+        r->pages += total;
+        r->reap_ns += stamp;
+        r->reap_ns_max = MAX(r->reap_ns_max, stamp);
         trace_kvm_dirty_ring_reap(total, stamp / 1000);
     }
 
@@ -778,35 +903,47 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
 }
 
 /*
- * Currently for simplicity, we must hold BQL before calling this.  We can
- * consider to drop the BQL if we're clear with all the race conditions.
+ * Reap the dirty rings of all vCPUs, or only the one of @cpu if not
+ * NULL.  Must not be called with the slots lock held.
  */
-static uint64_t kvm_dirty_ring_reap(KVMState *s)
+static uint64_t kvm_dirty_ring_reap(KVMState *s, CPUState *cpu)
 {
-    uint64_t total;
+    uint64_t total = 0;
+    uint32_t i;
 
-    /*
-     * We need to lock all kvm slots for all address spaces here,
-     * because:
-     *
-     * (1) We need to mark dirty for dirty bitmaps in multiple slots
-     *     and for tons of pages, so it's better to take the lock here
-     *     once rather than once per page.  And more importantly,
-     *
-     * (2) We must _NOT_ publish dirty bits to the other threads
-     *     (e.g., the migration thread) via the kvm memory slot dirty
-     *     bitmaps before correctly re-protect those dirtied pages.
-     *     Otherwise we can have potential risk of data corruption if
-     *     the page data is read in the other thread before we do
-     *     reset below.
-     */
-    kvm_slots_lock();
-    total = kvm_dirty_ring_reap_locked(s);
-    kvm_slots_unlock();
+    for (i = 0; i < s->kvm_dirty_ring_reapers; i++) {
+        struct KVMDirtyRingReaper *r = &s->reapers[i];
+
+        if (cpu && cpu->kvm_dirty_ring_reaper != r) {
+            continue;
+        }
+        qemu_mutex_lock(&r->lock);
+        total += kvm_dirty_ring_reap_locked(s, r, cpu);
+        qemu_mutex_unlock(&r->lock);
+    }
 
     return total;
 }
 
+/*
+ * The ring of @cpu is full: reap it right away without the BQL, and
+ * make its reaper poll more often so that it does not happen again.
+ */
+static void kvm_dirty_ring_ring_full(KVMState *s, CPUState *cpu)
+{
+    struct KVMDirtyRingReaper *r = cpu->kvm_dirty_ring_reaper;
+
+    qemu_mutex_lock(&r->lock);
+    kvm_dirty_ring_reap_locked(s, r, cpu);
+    r->ring_full_exits++;
+    qatomic_set(&r->interval_ms, MAX(r->interval_ms / 2,
+                                     KVM_DIRTY_RING_REAP_MIN_MS));
+    qemu_mutex_unlock(&r->lock);
+
+    trace_kvm_dirty_ring_reaper_kick("ring full");
+    qemu_sem_post(&r->kick);
+}
+
 static void do_kvm_cpu_synchronize_kick(CPUState *cpu, run_on_cpu_data arg)
 {
     /* No need to do anything */
@@ -848,7 +985,7 @@ static void kvm_dirty_ring_flush(void)
      * vcpus out in a synchronous way.
      */
     kvm_cpu_synchronize_kick_all();
-    kvm_dirty_ring_reap(kvm_state);
+    kvm_dirty_ring_reap(kvm_state, NULL);
     trace_kvm_dirty_ring_flush(1);
 }
 
@@ -1368,6 +1505,15 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     ram = memory_region_get_ram_ptr(mr) + mr_offset;
     ram_start_offset = memory_region_get_ram_addr(mr) + mr_offset;
 
+    /*
+     * Best effort sync of the dirty ring, see below.  It takes the
+     * slots lock on its own.
+     */
+    if (!add && kvm_state->kvm_dirty_ring_size &&
+        (kvm_mem_flags(mr) & KVM_MEM_LOG_DIRTY_PAGES)) {
+        kvm_dirty_ring_reap(kvm_state, NULL);
+    }
+
     kvm_slots_lock();
 
     if (!add) {
@@ -1391,12 +1537,10 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                  *
                  * Not easy.  Let's cross the fingers until it's fixed.
                  */
-                if (kvm_state->kvm_dirty_ring_size) {
-                    kvm_dirty_ring_reap_locked(kvm_state);
-                } else {
+                if (!kvm_state->kvm_dirty_ring_size) {
                     kvm_slot_get_dirty_log(kvm_state, mem);
+                    kvm_slot_sync_dirty_pages(mem);
                 }
-                kvm_slot_sync_dirty_pages(mem);
             }
 
             /* unregister the slot */
@@ -1443,29 +1587,63 @@ out:
     kvm_slots_unlock();
 }
 
+/*
+ * Poll faster when rings fill up between two reaps, so that vCPUs do
+ * not stall on ring-full exits, and slower when they stay mostly empty.
+ * The fill found after @elapsed_ms is scaled to a whole interval, so
+ * that early reaps do not make the rings look emptier than they are.
+ * Only a full interval without kicks shows that they stay empty.
+ * Must be with r->lock held.
+ */
+static void kvm_dirty_ring_reaper_adapt(KVMState *s,
+                                        struct KVMDirtyRingReaper *r,
+                                        int64_t elapsed_ms, bool kicked)
+{
+    unsigned interval = r->interval_ms;
+    uint64_t fill = (uint64_t)r->max_fill * interval / MAX(elapsed_ms, 1);
+
+    if (fill > s->kvm_dirty_ring_size / 2) {
+        interval = MAX(interval / 2, KVM_DIRTY_RING_REAP_MIN_MS);
+    } else if (fill < s->kvm_dirty_ring_size / 8 && !kicked &&
+               elapsed_ms >= interval) {
+        interval = MIN(interval * 2, KVM_DIRTY_RING_REAP_MAX_MS);
+    }
+    qatomic_set(&r->interval_ms, interval);
+}
+
 static void *kvm_dirty_ring_reaper_thread(void *data)
 {
-    KVMState *s = data;
-    struct KVMDirtyRingReaper *r = &s->reaper;
+    KVMState *s = kvm_state;
+    struct KVMDirtyRingReaper *r = data;
 
     rcu_register_thread();
 
     trace_kvm_dirty_ring_reaper("init");
 
+    r->last_reap_ms = get_clock() / SCALE_MS;
     while (true) {
+        int64_t now_ms;
+        bool kicked;
+
+        /* Kicks posted during the last reap were served by it */
+        while (qemu_sem_timedwait(&r->kick, 0) == 0) {
+            continue;
+        }
+
         r->reaper_state = KVM_DIRTY_RING_REAPER_WAIT;
         trace_kvm_dirty_ring_reaper("wait");
-        /*
-         * TODO: provide a smarter timeout rather than a constant?
-         */
-        sleep(1);
+        kicked = qemu_sem_timedwait(&r->kick,
+                                    qatomic_read(&r->interval_ms)) == 0;
 
         trace_kvm_dirty_ring_reaper("wakeup");
         r->reaper_state = KVM_DIRTY_RING_REAPER_REAPING;
 
-        qemu_mutex_lock_iothread();
-        kvm_dirty_ring_reap(s);
-        qemu_mutex_unlock_iothread();
+        qemu_mutex_lock(&r->lock);
+        kvm_dirty_ring_reap_locked(s, r, NULL);
+        now_ms = get_clock() / SCALE_MS;
+        kvm_dirty_ring_reaper_adapt(s, r, now_ms - r->last_reap_ms, kicked);
+        r->last_reap_ms = now_ms;
+        qemu_mutex_unlock(&r->lock);
 
         r->reaper_iteration++;
     }
@@ -1479,15 +1657,63 @@ static void *kvm_dirty_ring_reaper_thread(void *data)
 
 static int kvm_dirty_ring_reaper_init(KVMState *s)
 {
-    struct KVMDirtyRingReaper *r = &s->reaper;
+    uint32_t i;
 
-    qemu_thread_create(&r->reaper_thr, "kvm-reaper",
-                       kvm_dirty_ring_reaper_thread,
-                       s, QEMU_THREAD_JOINABLE);
+    s->reapers = g_new0(struct KVMDirtyRingReaper, s->kvm_dirty_ring_reapers);
+    for (i = 0; i < s->kvm_dirty_ring_reapers; i++) {
+        struct KVMDirtyRingReaper *r = &s->reapers[i];
+        g_autofree char *name = g_strdup_printf("kvm-reaper-%u", i);
+
+        qemu_mutex_init(&r->lock);
+        qemu_sem_init(&r->kick, 0);
+        r->cpus = g_ptr_array_new();
+        r->gfns = g_array_new(false, false, sizeof(struct kvm_dirty_gfn));
+        r->interval_ms = KVM_DIRTY_RING_REAP_MAX_MS;
+        qemu_thread_create(&r->reaper_thr, name,
+                           kvm_dirty_ring_reaper_thread,
+                           r, QEMU_THREAD_JOINABLE);
+    }
 
     return 0;
 }
 
+HumanReadableText *qmp_x_query_dirty_ring(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    KVMState *s = kvm_state;
+    uint32_t i;
+
+    if (!kvm_enabled() || !s->kvm_dirty_ring_size) {
+        error_setg(errp, "Dirty ring statistics are only available with "
+                   "accel=kvm,dirty-ring-size=N");
+        return NULL;
+    }
+
+    for (i = 0; i < s->kvm_dirty_ring_reapers; i++) {
+        struct KVMDirtyRingReaper *r = &s->reapers[i];
+        guint j;
+
+        qemu_mutex_lock(&r->lock);
+        g_string_append_printf(buf, "reaper %u: interval %u ms, vCPUs",
+                               i, r->interval_ms);
+        for (j = 0; j < r->cpus->len; j++) {
+            CPUState *cpu = g_ptr_array_index(r->cpus, j);
+
+            g_string_append_printf(buf, " %d", cpu->cpu_index);
+        }
+        g_string_append_printf(buf, "\n  reaps %" PRIu64 ", pages %" PRIu64
+                               ", ring full exits %" PRIu64 "\n",
+                               r->reaps, r->pages, r->ring_full_exits);
+        g_string_append_printf(buf, "  reap latency avg %" PRIu64
+                               " us, max %" PRIu64 " us\n",
+                               r->reaps ? r->reap_ns / r->reaps / 1000 : 0,
+                               r->reap_ns_max / 1000);
+        qemu_mutex_unlock(&r->lock);
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
 static void kvm_region_add(MemoryListener *listener,
                            MemoryRegionSection *section)
 {
@@ -1518,32 +1744,8 @@ static void kvm_log_sync(MemoryListener *listener,
 
 static void kvm_log_sync_global(MemoryListener *l)
 {
-    KVMMemoryListener *kml = container_of(l, KVMMemoryListener, listener);
-    KVMState *s = kvm_state;
-    KVMSlot *mem;
-    int i;
-
-    /* Flush all kernel dirty addresses into KVMSlot dirty bitmap */
+    /* Flush all kernel dirty addresses into the RAM dirty bitmaps */
     kvm_dirty_ring_flush();
-
-    /*
-     * TODO: make this faster when nr_slots is big while there are
-     * only a few used slots (small VMs).
-     */
-    kvm_slots_lock();
-    for (i = 0; i < s->nr_slots; i++) {
-        mem = &kml->slots[i];
-        if (mem->memory_size && mem->flags & KVM_MEM_LOG_DIRTY_PAGES) {
-            kvm_slot_sync_dirty_pages(mem);
-            /*
-             * This is not needed by KVM_GET_DIRTY_LOG because the
-             * ioctl will unconditionally overwrite the whole region.
-             * However kvm dirty ring has no such side effect.
-             */
-            kvm_slot_reset_dirty_pages(mem);
-        }
-    }
-    kvm_slots_unlock();
 }
 
 static void kvm_log_clear(MemoryListener *listener,
@@ -2930,9 +3132,7 @@ int kvm_cpu_exec(CPUState *cpu)
              * still full.  Got kicked by KVM_RESET_DIRTY_RINGS.
              */
             trace_kvm_dirty_ring_full(cpu->cpu_index);
-            qemu_mutex_lock_iothread();
-            kvm_dirty_ring_reap(kvm_state);
-            qemu_mutex_unlock_iothread();
+            kvm_dirty_ring_ring_full(kvm_state, cpu);
             ret = 0;
             break;
         case KVM_EXIT_SYSTEM_EVENT:
@@ -3613,6 +3813,39 @@ static void kvm_set_dirty_ring_size(Object *obj, Visitor *v,
     s->kvm_dirty_ring_size = value;
 }
 
+static void kvm_get_dirty_ring_reapers(Object *obj, Visitor *v,
+                                       const char *name, void *opaque,
+                                       Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value = s->kvm_dirty_ring_reapers;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void kvm_set_dirty_ring_reapers(Object *obj, Visitor *v,
+                                       const char *name, void *opaque,
+                                       Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value;
+
+    if (s->fd != -1) {
+        error_setg(errp, "Cannot set properties after the accelerator has been initialized");
+        return;
+    }
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!value) {
+        error_setg(errp, "dirty-ring-reapers must be at least 1");
+        return;
+    }
+
+    s->kvm_dirty_ring_reapers = value;
+}
+
 static void kvm_accel_instance_init(Object *obj)
 {
     KVMState *s = KVM_STATE(obj);
@@ -3624,6 +3857,7 @@ static void kvm_accel_instance_init(Object *obj)
     s->kernel_irqchip_split = ON_OFF_AUTO_AUTO;
     /* KVM dirty ring is by default off */
     s->kvm_dirty_ring_size = 0;
+    s->kvm_dirty_ring_reapers = 1;
 }
 
 static void kvm_accel_class_init(ObjectClass *oc, void *data)
@@ -3651,6 +3885,12 @@ static void kvm_accel_class_init(ObjectClass *oc, void *data)
         NULL, NULL);
     object_class_property_set_description(oc, "dirty-ring-size",
         "Size of KVM dirty page ring buffer (default: 0, i.e. use bitmap)");
+
+    object_class_property_add(oc, "dirty-ring-reapers", "uint32",
+        kvm_get_dirty_ring_reapers, kvm_set_dirty_ring_reapers,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-reapers",
+        "Number of threads reaping the KVM dirty rings (default: 1)");
 }
 
 static const TypeInfo kvm_accel_type = {
@@ -15,6 +15,8 @@
 
 #ifndef CONFIG_USER_ONLY
 #include "hw/pci/msi.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
 #endif
 
 KVMState *kvm_state;
@@ -152,4 +154,10 @@ bool kvm_dirty_ring_enabled(void)
 {
     return false;
 }
+
+HumanReadableText *qmp_x_query_dirty_ring(Error **errp)
+{
+    error_setg(errp, "KVM is not available");
+    return NULL;
+}
 #endif
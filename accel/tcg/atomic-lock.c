@@ -0,0 +1,93 @@
+/*
+ * Lock-based emulation of guest atomic operations
+ *
+ * Atomic operations that the host cannot perform with a single instruction
+ * (misaligned accesses, or 16-byte accesses on hosts without a 128-bit
+ * compare-and-swap) normally run in an exclusive section, which stops
+ * every other vCPU.  When enabled, they are serialized instead by a small
+ * array of spinlocks, hashed on the host address of the guest memory.
+ * Two such operations conflict only if they touch the same 16-byte
+ * granule (or two granules that hash to the same lock).
+ *
+ * The price is that these operations are only atomic with respect to each
+ * other: a concurrent host atomic instruction that overlaps them, e.g. an
+ * aligned 8-byte cmpxchg on one half of a location that another vCPU
+ * updates with a 16-byte cmpxchg, is not excluded.  That is why this mode
+ * must be enabled explicitly.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "internal.h"
+
+#define ATOMIC_LOCK_BITS     10
+#define ATOMIC_LOCK_GRANULE  4
+
+/* Keep each lock in its own cache line, they are taken by all vCPUs */
+typedef struct AtomicLock {
+    QemuSpin lock;
+} QEMU_ALIGNED(64) AtomicLock;
+
+static AtomicLock atomic_locks[1 << ATOMIC_LOCK_BITS];
+
+bool atomic_lock_enabled;
+
+void atomic_lock_init(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(atomic_locks); i++) {
+        qemu_spin_init(&atomic_locks[i].lock);
+    }
+    atomic_lock_enabled = true;
+}
+
+static unsigned atomic_lock_index(uintptr_t haddr)
+{
+    uintptr_t granule = haddr >> ATOMIC_LOCK_GRANULE;
+
+    return (granule ^ (granule >> ATOMIC_LOCK_BITS)) &
+           (ARRAY_SIZE(atomic_locks) - 1);
+}
+
+/*
+ * An access of at most 16 bytes spans at most two granules.  Take their
+ * locks in index order, so that two vCPUs locking overlapping ranges
+ * cannot deadlock.
+ */
+static void atomic_lock_range(void *haddr, size_t len,
+                              unsigned *first, unsigned *last)
+{
+    unsigned a = atomic_lock_index((uintptr_t)haddr);
+    unsigned b = atomic_lock_index((uintptr_t)haddr + len - 1);
+
+    *first = MIN(a, b);
+    *last = MAX(a, b);
+}
+
+void atomic_lock_acquire(void *haddr, size_t len)
+{
+    unsigned first, last;
+
+    atomic_lock_range(haddr, len, &first, &last);
+    qemu_spin_lock(&atomic_locks[first].lock);
+    if (last != first) {
+        qemu_spin_lock(&atomic_locks[last].lock);
+    }
+    /* Like the host atomic operations they replace, act as full barriers */
+    smp_mb();
+}
+
+void atomic_lock_release(void *haddr, size_t len)
+{
+    unsigned first, last;
+
+    smp_mb();
+    atomic_lock_range(haddr, len, &first, &last);
+    if (last != first) {
+        qemu_spin_unlock(&atomic_locks[last].lock);
+    }
+    qemu_spin_unlock(&atomic_locks[first].lock);
+}
@@ -59,6 +59,54 @@
 # define ABI_TYPE  uint32_t
 #endif
 
+/*
+ * Accesses that the host cannot perform atomically, because they are
+ * misaligned or because it lacks a 128-bit compare-and-swap, are only
+ * let through by atomic_mmu_lookup() if they can be serialized by the
+ * stripe locks instead.
+ */
+#if DATA_SIZE == 16 && !HAVE_CMPXCHG128
+# define ATOMIC_LOCKED(H)  true
+#else
+# define ATOMIC_LOCKED(H)  unlikely((uintptr_t)(H) & (DATA_SIZE - 1))
+#endif
+
+/* Under the stripe locks: LDO = *HADDR; BODY; *HADDR = LDN.  */
+#define ATOMIC_LOCKED_RMW(HADDR, LDO, LDN, BODY)  \
+    do {                                          \
+        atomic_lock_acquire(HADDR, DATA_SIZE);    \
+        memcpy(&(LDO), HADDR, DATA_SIZE);         \
+        BODY;                                     \
+        memcpy(HADDR, &(LDN), DATA_SIZE);         \
+        atomic_lock_release(HADDR, DATA_SIZE);    \
+    } while (0)
+
+static inline DATA_TYPE glue(atomic_locked_cmpxchg_, SUFFIX)
+    (DATA_TYPE *haddr, DATA_TYPE cmpv, DATA_TYPE newv)
+{
+    DATA_TYPE old;
+
+    atomic_lock_acquire(haddr, DATA_SIZE);
+    memcpy(&old, haddr, DATA_SIZE);
+#if DATA_SIZE == 16
+    if (int128_eq(old, cmpv)) {
+#else
+    if (old == cmpv) {
+#endif
+        memcpy(haddr, &newv, DATA_SIZE);
+    }
+    atomic_lock_release(haddr, DATA_SIZE);
+    return old;
+}
+
+#if DATA_SIZE == 16 && HAVE_CMPXCHG128
+# define ATOMIC_CMPXCHG(H, C, N)  atomic16_cmpxchg(H, C, N)
+#elif DATA_SIZE == 16
+# define ATOMIC_CMPXCHG(H, C, N)  glue(atomic_locked_cmpxchg_, SUFFIX)(H, C, N)
+#else
+# define ATOMIC_CMPXCHG(H, C, N)  qatomic_cmpxchg__nocheck(H, C, N)
+#endif
+
 /* Define host-endian atomic operations.  Note that END is used within
    the ATOMIC_NAME macro, and redefined below.  */
 #if DATA_SIZE == 1
@@ -78,11 +126,11 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, target_ulong addr,
     DATA_TYPE ret;
 
     atomic_trace_rmw_pre(env, addr, oi);
-#if DATA_SIZE == 16
-    ret = atomic16_cmpxchg(haddr, cmpv, newv);
-#else
-    ret = qatomic_cmpxchg__nocheck(haddr, cmpv, newv);
-#endif
+    if (ATOMIC_LOCKED(haddr)) {
+        ret = glue(atomic_locked_cmpxchg_, SUFFIX)(haddr, cmpv, newv);
+    } else {
+        ret = ATOMIC_CMPXCHG(haddr, cmpv, newv);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return ret;
@@ -98,7 +146,13 @@ ABI_TYPE ATOMIC_NAME(ld)(CPUArchState *env, target_ulong addr,
     DATA_TYPE val;
 
     atomic_trace_ld_pre(env, addr, oi);
-    val = atomic16_read(haddr);
+    if (ATOMIC_LOCKED(haddr)) {
+        atomic_lock_acquire(haddr, DATA_SIZE);
+        memcpy(&val, haddr, DATA_SIZE);
+        atomic_lock_release(haddr, DATA_SIZE);
+    } else {
+        val = atomic16_read(haddr);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_ld_post(env, addr, oi);
     return val;
@@ -111,7 +165,13 @@ void ATOMIC_NAME(st)(CPUArchState *env, target_ulong addr, ABI_TYPE val,
                                          PAGE_WRITE, retaddr);
 
     atomic_trace_st_pre(env, addr, oi);
-    atomic16_set(haddr, val);
+    if (ATOMIC_LOCKED(haddr)) {
+        atomic_lock_acquire(haddr, DATA_SIZE);
+        memcpy(haddr, &val, DATA_SIZE);
+        atomic_lock_release(haddr, DATA_SIZE);
+    } else {
+        atomic16_set(haddr, val);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_st_post(env, addr, oi);
 }
@@ -125,13 +185,19 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, target_ulong addr, ABI_TYPE val,
     DATA_TYPE ret;
 
     atomic_trace_rmw_pre(env, addr, oi);
-    ret = qatomic_xchg__nocheck(haddr, val);
+    if (ATOMIC_LOCKED(haddr)) {
+        DATA_TYPE new;
+        ATOMIC_LOCKED_RMW(haddr, ret, new, new = val);
+    } else {
+        ret = qatomic_xchg__nocheck(haddr, val);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return ret;
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+/* FN and RET are only used for accesses emulated under the stripe locks */
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
@@ -139,20 +205,34 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                                          PAGE_READ | PAGE_WRITE, retaddr); \
     DATA_TYPE ret;                                                  \
     atomic_trace_rmw_pre(env, addr, oi);                            \
-    ret = qatomic_##X(haddr, val);                                  \
+    if (ATOMIC_LOCKED(haddr)) {                                     \
+        DATA_TYPE old, new;                                         \
+        ATOMIC_LOCKED_RMW(haddr, old, new, new = FN(old, val));     \
+        ret = RET;                                                  \
+    } else {                                                        \
+        ret = qatomic_##X(haddr, val);                              \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return ret;                                                     \
 }
 
-GEN_ATOMIC_HELPER(fetch_add)
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(add_fetch)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+#define ADD(X, Y)   (X + Y)
+#define AND(X, Y)   (X & Y)
+#define OR(X, Y)    (X | Y)
+#define XOR(X, Y)   (X ^ Y)
+GEN_ATOMIC_HELPER(fetch_add, ADD, old)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(add_fetch, ADD, new)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
+#undef ADD
+#undef AND
+#undef OR
+#undef XOR
 
 #undef GEN_ATOMIC_HELPER
 
@@ -172,12 +252,16 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                                           PAGE_READ | PAGE_WRITE, retaddr); \
     XDATA_TYPE cmp, old, new, val = xval;                           \
     atomic_trace_rmw_pre(env, addr, oi);                            \
-    smp_mb();                                                       \
-    cmp = qatomic_read__nocheck(haddr);                             \
-    do {                                                            \
-        old = cmp; new = FN(old, val);                              \
-        cmp = qatomic_cmpxchg__nocheck(haddr, old, new);            \
-    } while (cmp != old);                                           \
+    if (ATOMIC_LOCKED(haddr)) {                                     \
+        ATOMIC_LOCKED_RMW(haddr, old, new, new = FN(old, val));     \
+    } else {                                                        \
+        smp_mb();                                                   \
+        cmp = qatomic_read__nocheck(haddr);                         \
+        do {                                                        \
+            old = cmp; new = FN(old, val);                          \
+            cmp = qatomic_cmpxchg__nocheck(haddr, old, new);        \
+        } while (cmp != old);                                       \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return RET;                                                     \
@@ -217,11 +301,12 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, target_ulong addr,
     DATA_TYPE ret;
 
     atomic_trace_rmw_pre(env, addr, oi);
-#if DATA_SIZE == 16
-    ret = atomic16_cmpxchg(haddr, BSWAP(cmpv), BSWAP(newv));
-#else
-    ret = qatomic_cmpxchg__nocheck(haddr, BSWAP(cmpv), BSWAP(newv));
-#endif
+    if (ATOMIC_LOCKED(haddr)) {
+        ret = glue(atomic_locked_cmpxchg_, SUFFIX)(haddr, BSWAP(cmpv),
+                                                   BSWAP(newv));
+    } else {
+        ret = ATOMIC_CMPXCHG(haddr, BSWAP(cmpv), BSWAP(newv));
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return BSWAP(ret);
@@ -237,7 +322,13 @@ ABI_TYPE ATOMIC_NAME(ld)(CPUArchState *env, target_ulong addr,
     DATA_TYPE val;
 
     atomic_trace_ld_pre(env, addr, oi);
-    val = atomic16_read(haddr);
+    if (ATOMIC_LOCKED(haddr)) {
+        atomic_lock_acquire(haddr, DATA_SIZE);
+        memcpy(&val, haddr, DATA_SIZE);
+        atomic_lock_release(haddr, DATA_SIZE);
+    } else {
+        val = atomic16_read(haddr);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_ld_post(env, addr, oi);
     return BSWAP(val);
@@ -251,7 +342,13 @@ void ATOMIC_NAME(st)(CPUArchState *env, target_ulong addr, ABI_TYPE val,
 
     atomic_trace_st_pre(env, addr, oi);
     val = BSWAP(val);
-    atomic16_set(haddr, val);
+    if (ATOMIC_LOCKED(haddr)) {
+        atomic_lock_acquire(haddr, DATA_SIZE);
+        memcpy(haddr, &val, DATA_SIZE);
+        atomic_lock_release(haddr, DATA_SIZE);
+    } else {
+        atomic16_set(haddr, val);
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_st_post(env, addr, oi);
 }
@@ -265,13 +362,23 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, target_ulong addr, ABI_TYPE val,
     ABI_TYPE ret;
 
     atomic_trace_rmw_pre(env, addr, oi);
-    ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    if (ATOMIC_LOCKED(haddr)) {
+        DATA_TYPE old, new;
+        ATOMIC_LOCKED_RMW(haddr, old, new, new = BSWAP(val));
+        ret = old;
+    } else {
+        ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
+    }
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr, oi);
     return BSWAP(ret);
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+/*
+ * Bitwise operations do not care about byte order: under the stripe
+ * locks, FN is applied to the byte-swapped operand.
+ */
+#define GEN_ATOMIC_HELPER(X, FN, RET)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
@@ -279,18 +386,30 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                                          PAGE_READ | PAGE_WRITE, retaddr); \
     DATA_TYPE ret;                                                  \
     atomic_trace_rmw_pre(env, addr, oi);                            \
-    ret = qatomic_##X(haddr, BSWAP(val));                           \
+    if (ATOMIC_LOCKED(haddr)) {                                     \
+        DATA_TYPE old, new;                                         \
+        ATOMIC_LOCKED_RMW(haddr, old, new, new = FN(old, BSWAP(val))); \
+        ret = RET;                                                  \
+    } else {                                                        \
+        ret = qatomic_##X(haddr, BSWAP(val));                       \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return BSWAP(ret);                                              \
 }
 
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+#define AND(X, Y)   (X & Y)
+#define OR(X, Y)    (X | Y)
+#define XOR(X, Y)   (X ^ Y)
+GEN_ATOMIC_HELPER(fetch_and, AND, old)
+GEN_ATOMIC_HELPER(fetch_or, OR, old)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, old)
+GEN_ATOMIC_HELPER(and_fetch, AND, new)
+GEN_ATOMIC_HELPER(or_fetch, OR, new)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, new)
+#undef AND
+#undef OR
+#undef XOR
 
 #undef GEN_ATOMIC_HELPER
 
@@ -309,12 +428,18 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, target_ulong addr,       \
                                           PAGE_READ | PAGE_WRITE, retaddr); \
     XDATA_TYPE ldo, ldn, old, new, val = xval;                      \
     atomic_trace_rmw_pre(env, addr, oi);                            \
-    smp_mb();                                                       \
-    ldn = qatomic_read__nocheck(haddr);                             \
-    do {                                                            \
-        ldo = ldn; old = BSWAP(ldo); new = FN(old, val);            \
-        ldn = qatomic_cmpxchg__nocheck(haddr, ldo, BSWAP(new));     \
-    } while (ldo != ldn);                                           \
+    if (ATOMIC_LOCKED(haddr)) {                                     \
+        ATOMIC_LOCKED_RMW(haddr, ldo, ldn,                          \
+                          old = BSWAP(ldo); new = FN(old, val);     \
+                          ldn = BSWAP(new));                        \
+    } else {                                                        \
+        smp_mb();                                                   \
+        ldn = qatomic_read__nocheck(haddr);                         \
+        do {                                                        \
+            ldo = ldn; old = BSWAP(ldo); new = FN(old, val);        \
+            ldn = qatomic_cmpxchg__nocheck(haddr, ldo, BSWAP(new)); \
+        } while (ldo != ldn);                                       \
+    }                                                               \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr, oi);                           \
     return RET;                                                     \
@@ -343,6 +468,9 @@ GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
 #undef END
 #endif /* DATA_SIZE > 1 */
 
+#undef ATOMIC_LOCKED
+#undef ATOMIC_LOCKED_RMW
+#undef ATOMIC_CMPXCHG
 #undef BSWAP
 #undef ABI_TYPE
 #undef DATA_TYPE
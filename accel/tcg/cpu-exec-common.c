@@ -21,6 +21,7 @@
 #include "sysemu/cpus.h"
 #include "sysemu/tcg.h"
 #include "exec/exec-all.h"
+#include "internal.h"
 
 bool tcg_allowed;
 
@@ -76,8 +77,22 @@ void cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc)
     cpu_loop_exit(cpu);
 }
 
-void cpu_loop_exit_atomic(CPUState *cpu, uintptr_t pc)
+void cpu_loop_exit_atomic_reason(CPUState *cpu, uintptr_t pc,
+                                 ExclusiveReason reason)
 {
+    exclusive_stats_inc(reason);
     cpu->exception_index = EXCP_ATOMIC;
     cpu_loop_exit_restore(cpu, pc);
 }
+
+void cpu_loop_exit_atomic(CPUState *cpu, uintptr_t pc)
+{
+    cpu_loop_exit_atomic_reason(cpu, pc, EXCLUSIVE_ATOMIC_INSN);
+}
+
+void cpu_loop_exit_deferred_io(CPUState *cpu, uintptr_t pc)
+{
+    cpu->icount_io_deferred = true;
+    cpu->exception_index = EXCP_INTERRUPT;
+    cpu_loop_exit_restore(cpu, pc);
+}
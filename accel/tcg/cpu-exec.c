@@ -27,6 +27,7 @@
 #include "trace.h"
 #include "disas/disas.h"
 #include "exec/exec-all.h"
+#include "exec/cputlb.h"
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
 #include "qemu/compiler.h"
@@ -171,34 +172,204 @@ uint32_t curr_cflags(CPUState *cpu)
     return cflags;
 }
 
+/* Check whether to resize the jump cache after this many lookups */
+#define TB_JMP_CACHE_WINDOW (1 << 16)
+/* Sample this many entries to estimate how full the jump cache is */
+#define TB_JMP_CACHE_SAMPLES 64
+
+/* Allocate an empty jump cache, keeping the totals of @old if any.  */
+static CPUJumpCache *tb_jmp_cache_new(unsigned int bits, CPUJumpCache *old)
+{
+    CPUJumpCache *jc = g_malloc0(sizeof(CPUJumpCache) +
+                                 (sizeof(TranslationBlock *) << bits));
+
+    jc->bits = bits;
+    if (old) {
+        jc->lookups = old->lookups;
+        jc->misses = old->misses;
+        jc->victim_hits = old->victim_hits;
+        jc->resizes = old->resizes + 1;
+    }
+    return jc;
+}
+
+/*
+ * Install @tb for @pc in the jump cache of the current vCPU.  The TB it
+ * replaces moves to the victim set of its own pc.
+ */
+static void tb_jmp_cache_insert(CPUJumpCache *jc, target_ulong pc,
+                                TranslationBlock *tb)
+{
+    uint32_t hash = tb_jmp_cache_hash_func(pc, jc->bits);
+    TranslationBlock *old = qatomic_read(&jc->array[hash]);
+
+    if (old && old != tb && !(tb_cflags(old) & CF_INVALID)) {
+        unsigned int v = tb_jmp_victim_hash_func(old->pc);
+
+        v += jc->victim_next++ % TB_JMP_VICTIM_WAYS;
+        qatomic_set(&jc->victim[v], old);
+    }
+    qatomic_set(&jc->array[hash], tb);
+}
+
+void tb_jmp_cache_remove(CPUState *cpu, TranslationBlock *tb)
+{
+    CPUJumpCache *jc;
+    unsigned int h, v, i;
+
+    RCU_READ_LOCK_GUARD();
+
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+    if (!jc) {
+        return;
+    }
+    h = tb_jmp_cache_hash_func(tb->pc, jc->bits);
+    if (qatomic_read(&jc->array[h]) == tb) {
+        qatomic_set(&jc->array[h], NULL);
+    }
+    v = tb_jmp_victim_hash_func(tb->pc);
+    for (i = v; i < v + TB_JMP_VICTIM_WAYS; i++) {
+        if (qatomic_read(&jc->victim[i]) == tb) {
+            qatomic_set(&jc->victim[i], NULL);
+        }
+    }
+}
+
+/*
+ * At the end of each window of lookups, resize the jump cache like
+ * tlb_mmu_resize_locked() does for the TLB.  Double it if more than
+ * 1/8 of the lookups found an existing TB outside of the first level
+ * while it was mostly full.  Halve it if it is mostly empty, e.g.
+ * because TLB flushes clear it before it fills up, and few lookups
+ * missed.  The new cache starts empty.
+ */
+static void tb_jmp_cache_resize_check(CPUState *cpu, CPUJumpCache *jc)
+{
+    unsigned int size = 1u << jc->bits;
+    unsigned int stride = size / TB_JMP_CACHE_SAMPLES + 1;
+    unsigned int i, used = 0, bits = jc->bits;
+    CPUJumpCache *new_jc;
+
+    for (i = 0; i < TB_JMP_CACHE_SAMPLES; i++) {
+        if (qatomic_read(&jc->array[(i * stride) & (size - 1)])) {
+            used++;
+        }
+    }
+
+    if (jc->window_misses > jc->window_lookups / 8 &&
+        used > TB_JMP_CACHE_SAMPLES / 2) {
+        bits = MIN(bits + 1, TB_JMP_CACHE_MAX_BITS);
+    } else if (jc->window_misses < jc->window_lookups / 64 &&
+               used < TB_JMP_CACHE_SAMPLES / 8) {
+        bits = MAX(bits - 1, TB_JMP_CACHE_MIN_BITS);
+    }
+
+    qatomic_set(&jc->lookups, jc->lookups + jc->window_lookups);
+    jc->window_lookups = 0;
+    jc->window_misses = 0;
+
+    if (bits != jc->bits) {
+        new_jc = tb_jmp_cache_new(bits, jc);
+        qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+        g_free_rcu(jc, rcu);
+    }
+}
+
+void tb_jmp_cache_dump_info(GString *buf)
+{
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+        uint64_t lookups, misses;
+
+        if (!jc) {
+            continue;
+        }
+        lookups = qatomic_read(&jc->lookups) +
+                  qatomic_read(&jc->window_lookups);
+        misses = qatomic_read(&jc->misses);
+        g_string_append_printf(buf, "  cpu %d: %u entries (%" PRIu64
+                               " resizes), %" PRIu64 " lookups, %.1f%% "
+                               "misses, %" PRIu64 " victim hits\n",
+                               cpu->cpu_index, 1u << jc->bits,
+                               qatomic_read(&jc->resizes), lookups,
+                               lookups ? misses * 100.0 / lookups : 0.0,
+                               qatomic_read(&jc->victim_hits));
+    }
+}
+
+static inline bool tb_lookup_match(CPUState *cpu, TranslationBlock *tb,
+                                   target_ulong pc, target_ulong cs_base,
+                                   uint32_t flags, uint32_t cflags)
+{
+    return (tb &&
+            tb->pc == pc &&
+            tb->cs_base == cs_base &&
+            tb->flags == flags &&
+            tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+            tb_cflags(tb) == cflags);
+}
+
+/*
+ * Look for the TB in the victim set of @pc, then in the global hash
+ * table, and install it in the first level of the jump cache.
+ */
+static TranslationBlock *tb_lookup_slow(CPUState *cpu, CPUJumpCache *jc,
+                                        target_ulong pc, target_ulong cs_base,
+                                        uint32_t flags, uint32_t cflags)
+{
+    unsigned int v = tb_jmp_victim_hash_func(pc);
+    TranslationBlock *tb;
+    unsigned int i;
+
+    qatomic_set(&jc->misses, jc->misses + 1);
+
+    for (i = v; i < v + TB_JMP_VICTIM_WAYS; i++) {
+        tb = qatomic_rcu_read(&jc->victim[i]);
+        if (tb_lookup_match(cpu, tb, pc, cs_base, flags, cflags)) {
+            qatomic_set(&jc->victim[i], NULL);
+            qatomic_set(&jc->victim_hits, jc->victim_hits + 1);
+            goto found;
+        }
+    }
+
+    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+    if (tb == NULL) {
+        return NULL;
+    }
+
+ found:
+    jc->window_misses++;
+    tb_jmp_cache_insert(jc, pc, tb);
+    if (jc->window_lookups >= TB_JMP_CACHE_WINDOW) {
+        tb_jmp_cache_resize_check(cpu, jc);
+    }
+    return tb;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
     TranslationBlock *tb;
     uint32_t hash;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
+    hash = tb_jmp_cache_hash_func(pc, jc->bits);
+    tb = qatomic_rcu_read(&jc->array[hash]);
+    jc->window_lookups++;
 
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
+    if (likely(tb_lookup_match(cpu, tb, pc, cs_base, flags, cflags))) {
         return tb;
     }
-    tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
-    if (tb == NULL) {
-        return NULL;
-    }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
-    return tb;
+    return tb_lookup_slow(cpu, jc, pc, cs_base, flags, cflags);
 }
 
 static inline void log_cpu_exec(target_ulong pc, CPUState *cpu,
@@ -450,9 +621,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
 
         tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
         if (tb == NULL) {
-            mmap_lock();
             tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
-            mmap_unlock();
         }
 
         cpu_exec_enter(cpu);
@@ -728,7 +897,23 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
      */
     qatomic_mb_set(&cpu_neg(cpu)->icount_decr.u16.high, 0);
 
-    if (unlikely(qatomic_read(&cpu->interrupt_request))) {
+#ifdef CONFIG_PLUGIN
+    /*
+     * The plugin sampling thread only kicks us out of the TB chain;
+     * report where we are and carry on with the next TB.
+     */
+    if (unlikely(qatomic_read(&cpu->plugin_sample_pending))) {
+        qemu_plugin_vcpu_sample_cb(cpu);
+    }
+#endif
+
+    /*
+     * In the parallel part of an icount quantum interrupts stay pending
+     * until every vCPU has reached the end of the quantum, so that they
+     * are taken at the same instruction count on every run.
+     */
+    if (unlikely(qatomic_read(&cpu->interrupt_request)) &&
+        !cpu->icount_parallel) {
         int interrupt_request;
         qemu_mutex_lock_iothread();
         interrupt_request = cpu->interrupt_request;
@@ -963,14 +1148,12 @@ int cpu_exec(CPUState *cpu)
 
             tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
             if (tb == NULL) {
-                mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
-                mmap_unlock();
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                tb_jmp_cache_insert(cpu->tb_jmp_cache, pc, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -1012,6 +1195,7 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
         cc->tcg_ops->initialize();
         tcg_target_initialized = true;
     }
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_BITS, NULL);
     tlb_init(cpu);
     qemu_plugin_vcpu_init_hook(cpu);
 
@@ -1023,12 +1207,18 @@ void tcg_exec_realizefn(CPUState *cpu, Error **errp)
 /* undo the initializations in reverse order */
 void tcg_exec_unrealizefn(CPUState *cpu)
 {
+    CPUJumpCache *jc;
+
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
     qemu_plugin_vcpu_exit_hook(cpu);
     tlb_destroy(cpu);
+
+    jc = cpu->tb_jmp_cache;
+    qatomic_rcu_set(&cpu->tb_jmp_cache, NULL);
+    g_free_rcu(jc, rcu);
 }
 
 #ifndef CONFIG_USER_ONLY
@@ -1067,6 +1257,20 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_tlb_stats(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB statistics are only available with accel=tcg");
+        return NULL;
+    }
+
+    tlb_dump_stats(buf);
+
+    return human_readable_text_from_str(buf);
+}
+
 HumanReadableText *qmp_x_query_opcount(Error **errp)
 {
     g_autoptr(GString) buf = g_string_new("");
@@ -98,21 +98,29 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
     desc->window_max_entries = max_entries;
 }
 
-static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
+static void tb_jmp_cache_clear_page(CPUJumpCache *jc, target_ulong page_addr)
 {
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
+    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr, jc->bits);
 
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+    for (i = 0; i < TB_JMP_PAGE_SIZE(jc->bits); i++) {
+        qatomic_set(&jc->array[i0 + i], NULL);
     }
 }
 
 static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
 {
+    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    unsigned int i;
+
     /* Discard jump cache entries for any tb which might potentially
        overlap the flushed page.  */
-    tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
-    tb_jmp_cache_clear_page(cpu, addr);
+    tb_jmp_cache_clear_page(jc, addr - TARGET_PAGE_SIZE);
+    tb_jmp_cache_clear_page(jc, addr);
+
+    /* The victim sets are not indexed by page, clear them all.  */
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        qatomic_set(&jc->victim[i], NULL);
+    }
 }
 
 /**
@@ -230,14 +238,50 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
+/*
+ * Geometry of the victim tlb, the same for all cpus and MMU modes.
+ * The set of a page is selected by the low bits of its page number.
+ * There are never more sets than entries in the smallest fast path
+ * table, so an entry evicted from the fast path table lands in the
+ * same set as the page that replaced it.
+ */
+static unsigned vtlb_sets = 1;
+static unsigned vtlb_ways = CPU_VTLB_SIZE;
+
+void tlb_set_victim_geometry(unsigned entries, unsigned ways)
+{
+    assert(is_power_of_2(entries) && is_power_of_2(ways) && ways <= entries);
+    assert(entries / ways <= 1 << CPU_TLB_DYN_MIN_BITS);
+    vtlb_sets = entries / ways;
+    vtlb_ways = ways;
+}
+
+static inline size_t vtlb_n_entries(void)
+{
+    return vtlb_sets * vtlb_ways;
+}
+
+/* Return the index of the first victim tlb entry that may hold @page.  */
+static inline size_t vtlb_set_base(target_ulong page)
+{
+    return ((page >> TARGET_PAGE_BITS) & (vtlb_sets - 1)) * vtlb_ways;
+}
+
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
+    int i;
+
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        desc->large_pages[i].vaddr = -1;
+        desc->large_pages[i].mask = 0;
+    }
+    desc->large_index = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, vtlb_n_entries() * sizeof(CPUTLBEntry));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -259,6 +303,8 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->iotlb = g_new(CPUIOTLBEntry, n_entries);
+    desc->vtable = g_new(CPUTLBEntry, vtlb_n_entries());
+    desc->viotlb = g_new(CPUIOTLBEntry, vtlb_n_entries());
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -300,28 +346,168 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->iotlb);
+        g_free(desc->vtable);
+        g_free(desc->viotlb);
+    }
+}
+
+static void tlb_flush_by_mmuidx_async_work(CPUState *cpu,
+                                           run_on_cpu_data data);
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              TLBFlushRangeData d);
+
+/*
+ * Merge @b into @a if they flush the same mmu_idx with the same
+ * significant bits, and their ranges overlap or are adjacent.
+ */
+static bool tlb_flush_range_merge(TLBFlushRangeData *a,
+                                  const TLBFlushRangeData *b)
+{
+    target_ulong start, last;
+
+    if (a->idxmap != b->idxmap || a->bits != b->bits) {
+        return false;
+    }
+    if (b->addr >= a->addr
+        ? b->addr - a->addr > a->len
+        : a->addr - b->addr > b->len) {
+        return false;
+    }
+    start = MIN(a->addr, b->addr);
+    last = MAX(a->addr + a->len - 1, b->addr + b->len - 1);
+    if (last - start + 1 == 0) {
+        /* The whole address space, which len cannot represent.  */
+        return false;
+    }
+    a->addr = start;
+    a->len = last - start + 1;
+    return true;
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_pending_add_locked(CPUTLBCommon *c,
+                                         TLBFlushRangeData d)
+{
+    unsigned i;
+
+    d.idxmap &= ~c->pending_full;
+    if (!d.idxmap) {
+        return;
+    }
+    for (i = 0; i < c->pending_n; i++) {
+        if (tlb_flush_range_merge(&c->pending[i], &d)) {
+            return;
+        }
     }
+    if (c->pending_n < CPU_TLB_PENDING_FLUSHES) {
+        c->pending[c->pending_n++] = d;
+        return;
+    }
+
+    /* Too many distinct ranges: flush their mmu_idx entirely instead.  */
+    c->pending_full |= d.idxmap;
+    for (i = 0; i < c->pending_n; i++) {
+        c->pending_full |= c->pending[i].idxmap;
+    }
+    c->pending_n = 0;
 }
 
-/* flush_all_helper: run fn across all cpus
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &env_tlb(cpu->env_ptr)->c;
+    TLBFlushRangeData pending[CPU_TLB_PENDING_FLUSHES];
+    uint16_t full;
+    unsigned i, n;
+
+    qemu_spin_lock(&c->lock);
+    full = c->pending_full;
+    n = c->pending_n;
+    memcpy(pending, c->pending, n * sizeof(pending[0]));
+    c->pending_full = 0;
+    c->pending_n = 0;
+    c->pending_queued = false;
+    qemu_spin_unlock(&c->lock);
+
+    qatomic_set(&c->remote_run_count, c->remote_run_count + 1);
+
+    /*
+     * Flushes only remove entries, and this cpu has not filled any since
+     * they were requested, so the order in which they run does not matter.
+     */
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        pending[i].idxmap &= ~full;
+        if (pending[i].idxmap) {
+            tlb_flush_range_by_mmuidx_async_0(cpu, pending[i]);
+        }
+    }
+}
+
+/*
+ * tlb_flush_remote:
+ * @cpu: cpu on which to flush, other than the current one
+ * @idxmap: set of mmu_idx to flush entirely
+ * @d: range to flush, or NULL
  *
- * If the wait flag is set then the src cpu's helper will be queued as
- * "safe" work and the loop exited creating a synchronisation point
- * where all queued work will be finished before execution starts
- * again.
+ * Add the flush to the ones pending on @cpu, and queue the work item
+ * that runs them unless it is already queued.  A burst of flushes thus
+ * costs @cpu a single work item and a single exit from the cpu loop.
  */
-static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
-                             run_on_cpu_data d)
+static void tlb_flush_remote(CPUState *cpu, uint16_t idxmap,
+                             const TLBFlushRangeData *d)
+{
+    CPUTLBCommon *c = &env_tlb(cpu->env_ptr)->c;
+    bool queue;
+
+    qemu_spin_lock(&c->lock);
+    c->pending_full |= idxmap;
+    if (d) {
+        tlb_flush_pending_add_locked(c, *d);
+    }
+    qatomic_set(&c->remote_request_count, c->remote_request_count + 1);
+    queue = !c->pending_queued;
+    c->pending_queued = true;
+    qemu_spin_unlock(&c->lock);
+
+    if (queue) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
+    }
+}
+
+/* flush_all_helper: queue a flush on all cpus but src
+ *
+ * The synced variants then queue the src cpu's flush as "safe" work,
+ * and the loop exited creating a synchronisation point where all
+ * queued work will be finished before execution starts again.
+ */
+static void flush_all_helper(CPUState *src, uint16_t idxmap,
+                             const TLBFlushRangeData *d)
 {
     CPUState *cpu;
 
     CPU_FOREACH(cpu) {
         if (cpu != src) {
-            async_run_on_cpu(cpu, fn, d);
+            tlb_flush_remote(cpu, idxmap, d);
         }
     }
 }
 
+/* Return a flush of the single page @addr, as a range.  */
+static TLBFlushRangeData tlb_flush_page_range(target_ulong addr,
+                                              uint16_t idxmap)
+{
+    TLBFlushRangeData d = {
+        .addr = addr,
+        .len = TARGET_PAGE_SIZE,
+        .idxmap = idxmap,
+        .bits = TARGET_LONG_BITS,
+    };
+
+    return d;
+}
+
 void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
 {
     CPUState *cpu;
@@ -339,6 +525,59 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_remote_flush_counts(size_t *prequested, size_t *prun)
+{
+    CPUState *cpu;
+    size_t requested = 0, run = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        requested += qatomic_read(&env_tlb(env)->c.remote_request_count);
+        run += qatomic_read(&env_tlb(env)->c.remote_run_count);
+    }
+    *prequested = requested;
+    *prun = run;
+}
+
+static inline void tlb_stat_inc(size_t *stat)
+{
+    qatomic_set(stat, *stat + 1);
+}
+
+void tlb_dump_stats(GString *buf)
+{
+    CPUState *cpu;
+    int mmu_idx;
+
+    g_string_append_printf(buf, "Victim TLB: %u entries, %u-way\n",
+                           vtlb_sets * vtlb_ways, vtlb_ways);
+    g_string_append_printf(buf, "Lookups that hit the fast path table "
+                           "in generated code are not counted.\n\n");
+    g_string_append_printf(buf, "cpu mmu_idx   fast misses        "
+                           "victim hits   large page hits            fills\n");
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+            size_t miss = qatomic_read(&desc->fast_miss_count);
+            size_t hit = qatomic_read(&desc->victim_hit_count);
+            size_t large = qatomic_read(&desc->large_hit_count);
+            size_t fill = qatomic_read(&desc->fill_count);
+
+            if (!miss && !fill) {
+                continue;
+            }
+            g_string_append_printf(buf, "%3d %7d %13zu %11zu (%5.1f%%) "
+                                   "%17zu %16zu\n", cpu->cpu_index, mmu_idx,
+                                   miss, hit,
+                                   miss ? hit * 100.0 / miss : 0.0,
+                                   large, fill);
+        }
+    }
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -385,8 +624,7 @@ void tlb_flush_by_mmuidx(CPUState *cpu, uint16_t idxmap)
     tlb_debug("mmu_idx: 0x%" PRIx16 "\n", idxmap);
 
     if (cpu->created && !qemu_cpu_is_self(cpu)) {
-        async_run_on_cpu(cpu, tlb_flush_by_mmuidx_async_work,
-                         RUN_ON_CPU_HOST_INT(idxmap));
+        tlb_flush_remote(cpu, idxmap, NULL);
     } else {
         tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(idxmap));
     }
@@ -403,7 +641,7 @@ void tlb_flush_by_mmuidx_all_cpus(CPUState *src_cpu, uint16_t idxmap)
 
     tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
 
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
+    flush_all_helper(src_cpu, idxmap, NULL);
     fn(src_cpu, RUN_ON_CPU_HOST_INT(idxmap));
 }
 
@@ -418,7 +656,7 @@ void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu, uint16_t idxmap)
 
     tlb_debug("mmu_idx: 0x%"PRIx16"\n", idxmap);
 
-    flush_all_helper(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
+    flush_all_helper(src_cpu, idxmap, NULL);
     async_safe_run_on_cpu(src_cpu, fn, RUN_ON_CPU_HOST_INT(idxmap));
 }
 
@@ -477,10 +715,15 @@ static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
                                             target_ulong mask)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
-    int k;
+    size_t k = 0, n = vtlb_n_entries();
 
     assert_cpu_is_self(env_cpu(env));
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    /* Unless @mask ignores some of the set index bits, scan one set.  */
+    if (!(((target_ulong)(vtlb_sets - 1) << TARGET_PAGE_BITS) & ~mask)) {
+        k = vtlb_set_base(page);
+        n = k + vtlb_ways;
+    }
+    for (; k < n; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(env, mmu_idx);
         }
@@ -549,8 +792,8 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
  * @cpu: cpu on which to flush
  * @data: encoded addr + idxmap
  *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The idxmap parameter is encoded in the page
+ * Helper for tlb_flush_page_by_mmuidx_all_cpus_synced, called through
+ * async_safe_run_on_cpu.  The idxmap parameter is encoded in the page
  * offset of the target_ptr field.  This limits the set of mmu_idx
  * that can be passed via this method.
  */
@@ -574,8 +817,8 @@ typedef struct {
  * @cpu: cpu on which to flush
  * @data: allocated addr + idxmap
  *
- * Helper for tlb_flush_page_by_mmuidx and friends, called through
- * async_run_on_cpu.  The addr+idxmap parameters are stored in a
+ * Helper for tlb_flush_page_by_mmuidx_all_cpus_synced, called through
+ * async_safe_run_on_cpu.  The addr+idxmap parameters are stored in a
  * TLBFlushPageByMMUIdxData structure that has been allocated
  * specifically for this helper.  Free the structure when done.
  */
@@ -597,22 +840,10 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
+        TLBFlushRangeData d = tlb_flush_page_range(addr, idxmap);
 
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_flush_remote(cpu, 0, &d);
     }
 }
 
@@ -624,35 +855,15 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
                                        uint16_t idxmap)
 {
+    TLBFlushRangeData d;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
-    }
-
+    d = tlb_flush_page_range(addr, idxmap);
+    flush_all_helper(src_cpu, 0, &d);
     tlb_flush_page_by_mmuidx_async_0(src_cpu, addr, idxmap);
 }
 
@@ -665,36 +876,27 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               target_ulong addr,
                                               uint16_t idxmap)
 {
+    TLBFlushRangeData range;
+
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    range = tlb_flush_page_range(addr, idxmap);
+    flush_all_helper(src_cpu, 0, &range);
+
     /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * Allocate memory to hold addr+idxmap only when needed: most
+     * targets have only a few mmu_idx, which fit in the low
+     * TARGET_PAGE_BITS.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
         d->addr = addr;
         d->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
@@ -734,11 +936,13 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     }
 
     /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
+     * Check if we need to flush due to large pages.  The range may
+     * be the merge of several flushes, so it may extend beyond the
+     * large page region on both sides.
      */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
+    if (d->large_page_addr != (target_ulong)-1 &&
+        addr <= (d->large_page_addr | ~d->large_page_mask) &&
+        addr + len - 1 >= d->large_page_addr) {
         tlb_debug("forcing full flush midx %d ("
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
@@ -757,13 +961,6 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     }
 }
 
-typedef struct {
-    target_ulong addr;
-    target_ulong len;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
                                               TLBFlushRangeData d)
 {
@@ -825,10 +1022,7 @@ void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_range_by_mmuidx_async_0(cpu, d);
     } else {
-        /* Otherwise allocate a structure, freed by the worker.  */
-        TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
-        async_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_1,
-                         RUN_ON_CPU_HOST_PTR(p));
+        tlb_flush_remote(cpu, 0, &d);
     }
 }
 
@@ -843,7 +1037,6 @@ void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
                                         uint16_t idxmap, unsigned bits)
 {
     TLBFlushRangeData d;
-    CPUState *dst_cpu;
 
     /*
      * If all bits are significant, and len is small,
@@ -865,16 +1058,7 @@ void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
-    CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
-            TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu,
-                             tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
-        }
-    }
-
+    flush_all_helper(src_cpu, 0, &d);
     tlb_flush_range_by_mmuidx_async_0(src_cpu, d);
 }
 
@@ -893,7 +1077,6 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                unsigned bits)
 {
     TLBFlushRangeData d, *p;
-    CPUState *dst_cpu;
 
     /*
      * If all bits are significant, and len is small,
@@ -915,14 +1098,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
-    CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
-        }
-    }
+    flush_all_helper(src_cpu, 0, &d);
 
     p = g_memdup(&d, sizeof(d));
     async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
@@ -1021,7 +1197,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        for (i = 0; i < vtlb_n_entries(); i++) {
             tlb_reset_dirty_range_locked(&env_tlb(env)->d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -1054,16 +1230,16 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        size_t k, base = vtlb_set_base(vaddr);
+        for (k = base; k < base + vtlb_ways; k++) {
             tlb_set_dirty1_locked(&env_tlb(env)->d[mmu_idx].vtable[k], vaddr);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB holds only TARGET_PAGE_SIZE entries, so remember the area covered
+   by large pages and trigger a full TLB flush if these are invalidated.  */
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
@@ -1086,9 +1262,53 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
     env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
 }
 
+/*
+ * Remember the translation of the large page containing @vaddr, so that
+ * misses on its other subpages can be filled by tlb_fill_large_page().
+ * Since the page is also within the region of tlb_add_large_page, any
+ * flush that affects it flushes the whole MMU mode, slots included.
+ */
+static void tlb_remember_large_page(CPUTLBDesc *desc, target_ulong vaddr,
+                                    hwaddr paddr, MemTxAttrs attrs, int prot,
+                                    target_ulong size)
+{
+    target_ulong mask = ~(size - 1);
+    target_ulong lp_vaddr = vaddr & mask;
+    CPUTLBLargePage *lp = NULL;
+    int i;
+
+    /*
+     * Only the target knows whether the whole page is one contiguous
+     * mapping, and pages that must be checked on every write cannot be
+     * replayed.
+     */
+    if (!(prot & PAGE_LARGE_UNIFORM) || (prot & PAGE_WRITE_INV)) {
+        return;
+    }
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        if (desc->large_pages[i].vaddr == lp_vaddr &&
+            desc->large_pages[i].mask == mask) {
+            lp = &desc->large_pages[i];
+            break;
+        }
+    }
+    if (!lp) {
+        lp = &desc->large_pages[desc->large_index++ % CPU_TLB_LARGE_PAGES];
+    }
+
+    lp->vaddr = lp_vaddr;
+    lp->mask = mask;
+    lp->paddr = (paddr & TARGET_PAGE_MASK) -
+                ((vaddr & TARGET_PAGE_MASK) - lp_vaddr);
+    lp->attrs = attrs;
+    lp->prot = prot;
+}
+
 /* Add a new TLB entry. At most one entry for a given virtual address
  * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
- * supplied size is only used by tlb_flush_page.
+ * supplied size is used by tlb_flush_page and, with PAGE_LARGE_UNIFORM,
+ * to fill the other subpages of a large page on demand.
  *
  * Called from TCG-generated code, which is under an RCU read-side
  * critical section.
@@ -1118,6 +1338,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
         sz = TARGET_PAGE_SIZE;
     } else {
         tlb_add_large_page(env, mmu_idx, vaddr, size);
+        tlb_remember_large_page(desc, vaddr, paddr, attrs, prot, size);
         sz = size;
     }
     vaddr_page = vaddr & TARGET_PAGE_MASK;
@@ -1205,7 +1426,9 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        /* Replace the ways of the set in round-robin order.  */
+        size_t vidx = vtlb_set_base(vaddr_page) +
+                      desc->vindex++ % vtlb_ways;
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -1286,6 +1509,51 @@ static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
     return ram_addr;
 }
 
+/*
+ * If @addr is within a large page that the target has already mapped
+ * with permissions allowing @access_type, install its entry from the
+ * saved translation instead of walking the guest page tables again.
+ * Return false if the target's tlb_fill hook must be called.
+ */
+static bool tlb_fill_large_page(CPUState *cpu, target_ulong addr,
+                                MMUAccessType access_type, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env_tlb(cpu->env_ptr)->d[mmu_idx];
+    int need;
+    int i;
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+        need = PAGE_READ;
+        break;
+    case MMU_DATA_STORE:
+        need = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        need = PAGE_EXEC;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &desc->large_pages[i];
+
+        if ((addr & lp->mask) == lp->vaddr) {
+            if (!(lp->prot & need)) {
+                return false;
+            }
+            tlb_stat_inc(&desc->large_hit_count);
+            tlb_set_page_with_attrs(cpu, addr,
+                                    lp->paddr + (addr - lp->vaddr),
+                                    lp->attrs, lp->prot, mmu_idx,
+                                    ~lp->mask + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
 /*
  * Note: tlb_fill() can trigger a resize of the TLB. This means that all of the
  * caller's prior references to the TLB table (e.g. CPUTLBEntry pointers) must
@@ -1297,6 +1565,11 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
+    if (tlb_fill_large_page(cpu, addr, access_type, mmu_idx)) {
+        return;
+    }
+    tlb_stat_inc(&env_tlb(cpu->env_ptr)->d[mmu_idx].fill_count);
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1347,6 +1620,9 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
     mr = section->mr;
     mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+    if (unlikely(cpu->icount_parallel)) {
+        cpu_loop_exit_deferred_io(cpu, retaddr);
+    }
     cpu->mem_io_pc = retaddr;
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
@@ -1402,6 +1678,9 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
     mr = section->mr;
     mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+    if (unlikely(cpu->icount_parallel)) {
+        cpu_loop_exit_deferred_io(cpu, retaddr);
+    }
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
@@ -1447,11 +1726,13 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
-    size_t vidx;
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    size_t vidx, base = vtlb_set_base(page);
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
+    tlb_stat_inc(&desc->fast_miss_count);
+    for (vidx = base; vidx < base + vtlb_ways; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         target_ulong cmp;
 
         /* elt_ofs might correspond to .addr_write, so use qatomic_read */
@@ -1471,9 +1752,10 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             copy_tlb_helper_locked(vtlb, &tmptlb);
             qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-            CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
-            CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
+            CPUIOTLBEntry tmpio, *io = &desc->iotlb[index];
+            CPUIOTLBEntry *vio = &desc->viotlb[vidx];
             tmpio = *io; *io = *vio; *vio = tmpio;
+            tlb_stat_inc(&desc->victim_hit_count);
             return true;
         }
     }
@@ -1599,11 +1881,14 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
-            if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
-                                       mmu_idx, nonfault, retaddr)) {
-                /* Non-faulting page table read failed.  */
-                *phost = NULL;
-                return TLB_INVALID_MASK;
+            if (!tlb_fill_large_page(cs, addr, access_type, mmu_idx)) {
+                tlb_stat_inc(&env_tlb(env)->d[mmu_idx].fill_count);
+                if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
+                                           mmu_idx, nonfault, retaddr)) {
+                    /* Non-faulting page table read failed.  */
+                    *phost = NULL;
+                    return TLB_INVALID_MASK;
+                }
             }
 
             /* TLB resize via tlb_fill may have moved the entry.  */
@@ -1759,6 +2044,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     CPUTLBEntry *tlbe;
     target_ulong tlb_addr;
     void *hostaddr;
+    ExclusiveReason reason;
 
     /* Adjust the given return address.  */
     retaddr -= GETPC_ADJ;
@@ -1774,8 +2060,14 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     if (unlikely(addr & (size - 1))) {
         /* We get here if guest alignment was not requested,
            or was not enforced by cpu_unaligned_access above.
-           We might widen the access and emulate, but for now
+           Unless the access can be emulated under the stripe locks,
            mark an exception and exit the cpu loop.  */
+        if (!atomic_lock_possible(addr, size)) {
+            reason = EXCLUSIVE_ATOMIC_UNALIGNED;
+            goto stop_the_world;
+        }
+    } else if (size == 16 && !HAVE_CMPXCHG128 && !atomic_lock_enabled) {
+        reason = EXCLUSIVE_ATOMIC_WIDE;
         goto stop_the_world;
     }
 
@@ -1805,6 +2097,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
              * and we do have the proper page loaded for write, this shouldn't
              * ever return.  But just in case, handle via stop-the-world.
              */
+            reason = EXCLUSIVE_ATOMIC_INSN;
             goto stop_the_world;
         }
     } else /* if (prot & PAGE_READ) */ {
@@ -1824,6 +2117,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     if (unlikely(tlb_addr & TLB_MMIO)) {
         /* There's really nothing that can be done to
            support this apart from stop-the-world.  */
+        reason = EXCLUSIVE_ATOMIC_IO;
         goto stop_the_world;
     }
 
@@ -1837,7 +2131,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     return hostaddr;
 
  stop_the_world:
-    cpu_loop_exit_atomic(env_cpu(env), retaddr);
+    cpu_loop_exit_atomic_reason(env_cpu(env), retaddr, reason);
 }
 
 /*
@@ -2563,10 +2857,8 @@ void cpu_stq_le_mmu(CPUArchState *env, target_ulong addr, uint64_t val,
 #include "atomic_template.h"
 #endif
 
-#if HAVE_CMPXCHG128 || HAVE_ATOMIC128
 #define DATA_SIZE 16
 #include "atomic_template.h"
-#endif
 
 /* Code access functions.  */
 
@@ -14,9 +14,42 @@
 TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
                               target_ulong cs_base, uint32_t flags,
                               int cflags);
+#ifdef CONFIG_USER_ONLY
+void tb_gen_code_abort(void);
+#endif
+
+typedef bool (*TBRegenFn)(TranslationBlock *tb, void *opaque);
+bool tb_regen_code(TranslationBlock *old, TranslationBlock *succ,
+                   TBRegenFn gen, void *opaque);
+
+/* Remove @tb from the jump cache of @cpu, which may be another vCPU.  */
+void tb_jmp_cache_remove(CPUState *cpu, TranslationBlock *tb);
+void tb_jmp_cache_dump_info(GString *buf);
 
 void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
 
+/*
+ * Stripe locks used to emulate the atomic operations that the host cannot
+ * perform natively, without an exclusive section.  See atomic-lock.c.
+ */
+extern bool atomic_lock_enabled;
+void atomic_lock_init(void);
+void atomic_lock_acquire(void *haddr, size_t len);
+void atomic_lock_release(void *haddr, size_t len);
+
+/*
+ * Return true if an atomic access of @size bytes at @addr, which the host
+ * cannot perform natively, can be emulated with the stripe locks.
+ */
+static inline bool atomic_lock_possible(target_ulong addr, int size)
+{
+    return atomic_lock_enabled &&
+           (addr & ~TARGET_PAGE_MASK) + size <= TARGET_PAGE_SIZE;
+}
+
+void QEMU_NORETURN cpu_loop_exit_atomic_reason(CPUState *cpu, uintptr_t pc,
+                                               ExclusiveReason reason);
+
 #endif /* ACCEL_TCG_INTERNAL_H */
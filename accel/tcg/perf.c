@@ -0,0 +1,353 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration.
+ *
+ * Without them, time spent in the code buffer shows up in perf as
+ * anonymous addresses. perf-<pid>.map maps each TB to a name made of
+ * its guest PC, guest symbol and flags; perf reads it at report time.
+ * jit-<pid>.dump follows the jitdump specification in the Linux tree
+ * (tools/perf/Documentation/jitdump-specification.txt) and also
+ * carries the code and timestamps, so "perf inject --jit" attributes
+ * samples correctly even when the code buffer is reused.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "disas/disas.h"
+#include "elf.h"
+#include "exec/exec-all.h"
+#include "perf.h"
+
+/* Protects both files, writers are the translating threads. */
+static QemuMutex perf_lock;
+static FILE *perfmap;
+static FILE *jitdump;
+static void *jitdump_marker;
+static uint64_t jitdump_code_index;
+
+/* Kept to re-register the prologue when the map is truncated */
+static const void *prologue_start;
+static size_t prologue_size;
+
+static FILE *safe_fopen_w(const char *path)
+{
+    int saved_errno;
+    FILE *f;
+    int fd;
+
+    /* Delete the old file, if any. */
+    unlink(path);
+
+    /* Avoid symlink attacks by using O_CREAT | O_EXCL. */
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    /* Convert fd to FILE*. */
+    f = fdopen(fd, "w");
+    if (f == NULL) {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    return f;
+}
+
+static void perf_exit(void)
+{
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+    if (jitdump) {
+        struct {
+            uint32_t id;
+            uint32_t total_size;
+            uint64_t timestamp;
+        } close_record = {
+            .id = 3, /* JIT_CODE_CLOSE */
+            .total_size = sizeof(close_record),
+        };
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        close_record.timestamp = ts.tv_sec * NANOSECONDS_PER_SECOND +
+                                 ts.tv_nsec;
+        fwrite(&close_record, sizeof(close_record), 1, jitdump);
+        munmap(jitdump_marker, qemu_real_host_page_size);
+        fclose(jitdump);
+        jitdump = NULL;
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+static bool perf_enable(void)
+{
+#ifdef CONFIG_TCG_INTERPRETER
+    warn_report("perfmap and jitdump have no effect with TCI");
+    return false;
+#else
+    static bool initialized;
+
+    if (!initialized) {
+        qemu_mutex_init(&perf_lock);
+        atexit(perf_exit);
+        initialized = true;
+    }
+    return true;
+#endif
+}
+
+void perf_enable_perfmap(void)
+{
+    g_autofree char *map_file = NULL;
+
+    if (!perf_enable()) {
+        return;
+    }
+    map_file = g_strdup_printf("/tmp/perf-%d.map", getpid());
+    perfmap = safe_fopen_w(map_file);
+    if (perfmap == NULL) {
+        warn_report("Could not open %s: %s, proceeding without perfmap",
+                    map_file, strerror(errno));
+    }
+}
+
+static uint32_t get_e_machine(void)
+{
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__i386__)
+    return EM_386;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__arm__)
+    return EM_ARM;
+#elif defined(__powerpc64__)
+    return EM_PPC64;
+#elif defined(__s390x__)
+    return EM_S390;
+#elif defined(__riscv)
+    return EM_RISCV;
+#elif defined(__mips__)
+    return EM_MIPS;
+#elif defined(__sparc__)
+    return EM_SPARCV9;
+#else
+    return 0; /* EM_NONE */
+#endif
+}
+
+void perf_enable_jitdump(void)
+{
+    struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t total_size;
+        uint32_t elf_mach;
+        uint32_t pad1;
+        uint32_t pid;
+        uint64_t timestamp;
+        uint64_t flags;
+    } header = {
+        .magic = 0x4A695444, /* "JiTD" */
+        .version = 1,
+        .total_size = sizeof(header),
+        .elf_mach = get_e_machine(),
+        .pid = getpid(),
+    };
+    g_autofree char *dump_file = NULL;
+    struct timespec ts;
+
+    if (!perf_enable()) {
+        return;
+    }
+    dump_file = g_strdup_printf("%s/jit-%d.dump", g_get_tmp_dir(), getpid());
+    jitdump = safe_fopen_w(dump_file);
+    if (jitdump == NULL) {
+        warn_report("Could not open %s: %s, proceeding without jitdump",
+                    dump_file, strerror(errno));
+        return;
+    }
+
+    /*
+     * perf inject finds the dump through this executable mapping of
+     * it, which shows up in perf.data as an mmap event.
+     */
+    jitdump_marker = mmap(NULL, qemu_real_host_page_size,
+                          PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                          fileno(jitdump), 0);
+    if (jitdump_marker == MAP_FAILED) {
+        warn_report("Could not map %s: %s, proceeding without jitdump",
+                    dump_file, strerror(errno));
+        fclose(jitdump);
+        jitdump = NULL;
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    header.timestamp = ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+    fwrite(&header, sizeof(header), 1, jitdump);
+}
+
+static void write_perfmap_entry(const void *start, size_t size,
+                                const char *name)
+{
+    fprintf(perfmap, "%"PRIxPTR" %zx %s\n", (uintptr_t)start, size, name);
+}
+
+static void write_jr_code_load(const void *start, size_t size,
+                               const char *name)
+{
+    struct {
+        uint32_t id;
+        uint32_t total_size;
+        uint64_t timestamp;
+        uint32_t pid;
+        uint32_t tid;
+        uint64_t vma;
+        uint64_t code_addr;
+        uint64_t code_size;
+        uint64_t code_index;
+    } record = {
+        .id = 0, /* JIT_CODE_LOAD */
+        .pid = getpid(),
+        .tid = qemu_get_thread_id(),
+        .vma = (uintptr_t)start,
+        .code_addr = (uintptr_t)start,
+        .code_size = size,
+        .code_index = jitdump_code_index++,
+    };
+    size_t name_size = strlen(name) + 1;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    record.timestamp = ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+    record.total_size = sizeof(record) + name_size + size;
+    fwrite(&record, sizeof(record), 1, jitdump);
+    fwrite(name, name_size, 1, jitdump);
+    fwrite(start, size, 1, jitdump);
+}
+
+static void perf_report(const void *start, size_t size, const char *name)
+{
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap) {
+        write_perfmap_entry(start, size, name);
+    }
+    if (jitdump) {
+        write_jr_code_load(start, size, name);
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+void perf_report_prologue(const void *start, size_t size)
+{
+    if (!perfmap && !jitdump) {
+        return;
+    }
+    prologue_start = start;
+    prologue_size = size;
+    perf_report(start, size, "tcg-prologue-buffer");
+}
+
+void perf_report_code(const TranslationBlock *tb, const void *start)
+{
+    g_autofree char *name = NULL;
+    const char *symbol;
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    symbol = lookup_symbol(tb->pc);
+    name = g_strdup_printf("guest-0x" TARGET_FMT_lx "%s%s%s flags=0x%x",
+                           tb->pc, symbol[0] ? " (" : "", symbol,
+                           symbol[0] ? ")" : "", tb->flags);
+    perf_report(start, tb->tc.size, name);
+}
+
+void perf_report_flush(void)
+{
+    if (!perfmap) {
+        /* jitdump records are timestamped, reuse needs no special care */
+        return;
+    }
+
+    /*
+     * perf reads the map once the profile has been recorded, so it has
+     * no notion of time: drop the stale entries rather than let them
+     * shadow the TBs that will reuse their addresses.
+     */
+    qemu_mutex_lock(&perf_lock);
+    fflush(perfmap);
+    if (ftruncate(fileno(perfmap), 0) == 0) {
+        rewind(perfmap);
+        if (prologue_start) {
+            write_perfmap_entry(prologue_start, prologue_size,
+                                "tcg-prologue-buffer");
+        }
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+void perf_report_evict(const void *start, size_t size)
+{
+    uintptr_t lo = (uintptr_t)start, hi = lo + size;
+    g_autofree char *map = NULL;
+    g_autoptr(GString) kept = NULL;
+    const char *line, *next;
+    struct stat st;
+    int fd;
+
+    if (!perfmap) {
+        /* jitdump records are timestamped, reuse needs no special care */
+        return;
+    }
+
+    /*
+     * As for a flush, but only the entries of the evicted region go
+     * away: read the map back and rewrite it without them.
+     */
+    qemu_mutex_lock(&perf_lock);
+    fflush(perfmap);
+    fd = fileno(perfmap);
+    if (fstat(fd, &st) < 0) {
+        goto out;
+    }
+    map = g_malloc(st.st_size + 1);
+    if (pread(fd, map, st.st_size, 0) != st.st_size) {
+        goto out;
+    }
+    map[st.st_size] = '\0';
+
+    kept = g_string_sized_new(st.st_size);
+    for (line = map; *line; line = next) {
+        uintptr_t addr, len;
+        char *end;
+
+        next = qemu_strchrnul(line, '\n');
+        if (*next) {
+            next++;
+        }
+        addr = g_ascii_strtoull(line, &end, 16);
+        len = g_ascii_strtoull(end, NULL, 16);
+        if (addr + len <= lo || addr >= hi) {
+            g_string_append_len(kept, line, next - line);
+        }
+    }
+
+    if (ftruncate(fd, 0) == 0) {
+        rewind(perfmap);
+        fwrite(kept->str, kept->len, 1, perfmap);
+    }
+out:
+    qemu_mutex_unlock(&perf_lock);
+}
@@ -0,0 +1,39 @@
+/*
+ * Linux perf perf-<pid>.map and jit-<pid>.dump integration.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_PERF_H
+#define ACCEL_TCG_PERF_H
+
+#include "exec/exec-all.h"
+
+/* Start writing perf-<pid>.map. */
+void perf_enable_perfmap(void);
+
+/* Start writing jit-<pid>.dump. */
+void perf_enable_jitdump(void);
+
+/* Add information about TCG prologue to profiler maps. */
+void perf_report_prologue(const void *start, size_t size);
+
+/*
+ * Add information about the host code generated for @tb, starting at
+ * @start in the executable view of the code buffer.
+ */
+void perf_report_code(const TranslationBlock *tb, const void *start);
+
+/*
+ * Called with all vCPUs stopped when the code buffer is flushed: the
+ * addresses handed out so far are about to be reused.
+ */
+void perf_report_flush(void);
+
+/*
+ * Called in an exclusive section when the code buffer region at @start,
+ * in its executable view, is reclaimed for new TBs.
+ */
+void perf_report_evict(const void *start, size_t size);
+
+#endif /* ACCEL_TCG_PERF_H */
@@ -41,6 +41,12 @@
  * optimization to avoid generating redundant operations. For instance, for the
  * second and all subsequent callbacks of an event, we do not need to reload the
  * CPU's index into a TCG temp, since the first callback did it already.
+ *
+ * Inline operations and conditional callbacks are not copied from an empty
+ * template, since their ops depend on the operation and on whether they
+ * update a per-vCPU scoreboard. Their empty event is only a pair of markers,
+ * and the ops are generated in place right after it by pointing
+ * tcg_ctx->emit_before_op at the op that follows.
  */
 #include "qemu/osdep.h"
 #include "tcg/tcg.h"
@@ -123,21 +129,9 @@ static void gen_empty_udata_cb(void)
     tcg_temp_free_i32(cpu_index);
 }
 
-/*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
- */
+/* inline ops are generated in place when injected, see append_inline_cb */
 static void gen_empty_inline_cb(void)
 {
-    TCGv_i64 val = tcg_temp_new_i64();
-    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
-
-    tcg_gen_ld_i64(val, ptr, 0);
-    /* pass an immediate != 0 so that it doesn't get optimized away */
-    tcg_gen_addi_i64(val, val, 0xdeadface);
-    tcg_gen_st_i64(val, ptr, 0);
-    tcg_temp_free_ptr(ptr);
-    tcg_temp_free_i64(val);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -325,19 +319,6 @@ static TCGOp *copy_extu_tl_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_ld_i64(TCGOp **begin_op, TCGOp *op)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* 2x ld_i32 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-        op = copy_op(begin_op, op, INDEX_op_ld_i32);
-    } else {
-        /* ld_i64 */
-        op = copy_op(begin_op, op, INDEX_op_ld_i64);
-    }
-    return op;
-}
-
 static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -351,21 +332,6 @@ static TCGOp *copy_st_i64(TCGOp **begin_op, TCGOp *op)
     return op;
 }
 
-static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
-{
-    if (TCG_TARGET_REG_BITS == 32) {
-        /* all 32-bit backends must implement add2_i32 */
-        g_assert(TCG_TARGET_HAS_add2_i32);
-        op = copy_op(begin_op, op, INDEX_op_add2_i32);
-        op->args[4] = tcgv_i32_arg(tcg_constant_i32(v));
-        op->args[5] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
-    } else {
-        op = copy_op(begin_op, op, INDEX_op_add_i64);
-        op->args[2] = tcgv_i64_arg(tcg_constant_i64(v));
-    }
-    return op;
-}
-
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -438,23 +404,148 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGv_i32 gen_cpu_index(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    return cpu_index;
+}
+
+/*
+ * Return the base address of @entry for the executing vCPU; the uint64_t
+ * itself is at @entry.offset from it. Without a scoreboard, @userp is the
+ * location shared by all vCPUs.
+ */
+static TCGv_ptr gen_plugin_u64_ptr(qemu_plugin_u64 entry, void *userp)
+{
+    struct qemu_plugin_scoreboard *score = entry.score;
+    TCGv_i32 cpu_index;
+    TCGv_ptr ptr, offset;
+
+    if (!score) {
+        return tcg_const_ptr(userp);
+    }
+
+    /* the scoreboard may move when vCPUs are added: load its base */
+    ptr = tcg_const_ptr(&score->data);
+    tcg_gen_ld_ptr(ptr, ptr, 0);
+
+    cpu_index = gen_cpu_index();
+    tcg_gen_muli_i32(cpu_index, cpu_index, score->element_size);
+    offset = tcg_temp_new_ptr();
+    tcg_gen_ext_i32_ptr(offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, offset);
+
+    tcg_temp_free_ptr(offset);
+    tcg_temp_free_i32(cpu_index);
+    return ptr;
+}
+
+static void gen_inline_op(const struct qemu_plugin_dyn_cb *cb)
+{
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
+    TCGv_ptr ptr = gen_plugin_u64_ptr(entry, cb->userp);
+    TCGv_i64 val;
+
+    switch (cb->inline_insn.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        val = tcg_temp_new_i64();
+        tcg_gen_ld_i64(val, ptr, entry.offset);
+        tcg_gen_addi_i64(val, val, cb->inline_insn.imm);
+        tcg_gen_st_i64(val, ptr, entry.offset);
+        tcg_temp_free_i64(val);
+        break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        tcg_gen_st_i64(tcg_constant_i64(cb->inline_insn.imm),
+                       ptr, entry.offset);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    tcg_temp_free_ptr(ptr);
+}
+
+/* Point the call to @empty_func that was just generated to @func. */
+static void redirect_last_call(void *empty_func, void *func)
+{
+    TCGOp *op;
+    int i;
+
+    if (tcg_ctx->emit_before_op) {
+        op = QTAILQ_PREV(tcg_ctx->emit_before_op, link);
+    } else {
+        op = QTAILQ_LAST(&tcg_ctx->ops);
+    }
+    while (op->opc != INDEX_op_call) {
+        op = QTAILQ_PREV(op, link);
+    }
+
+    for (i = 0; i < MAX_OPC_PARAM_ARGS; i++) {
+        if ((uintptr_t)op->args[i] == (uintptr_t)empty_func) {
+            op->args[i] = (uintptr_t)func;
+            return;
+        }
+    }
+    g_assert_not_reached();
+}
+
+static const TCGCond plugin_cond_to_tcg[] = {
+    [QEMU_PLUGIN_COND_NEVER] = TCG_COND_NEVER,
+    [QEMU_PLUGIN_COND_ALWAYS] = TCG_COND_ALWAYS,
+    [QEMU_PLUGIN_COND_EQ] = TCG_COND_EQ,
+    [QEMU_PLUGIN_COND_NE] = TCG_COND_NE,
+    [QEMU_PLUGIN_COND_LT] = TCG_COND_LTU,
+    [QEMU_PLUGIN_COND_LE] = TCG_COND_LEU,
+    [QEMU_PLUGIN_COND_GT] = TCG_COND_GTU,
+    [QEMU_PLUGIN_COND_GE] = TCG_COND_GEU,
+};
+
+/*
+ * Only used at the start of a TB: the branch ends a basic block, which
+ * would clobber the translator's temps in the middle of an instruction.
+ */
+static void gen_cond_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    qemu_plugin_u64 entry = cb->cond.entry;
+    TCGLabel *skip = gen_new_label();
+    TCGv_ptr ptr = gen_plugin_u64_ptr(entry, NULL);
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_i32 cpu_index;
+    TCGv_ptr udata;
+
+    tcg_gen_ld_i64(val, ptr, entry.offset);
+    tcg_gen_brcondi_i64(tcg_invert_cond(plugin_cond_to_tcg[cb->cond.cond]),
+                        val, cb->cond.imm, skip);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+
+    cpu_index = gen_cpu_index();
+    udata = tcg_const_ptr(cb->userp);
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    redirect_last_call(HELPER(plugin_vcpu_udata_cb), cb->f.vcpu_udata);
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(cpu_index);
+
+    gen_set_label(skip);
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    TCGOp *next = QTAILQ_NEXT(op, link);
 
-    /* ld_i64 */
-    op = copy_ld_i64(&begin_op, op);
-
-    /* add_i64 */
-    op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
-
-    /* st_i64 */
-    op = copy_st_i64(&begin_op, op);
+    tcg_ctx->emit_before_op = next;
+    if (cb->type == PLUGIN_CB_COND) {
+        gen_cond_cb(cb);
+    } else {
+        gen_inline_op(cb);
+    }
+    tcg_ctx->emit_before_op = NULL;
 
-    return op;
+    return next ? QTAILQ_PREV(next, link) : QTAILQ_LAST(&tcg_ctx->ops);
 }
 
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
@@ -507,13 +598,28 @@ static bool op_rw(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb)
     return !!(cb->rw & (w + 1));
 }
 
+static TCGOp *append_cb_type(const GArray *cbs, TCGOp *begin_op, TCGOp *op,
+                             inject_fn inject, op_ok_fn ok, int *cb_idx)
+{
+    int i;
+
+    for (i = 0; cbs && i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+
+        if (!ok(begin_op, cb)) {
+            continue;
+        }
+        op = inject(cb, begin_op, op, cb_idx);
+    }
+    return op;
+}
+
 static void inject_cb_type(const GArray *cbs, TCGOp *begin_op,
                            inject_fn inject, op_ok_fn ok)
 {
     TCGOp *end_op;
-    TCGOp *op;
     int cb_idx = -1;
-    int i;
 
     if (!cbs || cbs->len == 0) {
         rm_ops(begin_op);
@@ -523,16 +629,7 @@ static void inject_cb_type(const GArray *cbs, TCGOp *begin_op,
     end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
     tcg_debug_assert(end_op);
 
-    op = end_op;
-    for (i = 0; i < cbs->len; i++) {
-        struct qemu_plugin_dyn_cb *cb =
-            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
-
-        if (!ok(begin_op, cb)) {
-            continue;
-        }
-        op = inject(cb, begin_op, op, &cb_idx);
-    }
+    append_cb_type(cbs, begin_op, end_op, inject, ok, &cb_idx);
     rm_ops_range(begin_op, end_op);
 }
 
@@ -649,10 +746,22 @@ static void plugin_gen_tb_udata(const struct qemu_plugin_tb *ptb,
     inject_udata_cb(ptb->cbs[PLUGIN_CB_REGULAR], begin_op);
 }
 
+/* inline ops first, so that conditional callbacks see their result */
 static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
                                  TCGOp *begin_op)
 {
-    inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
+    TCGOp *end_op;
+    TCGOp *op;
+    int cb_idx = -1;
+
+    end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
+    tcg_debug_assert(end_op);
+
+    op = append_cb_type(ptb->cbs[PLUGIN_CB_INLINE], begin_op, end_op,
+                        append_inline_cb, op_ok, &cb_idx);
+    append_cb_type(ptb->cbs[PLUGIN_CB_COND], begin_op, op,
+                   append_inline_cb, op_ok, &cb_idx);
+    rm_ops_range(begin_op, end_op);
 }
 
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
@@ -35,6 +35,11 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_evict_count;
+    size_t tb_evict_tbs;
+    size_t tb_evict_bytes;
+    size_t smc_code_writes;
+    size_t smc_data_writes;
 };
 
 extern TBContext tb_ctx;
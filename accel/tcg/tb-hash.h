@@ -28,37 +28,58 @@
 
 /* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
    addresses on the same page.  The top bits are the same.  This allows
-   TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
-#define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
-#define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+   TLB invalidation to quickly clear a subset of the hash table.
+   All of these depend on the current number of bits of the cache.
+   The split must leave at least one bit of the page offset out of the
+   low part, or the hash shifts by 0 and folds every pc to 0 (e.g. with
+   256-byte target pages and a 16-bit cache).  */
+#define TB_JMP_PAGE_BITS(bits) MIN((bits) / 2, TARGET_PAGE_BITS - 1)
+#define TB_JMP_PAGE_SIZE(bits) (1 << TB_JMP_PAGE_BITS(bits))
+#define TB_JMP_ADDR_MASK(bits) (TB_JMP_PAGE_SIZE(bits) - 1)
+#define TB_JMP_PAGE_MASK(bits) ((1 << (bits)) - TB_JMP_PAGE_SIZE(bits))
 
-static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc)
+static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc,
+                                                  unsigned int bits)
 {
     target_ulong tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)));
+    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)))
+           & TB_JMP_PAGE_MASK(bits);
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
+static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc,
+                                                  unsigned int bits)
 {
     target_ulong tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)));
+    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)))
+             & TB_JMP_PAGE_MASK(bits))
+           | (tmp & TB_JMP_ADDR_MASK(bits)));
 }
 
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
+static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc,
+                                                  unsigned int bits)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> bits)) & ((1 << bits) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
 
+/*
+ * Index of the first way of the jump cache victim set for @pc.  Mix in
+ * higher bits than the first level does, so that the pcs colliding in
+ * the first level spread over the sets.
+ */
+static inline unsigned int tb_jmp_victim_hash_func(target_ulong pc)
+{
+    target_ulong tmp = pc ^ (pc >> 7) ^ (pc >> 17);
+
+    return (tmp & ((1 << TB_JMP_VICTIM_SET_BITS) - 1)) * TB_JMP_VICTIM_WAYS;
+}
+
 static inline
 uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc, uint32_t flags,
                       uint32_t cf_mask, uint32_t trace_vcpu_dstate)
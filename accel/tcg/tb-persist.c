@@ -0,0 +1,420 @@
+/*
+ * Persistent translation cache
+ *
+ * Translation blocks are stored as the opcode stream produced by the
+ * guest front end, keyed like the TB hash table and validated against
+ * a checksum of the guest code.  On a hit the front end is skipped and
+ * the stream is handed to the TCG optimizer and back end as usual, so
+ * that nothing in the cache depends on the layout of the host process.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "qemu/log.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/plugin.h"
+#include "qapi/error.h"
+#include "exec/exec-all.h"
+#include "exec/log.h"
+#include "sysemu/sysemu.h"
+#include "tcg/tcg.h"
+#include "tb-hash.h"
+#include "tb-persist.h"
+
+#define TB_PERSIST_MAGIC    "QEMUTBC1"
+#define TB_PERSIST_VERSION  1
+
+typedef struct TBPersistKey {
+    uint64_t phys_pc;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+} TBPersistKey;
+
+typedef struct TBPersistEntry {
+    TBPersistKey key;
+    uint16_t size;
+    uint16_t icount;
+    uint32_t code_crc;
+    uint32_t len;
+    uint8_t data[];
+} TBPersistEntry;
+
+typedef struct TBPersistStats {
+    size_t hits;
+    size_t misses;
+    size_t stale;
+    size_t stored;
+    size_t uncacheable;
+} TBPersistStats;
+
+static struct {
+    char *path;
+    QemuMutex lock;
+    /* TBPersistKey -> TBPersistEntry, protected by @lock */
+    GHashTable *table;
+    /* Fingerprint of the file, until checked against the running guest */
+    uint32_t fingerprint;
+    bool checked;
+    TBPersistStats stats;
+    Notifier exit_notifier;
+} tb_persist;
+
+/* Opcode stream recorded by tb_persist_record(), per translating thread */
+static __thread struct {
+    bool valid;
+    uint32_t code_crc;
+    TBPersistKey key;
+    GByteArray *buf;
+} tb_persist_pending;
+
+static guint tb_persist_key_hash(gconstpointer p)
+{
+    const TBPersistKey *k = p;
+
+    return tb_hash_func(k->phys_pc, k->pc, k->flags, k->cflags,
+                        k->trace_vcpu_dstate);
+}
+
+static gboolean tb_persist_key_equal(gconstpointer a, gconstpointer b)
+{
+    const TBPersistKey *ka = a, *kb = b;
+
+    return ka->phys_pc == kb->phys_pc && ka->pc == kb->pc &&
+           ka->cs_base == kb->cs_base && ka->flags == kb->flags &&
+           ka->cflags == kb->cflags &&
+           ka->trace_vcpu_dstate == kb->trace_vcpu_dstate;
+}
+
+static void tb_persist_key_init(TBPersistKey *k, const TranslationBlock *tb,
+                                tb_page_addr_t phys_pc)
+{
+    k->phys_pc = phys_pc;
+    k->pc = tb->pc;
+    k->cs_base = tb->cs_base;
+    k->flags = tb->flags;
+    k->cflags = tb->cflags & ~CF_INVALID;
+    k->trace_vcpu_dstate = tb->trace_vcpu_dstate;
+}
+
+static uint32_t tb_persist_code_crc(CPUState *cpu, target_ulong pc,
+                                    unsigned size)
+{
+    void *host;
+
+    get_page_addr_code_hostp(cpu->env_ptr, pc, &host);
+    return crc32c(0xffffffff, host, size);
+}
+
+static uint32_t tb_persist_fingerprint(CPUState *cpu)
+{
+    const char *type = object_get_typename(OBJECT(cpu));
+
+    return crc32c(tcg_op_stream_fingerprint(tcg_ctx),
+                  (const uint8_t *)type, strlen(type));
+}
+
+/* Called with tb_persist.lock held. */
+static void tb_persist_check(CPUState *cpu)
+{
+    uint32_t fingerprint = tb_persist_fingerprint(cpu);
+
+    if (fingerprint != tb_persist.fingerprint) {
+        if (g_hash_table_size(tb_persist.table)) {
+            warn_report("TB cache %s was created for a different "
+                        "configuration, ignoring its contents",
+                        tb_persist.path);
+            g_hash_table_remove_all(tb_persist.table);
+        }
+        tb_persist.fingerprint = fingerprint;
+    }
+    tb_persist.checked = true;
+}
+
+static bool tb_persist_usable(CPUState *cpu, tb_page_addr_t phys_pc)
+{
+    if (!tb_persist.table || phys_pc == -1) {
+        return false;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Plugins must see every translation. */
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool tb_persist_lookup(CPUState *cpu, TranslationBlock *tb,
+                       tb_page_addr_t phys_pc, int max_insns)
+{
+    TBPersistEntry *e;
+    TBPersistKey key;
+    bool hit = false;
+
+    tb_persist_pending.valid = false;
+
+    if (!tb_persist_usable(cpu, phys_pc) ||
+        qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)) {
+        return false;
+    }
+    tb_persist_key_init(&key, tb, phys_pc);
+
+    qemu_mutex_lock(&tb_persist.lock);
+    if (unlikely(!tb_persist.checked)) {
+        tb_persist_check(cpu);
+    }
+    e = g_hash_table_lookup(tb_persist.table, &key);
+    if (e == NULL) {
+        qatomic_set(&tb_persist.stats.misses, tb_persist.stats.misses + 1);
+    } else if (e->icount > max_insns ||
+               e->code_crc != tb_persist_code_crc(cpu, tb->pc, e->size)) {
+        qatomic_set(&tb_persist.stats.stale, tb_persist.stats.stale + 1);
+    } else if (!tcg_op_stream_load(tcg_ctx, tb, e->data, e->len)) {
+        tcg_func_start(tcg_ctx);
+        qatomic_set(&tb_persist.stats.stale, tb_persist.stats.stale + 1);
+    } else {
+        tb->size = e->size;
+        tb->icount = e->icount;
+        qatomic_set(&tb_persist.stats.hits, tb_persist.stats.hits + 1);
+        hit = true;
+    }
+    qemu_mutex_unlock(&tb_persist.lock);
+
+    return hit;
+}
+
+void tb_persist_record(CPUState *cpu, TranslationBlock *tb,
+                       tb_page_addr_t phys_pc)
+{
+    if (!tb_persist_usable(cpu, phys_pc)) {
+        return;
+    }
+
+    /*
+     * Only single-page TBs are stored: the checksum of a TB spanning
+     * two pages could not be verified without faulting in the second.
+     */
+    if ((tb->pc & TARGET_PAGE_MASK) !=
+        ((tb->pc + tb->size - 1) & TARGET_PAGE_MASK)) {
+        return;
+    }
+
+    if (!tb_persist_pending.buf) {
+        tb_persist_pending.buf = g_byte_array_new();
+    }
+    if (!tcg_op_stream_save(tcg_ctx, tb, tb_persist_pending.buf)) {
+        qatomic_set(&tb_persist.stats.uncacheable,
+                    tb_persist.stats.uncacheable + 1);
+        return;
+    }
+    tb_persist_key_init(&tb_persist_pending.key, tb, phys_pc);
+    tb_persist_pending.code_crc = tb_persist_code_crc(cpu, tb->pc, tb->size);
+    tb_persist_pending.valid = true;
+}
+
+void tb_persist_commit(CPUState *cpu, TranslationBlock *tb)
+{
+    GByteArray *buf = tb_persist_pending.buf;
+    TBPersistEntry *e;
+
+    if (!tb_persist_pending.valid) {
+        return;
+    }
+    tb_persist_pending.valid = false;
+
+    /* Do not store a stream if the code changed while it was translated. */
+    if (tb_persist_code_crc(cpu, tb->pc, tb->size) !=
+        tb_persist_pending.code_crc) {
+        return;
+    }
+
+    e = g_malloc(sizeof(*e) + buf->len);
+    e->key = tb_persist_pending.key;
+    e->size = tb->size;
+    e->icount = tb->icount;
+    e->code_crc = tb_persist_pending.code_crc;
+    e->len = buf->len;
+    memcpy(e->data, buf->data, buf->len);
+
+    qemu_mutex_lock(&tb_persist.lock);
+    g_hash_table_replace(tb_persist.table, &e->key, e);
+    qatomic_set(&tb_persist.stats.stored, tb_persist.stats.stored + 1);
+    qemu_mutex_unlock(&tb_persist.lock);
+}
+
+/*
+ * File format, all integers little-endian:
+ *
+ *   magic[8] version:u32 fingerprint:u32 ident_len:u32 ident[ident_len]
+ *   entries, each:
+ *     phys_pc:u64 pc:u64 cs_base:u64 flags:u32 cflags:u32
+ *     trace_vcpu_dstate:u32 size:u16 icount:u16 code_crc:u32
+ *     len:u32 data[len]
+ */
+
+#define TB_PERSIST_ENTRY_HDR_SIZE (3 * 8 + 3 * 4 + 2 * 2 + 2 * 4)
+
+static char *tb_persist_ident(void)
+{
+    return g_strdup_printf("QEMU %s %s", QEMU_VERSION, TARGET_NAME);
+}
+
+static bool tb_persist_parse(const uint8_t *p, size_t len, Error **errp)
+{
+    const uint8_t *end = p + len;
+    g_autofree char *ident = tb_persist_ident();
+    size_t ident_len = strlen(ident);
+
+    if (len < 20 || memcmp(p, TB_PERSIST_MAGIC, 8) ||
+        ldl_le_p(p + 8) != TB_PERSIST_VERSION) {
+        error_setg(errp, "not a TB cache file");
+        return false;
+    }
+    tb_persist.fingerprint = ldl_le_p(p + 12);
+    if (ldl_le_p(p + 16) != ident_len || len - 20 < ident_len ||
+        memcmp(p + 20, ident, ident_len)) {
+        error_setg(errp, "created by a different QEMU binary");
+        return false;
+    }
+    p += 20 + ident_len;
+
+    while (p < end) {
+        TBPersistEntry *e;
+        uint32_t data_len;
+
+        if ((size_t)(end - p) < TB_PERSIST_ENTRY_HDR_SIZE) {
+            error_setg(errp, "truncated entry");
+            return false;
+        }
+        data_len = ldl_le_p(p + TB_PERSIST_ENTRY_HDR_SIZE - 4);
+        if ((size_t)(end - p) - TB_PERSIST_ENTRY_HDR_SIZE < data_len) {
+            error_setg(errp, "truncated entry");
+            return false;
+        }
+
+        e = g_malloc(sizeof(*e) + data_len);
+        e->key.phys_pc = ldq_le_p(p);
+        e->key.pc = ldq_le_p(p + 8);
+        e->key.cs_base = ldq_le_p(p + 16);
+        e->key.flags = ldl_le_p(p + 24);
+        e->key.cflags = ldl_le_p(p + 28);
+        e->key.trace_vcpu_dstate = ldl_le_p(p + 32);
+        e->size = lduw_le_p(p + 36);
+        e->icount = lduw_le_p(p + 38);
+        e->code_crc = ldl_le_p(p + 40);
+        e->len = data_len;
+        p += TB_PERSIST_ENTRY_HDR_SIZE;
+        memcpy(e->data, p, data_len);
+        p += data_len;
+
+        g_hash_table_replace(tb_persist.table, &e->key, e);
+    }
+    return true;
+}
+
+static void tb_persist_save_entry(gpointer key, gpointer value, gpointer opaque)
+{
+    const TBPersistEntry *e = value;
+    GByteArray *buf = opaque;
+    uint8_t hdr[TB_PERSIST_ENTRY_HDR_SIZE];
+
+    stq_le_p(hdr, e->key.phys_pc);
+    stq_le_p(hdr + 8, e->key.pc);
+    stq_le_p(hdr + 16, e->key.cs_base);
+    stl_le_p(hdr + 24, e->key.flags);
+    stl_le_p(hdr + 28, e->key.cflags);
+    stl_le_p(hdr + 32, e->key.trace_vcpu_dstate);
+    stw_le_p(hdr + 36, e->size);
+    stw_le_p(hdr + 38, e->icount);
+    stl_le_p(hdr + 40, e->code_crc);
+    stl_le_p(hdr + 44, e->len);
+    g_byte_array_append(buf, hdr, sizeof(hdr));
+    g_byte_array_append(buf, e->data, e->len);
+}
+
+static void tb_persist_save(Notifier *n, void *data)
+{
+    g_autofree char *ident = tb_persist_ident();
+    g_autoptr(GByteArray) buf = g_byte_array_new();
+    g_autoptr(GError) err = NULL;
+    uint8_t hdr[20];
+
+    memcpy(hdr, TB_PERSIST_MAGIC, 8);
+    stl_le_p(hdr + 8, TB_PERSIST_VERSION);
+    stl_le_p(hdr + 12, tb_persist.fingerprint);
+    stl_le_p(hdr + 16, strlen(ident));
+    g_byte_array_append(buf, hdr, sizeof(hdr));
+    g_byte_array_append(buf, (const guint8 *)ident, strlen(ident));
+
+    qemu_mutex_lock(&tb_persist.lock);
+    /* Nothing was translated, keep whatever the file had. */
+    if (!tb_persist.checked) {
+        qemu_mutex_unlock(&tb_persist.lock);
+        return;
+    }
+    g_hash_table_foreach(tb_persist.table, tb_persist_save_entry, buf);
+    qemu_mutex_unlock(&tb_persist.lock);
+
+    if (!g_file_set_contents(tb_persist.path, (const gchar *)buf->data,
+                             buf->len, &err)) {
+        warn_report("Could not write TB cache %s: %s",
+                    tb_persist.path, err->message);
+    }
+}
+
+void tb_persist_init(const char *path)
+{
+    g_autofree gchar *contents = NULL;
+    Error *local_err = NULL;
+    gsize len;
+
+    tb_persist.path = g_strdup(path);
+    qemu_mutex_init(&tb_persist.lock);
+    tb_persist.table = g_hash_table_new_full(tb_persist_key_hash,
+                                             tb_persist_key_equal,
+                                             NULL, g_free);
+
+    if (g_file_get_contents(path, &contents, &len, NULL) &&
+        !tb_persist_parse((const uint8_t *)contents, len, &local_err)) {
+        warn_reportf_err(local_err, "Ignoring TB cache %s: ", path);
+        g_hash_table_remove_all(tb_persist.table);
+    }
+
+    tb_persist.exit_notifier.notify = tb_persist_save;
+    qemu_add_exit_notifier(&tb_persist.exit_notifier);
+}
+
+void tb_persist_dump_info(GString *buf)
+{
+    TBPersistStats *s = &tb_persist.stats;
+    size_t entries;
+
+    if (!tb_persist.table) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_persist.lock);
+    entries = g_hash_table_size(tb_persist.table);
+    qemu_mutex_unlock(&tb_persist.lock);
+
+    g_string_append_printf(buf, "\nTB cache:\n");
+    g_string_append_printf(buf, "file                %s\n", tb_persist.path);
+    g_string_append_printf(buf, "entries             %zu\n", entries);
+    g_string_append_printf(buf, "hits                %zu\n",
+                           qatomic_read(&s->hits));
+    g_string_append_printf(buf, "misses              %zu\n",
+                           qatomic_read(&s->misses));
+    g_string_append_printf(buf, "stale               %zu\n",
+                           qatomic_read(&s->stale));
+    g_string_append_printf(buf, "stored              %zu\n",
+                           qatomic_read(&s->stored));
+    g_string_append_printf(buf, "not cacheable       %zu\n",
+                           qatomic_read(&s->uncacheable));
+}
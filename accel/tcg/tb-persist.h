@@ -0,0 +1,56 @@
+/*
+ * Persistent translation cache
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_PERSIST_H
+#define ACCEL_TCG_TB_PERSIST_H
+
+#include "exec/exec-all.h"
+
+#ifdef CONFIG_SOFTMMU
+
+void tb_persist_init(const char *path);
+
+/*
+ * tb_persist_lookup:
+ * Fill tcg_ctx with the opcode stream previously recorded for @tb, and
+ * set tb->size and tb->icount accordingly.  Return false if there is no
+ * usable entry, in which case the front end must translate @tb.
+ */
+bool tb_persist_lookup(CPUState *cpu, TranslationBlock *tb,
+                       tb_page_addr_t phys_pc, int max_insns);
+
+/*
+ * tb_persist_record:
+ * Capture the opcode stream just generated by the front end for @tb.
+ * It is added to the cache by tb_persist_commit(), once the TB has been
+ * successfully generated.
+ */
+void tb_persist_record(CPUState *cpu, TranslationBlock *tb,
+                       tb_page_addr_t phys_pc);
+void tb_persist_commit(CPUState *cpu, TranslationBlock *tb);
+
+void tb_persist_dump_info(GString *buf);
+
+#else
+
+static inline bool tb_persist_lookup(CPUState *cpu, TranslationBlock *tb,
+                                     tb_page_addr_t phys_pc, int max_insns)
+{
+    return false;
+}
+
+static inline void tb_persist_record(CPUState *cpu, TranslationBlock *tb,
+                                     tb_page_addr_t phys_pc)
+{
+}
+
+static inline void tb_persist_commit(CPUState *cpu, TranslationBlock *tb)
+{
+}
+
+#endif /* CONFIG_SOFTMMU */
+
+#endif /* ACCEL_TCG_TB_PERSIST_H */
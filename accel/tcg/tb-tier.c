@@ -0,0 +1,612 @@
+/*
+ * Tiered translation
+ *
+ * New TBs are generated quickly, without running the TCG optimizer, and
+ * with a countdown prepended to their code.  The opcode stream produced
+ * by the front end is kept alongside the TB.  When the countdown expires
+ * the TB is queued for background threads, which regenerate it from the
+ * saved stream with additional optimization passes and swap the result in
+ * place of the original TB.  Start-up cost is thus paid only for code that
+ * actually turns out to be hot.
+ *
+ * With superblocks enabled, a TB being promoted is also merged with the
+ * successor it has been chained to most recently through goto_tb, when
+ * both are on the same page.  The two opcode streams are spliced into a
+ * single multi-exit TB, so that the optimizer and the register allocator
+ * see across the former block boundary.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/rcu.h"
+#include "qemu/units.h"
+#include "exec/exec-all.h"
+#include "exec/helper-gen.h"
+#include "tcg/tcg.h"
+#include "tcg/tcg-op.h"
+#include "tb-context.h"
+#include "internal.h"
+#include "tb-tier.h"
+
+/* Upper bound on the memory used by the opcode streams kept with TBs */
+#define TB_TIER_IR_BUDGET   (64 * MiB)
+/* Upper bound on the number of TBs waiting for promotion */
+#define TB_TIER_QUEUE_MAX   1024
+/* Upper bound on the number of TBs merged into a superblock */
+#define TB_TIER_MAX_BLOCKS  16
+
+typedef struct TBTierJob {
+    TranslationBlock *tb;
+    TBTierIR *ir;
+    unsigned flush_count;
+    /* Successor merged into the new TB, through jump slot @slot */
+    TranslationBlock *succ;
+    int slot;
+} TBTierJob;
+
+typedef struct TBTierStats {
+    size_t cold;
+    size_t promoted;
+    size_t failed;
+    size_t dropped;
+    size_t merged;
+} TBTierStats;
+
+static struct {
+    unsigned threshold;
+    unsigned nthreads;
+    bool superblocks;
+    QemuThread *threads;
+
+    /*
+     * @lock protects the TBTierJob queue and the count of workers busy
+     * generating code.  A flush of the translation buffer sets @flushing
+     * and waits on @idle_cond for the busy workers, so that code is never
+     * generated in a region being reset; workers wait on @cond.
+     */
+    QemuMutex lock;
+    QemuCond cond;
+    QemuCond idle_cond;
+    GQueue queue;
+    unsigned busy;
+    bool flushing;
+
+    size_t ir_bytes;
+    TBTierStats stats;
+} tb_tier;
+
+/* Opcode stream recorded by tb_tier_record(), per translating thread */
+static __thread struct {
+    bool valid;
+    GByteArray *buf;
+} tb_tier_pending;
+
+/* A worker may still be reading @ir; see tb_tier_gen_ops() */
+static void tb_tier_free_ir(TBTierIR *ir)
+{
+    if (ir) {
+        qatomic_sub(&tb_tier.ir_bytes, ir->len);
+        g_free_rcu(ir, rcu);
+    }
+}
+
+static TBTierIR *tb_tier_new_ir(GByteArray *buf)
+{
+    TBTierIR *ir = g_malloc(sizeof(*ir) + buf->len);
+
+    ir->len = buf->len;
+    memcpy(ir->data, buf->data, ir->len);
+    qatomic_add(&tb_tier.ir_bytes, ir->len);
+    return ir;
+}
+
+/*
+ * Map jump slot @n of the second block of a superblock to a slot left free
+ * by the first block, or to -1 if there is none.
+ */
+static int tb_tier_map_slot(int map[2], bool used[2], int n)
+{
+    if (map[n] == -2) {
+        map[n] = !used[0] ? 0 : !used[1] ? 1 : -1;
+        if (map[n] >= 0) {
+            used[map[n]] = true;
+        }
+    }
+    return map[n];
+}
+
+/*
+ * Splice the opcodes of tcg_ctx, made of the stream of @tb's first block
+ * up to @last and the stream of its successor through jump slot @n after
+ * it, into a single TB.  The goto_tb/exit_tb pair of slot @n becomes a
+ * branch to the successor, whose check for exit requests is dropped: one
+ * check at the start of the superblock is enough, as the successor is
+ * always entered from the first block.  The jump slots of the successor
+ * are renumbered into the ones left free, or turned into plain exits.
+ */
+static bool tb_tier_splice(TranslationBlock *tb, TCGOp *last, int n)
+{
+    TCGContext *s = tcg_ctx;
+    uintptr_t tb_rx = (uintptr_t)tcg_splitwx_to_rx(tb);
+    TCGOp *succ_first = QTAILQ_NEXT(last, link);
+    TCGOp *goto_op = NULL, *exit_op = NULL;
+    TCGOp *op, *next;
+    TCGLabel *exitreq = NULL, *l;
+    bool used[2] = { false, false };
+    int map[2] = { -2, -2 };
+
+    if (!succ_first) {
+        return false;
+    }
+
+    for (op = QTAILQ_FIRST(&s->ops); op != succ_first;
+         op = QTAILQ_NEXT(op, link)) {
+        if (op->opc == INDEX_op_goto_tb) {
+            if (op->args[0] != n) {
+                used[op->args[0]] = true;
+            } else if (goto_op) {
+                return false;
+            } else {
+                goto_op = op;
+            }
+        } else if (op->opc == INDEX_op_exit_tb && op->args[0] == tb_rx + n) {
+            if (exit_op) {
+                return false;
+            }
+            exit_op = op;
+        }
+    }
+    if (!goto_op || !exit_op) {
+        return false;
+    }
+
+    for (op = succ_first; op; op = QTAILQ_NEXT(op, link)) {
+        if (op->opc == INDEX_op_exit_tb &&
+            op->args[0] == tb_rx + TB_EXIT_REQUESTED) {
+            TCGOp *prev = QTAILQ_PREV(op, link);
+
+            if (prev->opc != INDEX_op_set_label) {
+                return false;
+            }
+            exitreq = arg_label(prev->args[0]);
+            break;
+        }
+    }
+    if (!exitreq) {
+        return false;
+    }
+
+    for (op = succ_first; op; op = next) {
+        uintptr_t arg = op->args[0];
+        int slot;
+
+        next = QTAILQ_NEXT(op, link);
+        switch (op->opc) {
+        case INDEX_op_brcond_i32:
+            if (arg_label(op->args[3]) == exitreq) {
+                tcg_op_remove(s, op);
+            }
+            break;
+        case INDEX_op_goto_tb:
+            slot = tb_tier_map_slot(map, used, arg);
+            if (slot < 0) {
+                tcg_op_remove(s, op);
+            } else {
+                op->args[0] = slot;
+            }
+            break;
+        case INDEX_op_exit_tb:
+            if (arg == tb_rx || arg == tb_rx + 1) {
+                slot = tb_tier_map_slot(map, used, arg - tb_rx);
+                op->args[0] = slot < 0 ? 0 : tb_rx + slot;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    l = gen_new_label();
+    op = tcg_op_insert_before(s, succ_first, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    l->present = 1;
+
+    op = tcg_op_insert_before(s, exit_op, INDEX_op_br);
+    op->args[0] = label_arg(l);
+    l->refs++;
+    tcg_op_remove(s, exit_op);
+    tcg_op_remove(s, goto_op);
+    return true;
+}
+
+/*
+ * Fill tcg_ctx for the promoted version of job->tb, merging job->succ
+ * if set.  The successor's stream is read under RCU, since the successor
+ * may be promoted concurrently.
+ */
+static bool tb_tier_gen_ops(TranslationBlock *tb, void *opaque)
+{
+    TBTierJob *job = opaque;
+    TCGContext *s = tcg_ctx;
+
+    if (!tcg_op_stream_load(s, tb, job->ir->data, job->ir->len)) {
+        return false;
+    }
+
+    if (job->succ) {
+        TBTierIR *succ_ir = qatomic_rcu_read(&job->succ->tier_ir);
+        TCGOp *last = QTAILQ_LAST(&s->ops);
+
+        if (!succ_ir ||
+            !tcg_op_stream_load(s, tb, succ_ir->data, succ_ir->len) ||
+            !tb_tier_splice(tb, last, job->slot)) {
+            return false;
+        }
+        tb->size = job->succ->pc + job->succ->size - tb->pc;
+        tb->icount += job->succ->icount;
+        tb->tier_blocks += job->succ->tier_blocks;
+    }
+
+    /* Keep the stream of the new TB, so that it can be merged in turn */
+    if (tb_tier.superblocks &&
+        qatomic_read(&tb_tier.ir_bytes) < TB_TIER_IR_BUDGET) {
+        if (!tb_tier_pending.buf) {
+            tb_tier_pending.buf = g_byte_array_new();
+        }
+        if (tcg_op_stream_save(s, tb, tb_tier_pending.buf)) {
+            qatomic_rcu_set(&tb->tier_ir,
+                            tb_tier_new_ir(tb_tier_pending.buf));
+        }
+    }
+    return true;
+}
+
+/*
+ * Pick the successor to merge into @tb: among the TBs that @tb is chained
+ * to, the one that is closest to its own promotion, provided it follows
+ * @tb on the same page and still has its opcode stream.
+ */
+static TranslationBlock *tb_tier_pick_succ(TranslationBlock *tb, int *slot)
+{
+    TranslationBlock *best = NULL;
+    int n;
+
+    if (!tb_tier.superblocks || tb->page_addr[1] != -1 ||
+        (tb_cflags(tb) & (CF_USE_ICOUNT | CF_NO_GOTO_TB))) {
+        return NULL;
+    }
+
+    for (n = 0; n < 2; n++) {
+        TranslationBlock *succ;
+        uintptr_t dest;
+
+        qemu_spin_lock(&tb->jmp_lock);
+        dest = tb->jmp_dest[n];
+        qemu_spin_unlock(&tb->jmp_lock);
+
+        /* the LSB is set if @tb is being invalidated */
+        succ = (TranslationBlock *)(dest & ~(uintptr_t)1);
+        if (succ == NULL || (dest & 1) || succ->pc <= tb->pc ||
+            succ->page_addr[0] != tb->page_addr[0] ||
+            succ->page_addr[1] != -1 ||
+            tb_cflags(succ) != tb_cflags(tb) ||
+            tb->icount + succ->icount > TCG_MAX_INSNS ||
+            tb->tier_blocks + succ->tier_blocks > TB_TIER_MAX_BLOCKS ||
+            qatomic_read(&succ->tier_ir) == NULL) {
+            continue;
+        }
+        if (best == NULL ||
+            qatomic_read(&succ->tier_count) < qatomic_read(&best->tier_count)) {
+            best = succ;
+            *slot = n;
+        }
+    }
+    return best;
+}
+
+static void tb_tier_promote(TBTierJob *job)
+{
+    bool ok;
+
+    if (job->flush_count != qatomic_read(&tb_ctx.tb_flush_count) ||
+        (tb_cflags(job->tb) & CF_INVALID)) {
+        qatomic_inc(&tb_tier.stats.dropped);
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    job->succ = tb_tier_pick_succ(job->tb, &job->slot);
+    ok = tb_regen_code(job->tb, job->succ, tb_tier_gen_ops, job);
+    if (job->succ) {
+        if (ok) {
+            qatomic_inc(&tb_tier.stats.merged);
+        } else {
+            /* The merged code may be too large; try the block on its own */
+            job->succ = NULL;
+            ok = tb_regen_code(job->tb, NULL, tb_tier_gen_ops, job);
+        }
+    }
+
+    if (ok) {
+        qatomic_inc(&tb_tier.stats.promoted);
+    } else {
+        qatomic_inc(&tb_tier.stats.failed);
+    }
+}
+
+static void *tb_tier_thread_fn(void *arg)
+{
+    bool registered = false;
+
+    rcu_register_thread();
+
+    for (;;) {
+        TBTierJob *job;
+
+        qemu_mutex_lock(&tb_tier.lock);
+        while (tb_tier.flushing || g_queue_is_empty(&tb_tier.queue)) {
+            qemu_cond_wait(&tb_tier.cond, &tb_tier.lock);
+        }
+        job = g_queue_pop_head(&tb_tier.queue);
+        tb_tier.busy++;
+        qemu_mutex_unlock(&tb_tier.lock);
+
+        /*
+         * Our context must be a copy of the one holding the target's
+         * globals, which are created after tb_tier_init() runs.  The
+         * first job can only come after a vCPU has generated code, so
+         * it is safe to register at that point.
+         */
+        if (!registered) {
+            tcg_register_thread();
+            registered = true;
+        }
+
+        tb_tier_promote(job);
+
+        qemu_mutex_lock(&tb_tier.lock);
+        if (--tb_tier.busy == 0 && tb_tier.flushing) {
+            qemu_cond_signal(&tb_tier.idle_cond);
+        }
+        qemu_mutex_unlock(&tb_tier.lock);
+
+        tb_tier_free_ir(job->ir);
+        g_free(job);
+    }
+
+    return NULL;
+}
+
+void tb_tier_init(unsigned threshold, unsigned nthreads, bool superblocks)
+{
+    unsigned i;
+
+    assert(threshold && nthreads);
+    tb_tier.threshold = threshold;
+    tb_tier.nthreads = nthreads;
+    tb_tier.superblocks = superblocks;
+    qemu_mutex_init(&tb_tier.lock);
+    qemu_cond_init(&tb_tier.cond);
+    qemu_cond_init(&tb_tier.idle_cond);
+    g_queue_init(&tb_tier.queue);
+
+    tb_tier.threads = g_new0(QemuThread, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        g_autofree char *name = g_strdup_printf("TCG tier %u", i);
+
+        qemu_thread_create(&tb_tier.threads[i], name, tb_tier_thread_fn,
+                           NULL, QEMU_THREAD_DETACHED);
+    }
+}
+
+void tb_tier_record(TranslationBlock *tb, tb_page_addr_t phys_pc)
+{
+    TCGContext *s = tcg_ctx;
+    TCGOp *first, *last, *op, *next;
+    TCGLabel *skip;
+    TCGv_ptr ptr;
+    TCGv_i32 count;
+
+    tb_tier_pending.valid = false;
+
+    if (!tb_tier.threshold || phys_pc == -1 ||
+        (tb->cflags & (CF_COUNT_MASK | CF_SINGLE_STEP)) ||
+        qatomic_read(&tb_tier.ir_bytes) >= TB_TIER_IR_BUDGET) {
+        return;
+    }
+
+    if (!tb_tier_pending.buf) {
+        tb_tier_pending.buf = g_byte_array_new();
+    }
+    if (!tcg_op_stream_save(s, tb, tb_tier_pending.buf)) {
+        return;
+    }
+    tb_tier_pending.valid = true;
+
+    /*
+     * Emit the countdown at the end of the opcode list, then move it to the
+     * front.  The update is not atomic: with MTTCG, concurrent executions
+     * may lose decrements or call the helper twice, which is harmless since
+     * only the first call finds the opcode stream.
+     */
+    first = QTAILQ_FIRST(&s->ops);
+    last = QTAILQ_LAST(&s->ops);
+
+    skip = gen_new_label();
+    ptr = tcg_const_ptr(&tb->tier_count);
+    count = tcg_temp_new_i32();
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, 0, skip);
+    tcg_temp_free_i32(count);
+    tcg_temp_free_ptr(ptr);
+    ptr = tcg_const_ptr(tb);
+    gen_helper_tb_hot(ptr);
+    tcg_temp_free_ptr(ptr);
+    gen_set_label(skip);
+
+    for (op = QTAILQ_NEXT(last, link); op; op = next) {
+        next = QTAILQ_NEXT(op, link);
+        QTAILQ_REMOVE(&s->ops, op, link);
+        QTAILQ_INSERT_BEFORE(first, op, link);
+    }
+
+    tb->tier_count = tb_tier.threshold;
+    s->opt_level = 0;
+}
+
+void tb_tier_commit(TranslationBlock *tb)
+{
+    TBTierIR *ir;
+
+    if (!tb_tier_pending.valid) {
+        return;
+    }
+    tb_tier_pending.valid = false;
+
+    ir = tb_tier_new_ir(tb_tier_pending.buf);
+    qatomic_rcu_set(&tb->tier_ir, ir);
+    qatomic_inc(&tb_tier.stats.cold);
+}
+
+void tb_tier_hot(TranslationBlock *tb)
+{
+    TBTierIR *ir = qatomic_xchg(&tb->tier_ir, NULL);
+    TBTierJob *job;
+
+    if (!ir) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_tier.lock);
+    if (g_queue_get_length(&tb_tier.queue) >= TB_TIER_QUEUE_MAX) {
+        qemu_mutex_unlock(&tb_tier.lock);
+        qatomic_inc(&tb_tier.stats.dropped);
+        tb_tier_free_ir(ir);
+        return;
+    }
+    job = g_new(TBTierJob, 1);
+    job->tb = tb;
+    job->ir = ir;
+    job->flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+    g_queue_push_tail(&tb_tier.queue, job);
+    qemu_cond_signal(&tb_tier.cond);
+    qemu_mutex_unlock(&tb_tier.lock);
+}
+
+void tb_tier_discard(TranslationBlock *tb)
+{
+    tb_tier_free_ir(qatomic_xchg(&tb->tier_ir, NULL));
+}
+
+static gboolean tb_tier_discard_iter(gpointer key, gpointer value,
+                                     gpointer data)
+{
+    tb_tier_discard(value);
+    return false;
+}
+
+void tb_tier_pause(void)
+{
+    TBTierJob *job;
+
+    if (!tb_tier.threshold) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_tier.lock);
+    tb_tier.flushing = true;
+    while (tb_tier.busy) {
+        qemu_cond_wait(&tb_tier.idle_cond, &tb_tier.lock);
+    }
+    while ((job = g_queue_pop_head(&tb_tier.queue))) {
+        tb_tier_free_ir(job->ir);
+        g_free(job);
+    }
+    qemu_mutex_unlock(&tb_tier.lock);
+}
+
+void tb_tier_resume(void)
+{
+    if (!tb_tier.threshold) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_tier.lock);
+    tb_tier.flushing = false;
+    qemu_cond_broadcast(&tb_tier.cond);
+    qemu_mutex_unlock(&tb_tier.lock);
+}
+
+void tb_tier_flush_begin(void)
+{
+    tb_tier_pause();
+    if (tb_tier.threshold) {
+        tcg_tb_foreach(tb_tier_discard_iter, NULL);
+    }
+}
+
+void tb_tier_flush_end(void)
+{
+    tb_tier_resume();
+}
+
+struct tb_tier_sb_stats {
+    size_t count;
+    size_t blocks;
+    unsigned max_blocks;
+};
+
+static gboolean tb_tier_sb_stats_iter(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    const TranslationBlock *tb = value;
+    struct tb_tier_sb_stats *sb = data;
+
+    if (tb->tier_blocks > 1 && !(tb_cflags(tb) & CF_INVALID)) {
+        sb->count++;
+        sb->blocks += tb->tier_blocks;
+        sb->max_blocks = MAX(sb->max_blocks, tb->tier_blocks);
+    }
+    return false;
+}
+
+void tb_tier_dump_info(GString *buf)
+{
+    TBTierStats *s = &tb_tier.stats;
+
+    if (!tb_tier.threshold) {
+        return;
+    }
+
+    g_string_append_printf(buf, "\nTiered translation:\n");
+    g_string_append_printf(buf, "threshold           %u (%u threads)\n",
+                           tb_tier.threshold, tb_tier.nthreads);
+    g_string_append_printf(buf, "cold TBs            %zu\n",
+                           qatomic_read(&s->cold));
+    g_string_append_printf(buf, "promoted TBs        %zu\n",
+                           qatomic_read(&s->promoted));
+    g_string_append_printf(buf, "failed promotions   %zu\n",
+                           qatomic_read(&s->failed));
+    g_string_append_printf(buf, "dropped promotions  %zu\n",
+                           qatomic_read(&s->dropped));
+    if (tb_tier.superblocks) {
+        struct tb_tier_sb_stats sb = {};
+
+        tcg_tb_foreach(tb_tier_sb_stats_iter, &sb);
+        g_string_append_printf(buf, "merged promotions   %zu\n",
+                               qatomic_read(&s->merged));
+        g_string_append_printf(buf, "superblock count    %zu "
+                               "(avg %0.1f TBs, max %u)\n",
+                               sb.count,
+                               sb.count ? (double)sb.blocks / sb.count : 0,
+                               sb.max_blocks);
+    }
+    g_string_append_printf(buf, "saved IR size       %zu KiB\n",
+                           qatomic_read(&tb_tier.ir_bytes) / KiB);
+}
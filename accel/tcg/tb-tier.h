@@ -0,0 +1,101 @@
+/*
+ * Tiered translation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_TIER_H
+#define ACCEL_TCG_TB_TIER_H
+
+#include "exec/exec-all.h"
+#include "qemu/rcu.h"
+
+/*
+ * Opcode stream of a cold TB, kept until the TB is promoted; with
+ * superblocks enabled, promoted TBs keep theirs too, so that they can be
+ * merged into their predecessors.
+ */
+typedef struct TBTierIR {
+    struct rcu_head rcu;
+    size_t len;
+    uint8_t data[];
+} TBTierIR;
+
+#ifdef CONFIG_SOFTMMU
+
+void tb_tier_init(unsigned threshold, unsigned nthreads, bool superblocks);
+
+/*
+ * tb_tier_record:
+ * Called after the front end has generated the opcode stream for @tb.
+ * If @tb is eligible for promotion, save the stream, prepend the
+ * execution countdown and select the cheap (unoptimized) code generator.
+ * The stream is attached to @tb by tb_tier_commit(), once code has been
+ * successfully generated for @tb.
+ */
+void tb_tier_record(TranslationBlock *tb, tb_page_addr_t phys_pc);
+void tb_tier_commit(TranslationBlock *tb);
+
+/* Called from the generated code when @tb's countdown expires. */
+void tb_tier_hot(TranslationBlock *tb);
+
+/* Release the stream of @tb, which is being invalidated or discarded. */
+void tb_tier_discard(TranslationBlock *tb);
+
+/*
+ * tb_tier_flush_begin/end:
+ * Bracket a flush of the translation buffer, waiting for any promotion
+ * in progress and dropping all pending ones.
+ */
+void tb_tier_flush_begin(void);
+void tb_tier_flush_end(void);
+
+/*
+ * tb_tier_pause/resume:
+ * Bracket the eviction of part of the translation buffer, waiting for any
+ * promotion in progress and dropping all pending ones.  Unlike a flush,
+ * the opcode streams of the surviving TBs are kept.
+ */
+void tb_tier_pause(void);
+void tb_tier_resume(void);
+
+void tb_tier_dump_info(GString *buf);
+
+#else
+
+static inline void tb_tier_record(TranslationBlock *tb,
+                                  tb_page_addr_t phys_pc)
+{
+}
+
+static inline void tb_tier_commit(TranslationBlock *tb)
+{
+}
+
+static inline void tb_tier_hot(TranslationBlock *tb)
+{
+}
+
+static inline void tb_tier_discard(TranslationBlock *tb)
+{
+}
+
+static inline void tb_tier_flush_begin(void)
+{
+}
+
+static inline void tb_tier_flush_end(void)
+{
+}
+
+static inline void tb_tier_pause(void)
+{
+}
+
+static inline void tb_tier_resume(void)
+{
+}
+
+#endif /* CONFIG_SOFTMMU */
+
+#endif /* ACCEL_TCG_TB_TIER_H */
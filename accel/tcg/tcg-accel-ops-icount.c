@@ -141,3 +141,275 @@ void icount_handle_interrupt(CPUState *cpu, int mask)
         cpu_abort(cpu, "Raised interrupt while not in I/O function");
     }
 }
+
+/*
+ * Parallel icount
+ *
+ * Each vCPU thread runs the same number of instructions, a quantum,
+ * then waits at a barrier for the others. Within a quantum the vCPUs
+ * do not look at interrupts and stop before any device access. Once
+ * all of them have arrived, the last one moves QEMU_CLOCK_VIRTUAL to
+ * the end of the quantum and runs its timers, then the vCPUs take
+ * turns in cpu_index order to take their pending interrupts and
+ * perform the access they stopped on. Device state, interrupts and
+ * virtual time therefore evolve identically from one run to the next,
+ * whatever the host scheduling.
+ *
+ * The order of accesses to guest RAM between vCPUs within a quantum is
+ * not controlled: guests that communicate through shared memory only
+ * run deterministically if they synchronize through devices or IPIs.
+ *
+ * All of the state below is protected by the BQL.
+ */
+
+typedef enum {
+    QUANTUM_PARALLEL,
+    QUANTUM_SERIAL,
+} QuantumPhase;
+
+static struct {
+    QuantumPhase phase;
+    /* incremented when a parallel phase starts */
+    uint64_t generation;
+    /* instructions in the current quantum */
+    int64_t length;
+    int members;
+    int arrived;
+    /* vCPU whose turn it is during the serial phase */
+    CPUState *serial_cpu;
+} quantum;
+
+static void icount_quantum_set_budget(CPUState *cpu, int64_t budget)
+{
+    int insns_left = MIN(0xffff, budget);
+
+    cpu->icount_budget = budget;
+    cpu_neg(cpu)->icount_decr.u16.low = insns_left;
+    cpu->icount_extra = budget - insns_left;
+}
+
+static void icount_quantum_account(CPUState *cpu)
+{
+    icount_update(cpu);
+    cpu_neg(cpu)->icount_decr.u16.low = 0;
+    cpu->icount_extra = 0;
+    cpu->icount_budget = 0;
+}
+
+static void icount_quantum_exec(CPUState *cpu)
+{
+    int r;
+
+    qemu_mutex_unlock_iothread();
+    r = tcg_cpus_exec(cpu);
+    qemu_mutex_lock_iothread();
+    switch (r) {
+    case EXCP_DEBUG:
+        cpu_handle_guest_debug(cpu);
+        break;
+    case EXCP_ATOMIC:
+        qemu_mutex_unlock_iothread();
+        cpu_exec_step_atomic(cpu);
+        qemu_mutex_lock_iothread();
+        break;
+    default:
+        break;
+    }
+    qatomic_mb_set(&cpu->exit_request, 0);
+}
+
+/*
+ * Work queued with async_guest_run_on_cpu(), e.g. to bring up a
+ * secondary vCPU, would change guest state at a point that depends on
+ * host timing.  It is only run during the serial turn of @cpu, or while
+ * no instruction can be executed anyway.  Other work, such as TLB
+ * flushes, is run at once as without icount-quantum.
+ */
+static void icount_quantum_wait_io_event(CPUState *cpu)
+{
+    if ((quantum.phase == QUANTUM_SERIAL && quantum.serial_cpu == cpu) ||
+        cpu_is_stopped(cpu)) {
+        qemu_wait_io_event_common(cpu);
+    } else {
+        qemu_wait_io_event_filtered(cpu);
+    }
+}
+
+/* Returns false if the vCPU is being unplugged instead */
+static bool icount_quantum_wait_can_run(CPUState *cpu)
+{
+    for (;;) {
+        icount_quantum_wait_io_event(cpu);
+        if (cpu_can_run(cpu)) {
+            return true;
+        }
+        if (cpu->unplug) {
+            return false;
+        }
+        qemu_cond_wait_iothread(cpu->halt_cond);
+    }
+}
+
+static void icount_quantum_start_parallel(void)
+{
+    bool idle = true;
+    int64_t deadline;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->icount_quantum_member &&
+            (!cpu->halted || cpu->icount_io_deferred)) {
+            idle = false;
+        }
+    }
+
+    /*
+     * End the quantum at the next timer, so that it fires at the same
+     * instruction count on every run. Realtime timers, unlike in
+     * icount_get_limit, must not have a say. When all vCPUs are halted
+     * nothing happens until then, so skip straight to it.
+     */
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          QEMU_TIMER_ATTR_ALL);
+    if (deadline < 0 || deadline > INT32_MAX) {
+        deadline = INT32_MAX;
+    }
+    quantum.length = icount_round(deadline);
+    if (!idle) {
+        quantum.length = MIN(quantum.length, icount_quantum);
+    }
+    quantum.length = MAX(quantum.length, 1);
+
+    quantum.phase = QUANTUM_PARALLEL;
+    quantum.serial_cpu = NULL;
+    quantum.generation++;
+    CPU_FOREACH(cpu) {
+        if (cpu->icount_quantum_member) {
+            qemu_cond_broadcast(cpu->halt_cond);
+        }
+    }
+}
+
+/* Hand the serial phase over to the member after @prev */
+static void icount_quantum_next_serial(CPUState *prev)
+{
+    CPUState *cpu = prev ? CPU_NEXT(prev) : first_cpu;
+
+    for (; cpu; cpu = CPU_NEXT(cpu)) {
+        if (cpu->icount_quantum_member) {
+            quantum.serial_cpu = cpu;
+            qemu_cond_broadcast(cpu->halt_cond);
+            return;
+        }
+    }
+    icount_quantum_start_parallel();
+}
+
+static void icount_quantum_end(void)
+{
+    quantum.arrived = 0;
+    icount_end_quantum(quantum.length);
+    icount_notify_aio_contexts();
+
+    quantum.phase = QUANTUM_SERIAL;
+    icount_quantum_next_serial(NULL);
+}
+
+/*
+ * Take pending interrupts, or wake up from halt, and perform the
+ * device access deferred during the parallel phase if any: with a
+ * budget of one instruction, that is all cpu_exec can do.
+ */
+static void icount_quantum_serial_step(CPUState *cpu)
+{
+    icount_quantum_set_budget(cpu, cpu->icount_io_deferred ? 1 : 0);
+    cpu->icount_io_deferred = false;
+    icount_quantum_exec(cpu);
+    icount_quantum_account(cpu);
+}
+
+/* Returns false if the vCPU is being unplugged instead */
+static bool icount_quantum_run(CPUState *cpu)
+{
+    int64_t budget = quantum.length - cpu->icount_quantum_insns;
+    bool ret = true;
+
+    if (budget <= 0 || cpu->halted || cpu->icount_io_deferred) {
+        return true;
+    }
+
+    icount_quantum_set_budget(cpu, budget);
+    cpu->icount_parallel = true;
+    while (cpu_neg(cpu)->icount_decr.u16.low + cpu->icount_extra > 0 &&
+           !cpu->halted && !cpu->icount_io_deferred) {
+        if (!icount_quantum_wait_can_run(cpu)) {
+            ret = false;
+            break;
+        }
+        icount_quantum_exec(cpu);
+    }
+    cpu->icount_parallel = false;
+    icount_quantum_account(cpu);
+    return ret;
+}
+
+static void icount_quantum_join(CPUState *cpu)
+{
+    if (!quantum.generation) {
+        quantum.phase = QUANTUM_PARALLEL;
+        quantum.generation = 1;
+        quantum.length = icount_quantum;
+    }
+    cpu->icount_quantum_member = true;
+    quantum.members++;
+}
+
+static void icount_quantum_leave(CPUState *cpu, bool arrived)
+{
+    cpu->icount_quantum_member = false;
+    cpu->icount_io_deferred = false;
+    quantum.members--;
+    if (arrived) {
+        quantum.arrived--;
+    }
+
+    if (quantum.phase == QUANTUM_SERIAL && quantum.serial_cpu == cpu) {
+        icount_quantum_next_serial(cpu);
+    } else if (quantum.phase == QUANTUM_PARALLEL && quantum.members &&
+               quantum.arrived == quantum.members) {
+        icount_quantum_end();
+    }
+}
+
+void icount_quantum_cpu_loop(CPUState *cpu)
+{
+    uint64_t done = 0;
+
+    icount_quantum_join(cpu);
+    for (;;) {
+        icount_quantum_wait_io_event(cpu);
+
+        if (quantum.phase == QUANTUM_SERIAL && quantum.serial_cpu == cpu) {
+            if (!icount_quantum_wait_can_run(cpu)) {
+                break;
+            }
+            icount_quantum_serial_step(cpu);
+            icount_quantum_next_serial(cpu);
+        } else if (quantum.phase == QUANTUM_PARALLEL &&
+                   quantum.generation != done) {
+            if (!icount_quantum_run(cpu)) {
+                break;
+            }
+            done = quantum.generation;
+            if (++quantum.arrived == quantum.members) {
+                icount_quantum_end();
+            }
+        } else if (cpu->unplug && !cpu_can_run(cpu)) {
+            break;
+        } else {
+            qemu_cond_wait_iothread(cpu->halt_cond);
+        }
+    }
+    icount_quantum_leave(cpu, quantum.phase == QUANTUM_PARALLEL &&
+                              quantum.generation == done);
+}
@@ -16,4 +16,7 @@ void icount_process_data(CPUState *cpu);
 
 void icount_handle_interrupt(CPUState *cpu, int mask);
 
+/* vCPU thread loop when icount runs vCPUs in parallel quanta */
+void icount_quantum_cpu_loop(CPUState *cpu);
+
 #endif /* TCG_CPUS_ICOUNT_H */
@@ -35,8 +35,13 @@
 #include "qemu/units.h"
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/boards.h"
+#include "exec/cputlb.h"
+#include "sysemu/replay.h"
 #endif
 #include "internal.h"
+#include "tb-persist.h"
+#include "tb-tier.h"
+#include "perf.h"
 
 struct TCGState {
     AccelState parent_obj;
@@ -44,9 +49,29 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    char *tb_cache;
+    uint32_t tier_threshold;
+    uint32_t tier_threads;
+    bool superblocks;
+    uint32_t pin_globals;
+    bool helper_audit;
+    uint32_t contexts;
+    bool tb_evict;
+    bool locked_atomics;
+    bool perfmap;
+    bool jitdump;
+    uint32_t vtlb_size;
+    uint32_t vtlb_ways;
+    uint32_t icount_quantum;
+    /* thread=single was given explicitly */
+    bool single_thread;
 };
 typedef struct TCGState TCGState;
 
+/* Bounds of the user-mode pool of TCG contexts, see tcg_register_thread() */
+#define TCG_DEFAULT_USER_CONTEXTS 8
+#define TCG_MAX_USER_CONTEXTS 64
+
 #define TYPE_TCG_ACCEL ACCEL_CLASS_NAME("tcg")
 
 DECLARE_INSTANCE_CHECKER(TCGState, TCG_STATE,
@@ -81,6 +106,20 @@ static bool check_tcg_memory_orders_compatible(void)
 #endif
 }
 
+/* Warn about what may go wrong when MTTCG is forced on */
+static void warn_mttcg_unsafe(void)
+{
+#ifndef TARGET_SUPPORTS_MTTCG
+    warn_report("Guest not yet converted to MTTCG - "
+                "you may get unexpected results");
+#endif
+    if (!check_tcg_memory_orders_compatible()) {
+        warn_report("Guest expects a stronger memory ordering "
+                    "than the host provides");
+        error_printf("This may cause strange/hard to debug errors\n");
+    }
+}
+
 static bool default_mttcg_enabled(void)
 {
     if (icount_enabled() || TCG_OVERSIZED_GUEST) {
@@ -105,6 +144,11 @@ static void tcg_accel_instance_init(Object *obj)
     s->splitwx_enabled = -1;
 #else
     s->splitwx_enabled = 0;
+#endif
+    s->tier_threads = 1;
+#if !defined(CONFIG_USER_ONLY)
+    s->vtlb_size = CPU_VTLB_SIZE;
+    s->vtlb_ways = CPU_VTLB_SIZE;
 #endif
 }
 
@@ -114,9 +158,47 @@ static int tcg_init_machine(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
 #ifdef CONFIG_USER_ONLY
-    unsigned max_cpus = 1;
+    /* Size of the pool of TCG contexts shared by the guest threads */
+    unsigned max_threads = s->contexts;
+
+    if (max_threads == 0) {
+        long host_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        max_threads = MAX(1, MIN(host_cpus, TCG_DEFAULT_USER_CONTEXTS));
+    }
 #else
-    unsigned max_cpus = ms->smp.max_cpus;
+    unsigned max_threads;
+
+    if (s->icount_quantum) {
+        if (icount_enabled() != 1) {
+            error_report("icount-quantum requires -icount with a fixed shift");
+            return -EINVAL;
+        }
+        if (replay_mode != REPLAY_MODE_NONE) {
+            error_report("icount-quantum is incompatible with record/replay");
+            return -EINVAL;
+        }
+        if (TCG_OVERSIZED_GUEST) {
+            error_report("icount-quantum needs MTTCG, "
+                         "not available when guest word size > hosts");
+            return -EINVAL;
+        }
+        if (s->single_thread) {
+            error_report("icount-quantum is incompatible with thread=single");
+            return -EINVAL;
+        }
+        /* The quanta are what make multi-threading deterministic */
+        warn_mttcg_unsafe();
+        s->mttcg_enabled = true;
+        icount_quantum = s->icount_quantum;
+    }
+
+    /* One TCG context per vCPU thread, plus the tiered translation threads */
+    max_threads = s->mttcg_enabled ? ms->smp.max_cpus : 1;
+
+    if (s->tier_threshold) {
+        max_threads += s->tier_threads;
+    }
 #endif
 
     tcg_allowed = true;
@@ -124,7 +206,19 @@ static int tcg_init_machine(MachineState *ms)
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_threads, s->tb_evict);
+    tcg_ctx->pin_globals = s->pin_globals;
+    tcg_ctx->helper_audit = s->helper_audit;
+    /* Before the prologue is generated, so that it is reported too */
+    if (s->perfmap) {
+        perf_enable_perfmap();
+    }
+    if (s->jitdump) {
+        perf_enable_jitdump();
+    }
+    if (s->locked_atomics) {
+        atomic_lock_init();
+    }
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -132,6 +226,20 @@ static int tcg_init_machine(MachineState *ms)
      * initialize the prologue now.
      */
     tcg_prologue_init(tcg_ctx);
+
+    if (s->tb_cache) {
+        tb_persist_init(s->tb_cache);
+    }
+    if (s->tier_threshold) {
+        tb_tier_init(s->tier_threshold, s->tier_threads, s->superblocks);
+    } else if (s->superblocks) {
+        warn_report("superblocks=on has no effect without tier-threshold");
+    }
+
+    /* At least one way, at most 1 << CPU_TLB_DYN_MIN_BITS sets */
+    tlb_set_victim_geometry(s->vtlb_size,
+                            MAX(MIN(s->vtlb_ways, s->vtlb_size),
+                                s->vtlb_size >> CPU_TLB_DYN_MIN_BITS));
 #endif
 
     return 0;
@@ -154,19 +262,13 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
         } else if (icount_enabled()) {
             error_setg(errp, "No MTTCG when icount is enabled");
         } else {
-#ifndef TARGET_SUPPORTS_MTTCG
-            warn_report("Guest not yet converted to MTTCG - "
-                        "you may get unexpected results");
-#endif
-            if (!check_tcg_memory_orders_compatible()) {
-                warn_report("Guest expects a stronger memory ordering "
-                            "than the host provides");
-                error_printf("This may cause strange/hard to debug errors\n");
-            }
+            warn_mttcg_unsafe();
             s->mttcg_enabled = true;
+            s->single_thread = false;
         }
     } else if (strcmp(value, "single") == 0) {
         s->mttcg_enabled = false;
+        s->single_thread = true;
     } else {
         error_setg(errp, "Invalid 'thread' setting %s", value);
     }
@@ -196,6 +298,62 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static bool tcg_get_tb_evict(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->tb_evict;
+}
+
+static void tcg_set_tb_evict(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->tb_evict = value;
+}
+
+static bool tcg_get_locked_atomics(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->locked_atomics;
+}
+
+static void tcg_set_locked_atomics(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->locked_atomics = value;
+}
+
+static bool tcg_get_perfmap(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->perfmap;
+}
+
+static void tcg_set_perfmap(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->perfmap = value;
+}
+
+static bool tcg_get_jitdump(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->jitdump;
+}
+
+static void tcg_set_jitdump(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->jitdump = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -208,6 +366,247 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static void tcg_get_pin_globals(Object *obj, Visitor *v,
+                                const char *name, void *opaque,
+                                Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->pin_globals;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_pin_globals(Object *obj, Visitor *v,
+                                const char *name, void *opaque,
+                                Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > TCG_MAX_PINNED_GLOBALS) {
+        error_setg(errp, "pin-globals must not exceed %d",
+                   TCG_MAX_PINNED_GLOBALS);
+        return;
+    }
+
+    s->pin_globals = value;
+}
+
+#if defined(CONFIG_USER_ONLY)
+static void tcg_get_contexts(Object *obj, Visitor *v,
+                             const char *name, void *opaque,
+                             Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->contexts;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_contexts(Object *obj, Visitor *v,
+                             const char *name, void *opaque,
+                             Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > TCG_MAX_USER_CONTEXTS) {
+        error_setg(errp, "contexts must not exceed %d",
+                   TCG_MAX_USER_CONTEXTS);
+        return;
+    }
+
+    s->contexts = value;
+}
+#endif
+
+static bool tcg_get_helper_audit(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->helper_audit;
+}
+
+static void tcg_set_helper_audit(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->helper_audit = value;
+}
+
+#if !defined(CONFIG_USER_ONLY)
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > INT32_MAX) {
+        error_setg(errp, "tier-threshold must not exceed %d", INT32_MAX);
+        return;
+    }
+
+    s->tier_threshold = value;
+}
+
+static void tcg_get_tier_threads(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->tier_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_threads(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < 1 || value > 64) {
+        error_setg(errp, "tier-threads must be between 1 and 64");
+        return;
+    }
+
+    s->tier_threads = value;
+}
+
+static void tcg_get_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->vtlb_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value) || value > 4096) {
+        error_setg(errp, "vtlb-size must be a power of 2, up to 4096");
+        return;
+    }
+
+    s->vtlb_size = value;
+}
+
+static void tcg_get_vtlb_ways(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->vtlb_ways;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_vtlb_ways(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value)) {
+        error_setg(errp, "vtlb-ways must be a power of 2");
+        return;
+    }
+
+    s->vtlb_ways = value;
+}
+
+static void tcg_get_icount_quantum(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->icount_quantum;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_icount_quantum(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->icount_quantum = value;
+}
+
+static bool tcg_get_superblocks(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->superblocks;
+}
+
+static void tcg_set_superblocks(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->superblocks = value;
+}
+#endif
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -225,10 +624,96 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_bool(oc, "tb-evict",
+        tcg_get_tb_evict, tcg_set_tb_evict);
+    object_class_property_set_description(oc, "tb-evict",
+        "Reclaim the oldest region of a full translation block cache "
+        "instead of flushing it");
+
+    object_class_property_add_bool(oc, "locked-atomics",
+        tcg_get_locked_atomics, tcg_set_locked_atomics);
+    object_class_property_set_description(oc, "locked-atomics",
+        "Serialize the atomic operations that the host cannot perform "
+        "with address-keyed locks instead of stopping all vCPUs");
+
+    object_class_property_add_bool(oc, "perfmap",
+        tcg_get_perfmap, tcg_set_perfmap);
+    object_class_property_set_description(oc, "perfmap",
+        "Write a perf-<pid>.map of the generated code for Linux perf");
+
+    object_class_property_add_bool(oc, "jitdump",
+        tcg_get_jitdump, tcg_set_jitdump);
+    object_class_property_set_description(oc, "jitdump",
+        "Write a jit-<pid>.dump of the generated code for Linux perf");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add(oc, "pin-globals", "int",
+        tcg_get_pin_globals, tcg_set_pin_globals,
+        NULL, NULL);
+    object_class_property_set_description(oc, "pin-globals",
+        "Number of guest registers kept in host registers across "
+        "a translation block");
+
+    object_class_property_add_bool(oc, "helper-audit",
+        tcg_get_helper_audit, tcg_set_helper_audit);
+    object_class_property_set_description(oc, "helper-audit",
+        "Count calls to helpers without DEF_HELPER_ENV annotations");
+
+#if defined(CONFIG_USER_ONLY)
+    object_class_property_add(oc, "contexts", "int",
+        tcg_get_contexts, tcg_set_contexts,
+        NULL, NULL);
+    object_class_property_set_description(oc, "contexts",
+        "Number of guest threads that can translate code concurrently "
+        "(0 picks one per host CPU, up to 8)");
+#else
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache,
+                                  tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File used to keep translations across runs");
+
+    object_class_property_add(oc, "tier-threshold", "int",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions after which a TB is retranslated with a second "
+        "optimizer pass (0 disables tiered translation)");
+
+    object_class_property_add(oc, "tier-threads", "int",
+        tcg_get_tier_threads, tcg_set_tier_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threads",
+        "Number of threads used for tiered translation");
+
+    object_class_property_add_bool(oc, "superblocks",
+        tcg_get_superblocks, tcg_set_superblocks);
+    object_class_property_set_description(oc, "superblocks",
+        "Merge hot chained TBs when retranslating them");
+
+    object_class_property_add(oc, "vtlb-size", "int",
+        tcg_get_vtlb_size, tcg_set_vtlb_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vtlb-size",
+        "Number of entries of the victim TLB of each MMU mode");
+
+    object_class_property_add(oc, "vtlb-ways", "int",
+        tcg_get_vtlb_ways, tcg_set_vtlb_ways,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vtlb-ways",
+        "Associativity of the victim TLB");
+
+    object_class_property_add(oc, "icount-quantum", "int",
+        tcg_get_icount_quantum, tcg_set_icount_quantum,
+        NULL, NULL);
+    object_class_property_set_description(oc, "icount-quantum",
+        "Run icount vCPUs in parallel, synchronizing them every "
+        "that many instructions (0 schedules them round-robin)");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
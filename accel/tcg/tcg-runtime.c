@@ -30,6 +30,7 @@
 #include "disas/disas.h"
 #include "exec/log.h"
 #include "tcg/tcg.h"
+#include "tb-tier.h"
 
 /* 32-bit helpers */
 
@@ -148,3 +149,8 @@ void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(env_cpu(env), GETPC());
 }
+
+void HELPER(tb_hot)(void *tb)
+{
+    tb_tier_hot(tb);
+}
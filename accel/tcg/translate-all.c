@@ -47,7 +47,7 @@
 
 #include "exec/cputlb.h"
 #include "exec/translate-all.h"
-#include "qemu/bitmap.h"
+#include "qemu/units.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
@@ -59,6 +59,9 @@
 #include "hw/core/tcg-cpu-ops.h"
 #include "tb-hash.h"
 #include "tb-context.h"
+#include "tb-persist.h"
+#include "tb-tier.h"
+#include "perf.h"
 #include "internal.h"
 
 /* #define DEBUG_TB_INVALIDATE */
@@ -101,19 +104,40 @@
 #define assert_memory_lock() tcg_debug_assert(have_mmap_lock())
 #endif
 
-#define SMC_BITMAP_USE_THRESHOLD 10
+#ifdef CONFIG_SOFTMMU
+/*
+ * Byte ranges [start, end) of a page that hold the code of some TB, sorted
+ * and coalesced, so that writes to the data around them can be told apart
+ * from self-modifying code.
+ */
+typedef struct PageCodeRange {
+    uint32_t start;
+    uint32_t end;
+} PageCodeRange;
+
+typedef struct PageCodeRanges {
+    unsigned int n;
+    unsigned int alloc;
+    PageCodeRange r[];
+} PageCodeRanges;
+
+/* Number of pages listed by "info jit" as written most often with code */
+#define SMC_TOP_PAGES 10
+#endif
 
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
 #ifdef CONFIG_SOFTMMU
-    /* in order to optimize self modifying code, we count the number
-       of lookups we do to a given page to use a bitmap */
-    unsigned long *code_bitmap;
-    unsigned int code_write_count;
+    /* built on the first write to the page, see tb_invalidate_phys_page_fast */
+    PageCodeRanges *code_ranges;
+    /* number of writes that invalidated code on this page */
+    unsigned int smc_count;
 #else
     unsigned long flags;
     void *target_data;
+    /* value of page_flags_gen when flags last changed */
+    unsigned int flags_gen;
 #endif
 #ifndef CONFIG_USER_ONLY
     QemuSpin lock;
@@ -907,13 +931,12 @@ void tb_htable_init(void)
 }
 
 /* call with @p->lock held */
-static inline void invalidate_page_bitmap(PageDesc *p)
+static inline void invalidate_page_code_ranges(PageDesc *p)
 {
     assert_page_locked(p);
 #ifdef CONFIG_SOFTMMU
-    g_free(p->code_bitmap);
-    p->code_bitmap = NULL;
-    p->code_write_count = 0;
+    g_free(p->code_ranges);
+    p->code_ranges = NULL;
 #endif
 }
 
@@ -931,7 +954,7 @@ static void page_flush_tb_1(int level, void **lp)
         for (i = 0; i < V_L2_SIZE; ++i) {
             page_lock(&pd[i]);
             pd[i].first_tb = (uintptr_t)NULL;
-            invalidate_page_bitmap(pd + i);
+            invalidate_page_code_ranges(pd + i);
             page_unlock(&pd[i]);
         }
     } else {
@@ -984,6 +1007,8 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
                tcg_code_size(), nb_tbs, nb_tbs > 0 ? host_size / nb_tbs : 0);
     }
 
+    tb_tier_flush_begin();
+
     CPU_FOREACH(cpu) {
         cpu_tb_jmp_cache_clear(cpu);
     }
@@ -992,10 +1017,13 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     page_flush_tb();
 
     tcg_region_reset_all();
+    perf_report_flush();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
 
+    tb_tier_flush_end();
+
 done:
     mmap_unlock();
     if (did_flush) {
@@ -1017,6 +1045,79 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+typedef struct TBEvictRequest {
+    unsigned flush_count;
+    unsigned evict_count;
+} TBEvictRequest;
+
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    size_t *nb_tbs = data;
+
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+    (*nb_tbs)++;
+    return false;
+}
+
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data data)
+{
+    TBEvictRequest *req = data.host_ptr;
+    size_t size = 0, nb_tbs = 0;
+    const void *start;
+    bool flush = false;
+
+    mmap_lock();
+    /* Space may have been reclaimed on request of another CPU */
+    if (tb_ctx.tb_flush_count == req->flush_count &&
+        tb_ctx.tb_evict_count == req->evict_count) {
+        tb_tier_pause();
+        size = tcg_region_evict(tb_evict_iter, &nb_tbs, &start);
+        tb_tier_resume();
+        if (size) {
+            CPUState *other;
+
+            /* The jump caches may still point into the reused region */
+            CPU_FOREACH(other) {
+                cpu_tb_jmp_cache_clear(other);
+            }
+            perf_report_evict(start, size);
+            tb_ctx.tb_evict_tbs += nb_tbs;
+            tb_ctx.tb_evict_bytes += size;
+            qatomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+        } else {
+            flush = true;
+        }
+    }
+    mmap_unlock();
+
+    if (size) {
+        qemu_plugin_flush_cb();
+    } else if (flush) {
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(req->flush_count));
+    }
+    g_free(req);
+}
+
+/*
+ * Make room in a full code buffer, by evicting its least recently
+ * allocated region if "-accel tcg,tb-evict=on", or by flushing it.
+ */
+static void tb_evict(CPUState *cpu)
+{
+    TBEvictRequest *req = g_new(TBEvictRequest, 1);
+
+    req->flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+    req->evict_count = qatomic_mb_read(&tb_ctx.tb_evict_count);
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_PTR(req));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_PTR(req));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1191,25 +1292,23 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     if (!qht_remove(&tb_ctx.htable, tb, h)) {
         return;
     }
+    tb_tier_discard(tb);
 
     /* remove the TB from the page list */
     if (rm_from_page_list) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
+        invalidate_page_code_ranges(p);
         if (tb->page_addr[1] != -1) {
             p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
+            invalidate_page_code_ranges(p);
         }
     }
 
     /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
-        }
+        tb_jmp_cache_remove(cpu, tb);
     }
 
     /* suppress this TB from the two jump lists */
@@ -1246,31 +1345,93 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* Return in [@start, @end) the bytes of its @n-th page covered by @tb */
+static void tb_page_range(const TranslationBlock *tb, unsigned int n,
+                          uint32_t *start, uint32_t *end)
+{
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        *start = tb->pc & ~TARGET_PAGE_MASK;
+        *end = MIN(*start + tb->size, TARGET_PAGE_SIZE);
+    } else {
+        *start = 0;
+        *end = (tb->pc + tb->size) & ~TARGET_PAGE_MASK;
+    }
+}
+
+/* Add [@start, @end) to @p's code ranges, merging overlapping ones */
+static void page_code_ranges_insert(PageDesc *p, uint32_t start, uint32_t end)
+{
+    PageCodeRanges *cr = p->code_ranges;
+    unsigned int lo = 0, hi = cr->n, i;
+
+    /* Find the first range that ends at or after @start */
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (cr->r[mid].end < start) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    /* Absorb the ranges that begin at or before @end */
+    for (i = lo; i < cr->n && cr->r[i].start <= end; i++) {
+        start = MIN(start, cr->r[i].start);
+        end = MAX(end, cr->r[i].end);
+    }
+    if (i == lo) {
+        if (cr->n == cr->alloc) {
+            cr->alloc *= 2;
+            cr = g_realloc(cr, sizeof(*cr) + cr->alloc * sizeof(cr->r[0]));
+            p->code_ranges = cr;
+        }
+        memmove(&cr->r[lo + 1], &cr->r[lo], (cr->n - lo) * sizeof(cr->r[0]));
+        cr->n++;
+    } else if (i > lo + 1) {
+        memmove(&cr->r[lo + 1], &cr->r[i], (cr->n - i) * sizeof(cr->r[0]));
+        cr->n -= i - lo - 1;
+    }
+    cr->r[lo].start = start;
+    cr->r[lo].end = end;
+}
+
 /* call with @p->lock held */
-static void build_page_bitmap(PageDesc *p)
+static void build_page_code_ranges(PageDesc *p)
 {
-    int n, tb_start, tb_end;
     TranslationBlock *tb;
+    uint32_t start, end;
+    int n;
 
     assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    p->code_ranges = g_malloc(sizeof(PageCodeRanges) +
+                              4 * sizeof(PageCodeRange));
+    p->code_ranges->n = 0;
+    p->code_ranges->alloc = 4;
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
+        tb_page_range(tb, n, &start, &end);
+        page_code_ranges_insert(p, start, end);
+    }
+}
+
+/* Return true if [@start, @start + @len) overlaps @p's code ranges */
+static bool page_code_ranges_hit(PageDesc *p, uint32_t start, int len)
+{
+    const PageCodeRanges *cr = p->code_ranges;
+    unsigned int lo = 0, hi = cr->n;
+
+    /* Find the first range that ends after @start */
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (cr->r[mid].end <= start) {
+            lo = mid + 1;
         } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+            hi = mid;
         }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
     }
+    return lo < cr->n && cr->r[lo].start < start + len;
 }
 #endif
 
@@ -1294,7 +1455,14 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     page_already_protected = p->first_tb != (uintptr_t)NULL;
 #endif
     p->first_tb = (uintptr_t)tb | n;
-    invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
+    if (p->code_ranges) {
+        uint32_t start, end;
+
+        tb_page_range(tb, n, &start, &end);
+        page_code_ranges_insert(p, start, end);
+    }
+#endif
 
 #if defined(CONFIG_USER_ONLY)
     /* translator_loop() must have made all TB pages non-writable */
@@ -1356,10 +1524,10 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     /* remove TB from the page(s) if we couldn't insert it */
     if (unlikely(existing_tb)) {
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
+        invalidate_page_code_ranges(p);
         if (p2) {
             tb_page_remove(p2, tb);
-            invalidate_page_bitmap(p2);
+            invalidate_page_code_ranges(p2);
         }
         tb = existing_tb;
     }
@@ -1377,7 +1545,101 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+#ifdef CONFIG_USER_ONLY
+/*
+ * In user-mode, guest threads generate code concurrently, each one into a
+ * TCG context claimed with tcg_claim_ctx(), and only take mmap_lock to link
+ * the new TB into the page tables.  Any change to the flags of a page (mmap,
+ * munmap, mprotect, or page_unprotect() for self-modifying code) bumps
+ * page_flags_gen and stamps the page with it, so that tb_gen_code() can tell
+ * that the guest code it read may be stale, and translate it again with
+ * mmap_lock held.
+ */
+static unsigned int page_flags_gen;
+
+static unsigned int page_flags_bump(void)
+{
+    assert_memory_lock();
+    qatomic_set(&page_flags_gen, page_flags_gen + 1);
+    return page_flags_gen;
+}
+
+static unsigned int tb_gen_begin(void)
+{
+    unsigned int gen;
+
+    tcg_claim_ctx();
+    /* No mapping change may be in progress when we sample the generation */
+    mmap_lock();
+    gen = page_flags_gen;
+    mmap_unlock();
+    return gen;
+}
+
+static bool tb_gen_stale(tb_page_addr_t phys1, tb_page_addr_t phys2,
+                         unsigned int gen)
+{
+    PageDesc *p;
+
+    assert_memory_lock();
+    p = page_find(phys1 >> TARGET_PAGE_BITS);
+    if (!p || (int)(p->flags_gen - gen) > 0) {
+        return true;
+    }
+    if (phys2 != -1) {
+        p = page_find(phys2 >> TARGET_PAGE_BITS);
+        if (!p || (int)(p->flags_gen - gen) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tb_gen_end(bool locked)
+{
+    if (locked) {
+        mmap_unlock();
+    }
+    tcg_release_ctx();
+}
+
+/*
+ * Release the locks taken by tb_gen_code(), which is being abandoned
+ * because of a fault while reading guest code.
+ */
+void tb_gen_code_abort(void)
+{
+    tb_gen_end(have_mmap_lock());
+}
+#else
+static inline unsigned int tb_gen_begin(void)
+{
+    return 0;
+}
+
+static inline bool tb_gen_stale(tb_page_addr_t phys1, tb_page_addr_t phys2,
+                                unsigned int gen)
+{
+    return false;
+}
+
+static inline void tb_gen_end(bool locked)
+{
+}
+#endif
+
+/* Undo the allocation of @tb, whose code starts at @gen_code_buf. */
+static void tb_gen_discard(TranslationBlock *tb, void *gen_code_buf)
+{
+    uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+
+    orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+    qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+    tcg_tb_remove(tb);
+    tb_tier_discard(tb);
+}
+
+/* Called without mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags, int cflags)
@@ -1388,13 +1650,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+    unsigned int flags_gen;
+    bool locked = false;
 #ifdef CONFIG_PROFILER
-    TCGProfile *prof = &tcg_ctx->prof;
+    TCGProfile *prof;
     int64_t ti;
 #endif
 
-    assert_memory_lock();
     qemu_thread_jit_write();
+    flags_gen = tb_gen_begin();
+#ifdef CONFIG_PROFILER
+    prof = &tcg_ctx->prof;
+#endif
 
     phys_pc = get_page_addr_code(env, pc);
 
@@ -1412,9 +1679,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
-        mmap_unlock();
+        /* flush or eviction must be done */
+        tb_evict(cpu);
+        tb_gen_end(locked);
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
@@ -1427,6 +1694,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->tier_count = 0;
+    tb->tier_blocks = 1;
+    tb->tier_ir = NULL;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1444,7 +1714,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_func_start(tcg_ctx);
 
     tcg_ctx->cpu = env_cpu(env);
-    gen_intermediate_code(cpu, tb, max_insns);
+    if (!tb_persist_lookup(cpu, tb, phys_pc, max_insns)) {
+        gen_intermediate_code(cpu, tb, max_insns);
+        tb_persist_record(cpu, tb, phys_pc);
+    }
+    tb_tier_record(tb, phys_pc);
     assert(tb->size != 0);
     tcg_ctx->cpu = NULL;
     max_insns = tb->icount;
@@ -1516,6 +1790,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    perf_report_code(tb, tcg_splitwx_to_rx(gen_code_buf));
 
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1621,6 +1896,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
      */
     if (phys_pc == -1) {
         tb->page_addr[0] = tb->page_addr[1] = -1;
+        tb_gen_end(locked);
         return tb;
     }
 
@@ -1630,6 +1906,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
      * lookup itself using host PC.
      */
     tcg_tb_insert(tb);
+    tb_tier_commit(tb);
 
     /* check next page if needed */
     virt_page2 = (pc + tb->size - 1) & TARGET_PAGE_MASK;
@@ -1637,23 +1914,204 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
+    if (!locked) {
+        mmap_lock();
+        locked = true;
+        if (unlikely(tb_gen_stale(phys_pc, phys_page2, flags_gen))) {
+            /* The guest code may have changed under our feet, start over */
+            tb_gen_discard(tb, gen_code_buf);
+            goto buffer_overflow;
+        }
+    }
     /*
      * No explicit memory barrier is required -- tb_link_page() makes the
      * TB visible in a consistent state.
      */
     existing_tb = tb_link_page(tb, phys_pc, phys_page2);
+    tb_persist_commit(cpu, tb);
     /* if the TB already exists, discard what we just translated */
     if (unlikely(existing_tb != tb)) {
-        uintptr_t orig_aligned = (uintptr_t)gen_code_buf;
+        tb_gen_discard(tb, gen_code_buf);
+    }
+    tb_gen_end(locked);
+    return existing_tb;
+}
 
-        orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
-        qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
-        tcg_tb_remove(tb);
-        return existing_tb;
+#ifdef CONFIG_SOFTMMU
+/*
+ * Replace @old with @tb, a new translation of the same guest code, in the
+ * page lists and the hash table.  If @tb also includes the code of @succ,
+ * which must be on the same page as @old, @succ must be valid as well.
+ * Return false if @old or @succ have been invalidated in the meantime, in
+ * which case @tb is not linked.
+ */
+static bool tb_replace(TranslationBlock *old, TranslationBlock *succ,
+                       TranslationBlock *tb)
+{
+    tb_page_addr_t phys_pc = old->page_addr[0] + (old->pc & ~TARGET_PAGE_MASK);
+    PageDesc *p;
+    PageDesc *p2 = NULL;
+    void *existing_tb = NULL;
+    bool replaced = false;
+    uint32_t h;
+
+    page_lock_pair(&p, old->page_addr[0], &p2, old->page_addr[1], 1);
+
+    /*
+     * CF_INVALID is only set with the page locks held, so if the TBs are
+     * still valid here they stay so until we are done.
+     */
+    if (!(tb_cflags(old) & CF_INVALID) &&
+        !(succ && (tb_cflags(succ) & CF_INVALID))) {
+        do_tb_phys_invalidate(old, true);
+
+        tb_page_add(p, tb, 0, old->page_addr[0]);
+        if (p2) {
+            tb_page_add(p2, tb, 1, old->page_addr[1]);
+        } else {
+            tb->page_addr[1] = -1;
+        }
+
+        h = tb_hash_func(phys_pc, tb->pc, tb->flags, tb->cflags,
+                         tb->trace_vcpu_dstate);
+        replaced = qht_insert(&tb_ctx.htable, tb, h, &existing_tb);
+
+        /* the hash table can only hold a TB that was generated meanwhile */
+        if (unlikely(!replaced)) {
+            tb_page_remove(p, tb);
+            invalidate_page_code_ranges(p);
+            if (p2) {
+                tb_page_remove(p2, tb);
+                invalidate_page_code_ranges(p2);
+            }
+        }
     }
-    return tb;
+
+    if (p2 && p2 != p) {
+        page_unlock(p2);
+    }
+    page_unlock(p);
+    return replaced;
 }
 
+/*
+ * tb_regen_code:
+ * Generate code again for @old, with the more expensive optimizations
+ * enabled, and make the result replace @old.  @gen fills tcg_ctx with the
+ * opcodes of the new TB, typically from the stream recorded when @old was
+ * translated; it may extend the new TB with the code of @succ, adjusting
+ * its size and icount.  Called by the tiered translation threads, which
+ * have no CPU of their own.
+ */
+bool tb_regen_code(TranslationBlock *old, TranslationBlock *succ,
+                   TBRegenFn gen, void *opaque)
+{
+    TranslationBlock *tb;
+    tcg_insn_unit *gen_code_buf;
+    int gen_code_size, search_size;
+    bool retried = false;
+
+    qemu_thread_jit_write();
+
+ buffer_overflow:
+    tb = tcg_tb_alloc(tcg_ctx);
+    if (unlikely(!tb)) {
+        /* Leave it to the vCPUs to flush the buffer */
+        qemu_thread_jit_execute();
+        return false;
+    }
+
+    gen_code_buf = tcg_ctx->code_gen_ptr;
+    tb->tc.ptr = tcg_splitwx_to_rx(gen_code_buf);
+    tb->pc = old->pc;
+    tb->cs_base = old->cs_base;
+    tb->flags = old->flags;
+    tb->cflags = tb_cflags(old) & ~CF_INVALID;
+    tb->trace_vcpu_dstate = old->trace_vcpu_dstate;
+    tb->size = old->size;
+    tb->icount = old->icount;
+    tb->tier_count = 0;
+    tb->tier_blocks = old->tier_blocks;
+    tb->tier_ir = NULL;
+    tcg_ctx->tb_cflags = tb->cflags;
+
+    if (sigsetjmp(tcg_ctx->jmp_trans, 0) != 0) {
+        /* The optimized code is too large; keep the cold version. */
+        goto fail;
+    }
+
+    tcg_func_start(tcg_ctx);
+    if (!gen(tb, opaque)) {
+        goto fail;
+    }
+    tcg_ctx->opt_level = 2;
+
+    tb->jmp_reset_offset[0] = TB_JMP_RESET_OFFSET_INVALID;
+    tb->jmp_reset_offset[1] = TB_JMP_RESET_OFFSET_INVALID;
+    tcg_ctx->tb_jmp_reset_offset = tb->jmp_reset_offset;
+    if (TCG_TARGET_HAS_direct_jump) {
+        tcg_ctx->tb_jmp_insn_offset = tb->jmp_target_arg;
+        tcg_ctx->tb_jmp_target_addr = NULL;
+    } else {
+        tcg_ctx->tb_jmp_insn_offset = NULL;
+        tcg_ctx->tb_jmp_target_addr = tb->jmp_target_arg;
+    }
+
+    gen_code_size = tcg_gen_code(tcg_ctx, tb);
+    if (unlikely(gen_code_size < 0)) {
+        if (gen_code_size == -1 && !retried) {
+            retried = true;
+            tb_tier_discard(tb);
+            goto buffer_overflow;
+        }
+        goto fail;
+    }
+    search_size = encode_search(tb, (void *)gen_code_buf + gen_code_size);
+    if (unlikely(search_size < 0)) {
+        if (!retried) {
+            retried = true;
+            tb_tier_discard(tb);
+            goto buffer_overflow;
+        }
+        goto fail;
+    }
+    tb->tc.size = gen_code_size;
+    perf_report_code(tb, tcg_splitwx_to_rx(gen_code_buf));
+
+    qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
+        ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
+                 CODE_GEN_ALIGN));
+
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_RESET_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    tcg_tb_insert(tb);
+    if (tb_replace(old, succ, tb)) {
+        qemu_thread_jit_execute();
+        return true;
+    }
+    tcg_tb_remove(tb);
+
+ fail:
+    /* Give back the space taken by @tb, nothing can refer to it */
+    tb_tier_discard(tb);
+    qatomic_set(&tcg_ctx->code_gen_ptr, (void *)tb);
+    qemu_thread_jit_execute();
+    return false;
+}
+#endif /* CONFIG_SOFTMMU */
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -1730,7 +2188,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 #if !defined(CONFIG_USER_ONLY)
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
-        invalidate_page_bitmap(p);
+        invalidate_page_code_ranges(p);
         tlb_unprotect_code(start);
     }
 #endif
@@ -1826,24 +2284,17 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
     }
 
     assert_page_locked(p);
-    if (!p->code_bitmap &&
-        ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
-        build_page_bitmap(p);
-    }
-    if (p->code_bitmap) {
-        unsigned int nr;
-        unsigned long b;
-
-        nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
-        if (b & ((1 << len) - 1)) {
-            goto do_invalidate;
-        }
-    } else {
-    do_invalidate:
-        tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
-                                              retaddr);
+    if (!p->code_ranges) {
+        build_page_code_ranges(p);
+    }
+    if (!page_code_ranges_hit(p, start & ~TARGET_PAGE_MASK, len)) {
+        qatomic_inc(&tb_ctx.smc_data_writes);
+        return;
     }
+    qatomic_inc(&tb_ctx.smc_code_writes);
+    qatomic_set(&p->smc_count, p->smc_count + 1);
+    tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
+                                          retaddr);
 }
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
@@ -2065,11 +2516,64 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
+typedef struct PageSMCStat {
+    tb_page_addr_t addr;
+    unsigned int count;
+} PageSMCStat;
+
+static void page_smc_top_1(int level, void **lp, tb_page_addr_t index,
+                           PageSMCStat *top)
+{
+    int i;
+
+    if (*lp == NULL) {
+        return;
+    }
+    if (level == 0) {
+        PageDesc *pd = *lp;
+
+        for (i = 0; i < V_L2_SIZE; ++i) {
+            unsigned int count = qatomic_read(&pd[i].smc_count);
+            int j;
+
+            if (count <= top[SMC_TOP_PAGES - 1].count) {
+                continue;
+            }
+            for (j = SMC_TOP_PAGES - 1; j > 0 && top[j - 1].count < count;
+                 j--) {
+                top[j] = top[j - 1];
+            }
+            top[j].addr = ((index << V_L2_BITS) | i) << TARGET_PAGE_BITS;
+            top[j].count = count;
+        }
+    } else {
+        void **pp = *lp;
+
+        for (i = 0; i < V_L2_SIZE; ++i) {
+            page_smc_top_1(level - 1, pp + i, (index << V_L2_BITS) | i, top);
+        }
+    }
+}
+
+/* Fill @top with the pages whose code was most often overwritten */
+static void page_smc_top(PageSMCStat *top)
+{
+    int i, l1_sz = v_l1_size;
+
+    memset(top, 0, SMC_TOP_PAGES * sizeof(*top));
+    for (i = 0; i < l1_sz; i++) {
+        page_smc_top_1(v_l2_levels, l1_map + i, i, top);
+    }
+}
+
 void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t flush_requested, flush_run;
+    PageSMCStat smc_top[SMC_TOP_PAGES];
+    int i;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2110,12 +2614,42 @@ void dump_exec_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "TB evict count      %u (%zu TBs, %zu KiB)\n",
+                           qatomic_read(&tb_ctx.tb_evict_count),
+                           tb_ctx.tb_evict_tbs, tb_ctx.tb_evict_bytes / KiB);
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_remote_flush_counts(&flush_requested, &flush_run);
+    g_string_append_printf(buf, "TLB remote flushes  %zu requested, "
+                           "%zu run\n", flush_requested, flush_run);
+    g_string_append_printf(buf, "SMC code writes     %zu "
+                           "(data writes to code pages %zu)\n",
+                           qatomic_read(&tb_ctx.smc_code_writes),
+                           qatomic_read(&tb_ctx.smc_data_writes));
+    page_smc_top(smc_top);
+    for (i = 0; i < SMC_TOP_PAGES && smc_top[i].count; i++) {
+        g_string_append_printf(buf, "  page 0x%" PRIx64 " %u code writes\n",
+                               (uint64_t)smc_top[i].addr, smc_top[i].count);
+    }
+    g_string_append_printf(buf, "Exclusive sections  %" PRIu64 " safe work, "
+                           "%" PRIu64 " atomic insns\n",
+                           exclusive_stats_get(EXCLUSIVE_SAFE_WORK),
+                           exclusive_stats_get(EXCLUSIVE_ATOMIC_INSN));
+    g_string_append_printf(buf, "  atomic accesses   %" PRIu64 " unaligned, "
+                           "%" PRIu64 " wide, %" PRIu64 " MMIO%s\n",
+                           exclusive_stats_get(EXCLUSIVE_ATOMIC_UNALIGNED),
+                           exclusive_stats_get(EXCLUSIVE_ATOMIC_WIDE),
+                           exclusive_stats_get(EXCLUSIVE_ATOMIC_IO),
+                           atomic_lock_enabled ? " (locked-atomics=on)" : "");
+    g_string_append_printf(buf, "TB jump cache:\n");
+    tb_jmp_cache_dump_info(buf);
     tcg_dump_info(buf);
+    tcg_dump_helper_audit(buf);
+    tb_persist_dump_info(buf);
+    tb_tier_dump_info(buf);
 }
 
 void dump_opcount_info(GString *buf)
@@ -2262,6 +2796,7 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
     target_ulong addr, len;
     bool reset_target_data;
+    unsigned int gen;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2280,12 +2815,14 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     }
     reset_target_data = !(flags & PAGE_VALID) || (flags & PAGE_RESET);
     flags &= ~PAGE_RESET;
+    gen = page_flags_bump();
 
     for (addr = start, len = end - start;
          len != 0;
          len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
         PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
 
+        p->flags_gen = gen;
         /* If the write protection bit is set, then we invalidate
            the code inside.  */
         if (!(p->flags & PAGE_WRITE) &&
@@ -2419,7 +2956,7 @@ void page_protect(tb_page_addr_t page_addr)
  */
 int page_unprotect(target_ulong address, uintptr_t pc)
 {
-    unsigned int prot;
+    unsigned int prot, gen;
     bool current_tb_invalidated;
     PageDesc *p;
     target_ulong host_start, host_end, addr;
@@ -2455,9 +2992,11 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             host_end = host_start + qemu_host_page_size;
 
             prot = 0;
+            gen = page_flags_bump();
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
                 p = page_find(addr >> TARGET_PAGE_BITS);
                 p->flags |= PAGE_WRITE;
+                p->flags_gen = gen;
                 prot |= p->flags;
 
                 /* and since the content will be modified, we must invalidate
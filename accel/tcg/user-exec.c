@@ -81,9 +81,10 @@ MMUAccessType adjust_signal_pc(uintptr_t *pc, bool is_write)
          * there's little we can do about that here).  Therefore, do not
          * trigger the unwinder.
          *
-         * Like tb_gen_code, release the memory lock before cpu_loop_exit.
+         * Like tb_gen_code, release the memory lock and the TCG context
+         * before cpu_loop_exit.
          */
-        mmap_unlock();
+        tb_gen_code_abort();
         *pc = 0;
         return MMU_INST_FETCH;
     }
@@ -500,9 +501,21 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
         cpu_loop_exit_sigbus(env_cpu(env), addr, t, retaddr);
     }
 
-    /* Enforce qemu required alignment.  */
+    /*
+     * Enforce qemu required alignment.  Accesses emulated under the stripe
+     * locks must not fault while holding them, so check the page first.
+     */
     if (unlikely(addr & (size - 1))) {
-        cpu_loop_exit_atomic(env_cpu(env), retaddr);
+        if (!atomic_lock_possible(addr, size) ||
+            page_check_range(addr, size, prot) < 0) {
+            cpu_loop_exit_atomic_reason(env_cpu(env), retaddr,
+                                        EXCLUSIVE_ATOMIC_UNALIGNED);
+        }
+    } else if (size == 16 && !HAVE_CMPXCHG128) {
+        if (!atomic_lock_enabled || page_check_range(addr, size, prot) < 0) {
+            cpu_loop_exit_atomic_reason(env_cpu(env), retaddr,
+                                        EXCLUSIVE_ATOMIC_WIDE);
+        }
     }
 
     ret = g2h(env_cpu(env), addr);
@@ -536,7 +549,5 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
 #include "atomic_template.h"
 #endif
 
-#if HAVE_ATOMIC128 || HAVE_CMPXCHG128
 #define DATA_SIZE 16
 #include "atomic_template.h"
-#endif
@@ -0,0 +1,252 @@
+/*
+ * Sampling profiler
+ *
+ * Periodically sample where each vCPU is and with which call stack,
+ * and write the result as folded stacks, one line per distinct stack
+ * followed by the number of samples, e.g.:
+ *
+ *   mmu0;main;compute;0x4011a6 42
+ *
+ * which is the format consumed by flamegraph.pl and similar tools.
+ * Nothing is added to the translated code, so the overhead only
+ * depends on the sampling period.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define MAX_DEPTH 64
+
+static uint64_t period_us = 1000;
+static size_t max_depth = MAX_DEPTH;
+static bool symbols = true;
+static const char *outfile;
+
+/* protects @samples and @sym_ranges */
+static GMutex lock;
+/* stack (GBytes of mmu_idx, pc, frames...) -> sample count */
+static GHashTable *samples;
+/*
+ * Contiguous code translated so far, keyed by start address.  Several
+ * symbols may have the same name, e.g. static functions, so ranges are
+ * only merged when they touch.
+ */
+static GTree *sym_ranges;
+
+typedef struct {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+} SymRange;
+
+typedef struct {
+    uint64_t addr;
+    SymRange *prev; /* last range starting at or before addr */
+    SymRange *next; /* first range starting after addr */
+} RangeSearch;
+
+static void vcpu_sample(qemu_plugin_id_t id, unsigned int vcpu_index,
+                        uint64_t pc, unsigned int mmu_idx,
+                        const uint64_t *frames, size_t n_frames)
+{
+    uint64_t key[2 + MAX_DEPTH];
+    size_t n = MIN(n_frames, max_depth);
+    g_autoptr(GBytes) stack = NULL;
+    uint64_t *count;
+
+    key[0] = mmu_idx;
+    key[1] = pc;
+    memcpy(&key[2], frames, n * sizeof(uint64_t));
+    stack = g_bytes_new(key, (2 + n) * sizeof(uint64_t));
+
+    g_mutex_lock(&lock);
+    count = g_hash_table_lookup(samples, stack);
+    if (!count) {
+        count = g_new0(uint64_t, 1);
+        g_hash_table_insert(samples, g_bytes_ref(stack), count);
+    }
+    (*count)++;
+    g_mutex_unlock(&lock);
+}
+
+static gint cmp_start(gconstpointer a, gconstpointer b, gpointer d)
+{
+    const SymRange *ra = a;
+    const SymRange *rb = b;
+
+    return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+/* Record the closest ranges on either side of the searched address */
+static gint search_addr(gconstpointer key, gconstpointer data)
+{
+    SymRange *r = (SymRange *)key;
+    RangeSearch *s = (RangeSearch *)data;
+
+    if (s->addr < r->start) {
+        s->next = r;
+        return -1;
+    }
+    s->prev = r;
+    return s->addr > r->start;
+}
+
+static RangeSearch find_ranges(uint64_t addr)
+{
+    RangeSearch s = { .addr = addr };
+
+    g_tree_search(sym_ranges, search_addr, &s);
+    return s;
+}
+
+static void add_range(const char *sym, uint64_t start, uint64_t end)
+{
+    RangeSearch s = find_ranges(start);
+    SymRange *r = s.prev;
+
+    if (r && r->end >= start && g_str_equal(r->name, sym)) {
+        r->end = MAX(r->end, end);
+    } else if (r && r->end > start) {
+        /* already covered by another symbol */
+        return;
+    } else {
+        r = g_new(SymRange, 1);
+        r->name = sym;
+        r->start = start;
+        r->end = end;
+        g_tree_insert(sym_ranges, r, r);
+    }
+
+    if (s.next && s.next->start <= r->end && g_str_equal(s.next->name, sym)) {
+        r->end = MAX(r->end, s.next->end);
+        g_tree_remove(sym_ranges, s.next);
+    }
+}
+
+/*
+ * Samples only carry addresses. Remember the extent of the code we
+ * translate in each function, which is enough to name both the sampled
+ * PCs and the return addresses, since the calls were translated too.
+ */
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    g_mutex_lock(&lock);
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+        const char *sym = qemu_plugin_insn_symbol(insn);
+        uint64_t start = qemu_plugin_insn_vaddr(insn);
+
+        if (sym) {
+            add_range(sym, start, start + qemu_plugin_insn_size(insn));
+        }
+    }
+    g_mutex_unlock(&lock);
+}
+
+/* A return address may point just past the last instruction of a caller */
+static void append_frame(GString *s, uint64_t addr)
+{
+    RangeSearch rs = find_ranges(addr);
+
+    if (rs.prev && addr <= rs.prev->end) {
+        g_string_append_printf(s, ";%s", rs.prev->name);
+    } else {
+        g_string_append_printf(s, ";0x%" PRIx64, addr);
+    }
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new("");
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_mutex_lock(&lock);
+    g_hash_table_iter_init(&iter, samples);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        gsize size;
+        const uint64_t *stack = g_bytes_get_data(key, &size);
+        size_t n = size / sizeof(uint64_t);
+        size_t i;
+
+        g_string_append_printf(report, "mmu%" PRIu64, stack[0]);
+        /* folded stacks start from the outermost frame */
+        for (i = n - 1; i >= 1; i--) {
+            append_frame(report, stack[i]);
+        }
+        g_string_append_printf(report, " %" PRIu64 "\n",
+                               *(uint64_t *)value);
+    }
+    g_hash_table_destroy(samples);
+    g_tree_destroy(sym_ranges);
+    g_mutex_unlock(&lock);
+
+    if (outfile) {
+        FILE *f = fopen(outfile, "w");
+
+        if (!f) {
+            fprintf(stderr, "sampler: cannot open %s\n", outfile);
+            return;
+        }
+        fputs(report->str, f);
+        fclose(f);
+    } else {
+        qemu_plugin_outs(report->str);
+    }
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_autofree char **tokens = g_strsplit(opt, "=", 2);
+
+        if (g_strcmp0(tokens[0], "period") == 0) {
+            period_us = g_ascii_strtoull(tokens[1], NULL, 10);
+            if (period_us == 0) {
+                fprintf(stderr, "invalid sampling period: %s\n", opt);
+                return -1;
+            }
+        } else if (g_strcmp0(tokens[0], "depth") == 0) {
+            max_depth = g_ascii_strtoull(tokens[1], NULL, 10);
+            max_depth = MIN(max_depth, MAX_DEPTH);
+        } else if (g_strcmp0(tokens[0], "symbols") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &symbols)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
+        } else if (g_strcmp0(tokens[0], "outfile") == 0) {
+            outfile = g_strdup(tokens[1]);
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+
+    samples = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                    (GDestroyNotify)g_bytes_unref, g_free);
+    sym_ranges = g_tree_new_full(cmp_start, NULL, g_free, NULL);
+
+    if (symbols) {
+        qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    }
+    qemu_plugin_register_vcpu_sample_cb(id, vcpu_sample, period_us * 1000);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
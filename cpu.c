@@ -429,6 +429,13 @@ int cpu_memory_rw_debug(CPUState *cpu, target_ulong addr,
     }
     return 0;
 }
+
+/* Guest memory is always host memory in user mode */
+int cpu_memory_read_ram_debug(CPUState *cpu, target_ulong addr,
+                              void *ptr, target_ulong len)
+{
+    return cpu_memory_rw_debug(cpu, addr, ptr, len, false);
+}
 #endif
 
 bool target_words_bigendian(void)
@@ -23,6 +23,7 @@
 #include "hw/core/cpu.h"
 #include "sysemu/cpus.h"
 #include "qemu/lockable.h"
+#include "qemu/stats64.h"
 
 static QemuMutex qemu_cpu_list_lock;
 static QemuCond exclusive_cond;
@@ -34,6 +35,8 @@ static QemuCond qemu_work_cond;
  */
 static int pending_cpus;
 
+static Stat64 exclusive_stats[EXCLUSIVE__MAX];
+
 void qemu_init_cpu_list(void)
 {
     /* This is needed because qemu_init_cpu_list is also called by the
@@ -118,7 +121,7 @@ struct qemu_work_item {
     QSIMPLEQ_ENTRY(qemu_work_item) node;
     run_on_cpu_func func;
     run_on_cpu_data data;
-    bool free, exclusive, done;
+    bool free, exclusive, guest, done;
 };
 
 static void queue_work_on_cpu(CPUState *cpu, struct qemu_work_item *wi)
@@ -146,6 +149,7 @@ void do_run_on_cpu(CPUState *cpu, run_on_cpu_func func, run_on_cpu_data data,
     wi.done = false;
     wi.free = false;
     wi.exclusive = false;
+    wi.guest = false;
 
     queue_work_on_cpu(cpu, &wi);
     while (!qatomic_mb_read(&wi.done)) {
@@ -168,6 +172,20 @@ void async_run_on_cpu(CPUState *cpu, run_on_cpu_func func, run_on_cpu_data data)
     queue_work_on_cpu(cpu, wi);
 }
 
+void async_guest_run_on_cpu(CPUState *cpu, run_on_cpu_func func,
+                            run_on_cpu_data data)
+{
+    struct qemu_work_item *wi;
+
+    wi = g_malloc0(sizeof(struct qemu_work_item));
+    wi->func = func;
+    wi->data = data;
+    wi->free = true;
+    wi->guest = true;
+
+    queue_work_on_cpu(cpu, wi);
+}
+
 /* Wait for pending exclusive operations to complete.  The CPU list lock
    must be held.  */
 static inline void exclusive_idle(void)
@@ -214,6 +232,16 @@ void start_exclusive(void)
     current_cpu->in_exclusive_context = true;
 }
 
+void exclusive_stats_inc(ExclusiveReason reason)
+{
+    stat64_add(&exclusive_stats[reason], 1);
+}
+
+uint64_t exclusive_stats_get(ExclusiveReason reason)
+{
+    return stat64_get(&exclusive_stats[reason]);
+}
+
 /* Finish an exclusive operation.  */
 void end_exclusive(void)
 {
@@ -314,7 +342,21 @@ void async_safe_run_on_cpu(CPUState *cpu, run_on_cpu_func func,
     queue_work_on_cpu(cpu, wi);
 }
 
-void process_queued_cpu_work(CPUState *cpu)
+/* Must be called with cpu->work_mutex held */
+static struct qemu_work_item *dequeue_cpu_work(CPUState *cpu, bool filter)
+{
+    struct qemu_work_item *wi;
+
+    QSIMPLEQ_FOREACH(wi, &cpu->work_list, node) {
+        if (!filter || !wi->guest) {
+            QSIMPLEQ_REMOVE(&cpu->work_list, wi, qemu_work_item, node);
+            return wi;
+        }
+    }
+    return NULL;
+}
+
+static void do_process_queued_cpu_work(CPUState *cpu, bool filter)
 {
     struct qemu_work_item *wi;
 
@@ -323,9 +365,7 @@ void process_queued_cpu_work(CPUState *cpu)
         qemu_mutex_unlock(&cpu->work_mutex);
         return;
     }
-    while (!QSIMPLEQ_EMPTY(&cpu->work_list)) {
-        wi = QSIMPLEQ_FIRST(&cpu->work_list);
-        QSIMPLEQ_REMOVE_HEAD(&cpu->work_list, node);
+    while ((wi = dequeue_cpu_work(cpu, filter))) {
         qemu_mutex_unlock(&cpu->work_mutex);
         if (wi->exclusive) {
             /* Running work items outside the BQL avoids the following deadlock:
@@ -335,6 +375,7 @@ void process_queued_cpu_work(CPUState *cpu)
              * neither CPU can proceed.
              */
             qemu_mutex_unlock_iothread();
+            exclusive_stats_inc(EXCLUSIVE_SAFE_WORK);
             start_exclusive();
             wi->func(cpu, wi->data);
             end_exclusive();
@@ -352,3 +393,13 @@ void process_queued_cpu_work(CPUState *cpu)
     qemu_mutex_unlock(&cpu->work_mutex);
     qemu_cond_broadcast(&qemu_work_cond);
 }
+
+void process_queued_cpu_work(CPUState *cpu)
+{
+    do_process_queued_cpu_work(cpu, false);
+}
+
+void process_queued_cpu_work_filtered(CPUState *cpu)
+{
+    do_process_queued_cpu_work(cpu, true);
+}
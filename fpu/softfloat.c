@@ -401,6 +401,144 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     return soft(ua.s, ub.s, s);
 }
 
+/*
+ * float16 and bfloat16 have no host type, so their hardfloat operations
+ * are computed in single precision.  Widening the operands is exact, and
+ * since float32 carries at least 2p+2 bits of precision for both formats,
+ * rounding the result of an addition, subtraction, multiplication or
+ * division once more to the narrow format gives the correctly rounded
+ * result.  Only results within the normal range of the narrow format are
+ * rounded here; zero, tiny and overflowing results go to softfloat, which
+ * raises the appropriate flags.
+ */
+
+typedef float16  (*soft_f16_op2_fn)(float16 a, float16 b, float_status *s);
+typedef bfloat16 (*soft_bf16_op2_fn)(bfloat16 a, bfloat16 b, float_status *s);
+typedef bool (*f16_check_fn)(float16 a, float16 b);
+typedef bool (*bf16_check_fn)(bfloat16 a, bfloat16 b);
+
+static inline bool f16_is_zon(float16 a)
+{
+    return float16_is_zero(a) || float16_is_normal(a);
+}
+
+static inline bool bf16_is_zon(bfloat16 a)
+{
+    return bfloat16_is_zero(a) || bfloat16_is_normal(a);
+}
+
+static inline bool f16_is_zon2(float16 a, float16 b)
+{
+    return f16_is_zon(a) && f16_is_zon(b);
+}
+
+static inline bool bf16_is_zon2(bfloat16 a, bfloat16 b)
+{
+    return bf16_is_zon(a) && bf16_is_zon(b);
+}
+
+/* Widen a zero or normal float16 to float32. */
+static inline union_float32 f16_widen(float16 a)
+{
+    uint32_t v = float16_val(a);
+    uint32_t mag = v & 0x7fff;
+    union_float32 r;
+
+    if (mag) {
+        mag += (127 - 15) << 10;
+    }
+    r.s = make_float32(((v & 0x8000) << 16) | (mag << 13));
+    return r;
+}
+
+/* Widen a zero or normal bfloat16 to float32. */
+static inline union_float32 bf16_widen(bfloat16 a)
+{
+    union_float32 r;
+
+    r.s = make_float32((uint32_t)a << 16);
+    return r;
+}
+
+/*
+ * Round @r to float16 if its magnitude lies in (2**-14, 65520), i.e. if
+ * the result is normal and does not round to infinity.
+ */
+static inline bool f16_narrow(union_float32 r, float16 *ret)
+{
+    uint32_t v = float32_val(r.s);
+    uint32_t mag = v & 0x7fffffff;
+
+    if (unlikely(mag <= 0x38800000 || mag >= 0x477ff000)) {
+        return false;
+    }
+    mag -= (127 - 15) << 23;
+    mag += 0xfff + ((mag >> 13) & 1);
+    *ret = make_float16(((v >> 16) & 0x8000) | (mag >> 13));
+    return true;
+}
+
+/*
+ * Round @r to bfloat16 if its magnitude lies in (FLT_MIN, 0x1.ffp127),
+ * i.e. if the result is normal and does not round to infinity.
+ */
+static inline bool bf16_narrow(union_float32 r, bfloat16 *ret)
+{
+    uint32_t v = float32_val(r.s);
+    uint32_t mag = v & 0x7fffffff;
+
+    if (unlikely(mag <= 0x00800000 || mag >= 0x7f7f8000)) {
+        return false;
+    }
+    mag += 0x7fff + ((mag >> 16) & 1);
+    *ret = ((v >> 16) & 0x8000) | (mag >> 16);
+    return true;
+}
+
+static inline float16
+float16_gen2(float16 a, float16 b, float_status *s,
+             hard_f32_op2_fn hard, soft_f16_op2_fn soft, f16_check_fn pre)
+{
+    union_float32 ua, ub, ur;
+    float16 r;
+
+    if (unlikely(!can_use_fpu(s)) || unlikely(!pre(a, b))) {
+        goto soft;
+    }
+
+    ua = f16_widen(a);
+    ub = f16_widen(b);
+    ur.h = hard(ua.h, ub.h);
+    if (likely(f16_narrow(ur, &r))) {
+        return r;
+    }
+
+ soft:
+    return soft(a, b, s);
+}
+
+static inline bfloat16
+bfloat16_gen2(bfloat16 a, bfloat16 b, float_status *s,
+              hard_f32_op2_fn hard, soft_bf16_op2_fn soft, bf16_check_fn pre)
+{
+    union_float32 ua, ub, ur;
+    bfloat16 r;
+
+    if (unlikely(!can_use_fpu(s)) || unlikely(!pre(a, b))) {
+        goto soft;
+    }
+
+    ua = bf16_widen(a);
+    ub = bf16_widen(b);
+    ur.h = hard(ua.h, ub.h);
+    if (likely(bf16_narrow(ur, &r))) {
+        return r;
+    }
+
+ soft:
+    return soft(a, b, s);
+}
+
 /*
  * Classify a floating point number. Everything above float_class_qnan
  * is a NaN so cls >= float_class_qnan is any NaN.
@@ -1797,8 +1935,8 @@ static floatx80 floatx80_round_pack_canonical(FloatParts128 *p,
  * Addition and subtraction
  */
 
-static float16 QEMU_FLATTEN
-float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_addsub(float16 a, float16 b, float_status *status, bool subtract)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -1809,14 +1947,14 @@ float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
     return float16_round_pack_canonical(pr, status);
 }
 
-float16 float16_add(float16 a, float16 b, float_status *status)
+static float16 soft_f16_add(float16 a, float16 b, float_status *status)
 {
-    return float16_addsub(a, b, status, false);
+    return soft_f16_addsub(a, b, status, false);
 }
 
-float16 float16_sub(float16 a, float16 b, float_status *status)
+static float16 soft_f16_sub(float16 a, float16 b, float_status *status)
 {
-    return float16_addsub(a, b, status, true);
+    return soft_f16_addsub(a, b, status, true);
 }
 
 static float32 QEMU_SOFTFLOAT_ATTR
@@ -1938,8 +2076,20 @@ float64_sub(float64 a, float64 b, float_status *s)
     return float64_addsub(a, b, s, hard_f64_sub, soft_f64_sub);
 }
 
-static bfloat16 QEMU_FLATTEN
-bfloat16_addsub(bfloat16 a, bfloat16 b, float_status *status, bool subtract)
+float16 QEMU_FLATTEN
+float16_add(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_add, soft_f16_add, f16_is_zon2);
+}
+
+float16 QEMU_FLATTEN
+float16_sub(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_sub, soft_f16_sub, f16_is_zon2);
+}
+
+static bfloat16 QEMU_SOFTFLOAT_ATTR
+soft_bf16_addsub(bfloat16 a, bfloat16 b, float_status *status, bool subtract)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -1950,14 +2100,26 @@ bfloat16_addsub(bfloat16 a, bfloat16 b, float_status *status, bool subtract)
     return bfloat16_round_pack_canonical(pr, status);
 }
 
-bfloat16 bfloat16_add(bfloat16 a, bfloat16 b, float_status *status)
+static bfloat16 soft_bf16_add(bfloat16 a, bfloat16 b, float_status *status)
+{
+    return soft_bf16_addsub(a, b, status, false);
+}
+
+static bfloat16 soft_bf16_sub(bfloat16 a, bfloat16 b, float_status *status)
 {
-    return bfloat16_addsub(a, b, status, false);
+    return soft_bf16_addsub(a, b, status, true);
 }
 
-bfloat16 bfloat16_sub(bfloat16 a, bfloat16 b, float_status *status)
+bfloat16 QEMU_FLATTEN
+bfloat16_add(bfloat16 a, bfloat16 b, float_status *s)
 {
-    return bfloat16_addsub(a, b, status, true);
+    return bfloat16_gen2(a, b, s, hard_f32_add, soft_bf16_add, bf16_is_zon2);
+}
+
+bfloat16 QEMU_FLATTEN
+bfloat16_sub(bfloat16 a, bfloat16 b, float_status *s)
+{
+    return bfloat16_gen2(a, b, s, hard_f32_sub, soft_bf16_sub, bf16_is_zon2);
 }
 
 static float128 QEMU_FLATTEN
@@ -2010,7 +2172,8 @@ floatx80 floatx80_sub(floatx80 a, floatx80 b, float_status *status)
  * Multiplication
  */
 
-float16 QEMU_FLATTEN float16_mul(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_mul(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2069,8 +2232,14 @@ float64_mul(float64 a, float64 b, float_status *s)
                         f64_is_zon2, f64_addsubmul_post);
 }
 
-bfloat16 QEMU_FLATTEN
-bfloat16_mul(bfloat16 a, bfloat16 b, float_status *status)
+float16 QEMU_FLATTEN
+float16_mul(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_mul, soft_f16_mul, f16_is_zon2);
+}
+
+static bfloat16 QEMU_SOFTFLOAT_ATTR
+soft_bf16_mul(bfloat16 a, bfloat16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2081,6 +2250,12 @@ bfloat16_mul(bfloat16 a, bfloat16 b, float_status *status)
     return bfloat16_round_pack_canonical(pr, status);
 }
 
+bfloat16 QEMU_FLATTEN
+bfloat16_mul(bfloat16 a, bfloat16 b, float_status *s)
+{
+    return bfloat16_gen2(a, b, s, hard_f32_mul, soft_bf16_mul, bf16_is_zon2);
+}
+
 float128 QEMU_FLATTEN
 float128_mul(float128 a, float128 b, float_status *status)
 {
@@ -2326,7 +2501,8 @@ float128 QEMU_FLATTEN float128_muladd(float128 a, float128 b, float128 c,
  * Division
  */
 
-float16 float16_div(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_div(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2419,8 +2595,19 @@ float64_div(float64 a, float64 b, float_status *s)
                         f64_div_pre, f64_div_post);
 }
 
-bfloat16 QEMU_FLATTEN
-bfloat16_div(bfloat16 a, bfloat16 b, float_status *status)
+static bool f16_div_pre(float16 a, float16 b)
+{
+    return f16_is_zon(a) && float16_is_normal(b);
+}
+
+float16 QEMU_FLATTEN
+float16_div(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_div, soft_f16_div, f16_div_pre);
+}
+
+static bfloat16 QEMU_SOFTFLOAT_ATTR
+soft_bf16_div(bfloat16 a, bfloat16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2431,6 +2618,17 @@ bfloat16_div(bfloat16 a, bfloat16 b, float_status *status)
     return bfloat16_round_pack_canonical(pr, status);
 }
 
+static bool bf16_div_pre(bfloat16 a, bfloat16 b)
+{
+    return bf16_is_zon(a) && bfloat16_is_normal(b);
+}
+
+bfloat16 QEMU_FLATTEN
+bfloat16_div(bfloat16 a, bfloat16 b, float_status *s)
+{
+    return bfloat16_gen2(a, b, s, hard_f32_div, soft_bf16_div, bf16_div_pre);
+}
+
 float128 QEMU_FLATTEN
 float128_div(float128 a, float128 b, float_status *status)
 {
@@ -2625,6 +2823,11 @@ float32 float16_to_float32(float16 a, bool ieee, float_status *s)
     const FloatFmt *fmt16 = ieee ? &float16_params : &float16_params_ahp;
     FloatParts64 p;
 
+    /* Widening conversion can never produce inexact results.  */
+    if (likely(f16_is_zon(a))) {
+        return f16_widen(a).s;
+    }
+
     float16a_unpack_canonical(&p, a, s, fmt16);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2645,6 +2848,16 @@ float16 float32_to_float16(float32 a, bool ieee, float_status *s)
     FloatParts64 p;
     const FloatFmt *fmt;
 
+    if (ieee && can_use_fpu(s) && float32_is_normal(a)) {
+        union_float32 ua;
+        float16 r;
+
+        ua.s = a;
+        if (likely(f16_narrow(ua, &r))) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     if (ieee) {
         parts_float_to_float(&p, s);
@@ -2702,6 +2915,17 @@ float32 float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (can_use_fpu(s) && likely(float64_is_normal(a))) {
+        union_float64 ua;
+        union_float32 ur;
+
+        ua.s = a;
+        ur.h = ua.h;
+        if (likely(fabsf(ur.h) > FLT_MIN && !f32_is_inf(ur))) {
+            return ur.s;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2711,6 +2935,10 @@ float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(bf16_is_zon(a))) {
+        return bf16_widen(a).s;
+    }
+
     bfloat16_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2729,6 +2957,16 @@ bfloat16 float32_to_bfloat16(float32 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (can_use_fpu(s) && float32_is_normal(a)) {
+        union_float32 ua;
+        bfloat16 r;
+
+        ua.s = a;
+        if (likely(bf16_narrow(ua, &r))) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return bfloat16_round_pack_canonical(&p, s);
@@ -2916,6 +3154,28 @@ floatx80 floatx80_round_to_int(floatx80 a, float_status *status)
  * Floating-point to signed integer conversions
  */
 
+/*
+ * Hardfloat conversions to integer handle round-to-nearest-even, which is
+ * the host rounding mode, and round-to-zero.  NaNs and out of range inputs
+ * fail the range check done by the callers and are left to softfloat.
+ */
+static inline bool can_use_fpu_to_int(FloatRoundMode rmode, int scale,
+                                      const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(scale == 0 &&
+                  s->float_exception_flags & float_flag_inexact &&
+                  (rmode == float_round_nearest_even ||
+                   rmode == float_round_to_zero));
+}
+
+static inline double hard_round_to_int(double a, FloatRoundMode rmode)
+{
+    return rmode == float_round_to_zero ? trunc(a) : rint(a);
+}
+
 int8_t float16_to_int8_scalbn(float16 a, FloatRoundMode rmode, int scale,
                               float_status *s)
 {
@@ -2966,6 +3226,18 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (can_use_fpu_to_int(rmode, scale, s)) {
+        union_float32 ua;
+        double r;
+
+        ua.s = a;
+        float32_input_flush1(&ua.s, s);
+        r = hard_round_to_int(ua.h, rmode);
+        if (likely(r >= INT32_MIN && r <= INT32_MAX)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -2975,6 +3247,18 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (can_use_fpu_to_int(rmode, scale, s)) {
+        union_float32 ua;
+        double r;
+
+        ua.s = a;
+        float32_input_flush1(&ua.s, s);
+        r = hard_round_to_int(ua.h, rmode);
+        if (likely(r >= -0x1p63 && r < 0x1p63)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
@@ -2993,6 +3277,18 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (can_use_fpu_to_int(rmode, scale, s)) {
+        union_float64 ua;
+        double r;
+
+        ua.s = a;
+        float64_input_flush1(&ua.s, s);
+        r = hard_round_to_int(ua.h, rmode);
+        if (likely(r >= INT32_MIN && r <= INT32_MAX)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3002,6 +3298,18 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (can_use_fpu_to_int(rmode, scale, s)) {
+        union_float64 ua;
+        double r;
+
+        ua.s = a;
+        float64_input_flush1(&ua.s, s);
+        r = hard_round_to_int(ua.h, rmode);
+        if (likely(r >= -0x1p63 && r < 0x1p63)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
@@ -3870,10 +4178,36 @@ float128 uint64_to_float128(uint64_t a, float_status *status)
  * Minimum and maximum
  */
 
+/*
+ * No flags are raised for zero or normal operands, so the host can pick
+ * the result.  Ties depend on the sign of zero, or on the sign alone when
+ * comparing magnitudes, and are left to softfloat.
+ * Return 0 to select @a, 1 to select @b, or -1 for a tie.
+ */
+static inline int hard_minmax(double a, double b, int flags)
+{
+    if (flags & minmax_ismag) {
+        a = fabs(a);
+        b = fabs(b);
+    }
+    if (unlikely(a == b)) {
+        return -1;
+    }
+    return (a < b) == !(flags & minmax_ismin);
+}
+
 static float16 float16_minmax(float16 a, float16 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    if (!QEMU_NO_HARDFLOAT && likely(f16_is_zon2(a, b))) {
+        int sel = hard_minmax(f16_widen(a).h, f16_widen(b).h, flags);
+
+        if (likely(sel >= 0)) {
+            return sel ? b : a;
+        }
+    }
+
     float16_unpack_canonical(&pa, a, s);
     float16_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -3886,6 +4220,14 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
 {
     FloatParts64 pa, pb, *pr;
 
+    if (!QEMU_NO_HARDFLOAT && likely(bf16_is_zon2(a, b))) {
+        int sel = hard_minmax(bf16_widen(a).h, bf16_widen(b).h, flags);
+
+        if (likely(sel >= 0)) {
+            return sel ? b : a;
+        }
+    }
+
     bfloat16_unpack_canonical(&pa, a, s);
     bfloat16_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -3897,6 +4239,19 @@ static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    if (!QEMU_NO_HARDFLOAT &&
+        likely(float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b))) {
+        union_float32 ua, ub;
+        int sel;
+
+        ua.s = a;
+        ub.s = b;
+        sel = hard_minmax(ua.h, ub.h, flags);
+        if (likely(sel >= 0)) {
+            return sel ? b : a;
+        }
+    }
+
     float32_unpack_canonical(&pa, a, s);
     float32_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -3908,6 +4263,19 @@ static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    if (!QEMU_NO_HARDFLOAT &&
+        likely(float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b))) {
+        union_float64 ua, ub;
+        int sel;
+
+        ua.s = a;
+        ub.s = b;
+        sel = hard_minmax(ua.h, ub.h, flags);
+        if (likely(sel >= 0)) {
+            return sel ? b : a;
+        }
+    }
+
     float64_unpack_canonical(&pa, a, s);
     float64_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -3954,7 +4322,7 @@ MINMAX_2(float128)
  * Floating point compare
  */
 
-static FloatRelation QEMU_FLATTEN
+static FloatRelation QEMU_SOFTFLOAT_ATTR
 float16_do_compare(float16 a, float16 b, float_status *s, bool is_quiet)
 {
     FloatParts64 pa, pb;
@@ -3964,14 +4332,37 @@ float16_do_compare(float16 a, float16 b, float_status *s, bool is_quiet)
     return parts_compare(&pa, &pb, s, is_quiet);
 }
 
+static FloatRelation QEMU_FLATTEN
+float16_hs_compare(float16 a, float16 b, float_status *s, bool is_quiet)
+{
+    union_float32 ua, ub;
+
+    if (QEMU_NO_HARDFLOAT || unlikely(!f16_is_zon2(a, b))) {
+        goto soft;
+    }
+
+    ua = f16_widen(a);
+    ub = f16_widen(b);
+    if (isgreater(ua.h, ub.h)) {
+        return float_relation_greater;
+    }
+    if (isless(ua.h, ub.h)) {
+        return float_relation_less;
+    }
+    return float_relation_equal;
+
+ soft:
+    return float16_do_compare(a, b, s, is_quiet);
+}
+
 FloatRelation float16_compare(float16 a, float16 b, float_status *s)
 {
-    return float16_do_compare(a, b, s, false);
+    return float16_hs_compare(a, b, s, false);
 }
 
 FloatRelation float16_compare_quiet(float16 a, float16 b, float_status *s)
 {
-    return float16_do_compare(a, b, s, true);
+    return float16_hs_compare(a, b, s, true);
 }
 
 static FloatRelation QEMU_SOFTFLOAT_ATTR
@@ -4074,7 +4465,7 @@ FloatRelation float64_compare_quiet(float64 a, float64 b, float_status *s)
     return float64_hs_compare(a, b, s, true);
 }
 
-static FloatRelation QEMU_FLATTEN
+static FloatRelation QEMU_SOFTFLOAT_ATTR
 bfloat16_do_compare(bfloat16 a, bfloat16 b, float_status *s, bool is_quiet)
 {
     FloatParts64 pa, pb;
@@ -4084,14 +4475,37 @@ bfloat16_do_compare(bfloat16 a, bfloat16 b, float_status *s, bool is_quiet)
     return parts_compare(&pa, &pb, s, is_quiet);
 }
 
+static FloatRelation QEMU_FLATTEN
+bfloat16_hs_compare(bfloat16 a, bfloat16 b, float_status *s, bool is_quiet)
+{
+    union_float32 ua, ub;
+
+    if (QEMU_NO_HARDFLOAT || unlikely(!bf16_is_zon2(a, b))) {
+        goto soft;
+    }
+
+    ua = bf16_widen(a);
+    ub = bf16_widen(b);
+    if (isgreater(ua.h, ub.h)) {
+        return float_relation_greater;
+    }
+    if (isless(ua.h, ub.h)) {
+        return float_relation_less;
+    }
+    return float_relation_equal;
+
+ soft:
+    return bfloat16_do_compare(a, b, s, is_quiet);
+}
+
 FloatRelation bfloat16_compare(bfloat16 a, bfloat16 b, float_status *s)
 {
-    return bfloat16_do_compare(a, b, s, false);
+    return bfloat16_hs_compare(a, b, s, false);
 }
 
 FloatRelation bfloat16_compare_quiet(bfloat16 a, bfloat16 b, float_status *s)
 {
-    return bfloat16_do_compare(a, b, s, true);
+    return bfloat16_hs_compare(a, b, s, true);
 }
 
 static FloatRelation QEMU_FLATTEN
@@ -281,6 +281,23 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tlb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show softmmu TLB statistics",
+    },
+#endif
+
+SRST
+  ``info tlb-stats``
+    Show, for each CPU and MMU mode, how many lookups missed the TLB
+    used by the generated code, how many of those were found in the
+    victim TLB or rebuilt from a large page mapping, and how many
+    needed a page table walk.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -780,6 +797,37 @@ SRST
     Dump all the ramblocks of the system.
 ERST
 
+    {
+        .name       = "bounce-buffers",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show DMA bounce buffer usage",
+        .cmd_info_hrt = qmp_x_query_bounce_buffers,
+    },
+
+SRST
+  ``info bounce-buffers``
+    Show, for each address space that needed them, how much bounce
+    buffer memory is in use out of its budget, the peak usage, and how
+    many mappings used a bounce buffer or had to wait for one.
+ERST
+
+    {
+        .name       = "dirty-ring",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show KVM dirty ring reaper statistics",
+        .cmd_info_hrt = qmp_x_query_dirty_ring,
+    },
+
+SRST
+  ``info dirty-ring``
+    Show, for each thread reaping the KVM dirty rings, the vCPUs it is
+    in charge of, its current polling interval, how many pages it
+    reaped, how many times one of its rings filled up, and how long
+    reaping took.
+ERST
+
     {
         .name       = "hotpluggable-cpus",
         .args_type  = "",
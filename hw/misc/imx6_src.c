@@ -155,7 +155,7 @@ static void imx6_defer_clear_reset_bit(int cpuid,
     ri->s = s;
     ri->reset_bit = reset_shift;
 
-    async_run_on_cpu(cpu, imx6_clear_reset_bit, RUN_ON_CPU_HOST_PTR(ri));
+    async_guest_run_on_cpu(cpu, imx6_clear_reset_bit, RUN_ON_CPU_HOST_PTR(ri));
 }
 
 
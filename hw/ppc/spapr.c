@@ -3409,7 +3409,8 @@ static void spapr_nmi(NMIState *n, int cpu_index, Error **errp)
     CPUState *cs;
 
     CPU_FOREACH(cs) {
-        async_run_on_cpu(cs, spapr_do_system_reset_on_cpu, RUN_ON_CPU_NULL);
+        async_guest_run_on_cpu(cs, spapr_do_system_reset_on_cpu,
+                               RUN_ON_CPU_NULL);
     }
 }
 
@@ -48,7 +48,7 @@ static void qemu_s390_tod_set(S390TODState *td, const S390TOD *tod,
      * suspended".
      */
     CPU_FOREACH(cpu) {
-        async_run_on_cpu(cpu, tcg_s390_tod_updated, RUN_ON_CPU_NULL);
+        async_guest_run_on_cpu(cpu, tcg_s390_tod_updated, RUN_ON_CPU_NULL);
     }
 }
 
@@ -23,6 +23,7 @@
 #include "qemu-common.h"
 #include "hw/qdev-properties.h"
 #include "hw/virtio/virtio.h"
+#include "exec/address-spaces.h"
 #include "sysemu/kvm.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
@@ -111,6 +112,92 @@ static IOMMUMemoryRegion *virtio_iommu_mr(VirtIOIOMMU *s, uint32_t sid)
     return NULL;
 }
 
+static bool virtio_iommu_bypass_allowed(VirtIOIOMMU *s)
+{
+    return virtio_vdev_has_feature(&s->parent_obj, VIRTIO_IOMMU_F_BYPASS);
+}
+
+/*
+ * Whether DMA from @sdev goes untranslated to system memory, as
+ * virtio_iommu_translate() would let it.  @bypass_allowed tells whether
+ * VIRTIO_IOMMU_F_BYPASS is negotiated, which the caller knows better
+ * while the device is being reset.
+ */
+static bool virtio_iommu_device_bypassed(IOMMUDevice *sdev,
+                                         bool bypass_allowed)
+{
+    VirtIOIOMMU *s = sdev->viommu;
+    VirtIOIOMMUEndpoint *ep = NULL;
+    bool bypassed = true;
+    int i;
+
+    if (!bypass_allowed) {
+        return false;
+    }
+
+    qemu_mutex_lock(&s->mutex);
+    if (s->endpoints) {
+        ep = g_tree_lookup(s->endpoints,
+                           GUINT_TO_POINTER(virtio_iommu_get_bdf(sdev)));
+    }
+    if (ep) {
+        /* Reserved regions are still enforced for known endpoints */
+        bypassed = !ep->domain;
+        for (i = 0; bypassed && i < s->nb_reserved_regions; i++) {
+            bypassed = s->reserved_regions[i].type ==
+                       VIRTIO_IOMMU_RESV_MEM_T_MSI;
+        }
+    }
+    qemu_mutex_unlock(&s->mutex);
+    return bypassed;
+}
+
+/*
+ * Bypassed devices see system memory through an alias rather than the
+ * IOMMU region, so that their address spaces all share one FlatView
+ * and assigned devices map the guest RAM directly.
+ */
+static void virtio_iommu_switch_address_space(IOMMUDevice *sdev,
+                                              bool bypass_allowed)
+{
+    bool bypassed = virtio_iommu_device_bypassed(sdev, bypass_allowed);
+
+    assert(qemu_mutex_iothread_locked());
+    trace_virtio_iommu_switch_address_space(pci_bus_num(sdev->bus),
+                                            PCI_SLOT(sdev->devfn),
+                                            PCI_FUNC(sdev->devfn),
+                                            bypassed);
+
+    /* Turn off first then on the other */
+    if (bypassed) {
+        memory_region_set_enabled(MEMORY_REGION(&sdev->iommu_mr), false);
+        memory_region_set_enabled(&sdev->bypass_mr, true);
+    } else {
+        memory_region_set_enabled(&sdev->bypass_mr, false);
+        memory_region_set_enabled(MEMORY_REGION(&sdev->iommu_mr), true);
+    }
+}
+
+static void virtio_iommu_switch_address_space_all(VirtIOIOMMU *s,
+                                                  bool bypass_allowed)
+{
+    GHashTableIter iter;
+    IOMMUPciBus *sbus;
+    int i;
+
+    memory_region_transaction_begin();
+    g_hash_table_iter_init(&iter, s->as_by_busptr);
+    while (g_hash_table_iter_next(&iter, NULL, (void **)&sbus)) {
+        for (i = 0; i < PCI_DEVFN_MAX; i++) {
+            if (sbus->pbdev[i]) {
+                virtio_iommu_switch_address_space(sbus->pbdev[i],
+                                                  bypass_allowed);
+            }
+        }
+    }
+    memory_region_transaction_commit();
+}
+
 static gint interval_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
 {
     VirtIOIOMMUInterval *inta = (VirtIOIOMMUInterval *)a;
@@ -317,12 +404,24 @@ static AddressSpace *virtio_iommu_find_add_as(PCIBus *bus, void *opaque,
 
         trace_virtio_iommu_init_iommu_mr(name);
 
+        memory_region_init(&sdev->root, OBJECT(s), name, UINT64_MAX);
+        address_space_init(&sdev->as, &sdev->root, TYPE_VIRTIO_IOMMU);
+
         memory_region_init_iommu(&sdev->iommu_mr, sizeof(sdev->iommu_mr),
                                  TYPE_VIRTIO_IOMMU_MEMORY_REGION,
                                  OBJECT(s), name,
                                  UINT64_MAX);
-        address_space_init(&sdev->as,
-                           MEMORY_REGION(&sdev->iommu_mr), TYPE_VIRTIO_IOMMU);
+        memory_region_init_alias(&sdev->bypass_mr, OBJECT(s),
+                                 "virtio-iommu-bypass", get_system_memory(),
+                                 0, memory_region_size(get_system_memory()));
+
+        /* Only one of them is enabled at a time */
+        memory_region_add_subregion_overlap(&sdev->root, 0,
+                                            MEMORY_REGION(&sdev->iommu_mr),
+                                            0);
+        memory_region_add_subregion_overlap(&sdev->root, 0,
+                                            &sdev->bypass_mr, 0);
+        virtio_iommu_switch_address_space(sdev, virtio_iommu_bypass_allowed(s));
         g_free(name);
     }
     return &sdev->as;
@@ -594,12 +693,13 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
     VirtQueueElement *elem;
     unsigned int iov_cnt;
     struct iovec *iov;
+    bool attach_changed = false;
     void *buf = NULL;
 
     for (;;) {
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
-            return;
+            break;
         }
 
         if (iov_size(elem->in_sg, elem->in_num) < sizeof(tail) ||
@@ -621,9 +721,11 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
         switch (head.type) {
         case VIRTIO_IOMMU_T_ATTACH:
             tail.status = virtio_iommu_handle_attach(s, iov, iov_cnt);
+            attach_changed = true;
             break;
         case VIRTIO_IOMMU_T_DETACH:
             tail.status = virtio_iommu_handle_detach(s, iov, iov_cnt);
+            attach_changed = true;
             break;
         case VIRTIO_IOMMU_T_MAP:
             tail.status = virtio_iommu_handle_map(s, iov, iov_cnt);
@@ -658,6 +760,15 @@ out:
         g_free(elem);
         g_free(buf);
     }
+
+    /*
+     * Outside of s->mutex: the memory listeners of the switched
+     * address spaces may replay the mappings.
+     */
+    if (attach_changed) {
+        virtio_iommu_switch_address_space_all(s,
+                                              virtio_iommu_bypass_allowed(s));
+    }
 }
 
 static void virtio_iommu_report_fault(VirtIOIOMMU *viommu, uint8_t reason,
@@ -1042,11 +1153,22 @@ static void virtio_iommu_device_reset(VirtIODevice *vdev)
                                  NULL, NULL, virtio_iommu_put_domain);
     s->endpoints = g_tree_new_full((GCompareDataFunc)int_cmp,
                                    NULL, NULL, virtio_iommu_put_endpoint);
+    /* The negotiated features are only cleared after this returns */
+    virtio_iommu_switch_address_space_all(s, false);
 }
 
 static void virtio_iommu_set_status(VirtIODevice *vdev, uint8_t status)
 {
+    VirtIOIOMMU *s = VIRTIO_IOMMU(vdev);
+
     trace_virtio_iommu_device_status(status);
+
+    /*
+     * VIRTIO_IOMMU_F_BYPASS may just have been negotiated.  A status of
+     * zero is a reset, which will clear the features afterwards.
+     */
+    virtio_iommu_switch_address_space_all(s, status &&
+                                          virtio_iommu_bypass_allowed(s));
 }
 
 static void virtio_iommu_instance_init(Object *obj)
@@ -1141,6 +1263,7 @@ static int iommu_post_load(void *opaque, int version_id)
     VirtIOIOMMU *s = opaque;
 
     g_tree_foreach(s->domains, reconstruct_endpoints, s);
+    virtio_iommu_switch_address_space_all(s, virtio_iommu_bypass_allowed(s));
     return 0;
 }
 
@@ -270,6 +270,14 @@ extern intptr_t qemu_host_page_mask;
 /* Target-specific bits that will be used via page_get_flags().  */
 #define PAGE_TARGET_1  0x0200
 #define PAGE_TARGET_2  0x0400
+/*
+ * For use with tlb_set_page_with_attrs(): the whole page of the given
+ * size maps physically contiguous memory, with the same permissions and
+ * attributes throughout, so the TLB may fill its other subpages without
+ * calling tlb_fill.  Not true e.g. under nested paging, where the size
+ * is that of the guest page but each subpage is translated separately.
+ */
+#define PAGE_LARGE_UNIFORM 0x0800
 
 #if defined(CONFIG_USER_ONLY)
 void page_dump(FILE *f);
@@ -448,6 +456,14 @@ void tcg_exec_unrealizefn(CPUState *cpu);
 int cpu_memory_rw_debug(CPUState *cpu, target_ulong addr,
                         void *ptr, target_ulong len, bool is_write);
 
+/*
+ * Like cpu_memory_rw_debug() for a read, but fail rather than access
+ * anything other than RAM, so that the read has no side effects on
+ * devices.  Returns: 0 on success, -1 on error
+ */
+int cpu_memory_read_ram_debug(CPUState *cpu, target_ulong addr,
+                              void *ptr, target_ulong len);
+
 /**
  * cpu_set_cpustate_pointers(cpu)
  * @cpu: The cpu object
@@ -76,9 +76,18 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
+/*
+ * By default, use a fully associative victim tlb of 8 entries.  See
+ * tlb_set_victim_geometry() for larger, set-associative ones.
+ */
 #define CPU_VTLB_SIZE 8
 
+/* Number of large page translations remembered per MMU mode.  */
+#define CPU_TLB_LARGE_PAGES 4
+
+/* Number of distinct flush ranges that other cpus can leave pending.  */
+#define CPU_TLB_PENDING_FLUSHES 16
+
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
 #else
@@ -150,6 +159,22 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A translation installed by the target for a page larger than
+ * TARGET_PAGE_SIZE.  The entries of its other subpages are built from
+ * it on a miss, without another call to the target's tlb_fill hook.
+ * The slot is unused if vaddr is -1.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong vaddr;
+    /* ~(size - 1), or 0 if unused */
+    target_ulong mask;
+    /* physical address mapped at vaddr */
+    hwaddr paddr;
+    MemTxAttrs attrs;
+    int prot;
+} CPUTLBLargePage;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -163,18 +188,32 @@ typedef struct CPUTLBDesc {
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /* The most recent large pages, all within the region above.  */
+    CPUTLBLargePage large_pages[CPU_TLB_LARGE_PAGES];
+    /* The next large page slot to replace.  */
+    size_t large_index;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
+    /* The next way to replace in the tlb victim table.  */
     size_t vindex;
-    /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
+    /* The tlb victim table, in two parts, grouped by set.  */
+    CPUTLBEntry *vtable;
+    CPUIOTLBEntry *viotlb;
     /* The iotlb.  */
     CPUIOTLBEntry *iotlb;
+    /*
+     * Statistics, written by the owning cpu and read atomically by the
+     * monitor: misses of the fast path table, how many of them hit the
+     * victim tlb, how many were rebuilt from a large page, and calls to
+     * the target's tlb_fill hook.
+     */
+    size_t fast_miss_count;
+    size_t victim_hit_count;
+    size_t large_hit_count;
+    size_t fill_count;
 } CPUTLBDesc;
 
 /*
@@ -188,6 +227,17 @@ typedef struct CPUTLBDescFast {
     CPUTLBEntry *table;
 } CPUTLBDescFast QEMU_ALIGNED(2 * sizeof(void *));
 
+/*
+ * A flush of the pages in [addr, addr + len) from the mmu_idx in idxmap,
+ * comparing only the low @bits bits of the addresses.
+ */
+typedef struct {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+    uint16_t bits;
+} TLBFlushRangeData;
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -200,6 +250,15 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Flushes requested by other cpus, merged until this cpu runs them
+     * from a single work item; pending_queued is set while that item is
+     * queued.  Protected by tlb_c.lock.
+     */
+    uint16_t pending_full;
+    bool pending_queued;
+    unsigned pending_n;
+    TLBFlushRangeData pending[CPU_TLB_PENDING_FLUSHES];
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -208,6 +267,9 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Flushes requested by other cpus, and work items that ran them.  */
+    size_t remote_request_count;
+    size_t remote_run_count;
 } CPUTLBCommon;
 
 /*
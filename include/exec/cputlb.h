@@ -27,5 +27,14 @@
 void tlb_protect_code(ram_addr_t ram_addr);
 void tlb_unprotect_code(ram_addr_t ram_addr);
 void tlb_flush_counts(size_t *full, size_t *part, size_t *elide);
+void tlb_remote_flush_counts(size_t *requested, size_t *run);
+void tlb_dump_stats(GString *buf);
+/*
+ * tlb_set_victim_geometry:
+ * Size the victim tlb of the cpus created from now on to @entries, split
+ * into sets of @ways entries.  Both must be powers of 2, and there can be
+ * at most 1 << CPU_TLB_DYN_MIN_BITS sets.
+ */
+void tlb_set_victim_geometry(unsigned entries, unsigned ways);
 #endif
 #endif
@@ -66,6 +66,17 @@ void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
 void QEMU_NORETURN cpu_loop_exit_atomic(CPUState *cpu, uintptr_t pc);
 
+/**
+ * cpu_loop_exit_deferred_io:
+ * @cpu: The CPU state
+ * @pc: The host return address of the access
+ *
+ * Leave the parallel part of an icount quantum before the instruction
+ * that accesses a device; it is executed again once all vCPUs have
+ * reached the end of the quantum, in a fixed order.
+ */
+void QEMU_NORETURN cpu_loop_exit_deferred_io(CPUState *cpu, uintptr_t pc);
+
 /**
  * cpu_loop_exit_requested:
  * @cpu: The CPU state to be tested
@@ -305,8 +316,9 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
  * which provoked the TLB miss.
  *
  * At most one entry for a given virtual address is permitted. Only a
- * single TARGET_PAGE_SIZE region is mapped; the supplied @size is only
- * used by tlb_flush_page.
+ * single TARGET_PAGE_SIZE region is mapped; the supplied @size is used
+ * by tlb_flush_page and, if @prot has PAGE_LARGE_UNIFORM, to fill the
+ * other subpages of the page on demand.
  */
 void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
                              hwaddr paddr, MemTxAttrs attrs,
@@ -559,6 +571,19 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Tiered translation (see accel/tcg/tb-tier.c).  @tier_count is
+     * decremented by the TB's own code on each execution; when it reaches
+     * zero the opcode stream kept in @tier_ir is retranslated with full
+     * optimization in the background, and the new TB replaces this one.
+     * @tier_ir is handed over with qatomic_xchg() and freed after an RCU
+     * grace period.  @tier_blocks counts the TBs merged into this one
+     * when forming superblocks.
+     */
+    int32_t tier_count;
+    uint16_t tier_blocks;
+    struct TBTierIR *tier_ir;
 };
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
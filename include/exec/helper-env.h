@@ -0,0 +1,38 @@
+/* Helper file for declaring TCG helper functions.
+   This one expands the CPUArchState accesses declared with DEF_HELPER_ENV,
+   and is private to tcg.c.  */
+
+#ifndef HELPER_ENV_H
+#define HELPER_ENV_H
+
+#include "exec/helper-head.h"
+
+#define DEF_HELPER_FLAGS_0(NAME, FLAGS, ret)
+#define DEF_HELPER_FLAGS_1(NAME, FLAGS, ret, t1)
+#define DEF_HELPER_FLAGS_2(NAME, FLAGS, ret, t1, t2)
+#define DEF_HELPER_FLAGS_3(NAME, FLAGS, ret, t1, t2, t3)
+#define DEF_HELPER_FLAGS_4(NAME, FLAGS, ret, t1, t2, t3, t4)
+#define DEF_HELPER_FLAGS_5(NAME, FLAGS, ret, t1, t2, t3, t4, t5)
+#define DEF_HELPER_FLAGS_6(NAME, FLAGS, ret, t1, t2, t3, t4, t5, t6)
+#define DEF_HELPER_FLAGS_7(NAME, FLAGS, ret, t1, t2, t3, t4, t5, t6, t7)
+
+#undef DEF_HELPER_ENV
+#define DEF_HELPER_ENV(NAME, READS, WRITES) \
+  { .func = HELPER(NAME), .reads = READS, .writes = WRITES },
+
+#include "helper.h"
+#include "accel/tcg/tcg-runtime.h"
+
+#undef DEF_HELPER_ENV
+#define DEF_HELPER_ENV(name, reads, writes)
+
+#undef DEF_HELPER_FLAGS_0
+#undef DEF_HELPER_FLAGS_1
+#undef DEF_HELPER_FLAGS_2
+#undef DEF_HELPER_FLAGS_3
+#undef DEF_HELPER_FLAGS_4
+#undef DEF_HELPER_FLAGS_5
+#undef DEF_HELPER_FLAGS_6
+#undef DEF_HELPER_FLAGS_7
+
+#endif /* HELPER_ENV_H */
@@ -134,4 +134,33 @@
 
 /* MAX_OPC_PARAM_IARGS must be set to n if last entry is DEF_HELPER_FLAGS_n. */
 
+/*
+ * DEF_HELPER_ENV(name, reads, writes) states which CPUArchState fields
+ * helper 'name' may read and write, for helpers that do access globals.
+ * Only the TCG globals backed by those fields are then synced before
+ * the call or reloaded after it.  'reads' and 'writes' are either
+ * DH_ENV_ANY, DH_ENV_NONE or a list of up to 4 fields, e.g.
+ * DH_ENV(regs[R_EAX], regs[R_EDX]).  A helper that can raise an
+ * exception must use DH_ENV_ANY for 'reads'.  The declaration is only
+ * expanded by tcg.c; it can be placed anywhere after the DEF_HELPER
+ * line of the helper.
+ */
+#define DEF_HELPER_ENV(name, reads, writes)
+
+#define DH_ENV_ANY  NULL
+#define DH_ENV_NONE ((const TCGEnvRange[]) { { 0, 0 } })
+
+#define dh_env_range(f) \
+    { offsetof(CPUArchState, f), sizeof_field(CPUArchState, f) },
+#define dh_env_1(a) dh_env_range(a)
+#define dh_env_2(a, b) dh_env_1(a) dh_env_range(b)
+#define dh_env_3(a, b, c) dh_env_2(a, b) dh_env_range(c)
+#define dh_env_4(a, b, c, d) dh_env_3(a, b, c) dh_env_range(d)
+#define dh_env_n(_1, _2, _3, _4, NAME, ...) NAME
+
+#define DH_ENV(...) \
+    ((const TCGEnvRange[]) {                                            \
+        dh_env_n(__VA_ARGS__, dh_env_4, dh_env_3, dh_env_2, dh_env_1)   \
+        (__VA_ARGS__) { 0, 0 } })
+
 #endif /* EXEC_HELPER_HEAD_H */
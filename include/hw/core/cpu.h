@@ -26,6 +26,7 @@
 #include "exec/memattrs.h"
 #include "qapi/qapi-types-run-state.h"
 #include "qemu/bitmap.h"
+#include "qemu/rcu.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
@@ -218,13 +219,52 @@ typedef struct SavedIOTLB {
 #endif
 
 struct KVMState;
+struct KVMDirtyRingReaper;
 struct kvm_run;
 
 struct hax_vcpu_state;
 struct hvf_vcpu_state;
 
+/*
+ * The jump cache starts with 1 << TB_JMP_CACHE_BITS entries, and is
+ * resized between the MIN and MAX bounds according to its hit rate.
+ */
 #define TB_JMP_CACHE_BITS 12
-#define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_MIN_BITS 10
+#define TB_JMP_CACHE_MAX_BITS 16
+
+/* Geometry of the set-associative second level of the jump cache.  */
+#define TB_JMP_VICTIM_SET_BITS 4
+#define TB_JMP_VICTIM_WAYS 4
+#define TB_JMP_VICTIM_SIZE (TB_JMP_VICTIM_WAYS << TB_JMP_VICTIM_SET_BITS)
+
+/*
+ * Per-vCPU cache of the TBs last looked up, indexed by a hash of their
+ * virtual pc.  A TB displaced from @array moves to the set of @victim
+ * selected by another hash, so that two pcs that collide in @array,
+ * e.g. targets of the same indirect branch, can both stay cached.
+ *
+ * The cache is replaced, rather than resized in place, by the vCPU
+ * that owns it, and freed after an RCU grace period.  Other threads
+ * may clear its entries.
+ */
+typedef struct CPUJumpCache {
+    struct rcu_head rcu;
+    unsigned int bits;
+    /* Next way to replace in a @victim set */
+    unsigned int victim_next;
+    /* Lookups since the last resize check, and how many missed the cache */
+    unsigned int window_lookups;
+    unsigned int window_misses;
+    /* Totals carried over resizes, read atomically by the monitor */
+    uint64_t lookups;
+    uint64_t misses;
+    uint64_t victim_hits;
+    uint64_t resizes;
+    /* Accessed in parallel; all accesses must be atomic */
+    TranslationBlock *victim[TB_JMP_VICTIM_SIZE];
+    TranslationBlock *array[];
+} CPUJumpCache;
 
 /* work queue */
 
@@ -274,6 +314,13 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @icount_quantum_insns: Instructions run in the current quantum of
+ * parallel icount; the global count only moves between quanta.
+ * @icount_parallel: Executing the parallel part of an icount quantum, where
+ * interrupts stay pending and device accesses are deferred.
+ * @icount_io_deferred: A device access was deferred to the end of the
+ * quantum.
+ * @icount_quantum_member: Takes part in the parallel icount barrier.
  * @can_do_io: Nonzero if memory-mapped IO is safe. Deterministic execution
  * requires that IO only be performed on the last instruction of a TB
  * so that interrupts take effect immediately.
@@ -304,6 +351,8 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @kvm_dirty_ring_reaper: The reaper thread in charge of the KVM dirty ring
+ *    of this CPU.
  *
  * State of one CPU core or thread.
  */
@@ -340,6 +389,10 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t icount_quantum_insns;
+    bool icount_parallel;
+    bool icount_io_deferred;
+    bool icount_quantum_member;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
 
@@ -354,8 +407,8 @@ struct CPUState {
     void *env_ptr; /* CPUArchState */
     IcountDecr *icount_decr_ptr;
 
-    /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* Written by this vCPU only, read under RCU by other threads */
+    CPUJumpCache *tb_jmp_cache;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -381,6 +434,7 @@ struct CPUState {
     struct kvm_run *kvm_run;
     struct kvm_dirty_gfn *kvm_dirty_gfns;
     uint32_t kvm_fetch_index;
+    struct KVMDirtyRingReaper *kvm_dirty_ring_reaper;
     uint64_t dirty_pages;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
@@ -393,6 +447,8 @@ struct CPUState {
     GArray *plugin_mem_cbs;
     /* saved iotlb data from io_writex */
     SavedIOTLB saved_iotlb;
+    /* set by the plugin sampling thread, see cpu_handle_interrupt() */
+    bool plugin_sample_pending;
 #endif
 
     /* TODO Move common fields from CPUArchState here. */
@@ -434,10 +490,20 @@ extern __thread CPUState *current_cpu;
 
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
+    CPUJumpCache *jc;
     unsigned int i;
 
-    for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
+    RCU_READ_LOCK_GUARD();
+
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+    if (!jc) {
+        return;
+    }
+    for (i = 0; i < (1u << jc->bits); i++) {
+        qatomic_set(&jc->array[i], NULL);
+    }
+    for (i = 0; i < TB_JMP_VICTIM_SIZE; i++) {
+        qatomic_set(&jc->victim[i], NULL);
     }
 }
 
@@ -717,6 +783,21 @@ void run_on_cpu(CPUState *cpu, run_on_cpu_func func, run_on_cpu_data data);
  */
 void async_run_on_cpu(CPUState *cpu, run_on_cpu_func func, run_on_cpu_data data);
 
+/**
+ * async_guest_run_on_cpu:
+ * @cpu: The vCPU to run on.
+ * @func: The function to be executed.
+ * @data: Data to pass to the function.
+ *
+ * Like async_run_on_cpu(), for work that changes the state of @cpu as
+ * seen by the guest, e.g. powering it on or resetting it.  With
+ * "-accel tcg,icount-quantum=n" the function only runs at the turn of
+ * @cpu in the serial phase of a quantum, so that the guest sees the
+ * change at the same point on every run.
+ */
+void async_guest_run_on_cpu(CPUState *cpu, run_on_cpu_func func,
+                            run_on_cpu_data data);
+
 /**
  * async_safe_run_on_cpu:
  * @cpu: The vCPU to run on.
@@ -836,6 +917,15 @@ void cpu_remove_sync(CPUState *cpu);
  */
 void process_queued_cpu_work(CPUState *cpu);
 
+/**
+ * process_queued_cpu_work_filtered() - process some items on CPU work queue
+ * @cpu: The CPU which work queue to process.
+ *
+ * Process all items except those queued with async_guest_run_on_cpu(),
+ * which are left on the queue in order.
+ */
+void process_queued_cpu_work_filtered(CPUState *cpu);
+
 /**
  * cpu_exec_start:
  * @cpu: The CPU for the current thread.
@@ -873,6 +963,41 @@ void start_exclusive(void);
  */
 void end_exclusive(void);
 
+/**
+ * ExclusiveReason:
+ *
+ * Why a CPU entered an exclusive section.  Only used for statistics.
+ */
+typedef enum ExclusiveReason {
+    /* async_safe_run_on_cpu() work item */
+    EXCLUSIVE_SAFE_WORK,
+    /* Instruction without a parallel implementation, requested by the target */
+    EXCLUSIVE_ATOMIC_INSN,
+    /* Atomic access that is misaligned or crosses a page */
+    EXCLUSIVE_ATOMIC_UNALIGNED,
+    /* Atomic access wider than the host supports */
+    EXCLUSIVE_ATOMIC_WIDE,
+    /* Atomic access to MMIO */
+    EXCLUSIVE_ATOMIC_IO,
+    EXCLUSIVE__MAX
+} ExclusiveReason;
+
+/**
+ * exclusive_stats_inc:
+ * @reason: Why the exclusive section is entered.
+ *
+ * Count the entry into an exclusive section.
+ */
+void exclusive_stats_inc(ExclusiveReason reason);
+
+/**
+ * exclusive_stats_get:
+ * @reason: Reason to look up.
+ *
+ * Returns: the number of exclusive sections entered for @reason.
+ */
+uint64_t exclusive_stats_get(ExclusiveReason reason);
+
 /**
  * qemu_init_vcpu:
  * @cpu: The vCPU to initialize.
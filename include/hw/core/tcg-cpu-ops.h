@@ -37,6 +37,18 @@ struct TCGCPUOps {
     void (*cpu_exec_exit)(CPUState *cpu);
     /** @debug_excp_handler: Callback for handling debug exceptions */
     void (*debug_excp_handler)(CPUState *cpu);
+    /**
+     * @unwind_frames: Walk the guest call stack
+     *
+     * Store at most @max_frames return addresses of the guest call
+     * stack in @frames, innermost first, by following the frame
+     * pointer chain of the current CPU state. Return the number of
+     * addresses stored. Used by the plugin sampler; it must not raise
+     * guest exceptions, and should stop at the first frame that cannot
+     * be read or does not look sane.
+     */
+    size_t (*unwind_frames)(CPUState *cpu, uint64_t *frames,
+                            size_t max_frames);
 
 #ifdef NEED_CPU_H
 #if defined(CONFIG_USER_ONLY) && defined(TARGET_I386)
@@ -35,7 +35,9 @@ typedef struct IOMMUDevice {
     void         *viommu;
     PCIBus       *bus;
     int           devfn;
+    MemoryRegion  root;         /* The device's address space */
     IOMMUMemoryRegion  iommu_mr;
+    MemoryRegion  bypass_mr;    /* The alias of system memory */
     AddressSpace  as;
 } IOMMUDevice;
 
@@ -25,6 +25,7 @@ enum qemu_plugin_event {
     QEMU_PLUGIN_EV_VCPU_RESUME,
     QEMU_PLUGIN_EV_VCPU_SYSCALL,
     QEMU_PLUGIN_EV_VCPU_SYSCALL_RET,
+    QEMU_PLUGIN_EV_VCPU_SAMPLE,
     QEMU_PLUGIN_EV_FLUSH,
     QEMU_PLUGIN_EV_ATEXIT,
     QEMU_PLUGIN_EV_MAX, /* total number of plugin events we support */
@@ -76,6 +77,7 @@ union qemu_plugin_cb_sig {
     qemu_plugin_vcpu_mem_cb_t        vcpu_mem;
     qemu_plugin_vcpu_syscall_cb_t    vcpu_syscall;
     qemu_plugin_vcpu_syscall_ret_cb_t vcpu_syscall_ret;
+    qemu_plugin_vcpu_sample_cb_t     vcpu_sample;
     void *generic;
 };
 
@@ -88,9 +90,22 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
     PLUGIN_N_CB_SUBTYPES,
 };
 
+/*
+ * Per-vCPU storage for inline ops. @data holds one entry of
+ * @element_size bytes per vCPU; translated code loads @data every time
+ * it accesses the scoreboard, so that it can be reallocated (with all
+ * vCPUs stopped) when more vCPUs are created.
+ */
+struct qemu_plugin_scoreboard {
+    void *data;
+    size_t element_size;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -104,10 +119,17 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* @entry.score == NULL means @userp is the location to update */
         struct {
             enum qemu_plugin_op op;
+            qemu_plugin_u64 entry;
             uint64_t imm;
         } inline_insn;
+        struct {
+            enum qemu_plugin_cond cond;
+            qemu_plugin_u64 entry;
+            uint64_t imm;
+        } cond;
     };
 };
 
@@ -202,6 +224,7 @@ qemu_plugin_vcpu_syscall(CPUState *cpu, int64_t num, uint64_t a1,
                          uint64_t a2, uint64_t a3, uint64_t a4, uint64_t a5,
                          uint64_t a6, uint64_t a7, uint64_t a8);
 void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret);
+void qemu_plugin_vcpu_sample_cb(CPUState *cpu);
 
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw);
@@ -267,6 +290,9 @@ static inline
 void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
 { }
 
+static inline void qemu_plugin_vcpu_sample_cb(CPUState *cpu)
+{ }
+
 static inline void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                                            MemOpIdx oi,
                                            enum qemu_plugin_mem_rw rw)
@@ -50,7 +50,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -269,16 +269,123 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
                                           enum qemu_plugin_cb_flags flags,
                                           void *userdata);
 
+/**
+ * struct qemu_plugin_scoreboard - opaque handle for a scoreboard
+ *
+ * A scoreboard is an array of entries of a fixed size, one per vCPU,
+ * whose memory is managed by QEMU. Inline ops and conditional
+ * callbacks operating on a scoreboard always use the entry of the vCPU
+ * executing the code, so counters do not have to be shared between
+ * vCPUs.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of a scoreboard entry
+ * @score: the scoreboard
+ * @offset: offset of the member in each entry
+ *
+ * This is how inline ops designate the location they operate on.
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_new() - alloc a new scoreboard
+ * @element_size: size (in bytes) of each entry
+ *
+ * Returns a zero-initialized scoreboard with one entry per vCPU. The
+ * scoreboard grows automatically when new vCPUs are created.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * The scoreboard must not be used by translated code anymore, which in
+ * practice means it can only be freed from the atexit callback.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get pointer to an entry of a scoreboard
+ * @score: scoreboard to query
+ * @vcpu_index: entry index
+ *
+ * Returns the address of the entry of @vcpu_index. The address is only
+ * valid until the next vCPU is created, since the scoreboard may be
+ * reallocated to make room for it.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* Macros to define a qemu_plugin_u64 */
+#define qemu_plugin_scoreboard_u64(score) \
+    (qemu_plugin_u64) {score, 0}
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    (qemu_plugin_u64) {score, offsetof(type, member)}
+
+/**
+ * qemu_plugin_u64_add() - add a value to a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to update
+ * @vcpu_index: entry index
+ * @added: value to add
+ */
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/**
+ * qemu_plugin_u64_get() - get value of a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to read
+ * @vcpu_index: entry index
+ */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - set value of a qemu_plugin_u64 for a given vcpu
+ * @entry: entry to write
+ * @vcpu_index: entry index
+ * @val: new value
+ */
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - return sum of all vcpu entries in a scoreboard
+ * @entry: entry to sum
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 /**
  * enum qemu_plugin_op - describes an inline op
  *
  * @QEMU_PLUGIN_INLINE_ADD_U64: add an immediate value uint64_t
- *
- * Note: currently only a single inline op is supported.
+ * @QEMU_PLUGIN_INLINE_STORE_U64: store an immediate value uint64_t
  */
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
+};
+
+/**
+ * enum qemu_plugin_cond - condition of a conditional callback
+ *
+ * The value of the scoreboard entry is compared, unsigned, to the
+ * immediate value given at registration.
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
 };
 
 /**
@@ -299,6 +406,47 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - execution inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies
+ * to the entry of the executing vCPU, so the result is exact even
+ * when vCPUs run in parallel.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check
+ * @entry: entry of a scoreboard to compare
+ * @imm: value to compare the entry to
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when the translated unit executes and
+ * the entry of the executing vCPU satisfies @cond. The comparison is
+ * done inline, so e.g. counting executions inline and calling back
+ * only when a threshold is reached costs a few host instructions per
+ * execution instead of a call.
+ */
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -327,6 +475,22 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - insn exec inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Insert an inline op on the entry of the executing vCPU every time
+ * an instruction executes.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -496,6 +660,24 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - memory inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Insert an inline op on the entry of the executing vCPU every time
+ * the instruction performs a memory access matching @rw.
+ */
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 
 
 typedef void
@@ -515,6 +697,44 @@ void
 qemu_plugin_register_vcpu_syscall_ret_cb(qemu_plugin_id_t id,
                                          qemu_plugin_vcpu_syscall_ret_cb_t cb);
 
+/**
+ * typedef qemu_plugin_vcpu_sample_cb_t - vcpu sample callback
+ * @id: the unique qemu_plugin_id_t
+ * @vcpu_index: the sampled vCPU
+ * @pc: guest virtual address of the next TB the vCPU executes
+ * @mmu_idx: target specific MMU index the vCPU runs with, which
+ *           usually tells apart privilege levels
+ * @frames: return addresses found by walking the guest frame
+ *          pointers, innermost first
+ * @n_frames: number of entries in @frames; always 0 for targets that
+ *            do not know how to unwind guest frames
+ *
+ * @frames is only valid for the duration of the callback.
+ */
+typedef void
+(*qemu_plugin_vcpu_sample_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
+                                uint64_t pc, unsigned int mmu_idx,
+                                const uint64_t *frames, size_t n_frames);
+
+/**
+ * qemu_plugin_register_vcpu_sample_cb() - sample the vCPUs periodically
+ * @id: plugin ID
+ * @cb: callback function
+ * @period_ns: sampling period in host nanoseconds
+ *
+ * A host thread flags every running vCPU once per @period_ns, and
+ * @cb is called from the vCPU thread before it enters its next TB.
+ * Unlike TB or instruction callbacks this adds no code to the
+ * translated blocks, so the overhead only depends on the sampling
+ * rate.
+ *
+ * The period is shared by all plugins; the shortest one requested
+ * wins. Passing a NULL @cb unregisters the callback.
+ */
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         qemu_plugin_vcpu_sample_cb_t cb,
+                                         uint64_t period_ns);
+
 
 /**
  * qemu_plugin_insn_disas() - return disassembly string for instruction
@@ -31,12 +31,24 @@ extern int use_icount;
 #define icount_enabled() 0
 #endif
 
+/*
+ * Instructions each vCPU runs between two synchronization points when
+ * icount vCPUs run in parallel, or 0 when they run round-robin.
+ */
+extern int64_t icount_quantum;
+
 /*
  * Update the icount with the executed instructions. Called by
  * cpus-tcg vCPU thread so the main-loop can see time has moved forward.
  */
 void icount_update(CPUState *cpu);
 
+/*
+ * Move the shared count to the end of a parallel quantum of @insns
+ * instructions. Called with all vCPUs waiting at the barrier.
+ */
+void icount_end_quantum(int64_t insns);
+
 /* get raw icount value */
 int64_t icount_get_raw(void);
 
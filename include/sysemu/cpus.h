@@ -23,6 +23,8 @@ bool cpu_thread_is_idle(CPUState *cpu);
 bool all_cpu_threads_idle(void);
 bool cpu_can_run(CPUState *cpu);
 void qemu_wait_io_event_common(CPUState *cpu);
+/* Same, but leave async_guest_run_on_cpu() work queued, see cpu.h */
+void qemu_wait_io_event_filtered(CPUState *cpu);
 void qemu_wait_io_event(CPUState *cpu);
 void cpu_thread_signal_created(CPUState *cpu);
 void cpu_thread_signal_destroyed(CPUState *cpu);
@@ -277,6 +277,7 @@ typedef struct TCGPool {
 #define TCG_POOL_CHUNK_SIZE 32768
 
 #define TCG_MAX_TEMPS 512
+#define TCG_MAX_PINNED_GLOBALS 8
 #define TCG_MAX_INSNS 512
 
 /* when the size of the arguments of a called function is smaller than
@@ -451,6 +452,9 @@ typedef struct TCGTemp {
     unsigned int mem_coherent:1;
     unsigned int mem_allocated:1;
     unsigned int temp_allocated:1;
+    /* Global kept in pin_reg for the whole TB, see tcg_pin_globals().  */
+    unsigned int pinned:1;
+    TCGReg pin_reg:8;
 
     int64_t val;
     struct TCGTemp *mem_base;
@@ -527,6 +531,7 @@ typedef struct TCGProfile {
     int64_t opt_time;
     int64_t restore_count;
     int64_t restore_time;
+    int64_t pinned_count;
     int64_t table_op_count[NB_OPS];
 } TCGProfile;
 
@@ -547,6 +552,13 @@ struct TCGContext {
 
     TCGRegSet reserved_regs;
     uint32_t tb_cflags; /* cflags of the current TB */
+    bool tb_host_ptrs;  /* opcode stream embeds host pointers */
+    uint8_t opt_level;  /* 0: none, 1: default, 2: optimize twice */
+    uint8_t pin_globals; /* max globals kept in host registers per TB */
+    bool helper_audit;   /* count calls to helpers that may write globals */
+    uint8_t nb_pinned;
+    TCGRegSet pinned_regs;
+    TCGTemp *pinned_temps[TCG_MAX_PINNED_GLOBALS];
     intptr_t current_frame_offset;
     intptr_t frame_start;
     intptr_t frame_end;
@@ -601,6 +613,12 @@ struct TCGContext {
 
     /* descriptor of the instruction being translated */
     struct qemu_plugin_insn *plugin_insn;
+
+    /*
+     * If set, tcg_emit_op() inserts new ops before this one instead of
+     * appending them; used to generate instrumentation in place.
+     */
+    TCGOp *emit_before_op;
 #endif
 
     GHashTable *const_table[TCG_TYPE_COUNT];
@@ -801,6 +819,8 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data,
+                        const void **prx);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -830,13 +850,23 @@ static inline void *tcg_malloc(int size)
     }
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_init(size_t tb_size, int splitwx, unsigned max_threads, bool evict);
 void tcg_register_thread(void);
+#ifdef CONFIG_USER_ONLY
+void tcg_claim_ctx(void);
+void tcg_release_ctx(void);
+#endif
 void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb);
 
+bool tcg_op_stream_save(TCGContext *s, const TranslationBlock *tb,
+                        GByteArray *buf);
+bool tcg_op_stream_load(TCGContext *s, const TranslationBlock *tb,
+                        const void *data, size_t len);
+uint32_t tcg_op_stream_fingerprint(TCGContext *s);
+
 void tcg_set_frame(TCGContext *s, TCGReg reg, intptr_t start, intptr_t size);
 
 TCGTemp *tcg_global_mem_new_internal(TCGType, TCGv_ptr,
@@ -938,6 +968,7 @@ int tcg_check_temp_count(void);
 
 int64_t tcg_cpu_exec_time(void);
 void tcg_dump_info(GString *buf);
+void tcg_dump_helper_audit(GString *buf);
 void tcg_dump_op_count(GString *buf);
 
 #define TCG_CT_CONST  1 /* any constant of register size */
@@ -1048,12 +1079,20 @@ static inline TCGv_i64 tcg_constant_i64(int64_t val)
 TCGv_vec tcg_constant_vec(TCGType type, unsigned vece, int64_t val);
 TCGv_vec tcg_constant_vec_matching(TCGv_vec match, unsigned vece, int64_t val);
 
+/*
+ * Constant pointers are assumed to point into the host address space,
+ * which makes the opcode stream specific to this process.
+ */
 #if UINTPTR_MAX == UINT32_MAX
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i32((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
+# define tcg_const_ptr(x)        (tcg_ctx->tb_host_ptrs = true, \
+                                  (TCGv_ptr)tcg_const_i32((intptr_t)(x)))
+# define tcg_const_local_ptr(x)  (tcg_ctx->tb_host_ptrs = true, \
+                                  (TCGv_ptr)tcg_const_local_i32((intptr_t)(x)))
 #else
-# define tcg_const_ptr(x)        ((TCGv_ptr)tcg_const_i64((intptr_t)(x)))
-# define tcg_const_local_ptr(x)  ((TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
+# define tcg_const_ptr(x)        (tcg_ctx->tb_host_ptrs = true, \
+                                  (TCGv_ptr)tcg_const_i64((intptr_t)(x)))
+# define tcg_const_local_ptr(x)  (tcg_ctx->tb_host_ptrs = true, \
+                                  (TCGv_ptr)tcg_const_local_i64((intptr_t)(x)))
 #endif
 
 TCGLabel *gen_new_label(void);
@@ -375,6 +375,30 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_tcg_contexts(const char *arg)
+{
+    object_property_parse(OBJECT(current_accel()), "contexts", arg,
+                          &error_fatal);
+}
+
+static void handle_arg_locked_atomics(const char *arg)
+{
+    object_property_parse(OBJECT(current_accel()), "locked-atomics", "on",
+                          &error_fatal);
+}
+
+static void handle_arg_perfmap(const char *arg)
+{
+    object_property_parse(OBJECT(current_accel()), "perfmap", "on",
+                          &error_fatal);
+}
+
+static void handle_arg_jitdump(const char *arg)
+{
+    object_property_parse(OBJECT(current_accel()), "jitdump", "on",
+                          &error_fatal);
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -453,6 +477,14 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"tcg-contexts", "QEMU_TCG_CONTEXTS", true, handle_arg_tcg_contexts,
+     "n",          "let up to 'n' threads translate code concurrently"},
+    {"locked-atomics", "QEMU_LOCKED_ATOMICS", false, handle_arg_locked_atomics,
+     "",           "emulate atomics without stopping all threads"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "Generate a /tmp/perf-${pid}.map file for perf"},
+    {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
+     "",           "Generate a jit-${pid}.dump file for perf"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
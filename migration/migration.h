@@ -292,6 +292,13 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Number of threads, the migration thread included, that move the
+     * dirty bits of guest memory to the migration bitmap at each sync.
+     * Only worth raising for guests with hundreds of GB of memory.
+     */
+    uint8_t dirty_sync_threads;
+
     /*
      * This save hostname when out-going migration starts
      */
@@ -989,6 +989,188 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * Parallel dirty bitmap sync
+ *
+ * For large guests, moving the dirty bits to the migration bitmap
+ * dominates each iteration. With x-dirty-sync-threads > 1, RAMBlocks
+ * are split into chunks that a pool of threads and the migration
+ * thread process together. Chunks cover whole words of both bitmaps
+ * and whole clear_bmap chunks, so that no word is shared.
+ */
+#define DIRTY_SYNC_CHUNK_SIZE (1ULL << 30)
+
+typedef struct DirtySyncChunk {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtySyncChunk;
+
+static struct {
+    QemuThread *threads;
+    int nr_threads;
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond done_cond;
+    /* Bumped when a new set of chunks is ready */
+    unsigned generation;
+    /* Threads still working on the current set */
+    int busy;
+    bool quit;
+    GArray *chunks;
+    unsigned next_chunk;
+    uint64_t num_dirty;
+} dirty_sync;
+
+/* Called with RCU critical section */
+static uint64_t dirty_sync_process_chunks(void)
+{
+    uint64_t num_dirty = 0;
+    unsigned i;
+
+    while ((i = qatomic_fetch_inc(&dirty_sync.next_chunk)) <
+           dirty_sync.chunks->len) {
+        DirtySyncChunk *c = &g_array_index(dirty_sync.chunks,
+                                           DirtySyncChunk, i);
+
+        num_dirty += cpu_physical_memory_sync_dirty_bitmap(c->block,
+                                                           c->start,
+                                                           c->length);
+    }
+    return num_dirty;
+}
+
+static void *dirty_sync_thread(void *opaque)
+{
+    unsigned generation = 0;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&dirty_sync.lock);
+    while (!dirty_sync.quit) {
+        uint64_t num_dirty;
+
+        if (generation == dirty_sync.generation) {
+            qemu_cond_wait(&dirty_sync.work_cond, &dirty_sync.lock);
+            continue;
+        }
+        generation = dirty_sync.generation;
+        qemu_mutex_unlock(&dirty_sync.lock);
+
+        WITH_RCU_READ_LOCK_GUARD() {
+            num_dirty = dirty_sync_process_chunks();
+        }
+
+        qemu_mutex_lock(&dirty_sync.lock);
+        dirty_sync.num_dirty += num_dirty;
+        if (--dirty_sync.busy == 0) {
+            qemu_cond_signal(&dirty_sync.done_cond);
+        }
+    }
+    qemu_mutex_unlock(&dirty_sync.lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void dirty_sync_setup(int nr_threads)
+{
+    int i;
+
+    qemu_mutex_init(&dirty_sync.lock);
+    qemu_cond_init(&dirty_sync.work_cond);
+    qemu_cond_init(&dirty_sync.done_cond);
+    dirty_sync.chunks = g_array_new(false, false, sizeof(DirtySyncChunk));
+    dirty_sync.generation = 0;
+    dirty_sync.quit = false;
+    dirty_sync.nr_threads = nr_threads;
+    dirty_sync.threads = g_new0(QemuThread, nr_threads);
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_create(dirty_sync.threads + i, "dirty-sync",
+                           dirty_sync_thread, NULL, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void dirty_sync_cleanup(void)
+{
+    int i;
+
+    if (!dirty_sync.threads) {
+        return;
+    }
+
+    qemu_mutex_lock(&dirty_sync.lock);
+    dirty_sync.quit = true;
+    qemu_cond_broadcast(&dirty_sync.work_cond);
+    qemu_mutex_unlock(&dirty_sync.lock);
+
+    for (i = 0; i < dirty_sync.nr_threads; i++) {
+        qemu_thread_join(dirty_sync.threads + i);
+    }
+    g_free(dirty_sync.threads);
+    dirty_sync.threads = NULL;
+    g_array_free(dirty_sync.chunks, true);
+    qemu_cond_destroy(&dirty_sync.done_cond);
+    qemu_cond_destroy(&dirty_sync.work_cond);
+    qemu_mutex_destroy(&dirty_sync.lock);
+}
+
+/* Called with RCU critical section */
+static void ramblock_sync_dirty_bitmap_parallel(RAMState *rs,
+                                                int nr_threads)
+{
+    uint64_t new_dirty_pages;
+    RAMBlock *block;
+
+    /* The migration thread is one of them */
+    if (dirty_sync.threads && dirty_sync.nr_threads != nr_threads - 1) {
+        dirty_sync_cleanup();
+    }
+    if (!dirty_sync.threads) {
+        dirty_sync_setup(nr_threads - 1);
+    }
+
+    g_array_set_size(dirty_sync.chunks, 0);
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t chunk_size = DIRTY_SYNC_CHUNK_SIZE;
+        ram_addr_t start;
+
+        if (block->clear_bmap) {
+            chunk_size = MAX(chunk_size, (ram_addr_t)TARGET_PAGE_SIZE <<
+                                         block->clear_bmap_shift);
+        }
+        for (start = 0; start < block->used_length; start += chunk_size) {
+            DirtySyncChunk c = {
+                .block = block,
+                .start = start,
+                .length = MIN(chunk_size, block->used_length - start),
+            };
+
+            g_array_append_val(dirty_sync.chunks, c);
+        }
+    }
+
+    qemu_mutex_lock(&dirty_sync.lock);
+    dirty_sync.next_chunk = 0;
+    dirty_sync.num_dirty = 0;
+    dirty_sync.busy = dirty_sync.nr_threads;
+    dirty_sync.generation++;
+    qemu_cond_broadcast(&dirty_sync.work_cond);
+    qemu_mutex_unlock(&dirty_sync.lock);
+
+    new_dirty_pages = dirty_sync_process_chunks();
+
+    qemu_mutex_lock(&dirty_sync.lock);
+    while (dirty_sync.busy) {
+        qemu_cond_wait(&dirty_sync.done_cond, &dirty_sync.lock);
+    }
+    new_dirty_pages += dirty_sync.num_dirty;
+    qemu_mutex_unlock(&dirty_sync.lock);
+
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1099,6 +1281,8 @@ static void migration_trigger_throttle(RAMState *rs)
 
 static void migration_bitmap_sync(RAMState *rs)
 {
+    int nr_threads = migrate_get_current()->dirty_sync_threads;
+    int64_t start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     RAMBlock *block;
     int64_t end_time;
 
@@ -1113,15 +1297,22 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
+        if (nr_threads > 1) {
+            ramblock_sync_dirty_bitmap_parallel(rs, nr_threads);
+        } else {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ramblock_sync_dirty_bitmap(rs, block);
+            }
         }
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    ram_counters.dirty_sync_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                   start_us;
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+                                    ram_counters.dirty_sync_time);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
@@ -2345,6 +2536,7 @@ static void xbzrle_load_cleanup(void)
 
 static void ram_state_cleanup(RAMState **rsp)
 {
+    dirty_sync_cleanup();
     if (*rsp) {
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
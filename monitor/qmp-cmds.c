@@ -39,6 +39,7 @@
 #include "qapi/type-helpers.h"
 #include "qapi/qmp/qerror.h"
 #include "exec/ramlist.h"
+#include "exec/memory.h"
 #include "hw/mem/memory-device.h"
 #include "hw/acpi/acpi_dev_interface.h"
 #include "hw/intc/intc.h"
@@ -424,6 +425,13 @@ HumanReadableText *qmp_x_query_ramblock(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_bounce_buffers(Error **errp)
+{
+    g_autoptr(GString) buf = address_space_bounce_format();
+
+    return human_readable_text_from_str(buf);
+}
+
 static int qmp_x_query_irq_foreach(Object *obj, void *opaque)
 {
     InterruptStatsProvider *intc;
@@ -20,7 +20,10 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
 #include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
 #include "hw/core/cpu.h"
+#include "hw/core/tcg-cpu-ops.h"
 #include "exec/cpu-common.h"
 
 #include "exec/exec-all.h"
@@ -85,6 +88,10 @@ void plugin_unregister_cb__locked(struct qemu_plugin_ctx *ctx,
     if (QLIST_EMPTY_RCU(&plugin.cb_lists[ev])) {
         clear_bit(ev, plugin.mask);
         g_hash_table_foreach(plugin.cpu_ht, plugin_cpu_update__locked, NULL);
+        if (ev == QEMU_PLUGIN_EV_VCPU_SAMPLE) {
+            /* the sampling thread notices this and exits */
+            plugin.sample_period_ns = 0;
+        }
     }
 }
 
@@ -210,10 +217,54 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/*
+ * Make room for @cpu in all scoreboards. Translated code reloads the
+ * base of a scoreboard on every access, so it is enough to move the
+ * entries while all vCPUs are stopped; the code cache stays valid.
+ *
+ * Running vCPUs may be waiting for plugin.lock, so it is taken after
+ * start_exclusive(), as in qemu_plugin_user_exit().
+ */
+static void plugin_grow_scoreboards(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t old_size, new_size;
+
+    if ((size_t)cpu->cpu_index <
+        qatomic_read(&plugin.scoreboard_alloc_size)) {
+        return;
+    }
+
+    start_exclusive();
+    qemu_rec_mutex_lock(&plugin.lock);
+
+    /* another vCPU may have grown the scoreboards in the meantime */
+    old_size = plugin.scoreboard_alloc_size;
+    new_size = old_size;
+    while ((size_t)cpu->cpu_index >= new_size) {
+        new_size *= 2;
+    }
+    if (new_size > old_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            void *data = g_malloc0(new_size * score->element_size);
+
+            memcpy(data, score->data, old_size * score->element_size);
+            g_free(score->data);
+            score->data = data;
+        }
+        qatomic_set(&plugin.scoreboard_alloc_size, new_size);
+    }
+
+    qemu_rec_mutex_unlock(&plugin.lock);
+    end_exclusive();
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_grow_scoreboards(cpu);
+
     qemu_rec_mutex_lock(&plugin.lock);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
@@ -291,6 +342,24 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.entry = (qemu_plugin_u64) { NULL, 0 };
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.entry = entry;
     dyn_cb->inline_insn.imm = imm;
 }
 
@@ -307,6 +376,25 @@ void plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.imm = imm;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -390,6 +478,107 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret)
     }
 }
 
+/* deepest guest call stack reported to sample callbacks */
+#define PLUGIN_SAMPLE_MAX_FRAMES 64
+
+/*
+ * Flag every vCPU once per sampling period. Like cpu_exit(), setting
+ * icount_decr.u16.high makes the vCPU leave the chain of TBs it is
+ * running, but without exit_request it goes straight back to the
+ * next TB after reporting the sample from cpu_handle_interrupt().
+ */
+static void *plugin_sample_thread(void *opaque)
+{
+    CPUState *cpu;
+    uint64_t period;
+
+    for (;;) {
+        qemu_rec_mutex_lock(&plugin.lock);
+        period = plugin.sample_period_ns;
+        if (period == 0) {
+            plugin.sample_thread_running = false;
+        }
+        qemu_rec_mutex_unlock(&plugin.lock);
+        if (period == 0) {
+            return NULL;
+        }
+
+        g_usleep(DIV_ROUND_UP(period, SCALE_US));
+
+        cpu_list_lock();
+        CPU_FOREACH(cpu) {
+            if (qatomic_read(&cpu->halted)) {
+                continue;
+            }
+            qatomic_set(&cpu->plugin_sample_pending, true);
+            /* pairs with the barrier in cpu_handle_interrupt() */
+            smp_wmb();
+            qatomic_set(&cpu->icount_decr_ptr->u16.high, -1);
+        }
+        cpu_list_unlock();
+    }
+}
+
+void plugin_register_sample_cb(qemu_plugin_id_t id,
+                               qemu_plugin_vcpu_sample_cb_t cb,
+                               uint64_t period_ns)
+{
+    QemuThread thread;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    plugin_register_cb(id, QEMU_PLUGIN_EV_VCPU_SAMPLE, cb);
+    if (!cb || !test_bit(QEMU_PLUGIN_EV_VCPU_SAMPLE, plugin.mask)) {
+        return;
+    }
+
+    period_ns = MAX(period_ns, SCALE_US);
+    if (plugin.sample_period_ns == 0 || period_ns < plugin.sample_period_ns) {
+        plugin.sample_period_ns = period_ns;
+    }
+    if (!plugin.sample_thread_running) {
+        plugin.sample_thread_running = true;
+        qemu_thread_create(&thread, "plugin-sample", plugin_sample_thread,
+                           NULL, QEMU_THREAD_DETACHED);
+    }
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void qemu_plugin_vcpu_sample_cb(CPUState *cpu)
+{
+    struct qemu_plugin_cb *cb, *next;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_SAMPLE;
+    CPUArchState *env = cpu->env_ptr;
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    uint64_t frames[PLUGIN_SAMPLE_MAX_FRAMES];
+    target_ulong pc, cs_base;
+    uint32_t flags;
+    unsigned int mmu_idx;
+    size_t n_frames = 0;
+
+    qatomic_set(&cpu->plugin_sample_pending, false);
+    if (!test_bit(ev, cpu->plugin_mask)) {
+        return;
+    }
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    mmu_idx = cpu_mmu_index(env, false);
+    if (cc->tcg_ops->unwind_frames) {
+        n_frames = cc->tcg_ops->unwind_frames(cpu, frames,
+                                              ARRAY_SIZE(frames));
+    }
+
+    QLIST_FOREACH_SAFE_RCU(cb, &plugin.cb_lists[ev], entry, next) {
+        qemu_plugin_vcpu_sample_cb_t func = cb->f.vcpu_sample;
+
+        func(cb->ctx->id, cpu->cpu_index, pc, mmu_idx, frames, n_frames);
+    }
+}
+
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
@@ -432,14 +621,52 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->element_size = element_size;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    score->data = g_malloc0(element_size * plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_free(score->data);
+    g_free(score);
+}
+
+void *plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                             unsigned int vcpu_index)
 {
+    g_assert(vcpu_index < qatomic_read(&plugin.scoreboard_alloc_size));
+    return score->data + vcpu_index * score->element_size;
+}
+
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
+{
+    qemu_plugin_u64 entry = cb->inline_insn.entry;
     uint64_t *val = cb->userp;
 
+    if (entry.score) {
+        val = plugin_scoreboard_find(entry.score, cpu_index) + entry.offset;
+    }
+
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
@@ -467,7 +694,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
             break;
         default:
             g_assert_not_reached();
@@ -500,10 +727,10 @@ void qemu_plugin_user_exit(void)
     enum qemu_plugin_event ev;
     CPUState *cpu;
 
-    QEMU_LOCK_GUARD(&plugin.lock);
-
     start_exclusive();
 
+    QEMU_LOCK_GUARD(&plugin.lock);
+
     /* un-register all callbacks except the final AT_EXIT one */
     for (ev = 0; ev < QEMU_PLUGIN_EV_MAX; ev++) {
         if (ev != QEMU_PLUGIN_EV_ATEXIT) {
@@ -552,6 +779,8 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
+    plugin.scoreboard_alloc_size = 16;
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
@@ -65,8 +65,6 @@ QemuOptsList qemu_plugin_opts = {
 
 typedef int (*qemu_plugin_install_func_t)(qemu_plugin_id_t, const qemu_info_t *, int, char **);
 
-extern struct qemu_plugin_state plugin;
-
 void qemu_plugin_add_dyn_cb_arr(GArray *arr)
 {
     uint32_t hash = qemu_xxhash2((uint64_t)(uintptr_t)arr);
@@ -298,6 +296,9 @@ int qemu_plugin_load_list(QemuPluginList *head, Error **errp)
     info->system_emulation = true;
     info->system.smp_vcpus = ms->smp.cpus;
     info->system.max_vcpus = ms->smp.max_cpus;
+    /* size scoreboards so that hotplugged vCPUs never have to grow them */
+    plugin.scoreboard_alloc_size = MAX(plugin.scoreboard_alloc_size,
+                                       ms->smp.max_cpus);
 #else
     info->system_emulation = false;
 #endif
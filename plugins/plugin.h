@@ -44,8 +44,23 @@ struct qemu_plugin_state {
      * the code cache is flushed.
      */
     struct qht dyn_cb_arr_ht;
+    /*
+     * All live scoreboards, and the number of entries allocated in each
+     * of them. Both are protected by @lock; the entries are only
+     * reallocated with all vCPUs stopped.
+     */
+    QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    size_t scoreboard_alloc_size;
+    /*
+     * Period of the vCPU sampling thread, 0 when no plugin samples.
+     * Written under @lock, read atomically by the thread, which clears
+     * @sample_thread_running under @lock before exiting.
+     */
+    uint64_t sample_period_ns;
+    bool sample_thread_running;
 };
 
+extern struct qemu_plugin_state plugin;
 
 struct qemu_plugin_ctx {
     GModule *handle;
@@ -69,6 +84,12 @@ void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_op op, void *ptr,
                                uint64_t imm);
 
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm);
+
 void plugin_reset_uninstall(qemu_plugin_id_t id,
                             qemu_plugin_simple_cb_t cb,
                             bool reset);
@@ -83,11 +104,24 @@ void
 plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
                          void *func, void *udata);
 
+void plugin_register_sample_cb(qemu_plugin_id_t id,
+                               qemu_plugin_vcpu_sample_cb_t cb,
+                               uint64_t period_ns);
+
 void
 plugin_register_dyn_cb__udata(GArray **arr,
                               qemu_plugin_vcpu_udata_cb_t cb,
                               enum qemu_plugin_cb_flags flags, void *udata);
 
+void
+plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                   qemu_plugin_vcpu_udata_cb_t cb,
+                                   enum qemu_plugin_cb_flags flags,
+                                   enum qemu_plugin_cond cond,
+                                   qemu_plugin_u64 entry,
+                                   uint64_t imm,
+                                   void *udata);
+
 
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
@@ -95,6 +129,13 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb);
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index);
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+void *plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                             unsigned int vcpu_index);
 
 #endif /* _PLUGIN_INTERNAL_H_ */
@@ -151,7 +151,21 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-evict=on|off (reclaim a full TCG cache in parts)\n"
+    "                locked-atomics=on|off (emulate atomics without stopping all vCPUs)\n"
+    "                perfmap=on|off (write /tmp/perf-<pid>.map for perf)\n"
+    "                jitdump=on|off (write jit-<pid>.dump for perf)\n"
+    "                tb-cache=file (keep TCG translations across runs)\n"
+    "                tier-threshold=n (re-optimize TBs after n executions)\n"
+    "                tier-threads=n (tiered translation threads, default 1)\n"
+    "                superblocks=on|off (merge hot chained TBs, default off)\n"
+    "                pin-globals=n (guest registers kept in host registers)\n"
+    "                helper-audit=on|off (count unannotated helper calls)\n"
+    "                vtlb-size=n (victim TLB entries per MMU mode, default 8)\n"
+    "                vtlb-ways=n (victim TLB associativity, default 8)\n"
+    "                icount-quantum=n (parallel icount vCPUs, n insns per quantum)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                dirty-ring-reapers=n (KVM dirty ring reaper threads, default 1)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -185,6 +199,121 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-evict=on|off``
+        When the TCG translation block cache is full, discards only the
+        oldest part of it instead of all translations, which avoids long
+        pauses while the guest code is translated again.  The number of
+        evictions, and the translation blocks and bytes they reclaimed,
+        are shown by ``info jit``; frequent evictions suggest increasing
+        ``tb-size``.  The default is off.
+
+    ``locked-atomics=on|off``
+        Atomic operations that the host cannot perform natively, such as
+        misaligned ones that do not cross a page or 16-byte compare-and-swap
+        on hosts without it, normally stop all other vCPUs.  With this
+        option they are serialized by locks keyed on the address instead,
+        which scales much better on multi-threaded TCG.  They are then
+        atomic only with respect to each other, not to overlapping native
+        atomic operations on other vCPUs.  ``info jit`` shows how often
+        each kind of operation still needed all vCPUs to stop.  The
+        default is off.
+
+    ``tb-cache=file``
+        Keeps the intermediate code of translated blocks in ``file``
+        across runs of system emulation, so that the guest instruction
+        decoder is skipped for code that was already seen; host code is
+        still generated at run time.  Each entry is checked against the
+        guest code before being used.  The file is read at startup,
+        written back on exit, and ignored if it was created by a
+        different QEMU binary or for a different CPU model.  Changing
+        CPU properties other than the model requires a new file.
+        Statistics are shown by ``info jit``.
+
+    ``tier-threshold=n``
+        Enables tiered translation when ``n`` is not zero.  Translation
+        blocks are first generated without optimization, which makes
+        startup faster, and are regenerated in the background once they
+        have been executed ``n`` times.  The regenerated code goes through
+        the usual optimizer, then through unreachable code removal and the
+        optimizer once more.  The default is 0, i.e. disabled.
+
+    ``tier-threads=n``
+        Sets the number of background threads used by tiered translation.
+        The default is 1.
+
+    ``superblocks=on|off``
+        When tiered translation is enabled, merges a hot translation block
+        with the block it jumps to most often, if both are on the same
+        guest page, so that hot paths spanning several blocks are optimized
+        as a whole.  Requires ``tier-threshold``; disabled with ``-icount``.
+        The default is off.
+
+    ``pin-globals=n``
+        Keeps up to ``n`` frequently used guest registers in callee-saved
+        host registers for the whole translation block, instead of
+        reloading them after every branch target and helper call.  At most
+        8 registers are pinned, fewer if the host does not have enough of
+        them.  With tiered translation, only promoted blocks are affected.
+        The default is 0, i.e. disabled.
+
+    ``perfmap=on|off``
+        Writes ``/tmp/perf-<pid>.map`` as code is translated, so that
+        ``perf report`` can attribute the time spent in translated code
+        to the guest code it came from.  Each translation block is
+        named after its guest PC, the guest symbol containing it when
+        known, and its flags.  Entries are dropped when the
+        translation cache is flushed or, with ``tb-evict=on``, when the
+        region holding them is reclaimed, so the map only describes the
+        code currently in the cache.  The default is off.
+
+    ``jitdump=on|off``
+        Writes ``jit-<pid>.dump`` in the temporary directory, including
+        the generated code and timestamps.  Record with ``perf record
+        -k 1`` and run ``perf inject --jit`` on the result; unlike the
+        map, this correctly attributes samples taken before a flush of
+        the translation cache.  The default is off.
+
+    ``helper-audit=on|off``
+        Counts the calls to TCG helpers that may modify any guest
+        register, because they have neither ``TCG_CALL_NO_WG`` flags nor
+        a ``DEF_HELPER_ENV`` declaration.  ``info jit`` lists the most
+        frequently called ones, which are the best candidates for an
+        annotation.  Counting slows down emulation.  The default is off.
+
+    ``vtlb-size=n``
+        Sets the number of entries of the victim TLB, which keeps the
+        translations recently evicted from the TLB used by the generated
+        code, separately for each MMU mode.  ``n`` must be a power of 2,
+        up to 4096.  Larger values help guests with large working sets;
+        ``info tlb-stats`` shows how often the victim TLB avoids a page
+        table walk.  The default is 8.
+
+    ``vtlb-ways=n``
+        Sets the associativity of the victim TLB.  ``n`` must be a power
+        of 2; it is capped to ``vtlb-size``, and raised so that there are
+        at most 64 sets.  The default is 8, i.e. fully associative with
+        the default size.
+
+    ``icount-quantum=n``
+        With ``-icount`` and a fixed ``shift``, runs the vCPUs in parallel
+        on one thread each instead of one at a time, which implies
+        ``thread=multi`` and cannot be combined with ``thread=single``.
+        The same warnings as ``thread=multi`` are printed when the guest
+        is not known to be safe with MTTCG.  Every vCPU executes ``n``
+        instructions, or fewer to stop at the next ``QEMU_CLOCK_VIRTUAL``
+        timer, then waits for the others.  Interrupts are only taken,
+        vCPUs only powered on or reset, and device accesses only
+        performed, at these synchronization points, one vCPU at a time in
+        a fixed order, so virtual time and device state are the same on
+        every run.  Device accesses include MMIO, port I/O, and system
+        registers backed by devices, such as the Arm generic timer and
+        GIC CPU interface or the x86 local APIC.  Smaller quanta reduce
+        interrupt and I/O latency; larger ones synchronize less often.
+        When all vCPUs are halted, time skips to the next timer as with
+        ``sleep=off``.  The order of accesses to shared memory within a
+        quantum is not deterministic, and record/replay is not supported.
+        The default is 0, i.e. vCPUs are scheduled round-robin.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -203,6 +332,13 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+    ``dirty-ring-reapers=n``
+        When the KVM dirty ring is enabled, it controls how many threads
+        collect the dirty pages from the rings.  The vCPUs are split
+        between the threads, following their NUMA node if the machine has
+        more than one.  Each thread polls more often when its rings fill
+        up and less often when they stay mostly empty.  The default is 1.
+
 ERST
 
 DEF("smp", HAS_ARG, QEMU_OPTION_smp,
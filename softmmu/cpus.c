@@ -407,6 +407,15 @@ void qemu_wait_io_event_common(CPUState *cpu)
     process_queued_cpu_work(cpu);
 }
 
+void qemu_wait_io_event_filtered(CPUState *cpu)
+{
+    qatomic_mb_set(&cpu->thread_kicked, false);
+    if (cpu->stop) {
+        qemu_cpu_stop(cpu, false);
+    }
+    process_queued_cpu_work_filtered(cpu);
+}
+
 void qemu_wait_io_event(CPUState *cpu)
 {
     bool slept = false;
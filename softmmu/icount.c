@@ -58,6 +58,12 @@ static bool icount_sleep = true;
  */
 int use_icount;
 
+/*
+ * Instructions per quantum when vCPUs run in parallel, 0 when they are
+ * scheduled round-robin. Written before the vCPU threads are created.
+ */
+int64_t icount_quantum;
+
 static void icount_enable_precise(void)
 {
     use_icount = 1;
@@ -89,6 +95,11 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (icount_quantum) {
+        /* Only the end of the quantum moves the shared count */
+        cpu->icount_quantum_insns += executed;
+        return;
+    }
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
 }
@@ -107,9 +118,25 @@ void icount_update(CPUState *cpu)
                          &timers_state.vm_clock_lock);
 }
 
+void icount_end_quantum(int64_t insns)
+{
+    CPUState *cpu;
+
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    qatomic_set_i64(&timers_state.qemu_icount,
+                    timers_state.qemu_icount + insns);
+    CPU_FOREACH(cpu) {
+        cpu->icount_quantum_insns = 0;
+    }
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+}
+
 static int64_t icount_get_raw_locked(void)
 {
     CPUState *cpu = current_cpu;
+    int64_t local = 0;
 
     if (cpu && cpu->running) {
         if (!cpu->can_do_io) {
@@ -119,8 +146,12 @@ static int64_t icount_get_raw_locked(void)
         /* Take into account what has run */
         icount_update_locked(cpu);
     }
+    if (cpu && icount_quantum) {
+        /* A vCPU sees the start of the quantum plus its own progress */
+        local = cpu->icount_quantum_insns;
+    }
     /* The read is protected by the seqlock, but needs atomic64 to avoid UB */
-    return qatomic_read_i64(&timers_state.qemu_icount);
+    return qatomic_read_i64(&timers_state.qemu_icount) + local;
 }
 
 static int64_t icount_get_locked(void)
@@ -303,6 +334,11 @@ void icount_start_warp_timer(void)
         return;
     }
 
+    /* With quanta, idle time is skipped at the barrier instead */
+    if (icount_quantum) {
+        return;
+    }
+
     if (replay_mode != REPLAY_MODE_PLAY) {
         if (!all_cpu_threads_idle()) {
             return;
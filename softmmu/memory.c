@@ -48,6 +48,29 @@ static QTAILQ_HEAD(, AddressSpace) address_spaces
     = QTAILQ_HEAD_INITIALIZER(address_spaces);
 
 static GHashTable *flat_views;
+/*
+ * The distinct FlatViews of flat_views, looked up by content: roots
+ * that render to the same ranges, such as the per-device containers
+ * of IOMMUs in passthrough mode, share one FlatView and dispatch tree.
+ */
+static GHashTable *flat_views_unique;
+
+/*
+ * Regions modified since the last commit, compared by address only:
+ * they may have been freed in the meantime. The FlatView of a root
+ * whose tree contains none of them is kept as is.
+ */
+static GHashTable *memory_region_changed;
+/* Set when something outside the trees, such as dirty logging, changed */
+static bool flatviews_all_changed;
+
+static void memory_region_mark_changed(MemoryRegion *mr)
+{
+    if (!memory_region_changed) {
+        memory_region_changed = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(memory_region_changed, mr);
+}
 
 typedef struct AddrRange AddrRange;
 
@@ -252,6 +275,40 @@ static bool flatrange_equal(FlatRange *a, FlatRange *b)
         && a->nonvolatile == b->nonvolatile;
 }
 
+static guint flatview_hash(gconstpointer key)
+{
+    const FlatView *view = key;
+    guint h = view->nr;
+    unsigned i;
+
+    for (i = 0; i < view->nr; i++) {
+        const FlatRange *fr = &view->ranges[i];
+
+        h = h * 31 + g_direct_hash(fr->mr);
+        h = h * 31 + int128_getlo(fr->addr.start);
+        h = h * 31 + int128_getlo(fr->addr.size);
+        h = h * 31 + fr->offset_in_region;
+    }
+    return h;
+}
+
+static gboolean flatview_equal(gconstpointer a, gconstpointer b)
+{
+    const FlatView *va = a, *vb = b;
+    unsigned i;
+
+    if (va->nr != vb->nr) {
+        return false;
+    }
+    for (i = 0; i < va->nr; i++) {
+        if (!flatrange_equal(&va->ranges[i], &vb->ranges[i]) ||
+            va->ranges[i].dirty_log_mask != vb->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static FlatView *flatview_new(MemoryRegion *mr_root)
 {
     FlatView *view;
@@ -728,7 +785,7 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
 static FlatView *generate_memory_topology(MemoryRegion *mr)
 {
     int i;
-    FlatView *view;
+    FlatView *view, *shared;
 
     view = flatview_new(mr);
 
@@ -739,6 +796,16 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    shared = g_hash_table_lookup(flat_views_unique, view);
+    if (shared) {
+        /* Nothing was published yet, drop the copy before dispatching */
+        trace_flatview_share(shared, mr);
+        flatview_unref(view);
+        flatview_ref(shared);
+        g_hash_table_replace(flat_views, mr, shared);
+        return shared;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -747,6 +814,7 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     address_space_dispatch_compact(view->dispatch);
     g_hash_table_replace(flat_views, mr, view);
+    g_hash_table_add(flat_views_unique, view);
 
     return view;
 }
@@ -991,36 +1059,91 @@ static void flatviews_init(void)
 
     flat_views = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                                        (GDestroyNotify) flatview_unref);
+    flat_views_unique = g_hash_table_new(flatview_hash, flatview_equal);
     if (!empty_view) {
         empty_view = generate_memory_topology(NULL);
         /* We keep it alive forever in the global variable.  */
         flatview_ref(empty_view);
     } else {
         g_hash_table_replace(flat_views, NULL, empty_view);
+        g_hash_table_add(flat_views_unique, empty_view);
         flatview_ref(empty_view);
     }
 }
 
-static void flatviews_reset(void)
+/* Whether @mr or anything it contains or aliases was modified */
+static bool memory_region_tree_changed(MemoryRegion *mr, GHashTable *memo)
+{
+    MemoryRegion *subregion;
+    gpointer cached;
+    bool changed;
+
+    if (g_hash_table_lookup_extended(memo, mr, NULL, &cached)) {
+        return GPOINTER_TO_INT(cached);
+    }
+
+    changed = g_hash_table_contains(memory_region_changed, mr);
+    if (!changed && mr->alias) {
+        changed = memory_region_tree_changed(mr->alias, memo);
+    }
+    QTAILQ_FOREACH(subregion, &mr->subregions, subregions_link) {
+        if (changed) {
+            break;
+        }
+        changed = memory_region_tree_changed(subregion, memo);
+    }
+
+    g_hash_table_insert(memo, mr, GINT_TO_POINTER(changed));
+    return changed;
+}
+
+static void flatviews_reset(unsigned *rendered, unsigned *reused)
 {
+    GHashTable *old_views = flat_views;
+    GHashTable *memo = g_hash_table_new(NULL, NULL);
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
+    if (!memory_region_changed) {
+        memory_region_changed = g_hash_table_new(NULL, NULL);
+    }
+    if (flat_views_unique) {
+        g_hash_table_unref(flat_views_unique);
     }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /*
+     * Render unique FVs, walking the trees is much cheaper than
+     * rendering them and building their dispatch tables again.
+     */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view = NULL;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        if (old_views && !flatviews_all_changed &&
+            !memory_region_tree_changed(physmr, memo)) {
+            view = g_hash_table_lookup(old_views, physmr);
+        }
+        if (view) {
+            flatview_ref(view);
+            g_hash_table_replace(flat_views, physmr, view);
+            g_hash_table_add(flat_views_unique, view);
+            (*reused)++;
+        } else {
+            generate_memory_topology(physmr);
+            (*rendered)++;
+        }
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
+    g_hash_table_destroy(memo);
+    flatviews_all_changed = false;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1095,7 +1218,15 @@ void memory_region_transaction_commit(void)
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth) {
         if (memory_region_update_pending) {
-            flatviews_reset();
+            unsigned rendered = 0, reused = 0;
+            int64_t start = 0;
+
+            if (trace_event_get_state_backends(
+                    TRACE_MEMORY_REGION_TRANSACTION_COMMIT)) {
+                start = get_clock();
+            }
+
+            flatviews_reset(&rendered, &reused);
 
             MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
@@ -1106,12 +1237,21 @@ void memory_region_transaction_commit(void)
             memory_region_update_pending = false;
             ioeventfd_update_pending = false;
             MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
+
+            if (start) {
+                trace_memory_region_transaction_commit(rendered, reused,
+                                                       get_clock() - start);
+            }
         } else if (ioeventfd_update_pending) {
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
                 address_space_update_ioeventfds(as);
             }
             ioeventfd_update_pending = false;
         }
+        if (memory_region_changed) {
+            /* Consumed by flatviews_reset(), or changes to disabled regions */
+            g_hash_table_remove_all(memory_region_changed);
+        }
    }
 }
 
@@ -2126,6 +2266,7 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
     memory_region_update_pending |= mr->enabled;
+    memory_region_mark_changed(mr);
     memory_region_transaction_commit();
 }
 
@@ -2256,6 +2397,7 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
         memory_region_transaction_begin();
         mr->readonly = readonly;
         memory_region_update_pending |= mr->enabled;
+        memory_region_mark_changed(mr);
         memory_region_transaction_commit();
     }
 }
@@ -2266,6 +2408,7 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
         memory_region_update_pending |= mr->enabled;
+        memory_region_mark_changed(mr);
         memory_region_transaction_commit();
     }
 }
@@ -2276,6 +2419,7 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
         memory_region_update_pending |= mr->enabled;
+        memory_region_mark_changed(mr);
         memory_region_transaction_commit();
     }
 }
@@ -2528,6 +2672,7 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
     memory_region_update_pending |= mr->enabled && subregion->enabled;
+    memory_region_mark_changed(mr);
     memory_region_transaction_commit();
 }
 
@@ -2567,6 +2712,7 @@ void memory_region_del_subregion(MemoryRegion *mr,
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
+    memory_region_mark_changed(mr);
     memory_region_transaction_commit();
 }
 
@@ -2578,6 +2724,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     memory_region_transaction_begin();
     mr->enabled = enabled;
     memory_region_update_pending = true;
+    memory_region_mark_changed(mr);
     memory_region_transaction_commit();
 }
 
@@ -2594,6 +2741,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     memory_region_transaction_begin();
     mr->size = s;
     memory_region_update_pending = true;
+    memory_region_mark_changed(mr);
     memory_region_transaction_commit();
 }
 
@@ -2631,6 +2779,7 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
     memory_region_transaction_begin();
     mr->alias_offset = offset;
     memory_region_update_pending |= mr->enabled;
+    memory_region_mark_changed(mr);
     memory_region_transaction_commit();
 }
 
@@ -2789,6 +2938,7 @@ void memory_global_dirty_log_start(unsigned int flags)
     /* Refresh DIRTY_MEMORY_MIGRATION bit.  */
     memory_region_transaction_begin();
     memory_region_update_pending = true;
+    flatviews_all_changed = true;
     memory_region_transaction_commit();
 }
 
@@ -2803,6 +2953,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
     /* Refresh DIRTY_MEMORY_MIGRATION bit.  */
     memory_region_transaction_begin();
     memory_region_update_pending = true;
+    flatviews_all_changed = true;
     memory_region_transaction_commit();
 
     MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
@@ -2959,12 +3110,22 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     QTAILQ_INIT(&as->listeners);
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->name = g_strdup(name ? name : "anonymous");
+    as->max_bounce_buffer_size = DEFAULT_MAX_BOUNCE_BUFFER_SIZE;
+    as->bounce_buffer_size = 0;
+    stat64_init(&as->bounce_maps, 0);
+    stat64_init(&as->bounce_waits, 0);
+    stat64_init(&as->bounce_peak, 0);
+    qemu_mutex_init(&as->map_client_list_lock);
+    QLIST_INIT(&as->map_client_list);
     address_space_update_topology(as);
     address_space_update_ioeventfds(as);
 }
 
 static void do_address_space_destroy(AddressSpace *as)
 {
+    assert(qatomic_read(&as->bounce_buffer_size) == 0);
+    assert(QLIST_EMPTY(&as->map_client_list));
+    qemu_mutex_destroy(&as->map_client_list_lock);
     assert(QTAILQ_EMPTY(&as->listeners));
 
     flatview_unref(as->current_map);
@@ -2991,6 +3152,32 @@ void address_space_destroy(AddressSpace *as)
     call_rcu(as, do_address_space_destroy, rcu);
 }
 
+GString *address_space_bounce_format(void)
+{
+    GString *buf = g_string_new("");
+    AddressSpace *as;
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        uint64_t maps = stat64_get(&as->bounce_maps);
+        uint64_t waits = stat64_get(&as->bounce_waits);
+
+        if (!maps && !waits) {
+            continue;
+        }
+        g_string_append_printf(buf, "%s: %zu/%zu bytes in use, "
+                               "peak %" PRIu64 ", %" PRIu64 " maps, "
+                               "%" PRIu64 " waits\n",
+                               as->name,
+                               qatomic_read(&as->bounce_buffer_size),
+                               as->max_bounce_buffer_size,
+                               stat64_get(&as->bounce_peak), maps, waits);
+    }
+    if (!buf->len) {
+        g_string_append(buf, "No bounce buffer used\n");
+    }
+    return buf;
+}
+
 static const char *memory_region_type(MemoryRegion *mr)
 {
     if (mr->alias) {
@@ -3189,6 +3376,7 @@ static void mtree_print_flatview(gpointer key, gpointer value,
     int n = view->nr;
     int i;
     AddressSpace *as;
+    bool shared = false;
 
     qemu_printf("FlatView #%d\n", fvi->counter);
     ++fvi->counter;
@@ -3201,10 +3389,16 @@ static void mtree_print_flatview(gpointer key, gpointer value,
             qemu_printf(", alias %s", memory_region_name(as->root->alias));
         }
         qemu_printf("\n");
+        shared |= memory_region_get_flatview_root(as->root) != view->root;
     }
 
-    qemu_printf(" Root memory region: %s\n",
-      view->root ? memory_region_name(view->root) : "(none)");
+    if (shared) {
+        /* view->root is only the first of the roots that render alike */
+        qemu_printf(" Root memory regions: shared by the roots above\n");
+    } else {
+        qemu_printf(" Root memory region: %s\n",
+          view->root ? memory_region_name(view->root) : "(none)");
+    }
 
     if (n <= 0) {
         qemu_printf(MTREE_INDENT "No rendered FlatView\n\n");
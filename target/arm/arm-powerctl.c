@@ -227,8 +227,8 @@ int arm_set_cpu_on(uint64_t cpuid, uint64_t entry, uint64_t context_id,
     info->target_el = target_el;
     info->target_aa64 = target_aa64;
 
-    async_run_on_cpu(target_cpu_state, arm_set_cpu_on_async_work,
-                     RUN_ON_CPU_HOST_PTR(info));
+    async_guest_run_on_cpu(target_cpu_state, arm_set_cpu_on_async_work,
+                           RUN_ON_CPU_HOST_PTR(info));
 
     /* We are good to go */
     return QEMU_ARM_POWERCTL_RET_SUCCESS;
@@ -283,8 +283,9 @@ int arm_set_cpu_on_and_reset(uint64_t cpuid)
         return QEMU_ARM_POWERCTL_ON_PENDING;
     }
 
-    async_run_on_cpu(target_cpu_state, arm_set_cpu_on_and_reset_async_work,
-                     RUN_ON_CPU_NULL);
+    async_guest_run_on_cpu(target_cpu_state,
+                           arm_set_cpu_on_and_reset_async_work,
+                           RUN_ON_CPU_NULL);
 
     /* We are good to go */
     return QEMU_ARM_POWERCTL_RET_SUCCESS;
@@ -324,8 +325,8 @@ int arm_set_cpu_off(uint64_t cpuid)
     }
 
     /* Queue work to run under the target vCPUs context */
-    async_run_on_cpu(target_cpu_state, arm_set_cpu_off_async_work,
-                     RUN_ON_CPU_NULL);
+    async_guest_run_on_cpu(target_cpu_state, arm_set_cpu_off_async_work,
+                           RUN_ON_CPU_NULL);
 
     return QEMU_ARM_POWERCTL_RET_SUCCESS;
 }
@@ -361,8 +362,8 @@ int arm_reset_cpu(uint64_t cpuid)
     }
 
     /* Queue work to run under the target vCPUs context */
-    async_run_on_cpu(target_cpu_state, arm_reset_cpu_async_work,
-                     RUN_ON_CPU_NULL);
+    async_guest_run_on_cpu(target_cpu_state, arm_reset_cpu_async_work,
+                           RUN_ON_CPU_NULL);
 
     return QEMU_ARM_POWERCTL_RET_SUCCESS;
 }
@@ -2028,10 +2028,53 @@ static const struct SysemuCPUOps arm_sysemu_ops = {
 #endif
 
 #ifdef CONFIG_TCG
+/*
+ * AAPCS64 frame records: X29 points at a pair holding the caller's X29
+ * and the return address. AArch32 code has no single frame pointer
+ * convention, so only AArch64 state is unwound. X29 may point at MMIO,
+ * where even a read can have side effects, so only RAM is followed.
+ */
+static size_t arm_cpu_unwind_frames(CPUState *cs, uint64_t *frames,
+                                    size_t max_frames)
+{
+    ARMCPU *cpu = ARM_CPU(cs);
+    CPUARMState *env = &cpu->env;
+    uint64_t fp = env->xregs[29];
+    size_t n = 0;
+    bool be;
+
+    if (!is_a64(env)) {
+        return 0;
+    }
+    be = arm_cpu_data_is_big_endian(env);
+
+    while (n < max_frames && fp != 0 && !(fp & 7)) {
+        uint8_t buf[16];
+        uint64_t next, ret;
+
+        if (cpu_memory_read_ram_debug(cs, fp, buf, sizeof(buf))) {
+            break;
+        }
+        next = be ? ldq_be_p(buf) : ldq_le_p(buf);
+        ret = be ? ldq_be_p(buf + 8) : ldq_le_p(buf + 8);
+        if (ret == 0) {
+            break;
+        }
+        frames[n++] = ret;
+        /* the stack grows down, callers have their records above ours */
+        if (next <= fp) {
+            break;
+        }
+        fp = next;
+    }
+    return n;
+}
+
 static const struct TCGCPUOps arm_tcg_ops = {
     .initialize = arm_translate_init,
     .synchronize_from_tb = arm_cpu_synchronize_from_tb,
     .debug_excp_handler = arm_debug_excp_handler,
+    .unwind_frames = arm_cpu_unwind_frames,
 
 #ifdef CONFIG_USER_ONLY
     .record_sigsegv = arm_cpu_record_sigsegv,
@@ -538,8 +538,6 @@ uint64_t HELPER(paired_cmpxchg64_le_parallel)(CPUARMState *env, uint64_t addr,
     int mem_idx;
     MemOpIdx oi;
 
-    assert(HAVE_CMPXCHG128);
-
     mem_idx = cpu_mmu_index(env, false);
     oi = make_memop_idx(MO_LE | MO_128 | MO_ALIGN, mem_idx);
 
@@ -590,8 +588,6 @@ uint64_t HELPER(paired_cmpxchg64_be_parallel)(CPUARMState *env, uint64_t addr,
     int mem_idx;
     MemOpIdx oi;
 
-    assert(HAVE_CMPXCHG128);
-
     mem_idx = cpu_mmu_index(env, false);
     oi = make_memop_idx(MO_BE | MO_128 | MO_ALIGN, mem_idx);
 
@@ -616,8 +612,6 @@ void HELPER(casp_le_parallel)(CPUARMState *env, uint32_t rs, uint64_t addr,
     int mem_idx;
     MemOpIdx oi;
 
-    assert(HAVE_CMPXCHG128);
-
     mem_idx = cpu_mmu_index(env, false);
     oi = make_memop_idx(MO_LE | MO_128 | MO_ALIGN, mem_idx);
 
@@ -637,8 +631,6 @@ void HELPER(casp_be_parallel)(CPUARMState *env, uint32_t rs, uint64_t addr,
     int mem_idx;
     MemOpIdx oi;
 
-    assert(HAVE_CMPXCHG128);
-
     mem_idx = cpu_mmu_index(env, false);
     oi = make_memop_idx(MO_LE | MO_128 | MO_ALIGN, mem_idx);
 
@@ -6,6 +6,11 @@ DEF_HELPER_3(add_saturate, i32, env, i32, i32)
 DEF_HELPER_3(sub_saturate, i32, env, i32, i32)
 DEF_HELPER_3(add_usaturate, i32, env, i32, i32)
 DEF_HELPER_3(sub_usaturate, i32, env, i32, i32)
+DEF_HELPER_ENV(add_setq, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(add_saturate, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(sub_saturate, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(add_usaturate, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(sub_usaturate, DH_ENV_NONE, DH_ENV(QF))
 DEF_HELPER_FLAGS_3(sdiv, TCG_CALL_NO_RWG, s32, env, s32, s32)
 DEF_HELPER_FLAGS_3(udiv, TCG_CALL_NO_RWG, i32, env, i32, i32)
 DEF_HELPER_FLAGS_1(rbit, TCG_CALL_NO_RWG_SE, i32, i32)
@@ -39,6 +44,10 @@ DEF_HELPER_3(ssat, i32, env, i32, i32)
 DEF_HELPER_3(usat, i32, env, i32, i32)
 DEF_HELPER_3(ssat16, i32, env, i32, i32)
 DEF_HELPER_3(usat16, i32, env, i32, i32)
+DEF_HELPER_ENV(ssat, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(usat, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(ssat16, DH_ENV_NONE, DH_ENV(QF))
+DEF_HELPER_ENV(usat16, DH_ENV_NONE, DH_ENV(QF))
 
 DEF_HELPER_FLAGS_2(usad8, TCG_CALL_NO_RWG_SE, i32, i32, i32)
 
@@ -712,11 +712,25 @@ exept:
     raise_exception(env, EXCP_UDEF, syndrome, target_el);
 }
 
+/*
+ * Registers with ARM_CP_IO reach devices, such as the generic timer or
+ * the GIC CPU interface; keep them out of parallel icount quanta.
+ */
+static void check_deferred_io(CPUARMState *env, uintptr_t retaddr)
+{
+    CPUState *cs = env_cpu(env);
+
+    if (unlikely(cs->icount_parallel)) {
+        cpu_loop_exit_deferred_io(cs, retaddr);
+    }
+}
+
 void HELPER(set_cp_reg)(CPUARMState *env, void *rip, uint32_t value)
 {
     const ARMCPRegInfo *ri = rip;
 
     if (ri->type & ARM_CP_IO) {
+        check_deferred_io(env, GETPC());
         qemu_mutex_lock_iothread();
         ri->writefn(env, ri, value);
         qemu_mutex_unlock_iothread();
@@ -731,6 +745,7 @@ uint32_t HELPER(get_cp_reg)(CPUARMState *env, void *rip)
     uint32_t res;
 
     if (ri->type & ARM_CP_IO) {
+        check_deferred_io(env, GETPC());
         qemu_mutex_lock_iothread();
         res = ri->readfn(env, ri);
         qemu_mutex_unlock_iothread();
@@ -746,6 +761,7 @@ void HELPER(set_cp_reg64)(CPUARMState *env, void *rip, uint64_t value)
     const ARMCPRegInfo *ri = rip;
 
     if (ri->type & ARM_CP_IO) {
+        check_deferred_io(env, GETPC());
         qemu_mutex_lock_iothread();
         ri->writefn(env, ri, value);
         qemu_mutex_unlock_iothread();
@@ -760,6 +776,7 @@ uint64_t HELPER(get_cp_reg64)(CPUARMState *env, void *rip)
     uint64_t res;
 
     if (ri->type & ARM_CP_IO) {
+        check_deferred_io(env, GETPC());
         qemu_mutex_lock_iothread();
         res = ri->readfn(env, ri);
         qemu_mutex_unlock_iothread();
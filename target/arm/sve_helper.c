@@ -152,6 +152,30 @@ static inline uint64_t expand_pred_s(uint8_t byte)
     return word[byte & 0x11];
 }
 
+/*
+ * Return true if all elements of size 1 << @esz within the first @oprsz
+ * bytes of the vector are active in the predicate @vg.  The predicated
+ * expanders use this to fall back to a straight loop, which the compiler
+ * can vectorize, for the common case of an all-true predicate.
+ */
+static inline bool pred_all_true(void *vg, intptr_t oprsz, int esz)
+{
+    uint64_t *g = vg;
+    uint64_t mask = pred_esz_masks[esz];
+    intptr_t i;
+
+    for (i = 0; i < oprsz / 64; i++) {
+        if ((g[i] & mask) != mask) {
+            return false;
+        }
+    }
+    if (oprsz & 63) {
+        mask &= MAKE_64BIT_MASK(0, oprsz & 63);
+        return (g[i] & mask) == mask;
+    }
+    return true;
+}
+
 #define LOGICAL_PPPP(NAME, FUNC) \
 void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc)  \
 {                                                                         \
@@ -203,6 +227,14 @@ LOGICAL_PPPP(sve_nand_pppp, DO_NAND)
 void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc) \
 {                                                                       \
     intptr_t i, opr_sz = simd_oprsz(desc);                              \
+    if (pred_all_true(vg, opr_sz, ctz32(sizeof(TYPE)))) {               \
+        for (i = 0; i < opr_sz; i += sizeof(TYPE)) {                    \
+            TYPE nn = *(TYPE *)(vn + H(i));                             \
+            TYPE mm = *(TYPE *)(vm + H(i));                             \
+            *(TYPE *)(vd + H(i)) = OP(nn, mm);                          \
+        }                                                               \
+        return;                                                         \
+    }                                                                   \
     for (i = 0; i < opr_sz; ) {                                         \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));                 \
         do {                                                            \
@@ -223,6 +255,12 @@ void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc) \
     intptr_t i, opr_sz = simd_oprsz(desc) / 8;                  \
     TYPE *d = vd, *n = vn, *m = vm;                             \
     uint8_t *pg = vg;                                           \
+    if (pred_all_true(vg, opr_sz * 8, MO_64)) {                 \
+        for (i = 0; i < opr_sz; i += 1) {                       \
+            d[i] = OP(n[i], m[i]);                              \
+        }                                                       \
+        return;                                                 \
+    }                                                           \
     for (i = 0; i < opr_sz; i += 1) {                           \
         if (pg[H1(i)] & 1) {                                    \
             TYPE nn = n[i], mm = m[i];                          \
@@ -851,6 +889,13 @@ DO_ZPZW(sve_lsl_zpzw_s, uint32_t, uint64_t, H1_4, DO_LSL)
 void HELPER(NAME)(void *vd, void *vn, void *vg, uint32_t desc)  \
 {                                                               \
     intptr_t i, opr_sz = simd_oprsz(desc);                      \
+    if (pred_all_true(vg, opr_sz, ctz32(sizeof(TYPE)))) {       \
+        for (i = 0; i < opr_sz; i += sizeof(TYPE)) {            \
+            TYPE nn = *(TYPE *)(vn + H(i));                     \
+            *(TYPE *)(vd + H(i)) = OP(nn);                      \
+        }                                                       \
+        return;                                                 \
+    }                                                           \
     for (i = 0; i < opr_sz; ) {                                 \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));         \
         do {                                                    \
@@ -870,6 +915,12 @@ void HELPER(NAME)(void *vd, void *vn, void *vg, uint32_t desc)  \
     intptr_t i, opr_sz = simd_oprsz(desc) / 8;                  \
     TYPE *d = vd, *n = vn;                                      \
     uint8_t *pg = vg;                                           \
+    if (pred_all_true(vg, opr_sz * 8, MO_64)) {                 \
+        for (i = 0; i < opr_sz; i += 1) {                       \
+            d[i] = OP(n[i]);                                    \
+        }                                                       \
+        return;                                                 \
+    }                                                           \
     for (i = 0; i < opr_sz; i += 1) {                           \
         if (pg[H1(i)] & 1) {                                    \
             TYPE nn = n[i];                                     \
@@ -4302,6 +4353,14 @@ void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg,       \
 {                                                               \
     intptr_t i = simd_oprsz(desc);                              \
     uint64_t *g = vg;                                           \
+    if (pred_all_true(vg, i, ctz32(sizeof(TYPE)))) {            \
+        while ((i -= sizeof(TYPE)) >= 0) {                      \
+            TYPE nn = *(TYPE *)(vn + H(i));                     \
+            TYPE mm = *(TYPE *)(vm + H(i));                     \
+            *(TYPE *)(vd + H(i)) = OP(nn, mm, status);          \
+        }                                                       \
+        return;                                                 \
+    }                                                           \
     do {                                                        \
         uint64_t pg = g[(i - 1) >> 6];                          \
         do {                                                    \
@@ -6713,6 +6772,7 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
     ARMVectorReg scratch;
     intptr_t reg_off;
     SVEHostPage info, info2;
+    target_ulong info_page = -1;
 
     memset(&scratch, 0, reg_max);
     reg_off = 0;
@@ -6723,10 +6783,20 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                 target_ulong addr = base + (off_fn(vm, reg_off) << scale);
                 target_ulong in_page = -(addr | TARGET_PAGE_MASK);
 
-                sve_probe_page(&info, false, env, addr, 0, MMU_DATA_LOAD,
-                               mmu_idx, retaddr);
-
                 if (likely(in_page >= msize)) {
+                    /*
+                     * Elements of contiguous or clustered gathers often
+                     * share a page: only probe when the page changes.
+                     */
+                    if ((addr & TARGET_PAGE_MASK) != info_page) {
+                        sve_probe_page(&info, false, env, addr, 0,
+                                       MMU_DATA_LOAD, mmu_idx, retaddr);
+                        /* Keep the host address of the page, if any */
+                        if (info.host) {
+                            info.host -= addr & ~TARGET_PAGE_MASK;
+                        }
+                        info_page = addr & TARGET_PAGE_MASK;
+                    }
                     if (unlikely(info.flags & TLB_WATCHPOINT)) {
                         cpu_check_watchpoint(env_cpu(env), addr, msize,
                                              info.attrs, BP_MEM_READ, retaddr);
@@ -6734,9 +6804,17 @@ void sve_ld1_z(CPUARMState *env, void *vd, uint64_t *vg, void *vm,
                     if (mtedesc && arm_tlb_mte_tagged(&info.attrs)) {
                         mte_check(env, mtedesc, addr, retaddr);
                     }
-                    host_fn(&scratch, reg_off, info.host);
+                    if (unlikely(!info.host)) {
+                        tlb_fn(env, &scratch, reg_off, addr, retaddr);
+                    } else {
+                        host_fn(&scratch, reg_off,
+                                info.host + (addr & ~TARGET_PAGE_MASK));
+                    }
                 } else {
                     /* Element crosses the page boundary. */
+                    sve_probe_page(&info, false, env, addr, 0, MMU_DATA_LOAD,
+                                   mmu_idx, retaddr);
+                    info_page = -1;
                     sve_probe_page(&info2, false, env, addr + in_page, 0,
                                    MMU_DATA_LOAD, mmu_idx, retaddr);
                     if (unlikely((info.flags | info2.flags) & TLB_WATCHPOINT)) {
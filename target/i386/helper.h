@@ -13,6 +13,16 @@ DEF_HELPER_2(idivl_EAX, void, env, tl)
 DEF_HELPER_2(divq_EAX, void, env, tl)
 DEF_HELPER_2(idivq_EAX, void, env, tl)
 #endif
+DEF_HELPER_ENV(divb_AL, DH_ENV_ANY, DH_ENV(regs[R_EAX]))
+DEF_HELPER_ENV(idivb_AL, DH_ENV_ANY, DH_ENV(regs[R_EAX]))
+DEF_HELPER_ENV(divw_AX, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+DEF_HELPER_ENV(idivw_AX, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+DEF_HELPER_ENV(divl_EAX, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+DEF_HELPER_ENV(idivl_EAX, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+#ifdef TARGET_X86_64
+DEF_HELPER_ENV(divq_EAX, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+DEF_HELPER_ENV(idivq_EAX, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+#endif
 DEF_HELPER_FLAGS_2(cr4_testbit, TCG_CALL_NO_WG, void, env, i32)
 
 DEF_HELPER_FLAGS_2(bndck, TCG_CALL_NO_WG, void, env, i32)
@@ -82,6 +92,11 @@ DEF_HELPER_1(rechecking_single_step, void, env)
 DEF_HELPER_1(cpuid, void, env)
 DEF_HELPER_1(rdtsc, void, env)
 DEF_HELPER_1(rdtscp, void, env)
+DEF_HELPER_ENV(cpuid, DH_ENV_ANY,
+               DH_ENV(regs[R_EAX], regs[R_EBX], regs[R_ECX], regs[R_EDX]))
+DEF_HELPER_ENV(rdtsc, DH_ENV_ANY, DH_ENV(regs[R_EAX], regs[R_EDX]))
+DEF_HELPER_ENV(rdtscp, DH_ENV_ANY,
+               DH_ENV(regs[R_EAX], regs[R_ECX], regs[R_EDX]))
 DEF_HELPER_FLAGS_1(rdpmc, TCG_CALL_NO_WG, noreturn, env)
 
 #ifndef CONFIG_USER_ONLY
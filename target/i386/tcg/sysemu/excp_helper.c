@@ -438,6 +438,13 @@ static int handle_mmu_fault(CPUState *cs, vaddr addr, int size,
         paddr &= TARGET_PAGE_MASK;
 
         assert(prot & (1 << is_write1));
+        /*
+         * Under nested paging each 4KB subpage is translated and
+         * protected separately by the host page tables.
+         */
+        if (!(env->hflags2 & HF2_NPT_MASK)) {
+            prot |= PAGE_LARGE_UNIFORM;
+        }
         tlb_set_page_with_attrs(cs, vaddr, paddr, cpu_get_mem_attrs(env),
                                 prot, mmu_idx, page_size);
         return 0;
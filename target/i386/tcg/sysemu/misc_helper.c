@@ -25,38 +25,57 @@
 #include "exec/address-spaces.h"
 #include "tcg/helper-tcg.h"
 
+/*
+ * Port I/O and the local APIC registers reached through CR8 and MSRs
+ * are device accesses too, keep them out of parallel icount quanta.
+ */
+static void check_deferred_io(CPUX86State *env, uintptr_t retaddr)
+{
+    CPUState *cs = env_cpu(env);
+
+    if (unlikely(cs->icount_parallel)) {
+        cpu_loop_exit_deferred_io(cs, retaddr);
+    }
+}
+
 void helper_outb(CPUX86State *env, uint32_t port, uint32_t data)
 {
+    check_deferred_io(env, GETPC());
     address_space_stb(&address_space_io, port, data,
                       cpu_get_mem_attrs(env), NULL);
 }
 
 target_ulong helper_inb(CPUX86State *env, uint32_t port)
 {
+    check_deferred_io(env, GETPC());
     return address_space_ldub(&address_space_io, port,
                               cpu_get_mem_attrs(env), NULL);
 }
 
 void helper_outw(CPUX86State *env, uint32_t port, uint32_t data)
 {
+    check_deferred_io(env, GETPC());
     address_space_stw(&address_space_io, port, data,
                       cpu_get_mem_attrs(env), NULL);
 }
 
 target_ulong helper_inw(CPUX86State *env, uint32_t port)
 {
+    check_deferred_io(env, GETPC());
     return address_space_lduw(&address_space_io, port,
                               cpu_get_mem_attrs(env), NULL);
 }
 
 void helper_outl(CPUX86State *env, uint32_t port, uint32_t data)
 {
+    check_deferred_io(env, GETPC());
     address_space_stl(&address_space_io, port, data,
                       cpu_get_mem_attrs(env), NULL);
 }
 
 target_ulong helper_inl(CPUX86State *env, uint32_t port)
 {
+    check_deferred_io(env, GETPC());
     return address_space_ldl(&address_space_io, port,
                              cpu_get_mem_attrs(env), NULL);
 }
@@ -71,6 +90,7 @@ target_ulong helper_read_crN(CPUX86State *env, int reg)
         break;
     case 8:
         if (!(env->hflags2 & HF2_VINTR_MASK)) {
+            check_deferred_io(env, GETPC());
             val = cpu_get_apic_tpr(env_archcpu(env)->apic_state);
         } else {
             val = env->int_ctl & V_TPR_MASK;
@@ -117,6 +137,7 @@ void helper_write_crN(CPUX86State *env, int reg, target_ulong t0)
         break;
     case 8:
         if (!(env->hflags2 & HF2_VINTR_MASK)) {
+            check_deferred_io(env, GETPC());
             qemu_mutex_lock_iothread();
             cpu_set_apic_tpr(env_archcpu(env)->apic_state, t0);
             qemu_mutex_unlock_iothread();
@@ -157,6 +178,7 @@ void helper_wrmsr(CPUX86State *env)
         env->sysenter_eip = val;
         break;
     case MSR_IA32_APICBASE:
+        check_deferred_io(env, GETPC());
         cpu_set_apic_base(env_archcpu(env)->apic_state, val);
         break;
     case MSR_EFER:
@@ -325,6 +347,7 @@ void helper_rdmsr(CPUX86State *env)
         val = env->sysenter_eip;
         break;
     case MSR_IA32_APICBASE:
+        check_deferred_io(env, GETPC());
         val = cpu_get_apic_base(env_archcpu(env)->apic_state);
         break;
     case MSR_EFER:
@@ -54,6 +54,59 @@ static void x86_cpu_synchronize_from_tb(CPUState *cs,
     cpu->env.eip = tb->pc - tb->cs_base;
 }
 
+/*
+ * Follow the chain of saved frame pointers: with frame pointers the
+ * prologue of every function pushes the caller's EBP/RBP right below
+ * the return address and points EBP/RBP at it.  EBP/RBP is whatever
+ * the guest left there, so never read it from anything but RAM.
+ */
+static size_t x86_cpu_unwind_frames(CPUState *cs, uint64_t *frames,
+                                    size_t max_frames)
+{
+    X86CPU *cpu = X86_CPU(cs);
+    CPUX86State *env = &cpu->env;
+    bool code64 = env->hflags & HF_CS64_MASK;
+    int size = code64 ? 8 : 4;
+    target_ulong ss_base = code64 ? 0 : env->segs[R_SS].base;
+    target_ulong cs_base = code64 ? 0 : env->segs[R_CS].base;
+    target_ulong fp = env->regs[R_EBP];
+    size_t n = 0;
+
+    if (!code64 && !(env->hflags & HF_CS32_MASK)) {
+        /* 16-bit code has no usable frame pointer convention */
+        return 0;
+    }
+    if (!code64) {
+        fp = (uint32_t)fp;
+    }
+
+    while (n < max_frames && fp != 0 && !(fp & (size - 1))) {
+        uint8_t buf[16];
+        target_ulong next, ret;
+
+        if (cpu_memory_read_ram_debug(cs, ss_base + fp, buf, 2 * size)) {
+            break;
+        }
+        if (code64) {
+            next = ldq_le_p(buf);
+            ret = ldq_le_p(buf + 8);
+        } else {
+            next = ldl_le_p(buf);
+            ret = ldl_le_p(buf + 4);
+        }
+        if (ret == 0) {
+            break;
+        }
+        frames[n++] = cs_base + ret;
+        /* the stack grows down, callers have their frames above ours */
+        if (next <= fp) {
+            break;
+        }
+        fp = next;
+    }
+    return n;
+}
+
 #ifndef CONFIG_USER_ONLY
 static bool x86_debug_check_breakpoint(CPUState *cs)
 {
@@ -72,6 +125,7 @@ static const struct TCGCPUOps x86_tcg_ops = {
     .synchronize_from_tb = x86_cpu_synchronize_from_tb,
     .cpu_exec_enter = x86_cpu_exec_enter,
     .cpu_exec_exit = x86_cpu_exec_exit,
+    .unwind_frames = x86_cpu_unwind_frames,
 #ifdef CONFIG_USER_ONLY
     .fake_user_interrupt = x86_cpu_do_interrupt,
     .record_sigsegv = x86_cpu_record_sigsegv,
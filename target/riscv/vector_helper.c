@@ -204,12 +204,59 @@ static inline int vext_elem_mask(void *v0, int mlen, int index)
     return (((uint64_t *)v0)[idx] >> pos) & 1;
 }
 
+/*
+ * Return true if elements [0, @vl) are all active in the mask @v0.
+ * Masked operations then run like unmasked ones, without testing the
+ * mask of each element; an all-true v0 is common in compiled loops.
+ */
+static inline bool vext_elem_mask_all(void *v0, int mlen, uint32_t vl)
+{
+    uint64_t *m = v0;
+    /* the bit of each element within a 64-bit word of the mask */
+    uint64_t pat = mlen == 64 ? 1 : UINT64_MAX / MAKE_64BIT_MASK(0, mlen);
+    uint32_t bits = vl * mlen;
+    uint32_t i;
+
+    for (i = 0; i < bits / 64; i++) {
+        if ((m[i] & pat) != pat) {
+            return false;
+        }
+    }
+    if (bits % 64) {
+        pat &= MAKE_64BIT_MASK(0, bits % 64);
+        return (m[i] & pat) == pat;
+    }
+    return true;
+}
+
+/*
+ * Return the host address of [addr, addr + len) if it lies within a single
+ * page of plain RAM, so that the elements can be accessed directly; return
+ * NULL if the caller must go through the softmmu accessors instead.
+ * The range must already have been probed with probe_pages.
+ */
+static void *probe_host(CPURISCVState *env, target_ulong addr,
+                        target_ulong len, uintptr_t ra,
+                        MMUAccessType access_type)
+{
+    void *host;
+    int flags;
+
+    if (len == 0 || -(addr | TARGET_PAGE_MASK) < len) {
+        return NULL;
+    }
+    flags = probe_access_flags(env, addr, access_type,
+                               cpu_mmu_index(env, false), true, &host, ra);
+    return flags ? NULL : host;
+}
+
 /* elements operations for load and store */
 typedef void vext_ldst_elem_fn(CPURISCVState *env, target_ulong addr,
                                uint32_t idx, void *vd, uintptr_t retaddr);
+typedef void vext_ldst_host_fn(void *vd, uint32_t idx, void *host);
 typedef void clear_fn(void *vd, uint32_t idx, uint32_t cnt, uint32_t tot);
 
-#define GEN_VEXT_LD_ELEM(NAME, MTYPE, ETYPE, H, LDSUF)     \
+#define GEN_VEXT_LD_ELEM(NAME, MTYPE, ETYPE, H, LDSUF, HOSTSUF) \
 static void NAME(CPURISCVState *env, abi_ptr addr,         \
                  uint32_t idx, void *vd, uintptr_t retaddr)\
 {                                                          \
@@ -218,51 +265,65 @@ static void NAME(CPURISCVState *env, abi_ptr addr,         \
     data = cpu_##LDSUF##_data_ra(env, addr, retaddr);      \
     *cur = data;                                           \
 }                                                          \
+                                                           \
+static void NAME##_host(void *vd, uint32_t idx, void *host)\
+{                                                          \
+    MTYPE data;                                            \
+    ETYPE *cur = ((ETYPE *)vd + H(idx));                   \
+    data = HOSTSUF##_p(host);                              \
+    *cur = data;                                           \
+}
 
-GEN_VEXT_LD_ELEM(ldb_b, int8_t,  int8_t,  H1, ldsb)
-GEN_VEXT_LD_ELEM(ldb_h, int8_t,  int16_t, H2, ldsb)
-GEN_VEXT_LD_ELEM(ldb_w, int8_t,  int32_t, H4, ldsb)
-GEN_VEXT_LD_ELEM(ldb_d, int8_t,  int64_t, H8, ldsb)
-GEN_VEXT_LD_ELEM(ldh_h, int16_t, int16_t, H2, ldsw)
-GEN_VEXT_LD_ELEM(ldh_w, int16_t, int32_t, H4, ldsw)
-GEN_VEXT_LD_ELEM(ldh_d, int16_t, int64_t, H8, ldsw)
-GEN_VEXT_LD_ELEM(ldw_w, int32_t, int32_t, H4, ldl)
-GEN_VEXT_LD_ELEM(ldw_d, int32_t, int64_t, H8, ldl)
-GEN_VEXT_LD_ELEM(lde_b, int8_t,  int8_t,  H1, ldsb)
-GEN_VEXT_LD_ELEM(lde_h, int16_t, int16_t, H2, ldsw)
-GEN_VEXT_LD_ELEM(lde_w, int32_t, int32_t, H4, ldl)
-GEN_VEXT_LD_ELEM(lde_d, int64_t, int64_t, H8, ldq)
-GEN_VEXT_LD_ELEM(ldbu_b, uint8_t,  uint8_t,  H1, ldub)
-GEN_VEXT_LD_ELEM(ldbu_h, uint8_t,  uint16_t, H2, ldub)
-GEN_VEXT_LD_ELEM(ldbu_w, uint8_t,  uint32_t, H4, ldub)
-GEN_VEXT_LD_ELEM(ldbu_d, uint8_t,  uint64_t, H8, ldub)
-GEN_VEXT_LD_ELEM(ldhu_h, uint16_t, uint16_t, H2, lduw)
-GEN_VEXT_LD_ELEM(ldhu_w, uint16_t, uint32_t, H4, lduw)
-GEN_VEXT_LD_ELEM(ldhu_d, uint16_t, uint64_t, H8, lduw)
-GEN_VEXT_LD_ELEM(ldwu_w, uint32_t, uint32_t, H4, ldl)
-GEN_VEXT_LD_ELEM(ldwu_d, uint32_t, uint64_t, H8, ldl)
-
-#define GEN_VEXT_ST_ELEM(NAME, ETYPE, H, STSUF)            \
+GEN_VEXT_LD_ELEM(ldb_b, int8_t,  int8_t,  H1, ldsb, ldsb)
+GEN_VEXT_LD_ELEM(ldb_h, int8_t,  int16_t, H2, ldsb, ldsb)
+GEN_VEXT_LD_ELEM(ldb_w, int8_t,  int32_t, H4, ldsb, ldsb)
+GEN_VEXT_LD_ELEM(ldb_d, int8_t,  int64_t, H8, ldsb, ldsb)
+GEN_VEXT_LD_ELEM(ldh_h, int16_t, int16_t, H2, ldsw, ldsw_le)
+GEN_VEXT_LD_ELEM(ldh_w, int16_t, int32_t, H4, ldsw, ldsw_le)
+GEN_VEXT_LD_ELEM(ldh_d, int16_t, int64_t, H8, ldsw, ldsw_le)
+GEN_VEXT_LD_ELEM(ldw_w, int32_t, int32_t, H4, ldl, ldl_le)
+GEN_VEXT_LD_ELEM(ldw_d, int32_t, int64_t, H8, ldl, ldl_le)
+GEN_VEXT_LD_ELEM(lde_b, int8_t,  int8_t,  H1, ldsb, ldsb)
+GEN_VEXT_LD_ELEM(lde_h, int16_t, int16_t, H2, ldsw, ldsw_le)
+GEN_VEXT_LD_ELEM(lde_w, int32_t, int32_t, H4, ldl, ldl_le)
+GEN_VEXT_LD_ELEM(lde_d, int64_t, int64_t, H8, ldq, ldq_le)
+GEN_VEXT_LD_ELEM(ldbu_b, uint8_t,  uint8_t,  H1, ldub, ldub)
+GEN_VEXT_LD_ELEM(ldbu_h, uint8_t,  uint16_t, H2, ldub, ldub)
+GEN_VEXT_LD_ELEM(ldbu_w, uint8_t,  uint32_t, H4, ldub, ldub)
+GEN_VEXT_LD_ELEM(ldbu_d, uint8_t,  uint64_t, H8, ldub, ldub)
+GEN_VEXT_LD_ELEM(ldhu_h, uint16_t, uint16_t, H2, lduw, lduw_le)
+GEN_VEXT_LD_ELEM(ldhu_w, uint16_t, uint32_t, H4, lduw, lduw_le)
+GEN_VEXT_LD_ELEM(ldhu_d, uint16_t, uint64_t, H8, lduw, lduw_le)
+GEN_VEXT_LD_ELEM(ldwu_w, uint32_t, uint32_t, H4, ldl, ldl_le)
+GEN_VEXT_LD_ELEM(ldwu_d, uint32_t, uint64_t, H8, ldl, ldl_le)
+
+#define GEN_VEXT_ST_ELEM(NAME, ETYPE, H, STSUF, HOSTSUF)   \
 static void NAME(CPURISCVState *env, abi_ptr addr,         \
                  uint32_t idx, void *vd, uintptr_t retaddr)\
 {                                                          \
     ETYPE data = *((ETYPE *)vd + H(idx));                  \
     cpu_##STSUF##_data_ra(env, addr, data, retaddr);       \
-}
-
-GEN_VEXT_ST_ELEM(stb_b, int8_t,  H1, stb)
-GEN_VEXT_ST_ELEM(stb_h, int16_t, H2, stb)
-GEN_VEXT_ST_ELEM(stb_w, int32_t, H4, stb)
-GEN_VEXT_ST_ELEM(stb_d, int64_t, H8, stb)
-GEN_VEXT_ST_ELEM(sth_h, int16_t, H2, stw)
-GEN_VEXT_ST_ELEM(sth_w, int32_t, H4, stw)
-GEN_VEXT_ST_ELEM(sth_d, int64_t, H8, stw)
-GEN_VEXT_ST_ELEM(stw_w, int32_t, H4, stl)
-GEN_VEXT_ST_ELEM(stw_d, int64_t, H8, stl)
-GEN_VEXT_ST_ELEM(ste_b, int8_t,  H1, stb)
-GEN_VEXT_ST_ELEM(ste_h, int16_t, H2, stw)
-GEN_VEXT_ST_ELEM(ste_w, int32_t, H4, stl)
-GEN_VEXT_ST_ELEM(ste_d, int64_t, H8, stq)
+}                                                          \
+                                                           \
+static void NAME##_host(void *vd, uint32_t idx, void *host)\
+{                                                          \
+    ETYPE data = *((ETYPE *)vd + H(idx));                  \
+    HOSTSUF##_p(host, data);                               \
+}
+
+GEN_VEXT_ST_ELEM(stb_b, int8_t,  H1, stb, stb)
+GEN_VEXT_ST_ELEM(stb_h, int16_t, H2, stb, stb)
+GEN_VEXT_ST_ELEM(stb_w, int32_t, H4, stb, stb)
+GEN_VEXT_ST_ELEM(stb_d, int64_t, H8, stb, stb)
+GEN_VEXT_ST_ELEM(sth_h, int16_t, H2, stw, stw_le)
+GEN_VEXT_ST_ELEM(sth_w, int32_t, H4, stw, stw_le)
+GEN_VEXT_ST_ELEM(sth_d, int64_t, H8, stw, stw_le)
+GEN_VEXT_ST_ELEM(stw_w, int32_t, H4, stl, stl_le)
+GEN_VEXT_ST_ELEM(stw_d, int64_t, H8, stl, stl_le)
+GEN_VEXT_ST_ELEM(ste_b, int8_t,  H1, stb, stb)
+GEN_VEXT_ST_ELEM(ste_h, int16_t, H2, stw, stw_le)
+GEN_VEXT_ST_ELEM(ste_w, int32_t, H4, stl, stl_le)
+GEN_VEXT_ST_ELEM(ste_d, int64_t, H8, stq, stq_le)
 
 /*
  *** stride: access vector element from strided memory
@@ -271,14 +332,16 @@ static void
 vext_ldst_stride(void *vd, void *v0, target_ulong base,
                  target_ulong stride, CPURISCVState *env,
                  uint32_t desc, uint32_t vm,
-                 vext_ldst_elem_fn *ldst_elem, clear_fn *clear_elem,
-                 uint32_t esz, uint32_t msz, uintptr_t ra,
-                 MMUAccessType access_type)
+                 vext_ldst_elem_fn *ldst_elem, vext_ldst_host_fn *ldst_host,
+                 clear_fn *clear_elem, uint32_t esz, uint32_t msz,
+                 uintptr_t ra, MMUAccessType access_type)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
     uint32_t mlen = vext_mlen(desc);
     uint32_t vlmax = vext_maxsz(desc) / esz;
+    bool active = false;
+    void *host = NULL;
 
     /* probe every access*/
     for (i = 0; i < env->vl; i++) {
@@ -286,6 +349,15 @@ vext_ldst_stride(void *vd, void *v0, target_ulong base,
             continue;
         }
         probe_pages(env, base + stride * i, nf * msz, ra, access_type);
+        active = true;
+    }
+    /*
+     * Short strides, such as the masked form of unit-stride accesses,
+     * often stay within a single page: access it directly.
+     */
+    if (active && stride <= TARGET_PAGE_SIZE) {
+        host = probe_host(env, base, stride * (env->vl - 1) + nf * msz,
+                          ra, access_type);
     }
     /* do real access */
     for (i = 0; i < env->vl; i++) {
@@ -294,8 +366,12 @@ vext_ldst_stride(void *vd, void *v0, target_ulong base,
             continue;
         }
         while (k < nf) {
-            target_ulong addr = base + stride * i + k * msz;
-            ldst_elem(env, addr, i + k * vlmax, vd, ra);
+            target_ulong off = stride * i + k * msz;
+            if (host) {
+                ldst_host(vd, i + k * vlmax, host + off);
+            } else {
+                ldst_elem(env, base + off, i + k * vlmax, vd, ra);
+            }
             k++;
         }
     }
@@ -314,8 +390,8 @@ void HELPER(NAME)(void *vd, void * v0, target_ulong base,               \
 {                                                                       \
     uint32_t vm = vext_vm(desc);                                        \
     vext_ldst_stride(vd, v0, base, stride, env, desc, vm, LOAD_FN,      \
-                     CLEAR_FN, sizeof(ETYPE), sizeof(MTYPE),            \
-                     GETPC(), MMU_DATA_LOAD);                           \
+                     LOAD_FN##_host, CLEAR_FN, sizeof(ETYPE),           \
+                     sizeof(MTYPE), GETPC(), MMU_DATA_LOAD);            \
 }
 
 GEN_VEXT_LD_STRIDE(vlsb_v_b,  int8_t,   int8_t,   ldb_b,  clearb)
@@ -348,8 +424,8 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
 {                                                                       \
     uint32_t vm = vext_vm(desc);                                        \
     vext_ldst_stride(vd, v0, base, stride, env, desc, vm, STORE_FN,     \
-                     NULL, sizeof(ETYPE), sizeof(MTYPE),                \
-                     GETPC(), MMU_DATA_STORE);                          \
+                     STORE_FN##_host, NULL, sizeof(ETYPE),              \
+                     sizeof(MTYPE), GETPC(), MMU_DATA_STORE);           \
 }
 
 GEN_VEXT_ST_STRIDE(vssb_v_b, int8_t,  int8_t,  stb_b)
@@ -373,23 +449,32 @@ GEN_VEXT_ST_STRIDE(vsse_v_d, int64_t, int64_t, ste_d)
 /* unmasked unit-stride load and store operation*/
 static void
 vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
-             vext_ldst_elem_fn *ldst_elem, clear_fn *clear_elem,
-             uint32_t esz, uint32_t msz, uintptr_t ra,
+             vext_ldst_elem_fn *ldst_elem, vext_ldst_host_fn *ldst_host,
+             clear_fn *clear_elem, uint32_t esz, uint32_t msz, uintptr_t ra,
              MMUAccessType access_type)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
     uint32_t vlmax = vext_maxsz(desc) / esz;
+    target_ulong len = env->vl * nf * msz;
+    void *host;
 
     /* probe every access */
-    probe_pages(env, base, env->vl * nf * msz, ra, access_type);
-    /* load bytes from guest memory */
-    for (i = 0; i < env->vl; i++) {
-        k = 0;
-        while (k < nf) {
-            target_ulong addr = base + (i * nf + k) * msz;
-            ldst_elem(env, addr, i + k * vlmax, vd, ra);
-            k++;
+    probe_pages(env, base, len, ra, access_type);
+    /* then copy the whole range at once if it is in a single RAM page */
+    host = probe_host(env, base, len, ra, access_type);
+    if (host) {
+        for (i = 0; i < env->vl; i++) {
+            for (k = 0; k < nf; k++) {
+                ldst_host(vd, i + k * vlmax, host + (i * nf + k) * msz);
+            }
+        }
+    } else {
+        for (i = 0; i < env->vl; i++) {
+            for (k = 0; k < nf; k++) {
+                target_ulong addr = base + (i * nf + k) * msz;
+                ldst_elem(env, addr, i + k * vlmax, vd, ra);
+            }
         }
     }
     /* clear tail elements */
@@ -411,15 +496,16 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,         \
 {                                                                       \
     uint32_t stride = vext_nf(desc) * sizeof(MTYPE);                    \
     vext_ldst_stride(vd, v0, base, stride, env, desc, false, LOAD_FN,   \
-                     CLEAR_FN, sizeof(ETYPE), sizeof(MTYPE),            \
-                     GETPC(), MMU_DATA_LOAD);                           \
+                     LOAD_FN##_host, CLEAR_FN, sizeof(ETYPE),           \
+                     sizeof(MTYPE), GETPC(), MMU_DATA_LOAD);            \
 }                                                                       \
                                                                         \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
                   CPURISCVState *env, uint32_t desc)                    \
 {                                                                       \
-    vext_ldst_us(vd, base, env, desc, LOAD_FN, CLEAR_FN,                \
-                 sizeof(ETYPE), sizeof(MTYPE), GETPC(), MMU_DATA_LOAD); \
+    vext_ldst_us(vd, base, env, desc, LOAD_FN, LOAD_FN##_host,          \
+                 CLEAR_FN, sizeof(ETYPE), sizeof(MTYPE), GETPC(),       \
+                 MMU_DATA_LOAD);                                        \
 }
 
 GEN_VEXT_LD_US(vlb_v_b,  int8_t,   int8_t,   ldb_b,  clearb)
@@ -451,14 +537,14 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,         \
 {                                                                       \
     uint32_t stride = vext_nf(desc) * sizeof(MTYPE);                    \
     vext_ldst_stride(vd, v0, base, stride, env, desc, false, STORE_FN,  \
-                     NULL, sizeof(ETYPE), sizeof(MTYPE),                \
-                     GETPC(), MMU_DATA_STORE);                          \
+                     STORE_FN##_host, NULL, sizeof(ETYPE),              \
+                     sizeof(MTYPE), GETPC(), MMU_DATA_STORE);           \
 }                                                                       \
                                                                         \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
                   CPURISCVState *env, uint32_t desc)                    \
 {                                                                       \
-    vext_ldst_us(vd, base, env, desc, STORE_FN, NULL,                   \
+    vext_ldst_us(vd, base, env, desc, STORE_FN, STORE_FN##_host, NULL,  \
                  sizeof(ETYPE), sizeof(MTYPE), GETPC(), MMU_DATA_STORE);\
 }
 
@@ -908,8 +994,8 @@ static void do_vext_vv(void *vd, void *v0, void *vs1, void *vs2,
 {
     uint32_t vlmax = vext_maxsz(desc) / esz;
     uint32_t mlen = vext_mlen(desc);
-    uint32_t vm = vext_vm(desc);
     uint32_t vl = env->vl;
+    uint32_t vm = vext_vm(desc) || vext_elem_mask_all(v0, mlen, vl);
     uint32_t i;
 
     for (i = 0; i < vl; i++) {
@@ -973,8 +1059,8 @@ static void do_vext_vx(void *vd, void *v0, target_long s1, void *vs2,
 {
     uint32_t vlmax = vext_maxsz(desc) / esz;
     uint32_t mlen = vext_mlen(desc);
-    uint32_t vm = vext_vm(desc);
     uint32_t vl = env->vl;
+    uint32_t vm = vext_vm(desc) || vext_elem_mask_all(v0, mlen, vl);
     uint32_t i;
 
     for (i = 0; i < vl; i++) {
@@ -3185,8 +3271,9 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1,          \
 {                                                         \
     uint32_t vlmax = vext_maxsz(desc) / ESZ;              \
     uint32_t mlen = vext_mlen(desc);                      \
-    uint32_t vm = vext_vm(desc);                          \
     uint32_t vl = env->vl;                                \
+    uint32_t vm = vext_vm(desc) ||                        \
+                  vext_elem_mask_all(v0, mlen, vl);       \
     uint32_t i;                                           \
                                                           \
     for (i = 0; i < vl; i++) {                            \
@@ -3220,8 +3307,9 @@ void HELPER(NAME)(void *vd, void *v0, uint64_t s1,        \
 {                                                         \
     uint32_t vlmax = vext_maxsz(desc) / ESZ;              \
     uint32_t mlen = vext_mlen(desc);                      \
-    uint32_t vm = vext_vm(desc);                          \
     uint32_t vl = env->vl;                                \
+    uint32_t vm = vext_vm(desc) ||                        \
+                  vext_elem_mask_all(v0, mlen, vl);       \
     uint32_t i;                                           \
                                                           \
     for (i = 0; i < vl; i++) {                            \
@@ -53,9 +53,16 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
     size_t total_size; /* size of entire buffer, >= n * stride */
 
+    bool evict; /* reclaim regions one at a time, see tcg_region_evict() */
+
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    size_t *order; /* allocated regions, least recently allocated first */
+    size_t n_order;
+    size_t *free; /* evicted regions, ready for reuse */
+    size_t n_free;
+    bool *full; /* regions whose size is counted in agg_size_full */
 };
 
 static struct tcg_region_state region;
@@ -163,10 +170,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, which is in the buffer */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
 
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -177,19 +197,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -283,6 +291,13 @@ size_t tcg_nb_tbs(void)
     return nb_tbs;
 }
 
+static void tcg_region_tree_reset(struct tcg_region_tree *rt)
+{
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+}
+
 static void tcg_region_tree_reset_all(void)
 {
     size_t i;
@@ -291,9 +306,7 @@ static void tcg_region_tree_reset_all(void)
     for (i = 0; i < region.n; i++) {
         struct tcg_region_tree *rt = region_trees + i * tree_size;
 
-        /* Increment the refcount first so that destroy acts as a reset */
-        g_tree_ref(rt->tree);
-        g_tree_destroy(rt->tree);
+        tcg_region_tree_reset(rt);
     }
     tcg_region_tree_unlock_all();
 }
@@ -331,11 +344,17 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t curr_region;
+
+    if (region.current < region.n) {
+        curr_region = region.current++;
+    } else if (region.n_free) {
+        curr_region = region.free[--region.n_free];
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, curr_region);
+    region.order[region.n_order++] = curr_region;
     return false;
 }
 
@@ -346,13 +365,15 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
+    /* read the region now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t prev = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        region.full[prev] = true;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -384,6 +405,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.n_order = 0;
+    region.n_free = 0;
+    memset(region.full, 0, region.n * sizeof(region.full[0]));
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -394,34 +418,96 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
-static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
+/*
+ * Reclaim the least recently allocated region that no context is filling,
+ * after calling @func on each of its TBs, so that they can be invalidated.
+ * Return the size of the region and store in @prx the address of its
+ * executable view, or return 0 if eviction is disabled or there is no
+ * such region.
+ *
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(GTraverseFunc func, gpointer user_data,
+                        const void **prx)
 {
-#ifdef CONFIG_USER_ONLY
-    return 1;
-#else
-    size_t n_regions;
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    struct tcg_region_tree *rt;
+    size_t i, victim = 0, size = 0;
+    void *start, *end;
+
+    if (!region.evict) {
+        return 0;
+    }
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < region.n_order; i++) {
+        unsigned int j;
+
+        victim = region.order[i];
+        for (j = 0; j < n_ctxs; j++) {
+            const TCGContext *s = qatomic_read(&tcg_ctxs[j]);
+
+            if (tcg_region_index(s->code_gen_buffer) == victim) {
+                break;
+            }
+        }
+        if (j == n_ctxs) {
+            break;
+        }
+    }
+    if (i < region.n_order) {
+        memmove(&region.order[i], &region.order[i + 1],
+                (region.n_order - i - 1) * sizeof(region.order[0]));
+        region.n_order--;
+        region.free[region.n_free++] = victim;
+
+        tcg_region_bounds(victim, &start, &end);
+        size = end - start;
+        /* e.g. the region of tcg_init_ctx was never retired */
+        if (region.full[victim]) {
+            region.agg_size_full -= size - TCG_HIGHWATER;
+            region.full[victim] = false;
+        }
+        *prx = tcg_splitwx_to_rx(start);
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    if (size) {
+        rt = region_trees + victim * tree_size;
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, func, user_data);
+        tcg_region_tree_reset(rt);
+        qemu_mutex_unlock(&rt->lock);
+    }
+    return size;
+}
+
+static size_t tcg_n_regions(size_t tb_size, unsigned max_threads, bool evict)
+{
+    size_t n_regions, min_regions;
 
     /*
-     * It is likely that some vCPUs will translate more code than others,
-     * so we first try to set more regions than max_cpus, with those regions
-     * being of reasonable size. If that's not possible we make do by evenly
-     * dividing the code_gen_buffer among the vCPUs.
+     * It is likely that some TCG threads will translate more code than
+     * others, so we first try to set more regions than max_threads, with
+     * those regions being of reasonable size. If that's not possible we
+     * make do by evenly dividing the code_gen_buffer among the threads.
      */
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
+    /* Use a single region if all we have is one TCG thread */
+    if (max_threads == 1 && !evict) {
         return 1;
     }
 
     /*
-     * Try to have more regions than max_cpus, with each region being >= 2 MB.
-     * If we can't, then just allocate one region per vCPU thread.
+     * Try to have more regions than max_threads, with each region being
+     * >= 2 MB.  If we can't, then just allocate one region per thread,
+     * plus one that can be evicted while the threads fill theirs.
      */
     n_regions = tb_size / (2 * MiB);
-    if (n_regions <= max_cpus) {
-        return max_cpus;
+    min_regions = evict ? max_threads + 1 : max_threads;
+    if (n_regions <= min_regions) {
+        return min_regions;
     }
-    return MIN(n_regions, max_cpus * 8);
-#endif
+    return MIN(n_regions, max_threads * 8);
 }
 
 /*
@@ -705,25 +791,27 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * and then assigning regions to TCG threads so that the threads can translate
  * code in parallel without synchronization.
  *
- * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
- * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
- * must have been parsed before calling this function, since it calls
- * qemu_tcg_mttcg_enabled().
+ * In softmmu the number of TCG threads is bounded by max_threads, i.e. the
+ * vCPU threads (max_cpus in MTTCG, one otherwise) plus any background
+ * translation threads, so we use at least max_threads regions whenever
+ * there is more than one TCG thread.
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
- * is not supported, because the number of vCPU threads (recall that each thread
- * spawned by the guest corresponds to a vCPU thread) is only bounded by the
- * OS, and usually this number is huge (tens of thousands is not uncommon).
- * Thus, given this large bound on the number of vCPU threads and the fact
- * that code_gen_buffer is allocated at compile-time, we cannot guarantee
- * that the availability of at least one region per vCPU thread.
+ * With eviction enabled, even a single TCG thread gets several regions, so
+ * that when the buffer is full the least recently allocated region can be
+ * reclaimed on its own (see tcg_region_evict()) instead of flushing all
+ * translations.
  *
- * However, this user-mode limitation is unlikely to be a significant problem
- * in practice. Multi-threaded guests share most if not all of their translated
- * code, which makes parallel code generation less appealing than in softmmu.
+ * In user-mode the number of vCPU threads (recall that each thread spawned
+ * by the guest corresponds to a vCPU thread) is only bounded by the OS, and
+ * usually this number is huge (tens of thousands is not uncommon), so we
+ * cannot guarantee the availability of at least one region per vCPU thread.
+ * Instead, max_threads is the size of a pool of TCG contexts that the vCPU
+ * threads claim for the duration of each translation; see
+ * tcg_register_thread().  Like in softmmu, each context in the pool
+ * allocates from its own region.
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads,
+                     bool evict)
 {
     const size_t page_size = qemu_real_host_page_size;
     size_t region_size;
@@ -761,7 +849,11 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
-    region.n = tcg_n_regions(tb_size, max_cpus);
+    region.n = tcg_n_regions(tb_size, max_threads, evict);
+    region.evict = evict;
+    region.order = g_new(size_t, region.n);
+    region.free = g_new(size_t, region.n);
+    region.full = g_new0(bool, region.n);
     region_size = tb_size / region.n;
     region_size = QEMU_ALIGN_DOWN(region_size, page_size);
 
@@ -825,7 +917,7 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     /*
      * Leave the initial context initialized to the first region.
      * This will be the context into which we generate the prologue.
-     * It is also the only context for CONFIG_USER_ONLY.
+     * It is also the first context of the pool for CONFIG_USER_ONLY.
      */
     tcg_region_initial_alloc__locked(&tcg_init_ctx);
 }
@@ -27,11 +27,20 @@
 
 #define TCG_HIGHWATER 1024
 
+/* A range of CPUArchState; lists of ranges end with a zero size.  */
+typedef struct TCGEnvRange {
+    uint32_t offset;
+    uint32_t size;
+} TCGEnvRange;
+
 typedef struct TCGHelperInfo {
     void *func;
     const char *name;
     unsigned flags;
     unsigned typemask;
+    /* From DEF_HELPER_ENV; NULL if the flags alone apply.  */
+    const TCGEnvRange *env_reads;
+    const TCGEnvRange *env_writes;
 } TCGHelperInfo;
 
 extern TCGContext tcg_init_ctx;
@@ -39,7 +48,8 @@ extern TCGContext **tcg_ctxs;
 extern unsigned int tcg_cur_ctxs;
 extern unsigned int tcg_max_ctxs;
 
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads,
+                     bool evict);
 bool tcg_region_alloc(TCGContext *s);
 void tcg_region_initial_alloc(TCGContext *s);
 void tcg_region_prologue_set(TCGContext *s);
@@ -36,6 +36,7 @@
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/cacheflush.h"
+#include "qemu/crc32c.h"
 
 /* Note: the long term plan is to reduce the dependencies on the QEMU
    CPU definitions. Currently they are used for qemu_ld/st
@@ -60,6 +61,7 @@
 #include "exec/log.h"
 #include "tcg/tcg-ldst.h"
 #include "tcg-internal.h"
+#include "accel/tcg/perf.h"
 
 #ifdef CONFIG_TCG_INTERPRETER
 #include <ffi.h>
@@ -438,13 +440,35 @@ static void alloc_tcg_plugin_context(TCGContext *s)
 #endif
 }
 
+/* Copy the initial context into a new one, for use by another thread. */
+static TCGContext *tcg_context_clone(void)
+{
+    TCGContext *s = g_malloc(sizeof(*s));
+    unsigned int i, n;
+
+    *s = tcg_init_ctx;
+
+    /* Relink mem_base.  */
+    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
+        if (tcg_init_ctx.temps[i].mem_base) {
+            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
+            tcg_debug_assert(b >= 0 && b < n);
+            s->temps[i].mem_base = &s->temps[b];
+        }
+    }
+    return s;
+}
+
 /*
  * All TCG threads except the parent (i.e. the one that called tcg_context_init
  * and registered the target's TCG globals) must register with this function
  * before initiating translation.
  *
- * In user-mode we just point tcg_ctx to tcg_init_ctx. See the documentation
- * of tcg_region_init() for the reasoning behind this.
+ * In user-mode the number of threads is unbounded, so they share the fixed
+ * pool of contexts set up by tcg_prologue_init().  Each thread is given a
+ * "home" context in round-robin order, and claims a context for the duration
+ * of each translation with tcg_claim_ctx().  See the documentation of
+ * tcg_region_init() for the reasoning behind this.
  *
  * In softmmu each caller registers its context in tcg_ctxs[]. Note that in
  * softmmu tcg_ctxs[] does not track tcg_ctx_init, since the initial context
@@ -454,26 +478,77 @@ static void alloc_tcg_plugin_context(TCGContext *s)
  * over the array (e.g. tcg_code_size() the same for both softmmu and user-mode.
  */
 #ifdef CONFIG_USER_ONLY
-void tcg_register_thread(void)
+static QemuMutex *tcg_ctx_locks;
+static __thread unsigned int tcg_ctx_home;
+static __thread int tcg_ctx_claimed = -1;
+
+static void tcg_user_contexts_init(void)
 {
-    tcg_ctx = &tcg_init_ctx;
+    unsigned int i;
+
+    tcg_ctx_locks = g_new(QemuMutex, tcg_max_ctxs);
+    for (i = 0; i < tcg_max_ctxs; i++) {
+        qemu_mutex_init(&tcg_ctx_locks[i]);
+    }
+    for (i = 1; i < tcg_max_ctxs; i++) {
+        TCGContext *s = tcg_context_clone();
+
+        alloc_tcg_plugin_context(s);
+        tcg_region_initial_alloc(s);
+        tcg_ctxs[i] = s;
+    }
+    qatomic_set(&tcg_cur_ctxs, tcg_max_ctxs);
 }
-#else
+
 void tcg_register_thread(void)
 {
-    TCGContext *s = g_malloc(sizeof(*s));
-    unsigned int i, n;
+    static unsigned int next_home;
 
-    *s = tcg_init_ctx;
+    tcg_ctx_home = (qatomic_fetch_inc(&next_home) + 1) % tcg_max_ctxs;
+    tcg_ctx = tcg_ctxs[tcg_ctx_home];
+}
 
-    /* Relink mem_base.  */
-    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
-        if (tcg_init_ctx.temps[i].mem_base) {
-            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
-            tcg_debug_assert(b >= 0 && b < n);
-            s->temps[i].mem_base = &s->temps[b];
+/*
+ * Claim a context for translation: the home context of the thread if it
+ * is free, else any other free one; wait for the home context if they are
+ * all busy.
+ */
+void tcg_claim_ctx(void)
+{
+    unsigned int i, n = tcg_max_ctxs;
+    unsigned int k = tcg_ctx_home;
+
+    tcg_debug_assert(tcg_ctx_claimed < 0);
+    for (i = 0; i < n; i++, k = (k + 1) % n) {
+        if (qemu_mutex_trylock(&tcg_ctx_locks[k]) == 0) {
+            goto found;
         }
     }
+    k = tcg_ctx_home;
+    qemu_mutex_lock(&tcg_ctx_locks[k]);
+ found:
+    tcg_ctx_claimed = k;
+    tcg_ctx = tcg_ctxs[k];
+}
+
+/*
+ * Release the context claimed by tcg_claim_ctx(), if any.  This is also
+ * called when a translation is abandoned, e.g. because of a fault while
+ * reading guest code.
+ */
+void tcg_release_ctx(void)
+{
+    if (tcg_ctx_claimed >= 0) {
+        qemu_mutex_unlock(&tcg_ctx_locks[tcg_ctx_claimed]);
+        tcg_ctx_claimed = -1;
+        tcg_ctx = tcg_ctxs[tcg_ctx_home];
+    }
+}
+#else
+void tcg_register_thread(void)
+{
+    TCGContext *s = tcg_context_clone();
+    unsigned int n;
 
     /* Claim an entry in tcg_ctxs */
     n = qatomic_fetch_inc(&tcg_cur_ctxs);
@@ -544,11 +619,25 @@ void tcg_pool_reset(TCGContext *s)
 
 #include "exec/helper-proto.h"
 
-static const TCGHelperInfo all_helpers[] = {
+static TCGHelperInfo all_helpers[] = {
 #include "exec/helper-tcg.h"
 };
 static GHashTable *helper_table;
 
+typedef struct TCGHelperEnv {
+    void *func;
+    const TCGEnvRange *reads;
+    const TCGEnvRange *writes;
+} TCGHelperEnv;
+
+static const TCGHelperEnv all_helper_env[] = {
+#include "exec/helper-env.h"
+    { .func = NULL }
+};
+
+/* Approximate dynamic call counts, see tcg_dump_helper_audit().  */
+static uint64_t helper_calls[ARRAY_SIZE(all_helpers)];
+
 #ifdef CONFIG_TCG_INTERPRETER
 static GHashTable *ffi_table;
 
@@ -567,7 +656,7 @@ static void process_op_defs(TCGContext *s);
 static TCGTemp *tcg_global_reg_new_internal(TCGContext *s, TCGType type,
                                             TCGReg reg, const char *name);
 
-static void tcg_context_init(unsigned max_cpus)
+static void tcg_context_init(unsigned max_threads)
 {
     TCGContext *s = &tcg_init_ctx;
     int op, total_args, n, i;
@@ -604,6 +693,13 @@ static void tcg_context_init(unsigned max_cpus)
         g_hash_table_insert(helper_table, (gpointer)all_helpers[i].func,
                             (gpointer)&all_helpers[i]);
     }
+    for (i = 0; all_helper_env[i].func; ++i) {
+        TCGHelperInfo *info = g_hash_table_lookup(helper_table,
+                                                  all_helper_env[i].func);
+
+        info->env_reads = all_helper_env[i].reads;
+        info->env_writes = all_helper_env[i].writes;
+    }
 
 #ifdef CONFIG_TCG_INTERPRETER
     /* g_direct_hash/equal for direct comparisons on uint32_t.  */
@@ -668,18 +764,16 @@ static void tcg_context_init(unsigned max_cpus)
 
     tcg_ctx = s;
     /*
-     * In user-mode we simply share the init context among threads, since we
-     * use a single region. See the documentation tcg_region_init() for the
-     * reasoning behind this.
-     * In softmmu we will have at most max_cpus TCG threads.
+     * In user-mode the init context is the first of a pool of max_threads
+     * contexts, the others being created by tcg_prologue_init().  See the
+     * documentation of tcg_region_init() for the reasoning behind this.
+     * In softmmu we will have at most max_threads TCG threads.
      */
+    tcg_max_ctxs = max_threads;
+    tcg_ctxs = g_new0(TCGContext *, max_threads);
 #ifdef CONFIG_USER_ONLY
-    tcg_ctxs = &tcg_ctx;
+    tcg_ctxs[0] = s;
     tcg_cur_ctxs = 1;
-    tcg_max_ctxs = 1;
-#else
-    tcg_max_ctxs = max_cpus;
-    tcg_ctxs = g_new0(TCGContext *, max_cpus);
 #endif
 
     tcg_debug_assert(!tcg_regset_test_reg(s->reserved_regs, TCG_AREG0));
@@ -687,10 +781,10 @@ static void tcg_context_init(unsigned max_cpus)
     cpu_env = temp_tcgv_ptr(ts);
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_init(size_t tb_size, int splitwx, unsigned max_threads, bool evict)
 {
-    tcg_context_init(max_cpus);
-    tcg_region_init(tb_size, splitwx, max_cpus);
+    tcg_context_init(max_threads);
+    tcg_region_init(tb_size, splitwx, max_threads, evict);
 }
 
 /*
@@ -747,6 +841,7 @@ void tcg_prologue_init(TCGContext *s)
 #endif
 
     prologue_size = tcg_current_code_size(s);
+    perf_report_prologue(tcg_splitwx_to_rx(s->code_buf), prologue_size);
 
 #ifndef CONFIG_TCG_INTERPRETER
     flush_idcache_range((uintptr_t)tcg_splitwx_to_rx(s->code_buf),
@@ -794,6 +889,11 @@ void tcg_prologue_init(TCGContext *s)
 #endif
 
     tcg_region_prologue_set(s);
+
+#ifdef CONFIG_USER_ONLY
+    /* The other contexts inherit the prologue and the target's globals. */
+    tcg_user_contexts_init();
+#endif
 }
 
 void tcg_func_start(TCGContext *s)
@@ -814,6 +914,8 @@ void tcg_func_start(TCGContext *s)
     s->nb_ops = 0;
     s->nb_labels = 0;
     s->current_frame_offset = s->frame_start;
+    s->tb_host_ptrs = false;
+    s->opt_level = 1;
 
 #ifdef CONFIG_DEBUG_TCG
     s->goto_tb_issue_mask = 0;
@@ -1451,6 +1553,23 @@ bool tcg_op_supported(TCGOpcode op)
 /* Note: we convert the 64 bit args to 32 bit and do some alignment
    and endian swap. Maybe it would be better to do the alignment
    and endian swap in tcg_reg_alloc_call(). */
+
+/*
+ * Count the calls to a helper that may write all globals.  The counter
+ * is not updated atomically, which is good enough to rank the helpers.
+ */
+static void tcg_gen_helper_count(const TCGHelperInfo *info)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&helper_calls[info - all_helpers]);
+    TCGv_i64 val = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_addi_i64(val, val, 1);
+    tcg_gen_st_i64(val, ptr, 0);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+}
+
 void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args)
 {
     int i, real_args, nb_rets, pi;
@@ -1461,6 +1580,12 @@ void tcg_gen_callN(void *func, TCGTemp *ret, int nargs, TCGTemp **args)
     info = g_hash_table_lookup(helper_table, (gpointer)func);
     typemask = info->typemask;
 
+    if (unlikely(tcg_ctx->helper_audit)
+        && !(info->flags & TCG_CALL_NO_WRITE_GLOBALS)
+        && !info->env_writes) {
+        tcg_gen_helper_count(info);
+    }
+
 #ifdef CONFIG_PLUGIN
     /* detect non-plugin helpers */
     if (tcg_ctx->plugin_insn && unlikely(strncmp(info->name, "plugin_", 7))) {
@@ -2226,6 +2351,13 @@ static TCGOp *tcg_op_alloc(TCGOpcode opc)
 TCGOp *tcg_emit_op(TCGOpcode opc)
 {
     TCGOp *op = tcg_op_alloc(opc);
+
+#ifdef CONFIG_PLUGIN
+    if (tcg_ctx->emit_before_op) {
+        QTAILQ_INSERT_BEFORE(tcg_ctx->emit_before_op, op, link);
+        return op;
+    }
+#endif
     QTAILQ_INSERT_TAIL(&tcg_ctx->ops, op, link);
     return op;
 }
@@ -2244,6 +2376,358 @@ TCGOp *tcg_op_insert_after(TCGContext *s, TCGOp *old_op, TCGOpcode opc)
     return new_op;
 }
 
+/*
+ * Opcode stream serialization.
+ *
+ * The opcode stream produced by the front end, before any optimization,
+ * does not depend on where the host code will be placed.  It can thus be
+ * saved and later fed straight back to tcg_gen_code(), skipping the guest
+ * decoder.  Globals and temps are referenced by index, labels by id,
+ * helpers by their position in all_helpers[], and exit_tb values relative
+ * to the TranslationBlock.  Streams which embed other host pointers
+ * (see tcg_const_ptr) are refused.
+ */
+
+#define STREAM_TEMP_NONE    UINT32_MAX
+#define STREAM_EXIT_TB_REL  (1ull << 63)
+
+/* Set in the temp_allocated byte when the temp is in const_table. */
+#define STREAM_TEMP_HASHED  2
+
+typedef struct TCGStreamReader {
+    const uint8_t *ptr;
+    const uint8_t *end;
+    bool error;
+} TCGStreamReader;
+
+static void stream_put_u8(GByteArray *buf, uint8_t val)
+{
+    g_byte_array_append(buf, &val, 1);
+}
+
+static void stream_put_u16(GByteArray *buf, uint16_t val)
+{
+    val = cpu_to_le16(val);
+    g_byte_array_append(buf, (const guint8 *)&val, 2);
+}
+
+static void stream_put_u32(GByteArray *buf, uint32_t val)
+{
+    val = cpu_to_le32(val);
+    g_byte_array_append(buf, (const guint8 *)&val, 4);
+}
+
+static void stream_put_u64(GByteArray *buf, uint64_t val)
+{
+    val = cpu_to_le64(val);
+    g_byte_array_append(buf, (const guint8 *)&val, 8);
+}
+
+static const uint8_t *stream_get(TCGStreamReader *r, size_t len)
+{
+    const uint8_t *p = r->ptr;
+
+    if (r->error || (size_t)(r->end - p) < len) {
+        r->error = true;
+        return NULL;
+    }
+    r->ptr += len;
+    return p;
+}
+
+static uint8_t stream_get_u8(TCGStreamReader *r)
+{
+    const uint8_t *p = stream_get(r, 1);
+    return p ? *p : 0;
+}
+
+static uint16_t stream_get_u16(TCGStreamReader *r)
+{
+    const uint8_t *p = stream_get(r, 2);
+    return p ? lduw_le_p(p) : 0;
+}
+
+static uint32_t stream_get_u32(TCGStreamReader *r)
+{
+    const uint8_t *p = stream_get(r, 4);
+    return p ? ldl_le_p(p) : 0;
+}
+
+static uint64_t stream_get_u64(TCGStreamReader *r)
+{
+    const uint8_t *p = stream_get(r, 8);
+    return p ? ldq_le_p(p) : 0;
+}
+
+/* Return the index of the label argument of @c, or -1 if it has none. */
+static int op_label_arg_index(TCGOpcode c)
+{
+    switch (c) {
+    case INDEX_op_set_label:
+    case INDEX_op_br:
+        return 0;
+    case INDEX_op_brcond_i32:
+    case INDEX_op_brcond_i64:
+        return 3;
+    case INDEX_op_brcond2_i32:
+        return 5;
+    default:
+        return -1;
+    }
+}
+
+/* Return the number of temp arguments of @op, and its total in @nb_args. */
+static int op_stream_nb_args(TCGOpcode c, unsigned callo, unsigned calli,
+                             int *nb_args)
+{
+    const TCGOpDef *def = &tcg_op_defs[c];
+    int nb_temp_args;
+
+    if (c == INDEX_op_call) {
+        /* Outputs, inputs, then the function and TCGHelperInfo pointers. */
+        nb_temp_args = callo + calli;
+        *nb_args = nb_temp_args + 2;
+    } else {
+        nb_temp_args = def->nb_oargs + def->nb_iargs;
+        *nb_args = nb_temp_args + def->nb_cargs;
+    }
+    return nb_temp_args;
+}
+
+bool tcg_op_stream_save(TCGContext *s, const TranslationBlock *tb,
+                        GByteArray *buf)
+{
+    uintptr_t tb_rx = (uintptr_t)tcg_splitwx_to_rx((void *)tb);
+    TCGLabel *l;
+    TCGOp *op;
+    int i;
+
+    if (s->tb_host_ptrs) {
+        return false;
+    }
+
+    g_byte_array_set_size(buf, 0);
+    stream_put_u32(buf, s->nb_temps);
+    stream_put_u32(buf, s->nb_labels);
+    stream_put_u32(buf, s->nb_ops);
+
+    for (i = s->nb_globals; i < s->nb_temps; i++) {
+        TCGTemp *ts = &s->temps[i];
+        uint8_t alloc = ts->temp_allocated;
+
+        if (ts->kind == TEMP_CONST && s->const_table[ts->base_type] &&
+            g_hash_table_lookup(s->const_table[ts->base_type],
+                                &ts->val) == ts) {
+            alloc |= STREAM_TEMP_HASHED;
+        }
+        stream_put_u8(buf, ts->base_type);
+        stream_put_u8(buf, ts->type);
+        stream_put_u8(buf, ts->kind);
+        stream_put_u8(buf, alloc);
+        stream_put_u64(buf, ts->val);
+    }
+
+    QSIMPLEQ_FOREACH(l, &s->labels, next) {
+        stream_put_u8(buf, l->present);
+        stream_put_u16(buf, l->refs);
+    }
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        TCGOpcode c = op->opc;
+        int nb_args, nb_temp_args, label_idx;
+
+        nb_temp_args = op_stream_nb_args(c, TCGOP_CALLO(op), TCGOP_CALLI(op),
+                                         &nb_args);
+        label_idx = op_label_arg_index(c);
+
+        stream_put_u8(buf, c);
+        stream_put_u8(buf, op->param1);
+        stream_put_u8(buf, op->param2);
+
+        for (i = 0; i < nb_args; i++) {
+            TCGArg arg = op->args[i];
+
+            if (i < nb_temp_args) {
+                /* TCG_CALL_DUMMY_ARG pads call arguments on 32-bit hosts. */
+                stream_put_u32(buf, arg == TCG_CALL_DUMMY_ARG
+                               ? STREAM_TEMP_NONE : temp_idx(arg_temp(arg)));
+            } else if (i == label_idx) {
+                stream_put_u32(buf, arg_label(arg)->id);
+            } else if (c == INDEX_op_call) {
+                /* Both the function and its info map to the table index. */
+                if (i == nb_temp_args) {
+                    stream_put_u32(buf, tcg_call_info(op) - all_helpers);
+                }
+            } else if (c == INDEX_op_exit_tb && arg != 0) {
+                if ((arg & ~TB_EXIT_MASK) != tb_rx) {
+                    return false;
+                }
+                stream_put_u64(buf, STREAM_EXIT_TB_REL | (arg & TB_EXIT_MASK));
+            } else {
+                stream_put_u64(buf, arg);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Rebuild the opcode stream saved by tcg_op_stream_save() in @s, after
+ * tcg_func_start().  Several streams may be loaded one after the other;
+ * each gets its own temporaries and labels, appended to those already
+ * in @s.  On failure, @s must be reset again before being used for a
+ * regular translation.
+ */
+bool tcg_op_stream_load(TCGContext *s, const TranslationBlock *tb,
+                        const void *data, size_t len)
+{
+    uintptr_t tb_rx = (uintptr_t)tcg_splitwx_to_rx((void *)tb);
+    TCGStreamReader r = { .ptr = data, .end = data + len };
+    /* Offset of the stream's first non-global temp within s->temps */
+    uint32_t base = s->nb_temps - s->nb_globals;
+    uint32_t nb_temps, nb_labels, nb_ops;
+    TCGLabel **labels;
+    int i;
+
+    nb_temps = stream_get_u32(&r);
+    nb_labels = stream_get_u32(&r);
+    nb_ops = stream_get_u32(&r);
+    if (r.error || nb_temps < s->nb_globals ||
+        nb_temps > TCG_MAX_TEMPS - base || nb_labels > (1 << 14)) {
+        return false;
+    }
+
+    for (i = s->nb_globals; i < nb_temps; i++) {
+        TCGTemp *ts = tcg_temp_alloc(s);
+        uint8_t base_type = stream_get_u8(&r);
+        uint8_t type = stream_get_u8(&r);
+        uint8_t kind = stream_get_u8(&r);
+        uint8_t alloc = stream_get_u8(&r);
+
+        if (base_type >= TCG_TYPE_COUNT || type >= TCG_TYPE_COUNT ||
+            kind == TEMP_GLOBAL || kind == TEMP_FIXED || kind > TEMP_CONST) {
+            return false;
+        }
+        ts->base_type = base_type;
+        ts->type = type;
+        ts->kind = kind;
+        ts->temp_allocated = alloc & 1;
+        ts->val = stream_get_u64(&r);
+
+        if (alloc & STREAM_TEMP_HASHED) {
+            GHashTable *h = s->const_table[base_type];
+
+            if (h == NULL) {
+                h = g_hash_table_new(g_int64_hash, g_int64_equal);
+                s->const_table[base_type] = h;
+            }
+            g_hash_table_insert(h, &ts->val, ts);
+        }
+    }
+
+    labels = tcg_malloc(sizeof(TCGLabel *) * MAX(nb_labels, 1));
+    for (i = 0; i < nb_labels; i++) {
+        TCGLabel *l = gen_new_label();
+
+        l->present = stream_get_u8(&r);
+        l->refs = stream_get_u16(&r);
+        labels[i] = l;
+    }
+
+    for (i = 0; i < nb_ops && !r.error; i++) {
+        TCGOpcode c = stream_get_u8(&r);
+        unsigned param1 = stream_get_u8(&r);
+        unsigned param2 = stream_get_u8(&r);
+        int j, nb_args, nb_temp_args, label_idx;
+        TCGOp *op;
+
+        if (c >= NB_OPS) {
+            return false;
+        }
+        nb_temp_args = op_stream_nb_args(c, param2, param1, &nb_args);
+        if (nb_args > MAX_OPC_PARAM) {
+            return false;
+        }
+        label_idx = op_label_arg_index(c);
+
+        op = tcg_emit_op(c);
+        op->param1 = param1;
+        op->param2 = param2;
+
+        for (j = 0; j < nb_args; j++) {
+            if (j < nb_temp_args) {
+                uint32_t idx = stream_get_u32(&r);
+
+                if (idx == STREAM_TEMP_NONE) {
+                    op->args[j] = TCG_CALL_DUMMY_ARG;
+                } else if (idx < s->nb_globals) {
+                    op->args[j] = temp_arg(&s->temps[idx]);
+                } else if (idx < nb_temps) {
+                    op->args[j] = temp_arg(&s->temps[idx + base]);
+                } else {
+                    return false;
+                }
+            } else if (j == label_idx) {
+                uint32_t id = stream_get_u32(&r);
+
+                if (id >= nb_labels) {
+                    return false;
+                }
+                op->args[j] = label_arg(labels[id]);
+            } else if (c == INDEX_op_call) {
+                uint32_t idx = stream_get_u32(&r);
+
+                if (idx >= ARRAY_SIZE(all_helpers)) {
+                    return false;
+                }
+                op->args[j++] = (uintptr_t)all_helpers[idx].func;
+                op->args[j] = (uintptr_t)&all_helpers[idx];
+            } else if (c == INDEX_op_exit_tb) {
+                uint64_t val = stream_get_u64(&r);
+
+                if (val & STREAM_EXIT_TB_REL) {
+                    val = tb_rx + (val & TB_EXIT_MASK);
+                } else if (val != 0) {
+                    return false;
+                }
+                op->args[j] = val;
+            } else {
+                op->args[j] = stream_get_u64(&r);
+            }
+        }
+    }
+
+    return !r.error && r.ptr == r.end;
+}
+
+/*
+ * Summarize everything a saved opcode stream depends on outside of the
+ * stream itself: the opcode set, the globals defined by the target and
+ * the helper table.
+ */
+uint32_t tcg_op_stream_fingerprint(TCGContext *s)
+{
+    uint32_t hdr[3] = { NB_OPS, sizeof(TCGArg), s->nb_globals };
+    uint32_t crc = crc32c(0xffffffff, (const uint8_t *)hdr, sizeof(hdr));
+    int i;
+
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int64_t desc[3] = { ts->base_type, ts->kind, ts->mem_offset };
+
+        crc = crc32c(crc, (const uint8_t *)desc, sizeof(desc));
+        crc = crc32c(crc, (const uint8_t *)ts->name, strlen(ts->name));
+    }
+    for (i = 0; i < ARRAY_SIZE(all_helpers); i++) {
+        const TCGHelperInfo *info = &all_helpers[i];
+        uint32_t desc[2] = { info->flags, info->typemask };
+
+        crc = crc32c(crc, (const uint8_t *)desc, sizeof(desc));
+        crc = crc32c(crc, (const uint8_t *)info->name, strlen(info->name));
+    }
+    return crc;
+}
+
 /* Reachable analysis : remove unreachable code.  */
 static void reachable_code_pass(TCGContext *s)
 {
@@ -2429,6 +2913,51 @@ static void la_bb_sync(TCGContext *s, int ng, int nt)
     }
 }
 
+/* Return true if the helper may access the memory backing global TS.  */
+static bool tcg_env_access(const TCGEnvRange *r, const TCGTemp *ts)
+{
+    intptr_t size = ts->type == TCG_TYPE_I32 ? 4 : 8;
+
+    if (ts->kind == TEMP_FIXED) {
+        return false;
+    }
+    /* Globals that are not directly in env may alias anything.  */
+    if (ts->mem_base->kind != TEMP_FIXED) {
+        return true;
+    }
+    for (; r->size; r++) {
+        if (ts->mem_offset < (intptr_t)r->offset + r->size
+            && r->offset < ts->mem_offset + size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Return the call flags that apply to global TS for a call to INFO:
+ * TCG_CALL_NO_READ_GLOBALS if the helper does not access it,
+ * TCG_CALL_NO_WRITE_GLOBALS if it may only read it, and 0 if it may
+ * write it.
+ */
+static int tcg_call_global_flags(const TCGHelperInfo *info, const TCGTemp *ts)
+{
+    int flags = info->flags & (TCG_CALL_NO_READ_GLOBALS |
+                               TCG_CALL_NO_WRITE_GLOBALS);
+
+    if (flags & TCG_CALL_NO_READ_GLOBALS) {
+        return flags;
+    }
+    if (!flags && info->env_writes
+        && !tcg_env_access(info->env_writes, ts)) {
+        flags = TCG_CALL_NO_WRITE_GLOBALS;
+    }
+    if (flags && info->env_reads && !tcg_env_access(info->env_reads, ts)) {
+        flags |= TCG_CALL_NO_READ_GLOBALS;
+    }
+    return flags;
+}
+
 /* liveness analysis: sync globals back to memory and kill.  */
 static void la_global_kill(TCGContext *s, int ng)
 {
@@ -2440,6 +2969,33 @@ static void la_global_kill(TCGContext *s, int ng)
     }
 }
 
+/*
+ * liveness analysis: a call to a helper that declares which globals
+ * it accesses, see DEF_HELPER_ENV.
+ */
+static void la_global_call(TCGContext *s, int ng, const TCGHelperInfo *info)
+{
+    int i;
+
+    for (i = 0; i < ng; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int state = ts->state;
+
+        switch (tcg_call_global_flags(info, ts)) {
+        case 0:
+            ts->state = TS_DEAD | TS_MEM;
+            la_reset_pref(ts);
+            break;
+        case TCG_CALL_NO_WRITE_GLOBALS:
+            ts->state = state | TS_MEM;
+            if (state == TS_DEAD) {
+                la_reset_pref(ts);
+            }
+            break;
+        }
+    }
+}
+
 /* liveness analysis: note live globals crossing calls.  */
 static void la_cross_call(TCGContext *s, int nt)
 {
@@ -2528,8 +3084,11 @@ static void liveness_pass_1(TCGContext *s)
                     op->output_pref[i] = 0;
                 }
 
-                if (!(call_flags & (TCG_CALL_NO_WRITE_GLOBALS |
-                                    TCG_CALL_NO_READ_GLOBALS))) {
+                if (tcg_call_info(op)->env_reads
+                    || tcg_call_info(op)->env_writes) {
+                    la_global_call(s, nb_globals, tcg_call_info(op));
+                } else if (!(call_flags & (TCG_CALL_NO_WRITE_GLOBALS |
+                                           TCG_CALL_NO_READ_GLOBALS))) {
                     la_global_kill(s, nb_globals);
                 } else if (!(call_flags & TCG_CALL_NO_READ_GLOBALS)) {
                     la_global_sync(s, nb_globals);
@@ -2875,21 +3434,23 @@ static bool liveness_pass_2(TCGContext *s)
 
         /* Liveness analysis should ensure that the following are
            all correct, for call sites and basic block end points.  */
-        if (call_flags & TCG_CALL_NO_READ_GLOBALS) {
-            /* Nothing to do */
-        } else if (call_flags & TCG_CALL_NO_WRITE_GLOBALS) {
-            for (i = 0; i < nb_globals; ++i) {
+        for (i = 0; i < nb_globals; ++i) {
+            int flags = call_flags;
+
+            arg_ts = &s->temps[i];
+            if (opc == INDEX_op_call) {
+                flags = tcg_call_global_flags(tcg_call_info(op), arg_ts);
+            }
+            if (flags & TCG_CALL_NO_READ_GLOBALS) {
+                /* Nothing to do */
+            } else if (flags & TCG_CALL_NO_WRITE_GLOBALS) {
                 /* Liveness should see that globals are synced back,
                    that is, either TS_DEAD or TS_MEM.  */
-                arg_ts = &s->temps[i];
                 tcg_debug_assert(arg_ts->state_ptr == 0
                                  || arg_ts->state != 0);
-            }
-        } else {
-            for (i = 0; i < nb_globals; ++i) {
+            } else {
                 /* Liveness should see that globals are saved back,
                    that is, TS_DEAD, waiting to be reloaded.  */
-                arg_ts = &s->temps[i];
                 tcg_debug_assert(arg_ts->state_ptr == 0
                                  || arg_ts->state == TS_DEAD);
             }
@@ -2965,6 +3526,214 @@ static bool liveness_pass_2(TCGContext *s)
     return changes;
 }
 
+/* Number of registers that must remain available to the allocator.  */
+#define TCG_PIN_MIN_FREE_REGS 8
+
+static void tcg_unpin_globals(TCGContext *s)
+{
+    int i;
+
+    s->reserved_regs &= ~s->pinned_regs;
+    s->pinned_regs = 0;
+    for (i = 0; i < s->nb_pinned; i++) {
+        s->pinned_temps[i]->pinned = 0;
+    }
+    s->nb_pinned = 0;
+}
+
+/*
+ * Choose up to s->pin_globals globals that are kept in callee-saved host
+ * registers for the whole TB.  A pinned global is loaded once at the start
+ * of the TB and survives labels and helper calls; liveness still decides
+ * where it is stored back, and it is only reloaded after a helper that may
+ * write globals.  The score of a global is the number of regions, delimited
+ * by labels and calls, in which it is read: each of those costs a load when
+ * the global is not pinned.
+ */
+static void tcg_pin_globals(TCGContext *s)
+{
+    uint16_t score[TCG_MAX_TEMPS], region[TCG_MAX_TEMPS];
+    intptr_t env_access[64];
+    int nb_env_access = 0;
+    TCGRegSet pool, avail;
+    uint16_t cur = 1;
+    TCGOp *op;
+    int i, n;
+
+    /* Undo the choice made for a translation that was abandoned.  */
+    tcg_unpin_globals(s);
+
+    if (s->pin_globals == 0 || s->opt_level == 0) {
+        return;
+    }
+
+    avail = tcg_target_available_regs[TCG_TYPE_REG] & ~s->reserved_regs;
+    pool = avail & ~tcg_target_call_clobber_regs;
+    for (i = 0; i < ARRAY_SIZE(tcg_target_call_iarg_regs); i++) {
+        tcg_regset_reset_reg(pool, tcg_target_call_iarg_regs[i]);
+    }
+    for (i = 0; i < ARRAY_SIZE(tcg_target_call_oarg_regs); i++) {
+        tcg_regset_reset_reg(pool, tcg_target_call_oarg_regs[i]);
+    }
+
+    memset(score, 0, s->nb_globals * sizeof(score[0]));
+    memset(region, 0, s->nb_globals * sizeof(region[0]));
+
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        TCGOpcode opc = op->opc;
+        const TCGOpDef *def = &tcg_op_defs[opc];
+        int nb_oargs, nb_iargs;
+
+        switch (opc) {
+        case INDEX_op_set_label:
+            cur++;
+            continue;
+        case INDEX_op_call:
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+            break;
+        case INDEX_op_ld8u_i32 ... INDEX_op_st_i32:
+        case INDEX_op_ld8u_i64 ... INDEX_op_st_i64:
+        case INDEX_op_ld_vec:
+        case INDEX_op_st_vec:
+        case INDEX_op_dupm_vec:
+            /*
+             * Direct accesses to env may alias a global; remember them
+             * so that such globals are not pinned.
+             */
+            if (arg_temp(op->args[1])->kind == TEMP_FIXED) {
+                if (nb_env_access == ARRAY_SIZE(env_access)) {
+                    return;
+                }
+                env_access[nb_env_access++] = op->args[2];
+            }
+            /* fall through */
+        default:
+            nb_oargs = def->nb_oargs;
+            nb_iargs = def->nb_iargs;
+            /*
+             * Do not take away a register that is needed to satisfy
+             * the constraints of this op.
+             */
+            for (i = 0; i < nb_oargs + nb_iargs; i++) {
+                TCGRegSet set = def->args_ct[i].regs & avail;
+
+                if (set && !(set & ~pool)) {
+                    pool &= ~set;
+                }
+            }
+            break;
+        }
+
+        for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
+            TCGTemp *ts;
+            int idx;
+
+            if (op->args[i] == TCG_CALL_DUMMY_ARG) {
+                continue;
+            }
+            ts = arg_temp(op->args[i]);
+            if (ts->kind != TEMP_GLOBAL) {
+                continue;
+            }
+            idx = temp_idx(ts);
+            if (region[idx] != cur) {
+                region[idx] = cur;
+                score[idx]++;
+            }
+        }
+        if (def->flags & TCG_OPF_CALL_CLOBBER) {
+            cur++;
+        }
+    }
+
+    n = MIN(s->pin_globals, ctpop64(avail) - TCG_PIN_MIN_FREE_REGS);
+    while (s->nb_pinned < n && pool) {
+        TCGTemp *best = NULL;
+        TCGReg reg = TCG_TARGET_NB_REGS;
+        int best_score = 1;
+
+        for (i = 0; i < s->nb_globals; i++) {
+            TCGTemp *ts = &s->temps[i];
+            bool alias = false;
+            int j;
+
+            if (score[i] <= best_score
+                || ts->kind != TEMP_GLOBAL
+                || ts->indirect_reg
+                || ts->mem_base->kind != TEMP_FIXED
+                || ts->type > TCG_TYPE_REG) {
+                continue;
+            }
+            for (j = 0; j < nb_env_access; j++) {
+                if (env_access[j] < ts->mem_offset + 8
+                    && ts->mem_offset < env_access[j] + 32) {
+                    alias = true;
+                    break;
+                }
+            }
+            if (alias) {
+                score[i] = 0;
+                continue;
+            }
+            best = ts;
+            best_score = score[i];
+        }
+        if (!best) {
+            break;
+        }
+        score[temp_idx(best)] = 0;
+
+        /* Leave the registers preferred by the allocator alone.  */
+        for (i = ARRAY_SIZE(tcg_target_reg_alloc_order) - 1; i >= 0; i--) {
+            reg = tcg_target_reg_alloc_order[i];
+            if (tcg_regset_test_reg(pool, reg)
+                && tcg_regset_test_reg(tcg_target_available_regs[best->type],
+                                       reg)) {
+                break;
+            }
+        }
+        if (i < 0) {
+            break;
+        }
+        tcg_regset_reset_reg(pool, reg);
+        tcg_regset_set_reg(s->pinned_regs, reg);
+        best->pinned = 1;
+        best->pin_reg = reg;
+        best->reg = reg;
+        s->pinned_temps[s->nb_pinned++] = best;
+    }
+
+    if (s->nb_pinned == 0) {
+        return;
+    }
+    s->reserved_regs |= s->pinned_regs;
+
+    /*
+     * A pinned global never dies: the allocator must keep its register
+     * up to date, while the stores requested by liveness still take place.
+     */
+    QTAILQ_FOREACH(op, &s->ops, link) {
+        const TCGOpDef *def = &tcg_op_defs[op->opc];
+        int nb_args;
+
+        if (op->opc == INDEX_op_call) {
+            nb_args = TCGOP_CALLO(op) + TCGOP_CALLI(op);
+        } else {
+            nb_args = def->nb_oargs + def->nb_iargs;
+        }
+        for (i = 0; i < nb_args; i++) {
+            if (op->args[i] != TCG_CALL_DUMMY_ARG
+                && arg_temp(op->args[i])->pinned) {
+                op->life &= ~(DEAD_ARG << i);
+            }
+        }
+    }
+#ifdef CONFIG_PROFILER
+    qatomic_set(&s->prof.pinned_count, s->prof.pinned_count + s->nb_pinned);
+#endif
+}
+
 #ifdef CONFIG_DEBUG_TCG
 static void dump_regs(TCGContext *s)
 {
@@ -3090,6 +3859,12 @@ static void temp_free_or_dead(TCGContext *s, TCGTemp *ts, int free_or_dead)
     case TEMP_FIXED:
         return;
     case TEMP_GLOBAL:
+        /* A pinned global keeps its register.  */
+        if (ts->pinned && ts->val_type == TEMP_VAL_REG
+            && ts->reg == ts->pin_reg) {
+            return;
+        }
+        /* fall through */
     case TEMP_LOCAL:
         new_type = TEMP_VAL_MEM;
         break;
@@ -3239,6 +4014,17 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet required_regs,
     tcg_abort();
 }
 
+static TCGReg temp_load_reg(TCGContext *s, TCGTemp *ts,
+                            TCGRegSet desired_regs, TCGRegSet allocated_regs,
+                            TCGRegSet preferred_regs)
+{
+    if (ts->pinned && tcg_regset_test_reg(desired_regs, ts->pin_reg)) {
+        return ts->pin_reg;
+    }
+    return tcg_reg_alloc(s, desired_regs, allocated_regs,
+                         preferred_regs, ts->indirect_base);
+}
+
 /* Make sure the temporary is in a register.  If needed, allocate the register
    from DESIRED while avoiding ALLOCATED.  */
 static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
@@ -3250,8 +4036,8 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
     case TEMP_VAL_REG:
         return;
     case TEMP_VAL_CONST:
-        reg = tcg_reg_alloc(s, desired_regs, allocated_regs,
-                            preferred_regs, ts->indirect_base);
+        reg = temp_load_reg(s, ts, desired_regs, allocated_regs,
+                            preferred_regs);
         if (ts->type <= TCG_TYPE_I64) {
             tcg_out_movi(s, ts->type, reg, ts->val);
         } else {
@@ -3276,8 +4062,8 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
         ts->mem_coherent = 0;
         break;
     case TEMP_VAL_MEM:
-        reg = tcg_reg_alloc(s, desired_regs, allocated_regs,
-                            preferred_regs, ts->indirect_base);
+        reg = temp_load_reg(s, ts, desired_regs, allocated_regs,
+                            preferred_regs);
         tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
         ts->mem_coherent = 1;
         break;
@@ -3296,7 +4082,8 @@ static void temp_save(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs)
 {
     /* The liveness analysis already ensures that globals are back
        in memory. Keep an tcg_debug_assert for safety. */
-    tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || temp_readonly(ts));
+    tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || temp_readonly(ts)
+                     || (ts->pinned && ts->mem_coherent));
 }
 
 /* save globals to their canonical location and assume they can be
@@ -3326,6 +4113,114 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Make sure that the pinned globals are in their register, as assumed
+ * at the start of the TB and at every label.
+ */
+static void load_pinned_globals(TCGContext *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_pinned; i++) {
+        TCGTemp *ts = s->pinned_temps[i];
+
+        if (ts->val_type != TEMP_VAL_MEM) {
+            tcg_debug_assert(ts->val_type == TEMP_VAL_REG
+                             && ts->reg == ts->pin_reg);
+            continue;
+        }
+        tcg_out_ld(s, ts->type, ts->pin_reg,
+                   ts->mem_base->reg, ts->mem_offset);
+        ts->reg = ts->pin_reg;
+        ts->val_type = TEMP_VAL_REG;
+        ts->mem_coherent = 1;
+        s->reg_to_temp[ts->pin_reg] = ts;
+    }
+}
+
+/*
+ * A helper that may write globals invalidates the pinned registers.
+ * Reload them lazily, on their next use or at the next branch.
+ */
+static void clobber_pinned_global(TCGContext *s, TCGTemp *ts)
+{
+    tcg_debug_assert(ts->val_type == TEMP_VAL_MEM || ts->mem_coherent);
+    if (ts->val_type == TEMP_VAL_REG) {
+        s->reg_to_temp[ts->reg] = NULL;
+    }
+    ts->val_type = TEMP_VAL_MEM;
+}
+
+static void clobber_pinned_globals(TCGContext *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_pinned; i++) {
+        clobber_pinned_global(s, s->pinned_temps[i]);
+    }
+}
+
+/*
+ * Save the globals written by a helper annotated with DEF_HELPER_ENV,
+ * and sync those it reads.
+ */
+static void call_globals(TCGContext *s, const TCGHelperInfo *info,
+                         TCGRegSet allocated_regs)
+{
+    int i, n;
+
+    for (i = 0, n = s->nb_globals; i < n; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        switch (tcg_call_global_flags(info, ts)) {
+        case 0:
+            temp_save(s, ts, allocated_regs);
+            if (ts->pinned) {
+                clobber_pinned_global(s, ts);
+            }
+            break;
+        case TCG_CALL_NO_WRITE_GLOBALS:
+            tcg_debug_assert(ts->val_type != TEMP_VAL_REG
+                             || ts->kind == TEMP_FIXED
+                             || ts->mem_coherent);
+            break;
+        }
+    }
+}
+
+/*
+ * The outputs of an op are allocated like any other temp; move the
+ * pinned globals that were written back to their register.
+ */
+static void fixup_pinned_globals(TCGContext *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_pinned; i++) {
+        TCGTemp *ts = s->pinned_temps[i];
+
+        switch (ts->val_type) {
+        case TEMP_VAL_REG:
+            if (ts->reg == ts->pin_reg) {
+                continue;
+            }
+            tcg_out_mov(s, ts->type, ts->pin_reg, ts->reg);
+            s->reg_to_temp[ts->reg] = NULL;
+            break;
+        case TEMP_VAL_CONST:
+            tcg_out_movi(s, ts->type, ts->pin_reg, ts->val);
+            break;
+        case TEMP_VAL_MEM:
+            continue;
+        default:
+            g_assert_not_reached();
+        }
+        ts->reg = ts->pin_reg;
+        ts->val_type = TEMP_VAL_REG;
+        s->reg_to_temp[ts->pin_reg] = ts;
+    }
+}
+
 /* at the end of a basic block, we assume all temporaries are dead and
    all globals are stored at their canonical location. */
 static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
@@ -3363,6 +4258,7 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
 static void tcg_reg_alloc_cbranch(TCGContext *s, TCGRegSet allocated_regs)
 {
     sync_globals(s, allocated_regs);
+    load_pinned_globals(s);
 
     for (int i = s->nb_globals; i < s->nb_temps; i++) {
         TCGTemp *ts = &s->temps[i];
@@ -3464,7 +4360,7 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
         }
         temp_dead(s, ots);
     } else {
-        if (IS_DEAD_ARG(1) && ts->kind != TEMP_FIXED) {
+        if (IS_DEAD_ARG(1) && ts->kind != TEMP_FIXED && !ots->pinned) {
             /* the mov can be suppressed */
             if (ots->val_type == TEMP_VAL_REG) {
                 s->reg_to_temp[ots->reg] = NULL;
@@ -3472,7 +4368,12 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
             ots->reg = ts->reg;
             temp_dead(s, ts);
         } else {
-            if (ots->val_type != TEMP_VAL_REG) {
+            if (ots->pinned) {
+                if (ots->val_type == TEMP_VAL_REG) {
+                    s->reg_to_temp[ots->reg] = NULL;
+                }
+                ots->reg = ots->pin_reg;
+            } else if (ots->val_type != TEMP_VAL_REG) {
                 /* When allocating a new register, make sure to not spill the
                    input one. */
                 tcg_regset_set_reg(allocated_regs, ts->reg);
@@ -3671,7 +4572,11 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
              * register and move it.
              */
             if (temp_readonly(ts) || !IS_DEAD_ARG(i)) {
-                goto allocate_in_reg;
+                /* A pinned global can only be updated in place.  */
+                if (!ts->pinned
+                    || arg_temp(op->args[arg_ct->alias_index]) != ts) {
+                    goto allocate_in_reg;
+                }
             }
 
             /*
@@ -3729,6 +4634,9 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
         tcg_reg_alloc_cbranch(s, i_allocated_regs);
     } else if (def->flags & TCG_OPF_BB_END) {
         tcg_reg_alloc_bb_end(s, i_allocated_regs);
+        if (!(def->flags & TCG_OPF_BB_EXIT)) {
+            load_pinned_globals(s);
+        }
     } else {
         if (def->flags & TCG_OPF_CALL_CLOBBER) {
             /* XXX: permit generic clobber register list ? */ 
@@ -3760,6 +4668,9 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
                 reg = tcg_reg_alloc(s, arg_ct->regs,
                                     i_allocated_regs | o_allocated_regs,
                                     op->output_pref[k], ts->indirect_base);
+            } else if (ts->pinned
+                       && tcg_regset_test_reg(arg_ct->regs, ts->pin_reg)) {
+                reg = ts->pin_reg;
             } else {
                 reg = tcg_reg_alloc(s, arg_ct->regs, o_allocated_regs,
                                     op->output_pref[k], ts->indirect_base);
@@ -4005,10 +4916,13 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
        they might be read. */
     if (flags & TCG_CALL_NO_READ_GLOBALS) {
         /* Nothing to do */
+    } else if (info->env_reads || info->env_writes) {
+        call_globals(s, info, allocated_regs);
     } else if (flags & TCG_CALL_NO_WRITE_GLOBALS) {
         sync_globals(s, allocated_regs);
     } else {
         save_globals(s, allocated_regs);
+        clobber_pinned_globals(s);
     }
 
 #ifdef CONFIG_TCG_INTERPRETER
@@ -4092,6 +5006,7 @@ void tcg_profile_snapshot(TCGProfile *prof, bool counters, bool table)
             PROF_ADD(prof, orig, opt_time);
             PROF_ADD(prof, orig, restore_count);
             PROF_ADD(prof, orig, restore_time);
+            PROF_ADD(prof, orig, pinned_count);
         }
         if (table) {
             int i;
@@ -4217,7 +5132,17 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #endif
 
 #ifdef USE_TCG_OPTIMIZATIONS
-    tcg_optimize(s);
+    if (s->opt_level > 0) {
+        tcg_optimize(s);
+    }
+    if (s->opt_level > 1) {
+        /*
+         * Pruning unreachable code can expose further constant and copy
+         * propagation opportunities across the removed branches.
+         */
+        reachable_code_pass(s);
+        tcg_optimize(s);
+    }
 #endif
 
 #ifdef CONFIG_PROFILER
@@ -4261,6 +5186,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     }
 #endif
 
+    tcg_pin_globals(s);
     tcg_reg_alloc_start(s);
 
     /*
@@ -4270,6 +5196,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
      */
     s->code_buf = tcg_splitwx_to_rw(tb->tc.ptr);
     s->code_ptr = s->code_buf;
+    load_pinned_globals(s);
 
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     QSIMPLEQ_INIT(&s->ldst_labels);
@@ -4318,6 +5245,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             break;
         case INDEX_op_set_label:
             tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            load_pinned_globals(s);
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
@@ -4337,6 +5265,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             tcg_reg_alloc_op(s, op);
             break;
         }
+        if (s->nb_pinned) {
+            fixup_pinned_globals(s);
+        }
 #ifdef CONFIG_DEBUG_TCG
         check_regs(s);
 #endif
@@ -4354,6 +5285,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     }
     tcg_debug_assert(num_insns >= 0);
     s->gen_insn_end_off[num_insns] = tcg_current_code_size(s);
+    tcg_unpin_globals(s);
 
     /* Generate TB finalization at the end of block */
 #ifdef TCG_TARGET_NEED_LDST_LABELS
@@ -4382,6 +5314,39 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
     return tcg_current_code_size(s);
 }
 
+static int tcg_helper_calls_cmp(const void *a, const void *b)
+{
+    uint64_t ca = helper_calls[*(const int *)a];
+    uint64_t cb = helper_calls[*(const int *)b];
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+void tcg_dump_helper_audit(GString *buf)
+{
+    g_autofree int *order = NULL;
+    int i, n = 0;
+
+    if (!tcg_init_ctx.helper_audit) {
+        return;
+    }
+    order = g_new(int, ARRAY_SIZE(all_helpers));
+    for (i = 0; i < ARRAY_SIZE(all_helpers); i++) {
+        if (helper_calls[i]) {
+            order[n++] = i;
+        }
+    }
+    qsort(order, n, sizeof(order[0]), tcg_helper_calls_cmp);
+
+    g_string_append_printf(buf, "\nHelpers that may write all globals, "
+                           "by call count:\n");
+    for (i = 0; i < MIN(n, 20); i++) {
+        g_string_append_printf(buf, "%-24s %" PRIu64 "\n",
+                               all_helpers[order[i]].name,
+                               helper_calls[order[i]]);
+    }
+}
+
 #ifdef CONFIG_PROFILER
 void tcg_dump_info(GString *buf)
 {
@@ -4412,6 +5377,8 @@ void tcg_dump_info(GString *buf)
     g_string_append_printf(buf, "avg temps/TB        %0.2f max=%d\n",
                            (double)s->temp_count / tb_div_count,
                            s->temp_count_max);
+    g_string_append_printf(buf, "avg pinned/TB       %0.2f\n",
+                           (double)s->pinned_count / tb_div_count);
     g_string_append_printf(buf, "avg host code/TB    %0.1f\n",
                            (double)s->code_out_len / tb_div_count);
     g_string_append_printf(buf, "avg search data/TB  %0.1f\n",
@@ -136,6 +136,22 @@ static void tci_args_rrbb(uint32_t insn, TCGReg *r0, TCGReg *r1,
     *i3 = extract32(insn, 22, 6);
 }
 
+/*
+ * The fused compare-and-branch is two words long: the label follows
+ * the instruction word, relative to the end of the second word.
+ * Returns the pointer past the whole instruction.
+ */
+static const uint32_t *tci_args_rrcl(uint32_t insn, const uint32_t *tb_ptr,
+                                     TCGReg *r0, TCGReg *r1,
+                                     TCGCond *c2, void **l3)
+{
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = (int32_t)*tb_ptr + (void *)(tb_ptr + 1);
+    return tb_ptr + 1;
+}
+
 static void tci_args_rrrc(uint32_t insn,
                           TCGReg *r0, TCGReg *r1, TCGReg *r2, TCGCond *c3)
 {
@@ -451,6 +467,21 @@ static void tci_qemu_st(CPUArchState *env, target_ulong taddr, uint64_t val,
 # define CASE_64(x)
 #endif
 
+/*
+ * The interpreter is direct-threaded for the most frequent opcodes:
+ * each of their handlers fetches the next instruction and jumps to
+ * its handler through the dispatch table, instead of going back to
+ * the single indirect branch of the switch.  This gives the host
+ * branch predictor one history per handler.  Opcodes not listed in
+ * the table are dispatched by the switch.
+ */
+#define TCI_NEXT()                              \
+    do {                                        \
+        insn = *tb_ptr++;                       \
+        opc = extract32(insn, 0, 8);            \
+        goto *dispatch[opc];                    \
+    } while (0)
+
 /* Interpret pseudo code in tb. */
 /*
  * Disable CFI checks.
@@ -461,6 +492,35 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                                             const void *v_tb_ptr)
 {
     const uint32_t *tb_ptr = v_tb_ptr;
+    static const void * const dispatch[256] = {
+        [0 ... 255] = &&do_switch,
+        [INDEX_op_br] = &&do_br,
+        [INDEX_op_goto_tb] = &&do_goto_tb,
+        [INDEX_op_mov_i32] = &&do_mov,
+        [INDEX_op_tci_movi] = &&do_tci_movi,
+        [INDEX_op_tci_movl] = &&do_tci_movl,
+        [INDEX_op_ld_i32] = &&do_ld32u,
+        [INDEX_op_st_i32] = &&do_st32,
+        [INDEX_op_add_i32] = &&do_add,
+        [INDEX_op_sub_i32] = &&do_sub,
+        [INDEX_op_and_i32] = &&do_and,
+        [INDEX_op_or_i32] = &&do_or,
+        [INDEX_op_xor_i32] = &&do_xor,
+        [INDEX_op_tci_brcond32] = &&do_tci_brcond32,
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_mov_i64] = &&do_mov,
+        [INDEX_op_ld32u_i64] = &&do_ld32u,
+        [INDEX_op_ld_i64] = &&do_ld_i64,
+        [INDEX_op_st32_i64] = &&do_st32,
+        [INDEX_op_st_i64] = &&do_st_i64,
+        [INDEX_op_add_i64] = &&do_add,
+        [INDEX_op_sub_i64] = &&do_sub,
+        [INDEX_op_and_i64] = &&do_and,
+        [INDEX_op_or_i64] = &&do_or,
+        [INDEX_op_xor_i64] = &&do_xor,
+        [INDEX_op_tci_brcond64] = &&do_tci_brcond64,
+#endif
+    };
     tcg_target_ulong regs[TCG_TARGET_NB_REGS];
     uint64_t stack[(TCG_STATIC_CALL_ARGS_SIZE + TCG_STATIC_FRAME_SIZE)
                    / sizeof(uint64_t)];
@@ -487,9 +547,9 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
         int32_t ofs;
         void *ptr;
 
-        insn = *tb_ptr++;
-        opc = extract32(insn, 0, 8);
+        TCI_NEXT();
 
+    do_switch:
         switch (opc) {
         case INDEX_op_call:
             /*
@@ -541,9 +601,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 
         case INDEX_op_br:
+        do_br:
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = ptr;
-            continue;
+            TCI_NEXT();
         case INDEX_op_setcond_i32:
             tci_args_rrrc(insn, &r0, &r1, &r2, &condition);
             regs[r0] = tci_compare32(regs[r1], regs[r2], condition);
@@ -572,17 +633,20 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         CASE_32_64(mov)
+        do_mov:
             tci_args_rr(insn, &r0, &r1);
             regs[r0] = regs[r1];
-            break;
+            TCI_NEXT();
         case INDEX_op_tci_movi:
+        do_tci_movi:
             tci_args_ri(insn, &r0, &t1);
             regs[r0] = t1;
-            break;
+            TCI_NEXT();
         case INDEX_op_tci_movl:
+        do_tci_movl:
             tci_args_rl(insn, tb_ptr, &r0, &ptr);
             regs[r0] = *(tcg_target_ulong *)ptr;
-            break;
+            TCI_NEXT();
 
             /* Load/store operations (32 bit). */
 
@@ -608,10 +672,11 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_ld_i32:
         CASE_64(ld32u)
+        do_ld32u:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint32_t *)ptr;
-            break;
+            TCI_NEXT();
         CASE_32_64(st8)
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
@@ -624,37 +689,43 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
         case INDEX_op_st_i32:
         CASE_64(st32)
+        do_st32:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint32_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (mixed 32/64 bit). */
 
         CASE_32_64(add)
+        do_add:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] + regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(sub)
+        do_sub:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] - regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(mul)
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] * regs[r2];
             break;
         CASE_32_64(and)
+        do_and:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] & regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(or)
+        do_or:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] | regs[r2];
-            break;
+            TCI_NEXT();
         CASE_32_64(xor)
+        do_xor:
             tci_args_rrr(insn, &r0, &r1, &r2);
             regs[r0] = regs[r1] ^ regs[r2];
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_andc_i32 || TCG_TARGET_HAS_andc_i64
         CASE_32_64(andc)
             tci_args_rrr(insn, &r0, &r1, &r2);
@@ -773,6 +844,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tb_ptr = ptr;
             }
             break;
+        case INDEX_op_tci_brcond32:
+        do_tci_brcond32:
+            tb_ptr = tci_args_rrcl(insn, tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
         case INDEX_op_add2_i32:
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
@@ -861,15 +939,17 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             regs[r0] = *(int32_t *)ptr;
             break;
         case INDEX_op_ld_i64:
+        do_ld_i64:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             regs[r0] = *(uint64_t *)ptr;
-            break;
+            TCI_NEXT();
         case INDEX_op_st_i64:
+        do_st_i64:
             tci_args_rrs(insn, &r0, &r1, &ofs);
             ptr = (void *)(regs[r1] + ofs);
             *(uint64_t *)ptr = regs[r0];
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (64 bit). */
 
@@ -986,6 +1066,13 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
                 tb_ptr = ptr;
             }
             break;
+        case INDEX_op_tci_brcond64:
+        do_tci_brcond64:
+            tb_ptr = tci_args_rrcl(insn, tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            TCI_NEXT();
         case INDEX_op_ext32s_i64:
         case INDEX_op_ext_i32_i64:
             tci_args_rr(insn, &r0, &r1);
@@ -1011,9 +1098,10 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             return (uintptr_t)ptr;
 
         case INDEX_op_goto_tb:
+        do_goto_tb:
             tci_args_l(insn, tb_ptr, &ptr);
             tb_ptr = *(void **)ptr;
-            break;
+            TCI_NEXT();
 
         case INDEX_op_goto_ptr:
             tci_args_r(insn, &r0);
@@ -1187,6 +1275,13 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
                            op_name, str_r(r0), ptr);
         break;
 
+    case INDEX_op_tci_brcond32:
+    case INDEX_op_tci_brcond64:
+        tci_args_rrcl(insn, tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
+        return 2 * sizeof(insn);
+
     case INDEX_op_setcond_i32:
     case INDEX_op_setcond_i64:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
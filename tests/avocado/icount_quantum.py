@@ -0,0 +1,85 @@
+# Test that SMP guests run deterministically with icount-quantum
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or
+# later.  See the COPYING file in the top-level directory.
+
+import logging
+
+from boot_linux_console import LinuxKernelTest
+
+class IcountQuantum(LinuxKernelTest):
+    """
+    Boots an SMP Linux kernel twice with the same icount-quantum and
+    checks that the console output, including the printk timestamps
+    that come from the virtual clock, is the same on both runs.
+    """
+
+    timeout = 180
+    KERNEL_COMMON_COMMAND_LINE = 'printk.time=1 panic=-1 '
+
+    def run_vm(self, kernel_path, kernel_command_line, smp, quantum):
+        vm = self.get_vm()
+        vm.set_console()
+        vm.add_args('-accel', 'tcg,icount-quantum=%d' % quantum,
+                    '-icount', 'shift=1,sleep=off',
+                    '-smp', str(smp),
+                    # the kernel gets random seeds through the device tree
+                    '-seed', '1',
+                    '-kernel', kernel_path,
+                    '-append', kernel_command_line,
+                    '-net', 'none',
+                    '-no-reboot')
+        vm.launch()
+
+        # The kernel panics without a root device and QEMU exits
+        console = vm.console_socket.makefile(mode='rb', encoding='utf-8')
+        console_logger = logging.getLogger('console')
+        lines = []
+        for line in console:
+            msg = line.decode(errors='replace').rstrip()
+            console_logger.debug(msg)
+            lines.append(msg)
+        console.close()
+        vm.wait()
+
+        self.assertTrue(any('VFS: Cannot open root device' in msg
+                            for msg in lines))
+        return lines
+
+    def check_deterministic(self, kernel_path, kernel_command_line, smp,
+                            quantum=10000):
+        first = self.run_vm(kernel_path, kernel_command_line, smp, quantum)
+        second = self.run_vm(kernel_path, kernel_command_line, smp, quantum)
+        self.assertEqual(first, second)
+
+    def test_aarch64_virt(self):
+        """
+        Secondary vCPUs are brought up through PSCI CPU_ON
+
+        :avocado: tags=arch:aarch64
+        :avocado: tags=machine:virt
+        :avocado: tags=cpu:cortex-a53
+        """
+        kernel_url = ('https://archives.fedoraproject.org/pub/archive/fedora'
+                      '/linux/releases/29/Everything/aarch64/os/images/pxeboot'
+                      '/vmlinuz')
+        kernel_hash = '8c73e469fc6ea06a58dc83a628fc695b693b8493'
+        kernel_path = self.fetch_asset(kernel_url, asset_hash=kernel_hash)
+
+        kernel_command_line = (self.KERNEL_COMMON_COMMAND_LINE +
+                               'console=ttyAMA0')
+        self.check_deterministic(kernel_path, kernel_command_line, smp=4)
+
+    def test_x86_64_pc(self):
+        """
+        :avocado: tags=arch:x86_64
+        :avocado: tags=machine:pc
+        """
+        kernel_url = ('https://archives.fedoraproject.org/pub/archive/fedora'
+                      '/linux/releases/29/Everything/x86_64/os/images/pxeboot'
+                      '/vmlinuz')
+        kernel_hash = '23bebd2680757891cf7adedb033532163a792495'
+        kernel_path = self.fetch_asset(kernel_url, asset_hash=kernel_hash)
+
+        kernel_command_line = self.KERNEL_COMMON_COMMAND_LINE + 'console=ttyS0'
+        self.check_deterministic(kernel_path, kernel_command_line, smp=2)
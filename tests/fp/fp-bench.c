@@ -34,6 +34,8 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_MAX,
+    OP_TOINT,
     OP_MAX_NR,
 };
 
@@ -45,6 +47,8 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_MAX] = "max",
+    [OP_TOINT] = "toint",
     [OP_MAX_NR] = NULL,
 };
 
@@ -55,6 +59,8 @@ enum precision {
     PREC_FLOAT32,
     PREC_FLOAT64,
     PREC_FLOAT128,
+    PREC_FLOAT16,
+    PREC_BFLOAT16,
     PREC_MAX_NR,
 };
 
@@ -90,6 +96,8 @@ static const char * const tester_names[] = {
 union fp {
     float f;
     double d;
+    float16 f16;
+    bfloat16 bf16;
     float32 f32;
     float64 f64;
     float128 f128;
@@ -125,6 +133,7 @@ static float_status soft_status;
 static enum precision precision;
 static enum op operation;
 static enum tester tester;
+static bool force_soft;
 static uint64_t n_completed_ops;
 static unsigned int duration = DEFAULT_DURATION_SECS;
 static int64_t ns_elapsed;
@@ -151,6 +160,24 @@ static void update_random_ops(int n_ops, enum precision prec)
     for (i = 0; i < n_ops; i++) {
 
         switch (prec) {
+        case PREC_FLOAT16:
+        {
+            uint64_t r = random_ops[i];
+            do {
+                r = xorshift64star(r);
+            } while (!float16_is_normal(r));
+            random_ops[i] = r;
+            break;
+        }
+        case PREC_BFLOAT16:
+        {
+            uint64_t r = random_ops[i];
+            do {
+                r = xorshift64star(r);
+            } while (!bfloat16_is_normal(r));
+            random_ops[i] = r;
+            break;
+        }
         case PREC_SINGLE:
         case PREC_FLOAT32:
         {
@@ -191,13 +218,64 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * Scale the operands of conversions to integer down to the range of
+ * int32_t, so that the benchmark does not only measure saturation.
+ */
+static void fill_int_range(union fp *op, enum precision prec)
+{
+    int e;
+
+    switch (prec) {
+    case PREC_FLOAT16:
+        break;
+    case PREC_BFLOAT16:
+    {
+        union fp t;
+
+        t.f32 = make_float32((uint32_t)op->bf16 << 16);
+        t.f = ldexpf(frexpf(t.f, &e), e % 32);
+        op->bf16 = float32_val(t.f32) >> 16;
+        break;
+    }
+    case PREC_SINGLE:
+    case PREC_FLOAT32:
+        op->f = ldexpf(frexpf(op->f, &e), e % 32);
+        break;
+    case PREC_DOUBLE:
+    case PREC_FLOAT64:
+        op->d = ldexp(frexp(op->d, &e), e % 32);
+        break;
+    case PREC_QUAD:
+    case PREC_FLOAT128:
+        e = (op->f128.high >> 48) & 0x7fff;
+        op->f128.high &= ~(0x7fffULL << 48);
+        op->f128.high |= (uint64_t)(0x3fff + e % 32) << 48;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        bool no_neg, bool int_range)
 {
     int i;
 
     for (i = 0; i < n_ops; i++) {
         switch (prec) {
+        case PREC_FLOAT16:
+            ops[i].f16 = make_float16(random_ops[i]);
+            if (no_neg && float16_is_neg(ops[i].f16)) {
+                ops[i].f16 = float16_chs(ops[i].f16);
+            }
+            break;
+        case PREC_BFLOAT16:
+            ops[i].bf16 = random_ops[i];
+            if (no_neg && bfloat16_is_neg(ops[i].bf16)) {
+                ops[i].bf16 = bfloat16_chs(ops[i].bf16);
+            }
+            break;
         case PREC_SINGLE:
         case PREC_FLOAT32:
             ops[i].f32 = make_float32(random_ops[i]);
@@ -222,6 +300,9 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
         default:
             g_assert_not_reached();
         }
+        if (int_range) {
+            fill_int_range(&ops[i], prec);
+        }
     }
 }
 
@@ -241,7 +322,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +351,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MAX:
+                    res.f = fmaxf(a, b);
+                    break;
+                case OP_TOINT:
+                    res.u64 = lrintf(a);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,19 +392,116 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MAX:
+                    res.d = fmax(a, b);
+                    break;
+                case OP_TOINT:
+                    res.u64 = llrint(a);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_FLOAT16:
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
+            t0 = get_clock();
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float16 a = ops[0].f16;
+                float16 b = ops[1].f16;
+                float16 c = ops[2].f16;
+
+                if (force_soft) {
+                    soft_status.float_exception_flags = 0;
+                }
+                switch (op) {
+                case OP_ADD:
+                    res.f16 = float16_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    res.f16 = float16_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    res.f16 = float16_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    res.f16 = float16_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    res.f16 = float16_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    res.f16 = float16_sqrt(a, &soft_status);
+                    break;
+                case OP_CMP:
+                    res.u64 = float16_compare_quiet(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.f16 = float16_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float16_to_int32(a, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
+        case PREC_BFLOAT16:
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
+            t0 = get_clock();
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                bfloat16 a = ops[0].bf16;
+                bfloat16 b = ops[1].bf16;
+                bfloat16 c = ops[2].bf16;
+
+                if (force_soft) {
+                    soft_status.float_exception_flags = 0;
+                }
+                switch (op) {
+                case OP_ADD:
+                    res.bf16 = bfloat16_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    res.bf16 = bfloat16_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    res.bf16 = bfloat16_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    res.bf16 = bfloat16_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    res.bf16 = bfloat16_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    res.bf16 = bfloat16_sqrt(a, &soft_status);
+                    break;
+                case OP_CMP:
+                    res.u64 = bfloat16_compare_quiet(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.bf16 = bfloat16_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = bfloat16_to_int32(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
                 float32 b = ops[1].f32;
                 float32 c = ops[2].f32;
 
+                if (force_soft) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f32 = float32_add(a, b, &soft_status);
@@ -340,19 +524,28 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAX:
+                    res.f32 = float32_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float32_to_int32(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
                 float64 b = ops[1].f64;
                 float64 c = ops[2].f64;
 
+                if (force_soft) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f64 = float64_add(a, b, &soft_status);
@@ -375,19 +568,28 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAX:
+                    res.f64 = float64_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
                 float128 b = ops[1].f128;
                 float128 c = ops[2].f128;
 
+                if (force_soft) {
+                    soft_status.float_exception_flags = 0;
+                }
                 switch (op) {
                 case OP_ADD:
                     res.f128 = float128_add(a, b, &soft_status);
@@ -410,6 +612,12 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAX:
+                    res.f128 = float128_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float128_to_int64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -440,7 +648,9 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
     GEN_BENCH(bench_ ## opname ## _double, double, PREC_DOUBLE, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float32, float32, PREC_FLOAT32, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float64, float64, PREC_FLOAT64, op, n_ops) \
-    GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops)
+    GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops) \
+    GEN_BENCH(bench_ ## opname ## _float16, float16, PREC_FLOAT16, op, n_ops) \
+    GEN_BENCH(bench_ ## opname ## _bfloat16, bfloat16, PREC_BFLOAT16, op, n_ops)
 
 GEN_BENCH_ALL_TYPES(add, OP_ADD, 2)
 GEN_BENCH_ALL_TYPES(sub, OP_SUB, 2)
@@ -448,6 +658,8 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(max, OP_MAX, 2)
+GEN_BENCH_ALL_TYPES(toint, OP_TOINT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -455,7 +667,9 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
     GEN_BENCH_NO_NEG(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n) \
-    GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n)
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n) \
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float16, float16, PREC_FLOAT16, op, n) \
+    GEN_BENCH_NO_NEG(bench_ ## name ## _bfloat16, bfloat16, PREC_BFLOAT16, op, n)
 
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
@@ -470,6 +684,8 @@ GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
         [PREC_FLOAT32]   = bench_ ## opname ## _float32,        \
         [PREC_FLOAT64]   = bench_ ## opname ## _float64,        \
         [PREC_FLOAT128]   = bench_ ## opname ## _float128,      \
+        [PREC_FLOAT16]   = bench_ ## opname ## _float16,        \
+        [PREC_BFLOAT16]  = bench_ ## opname ## _bfloat16,       \
     }
 
 static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
@@ -480,6 +696,8 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(max, OP_MAX),
+    GEN_BENCH_FUNCS(toint, OP_TOINT),
 };
 
 #undef GEN_BENCH_FUNCS
@@ -515,10 +733,14 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, "options:\n");
     fprintf(stderr, " -d = duration, in seconds. Default: %d\n",
             DEFAULT_DURATION_SECS);
+    fprintf(stderr, " -f = force softfloat by clearing the inexact flag "
+            "before each operation (soft tester only, not for cmp and "
+            "max). Default: disabled\n");
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
-    fprintf(stderr, " -p = floating point precision (single, double, quad[soft only]). "
+    fprintf(stderr, " -p = floating point precision (single, double, "
+            "quad[soft only], half[soft only], bfloat16[soft only]). "
             "Default: single\n");
     fprintf(stderr, " -r = rounding mode (even, zero, down, up, tieaway). "
             "Default: even\n");
@@ -614,7 +836,7 @@ static void parse_args(int argc, char *argv[])
     int rounding = ROUND_EVEN;
 
     for (;;) {
-        c = getopt(argc, argv, "d:ho:p:r:t:zZ");
+        c = getopt(argc, argv, "d:fho:p:r:t:zZ");
         if (c < 0) {
             break;
         }
@@ -622,6 +844,9 @@ static void parse_args(int argc, char *argv[])
         case 'd':
             duration = atoi(optarg);
             break;
+        case 'f':
+            force_soft = true;
+            break;
         case 'h':
             usage_complete(argc, argv);
             exit(EXIT_SUCCESS);
@@ -640,6 +865,10 @@ static void parse_args(int argc, char *argv[])
                 precision = PREC_DOUBLE;
             } else if (!strcmp(optarg, "quad")) {
                 precision = PREC_QUAD;
+            } else if (!strcmp(optarg, "half")) {
+                precision = PREC_FLOAT16;
+            } else if (!strcmp(optarg, "bfloat16")) {
+                precision = PREC_BFLOAT16;
             } else {
                 fprintf(stderr, "Unsupported precision '%s'\n", optarg);
                 exit(EXIT_FAILURE);
@@ -669,6 +898,16 @@ static void parse_args(int argc, char *argv[])
         }
     }
 
+    /*
+     * Comparisons and min/max never raise inexact, so their hardfloat
+     * paths do not look at the flag and -f would not disable them.
+     */
+    if (force_soft && (operation == OP_CMP || operation == OP_MAX)) {
+        fprintf(stderr, "fatal: -f cannot force softfloat for '%s'\n",
+                op_names[operation]);
+        exit(EXIT_FAILURE);
+    }
+
     /* set precision and rounding mode based on the tester */
     switch (tester) {
     case TESTER_HOST:
@@ -686,6 +925,9 @@ static void parse_args(int argc, char *argv[])
         case PREC_QUAD:
             precision = PREC_FLOAT128;
             break;
+        case PREC_FLOAT16:
+        case PREC_BFLOAT16:
+            break;
         default:
             g_assert_not_reached();
         }
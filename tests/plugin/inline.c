@@ -0,0 +1,154 @@
+/*
+ * Check per-vCPU inline operations against callbacks
+ *
+ * Every event is counted twice, once from a callback and once with an
+ * inline op on a scoreboard, and the totals must match. Conditional
+ * callbacks and inline stores are checked along the way.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/* number of TB executions between two conditional callbacks */
+#define COND_PERIOD 1000
+
+typedef struct {
+    uint64_t tb_count;
+    uint64_t tb_count_inline;
+    uint64_t insn_count;
+    uint64_t insn_count_inline;
+    uint64_t mem_count;
+    uint64_t mem_count_inline;
+    uint64_t tb_vaddr;
+    uint64_t cond_count;
+    uint64_t cond_hits;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 tb_count;
+static qemu_plugin_u64 tb_count_inline;
+static qemu_plugin_u64 insn_count;
+static qemu_plugin_u64 insn_count_inline;
+static qemu_plugin_u64 mem_count;
+static qemu_plugin_u64 mem_count_inline;
+static qemu_plugin_u64 tb_vaddr;
+static qemu_plugin_u64 cond_count;
+static qemu_plugin_u64 cond_hits;
+
+static void plugin_exit(qemu_plugin_id_t id, void *udata)
+{
+    uint64_t tb = qemu_plugin_u64_sum(tb_count);
+    uint64_t insn = qemu_plugin_u64_sum(insn_count);
+    uint64_t mem = qemu_plugin_u64_sum(mem_count);
+    uint64_t hits = qemu_plugin_u64_sum(cond_hits);
+    g_autoptr(GString) report = g_string_new("");
+
+    g_string_printf(report, "tb: %" PRIu64 ", insn: %" PRIu64
+                    ", mem: %" PRIu64 ", cond: %" PRIu64 "\n",
+                    tb, insn, mem, hits);
+    qemu_plugin_outs(report->str);
+
+    g_assert(qemu_plugin_u64_sum(tb_count_inline) == tb);
+    g_assert(qemu_plugin_u64_sum(insn_count_inline) == insn);
+    g_assert(qemu_plugin_u64_sum(mem_count_inline) == mem);
+    g_assert(hits * COND_PERIOD + qemu_plugin_u64_sum(cond_count) == tb);
+
+    qemu_plugin_scoreboard_free(counts);
+}
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(tb_count, cpu_index, 1);
+}
+
+static void vcpu_tb_cond(unsigned int cpu_index, void *udata)
+{
+    g_assert(qemu_plugin_u64_get(cond_count, cpu_index) == COND_PERIOD);
+    qemu_plugin_u64_set(cond_count, cpu_index, 0);
+    qemu_plugin_u64_add(cond_hits, cpu_index, 1);
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    /* the TB inline store runs before any instruction of the TB */
+    g_assert(qemu_plugin_u64_get(tb_vaddr, cpu_index) ==
+             (uint64_t)(uintptr_t)udata);
+    qemu_plugin_u64_add(insn_count, cpu_index, 1);
+}
+
+static void vcpu_mem_access(unsigned int cpu_index, qemu_plugin_meminfo_t info,
+                            uint64_t vaddr, void *udata)
+{
+    qemu_plugin_u64_add(mem_count, cpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    uint64_t pc = qemu_plugin_tb_vaddr(tb);
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_count_inline, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_STORE_U64, tb_vaddr, pc);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, cond_count, 1);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_tb_cond, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_GE, cond_count, COND_PERIOD, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS,
+                                               (void *)(uintptr_t)pc);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_count_inline, 1);
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            mem_count_inline, 1);
+    }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    tb_count = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                    tb_count);
+    tb_count_inline = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                           tb_count_inline);
+    insn_count = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                      insn_count);
+    insn_count_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_count_inline);
+    mem_count = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                     mem_count);
+    mem_count_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_count_inline);
+    tb_vaddr = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                    tb_vaddr);
+    cond_count = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                      cond_count);
+    cond_hits = qemu_plugin_scoreboard_u64_in_struct(counts, CPUCount,
+                                                     cond_hits);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
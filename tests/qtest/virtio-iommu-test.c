@@ -0,0 +1,91 @@
+/*
+ * QTest testcase for the virtio-iommu bypass address spaces
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+#include "libqos/pci-pc.h"
+#include "libqos/qgraph.h"
+#include "libqos/virtio-pci.h"
+#include "standard-headers/linux/virtio_config.h"
+#include "standard-headers/linux/virtio_iommu.h"
+
+#define IOMMU_ARGS "-device virtio-iommu-pci,addr=04.0 " \
+                   "-device pci-testdev,addr=05.0"
+
+/*
+ * pci-testdev sits behind the IOMMU and has no endpoint, so its DMA
+ * bypasses the IOMMU exactly when VIRTIO_IOMMU_F_BYPASS is negotiated.
+ * Its address space then shows the bypass alias rather than the IOMMU
+ * region, disabled regions being hidden.
+ */
+static bool testdev_bypassed(QTestState *qts)
+{
+    g_autofree char *mtree = qtest_hmp(qts, "info mtree");
+
+    return strstr(mtree, "alias virtio-iommu-bypass") != NULL;
+}
+
+static QVirtioPCIDevice *start_with_bypass(QTestState *qts, QPCIBus *pcibus)
+{
+    QPCIAddress addr = { .devfn = QPCI_DEVFN(0x4, 0x0) };
+    QVirtioPCIDevice *dev = virtio_pci_new(pcibus, &addr);
+    uint64_t features;
+
+    g_assert_nonnull(dev);
+    qvirtio_pci_device_enable(dev);
+    qvirtio_start_device(&dev->vdev);
+
+    g_assert(!testdev_bypassed(qts));
+
+    features = qvirtio_get_features(&dev->vdev);
+    g_assert_cmphex(features & (1ull << VIRTIO_IOMMU_F_BYPASS), !=, 0);
+    qvirtio_set_features(&dev->vdev, (1ull << VIRTIO_F_VERSION_1) |
+                                     (1ull << VIRTIO_IOMMU_F_BYPASS));
+    qvirtio_set_driver_ok(&dev->vdev);
+
+    g_assert(testdev_bypassed(qts));
+    return dev;
+}
+
+static void test_guest_reset(void)
+{
+    QTestState *qts = qtest_init(IOMMU_ARGS);
+    QPCIBus *pcibus = qpci_new_pc(qts, NULL);
+    QVirtioPCIDevice *dev = start_with_bypass(qts, pcibus);
+
+    /* The reset clears the negotiated features */
+    qvirtio_reset(&dev->vdev);
+    g_assert(!testdev_bypassed(qts));
+
+    qos_object_destroy((QOSGraphObject *)dev);
+    qpci_free_pc(pcibus);
+    qtest_quit(qts);
+}
+
+static void test_system_reset(void)
+{
+    QTestState *qts = qtest_init(IOMMU_ARGS);
+    QPCIBus *pcibus = qpci_new_pc(qts, NULL);
+    QVirtioPCIDevice *dev = start_with_bypass(qts, pcibus);
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'system_reset' }");
+    qtest_qmp_eventwait(qts, "RESET");
+    g_assert(!testdev_bypassed(qts));
+
+    qos_object_destroy((QOSGraphObject *)dev);
+    qpci_free_pc(pcibus);
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/virtio-iommu/bypass/guest-reset", test_guest_reset);
+    qtest_add_func("/virtio-iommu/bypass/system-reset", test_system_reset);
+
+    return g_test_run();
+}
@@ -0,0 +1,155 @@
+/*
+ * Fixed workload for comparing TCG backends
+ *
+ * Run a small bytecode interpreter over a fixed program: the hot loop
+ * is dominated by loads, stores, ALU operations and compare-and-branch,
+ * which are the operations that matter most for the speed of the
+ * translated code.  Report the elapsed time and the throughput, and
+ * check the result so that the same binary can be timed under a TCI
+ * build and a native TCG build of QEMU.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ROUNDS      200
+#define ITERATIONS  1000
+#define MEM_SIZE    256
+
+/* Checksum of mem[] after ROUNDS runs of program[]. */
+#define EXPECTED_SUM 0xf031e5acu
+
+enum {
+    OP_LOADI,       /* r[a] = imm */
+    OP_MOV,         /* r[a] = r[b] */
+    OP_ADD,         /* r[a] += r[b] */
+    OP_XOR,         /* r[a] ^= r[b] */
+    OP_SHL,         /* r[a] <<= imm */
+    OP_SHR,         /* r[a] >>= imm */
+    OP_LOAD,        /* r[a] = mem[r[b] % MEM_SIZE] */
+    OP_STORE,       /* mem[r[b] % MEM_SIZE] = r[a] */
+    OP_DEC_JNZ,     /* if (--r[a]) pc = imm */
+    OP_HALT,
+};
+
+typedef struct {
+    uint8_t op, a, b;
+    uint32_t imm;
+} Insn;
+
+/* xorshift32 in r0, mixed through memory into r2. */
+static const Insn program[] = {
+    { OP_LOADI,   0, 0, 0x12345678 },
+    { OP_LOADI,   1, 0, ITERATIONS },
+    { OP_LOADI,   2, 0, 0 },
+    /* loop: pc == 3 */
+    { OP_MOV,     4, 0, 0 },
+    { OP_SHL,     4, 0, 13 },
+    { OP_XOR,     0, 4, 0 },
+    { OP_MOV,     4, 0, 0 },
+    { OP_SHR,     4, 0, 17 },
+    { OP_XOR,     0, 4, 0 },
+    { OP_MOV,     4, 0, 0 },
+    { OP_SHL,     4, 0, 5 },
+    { OP_XOR,     0, 4, 0 },
+    { OP_LOAD,    3, 0, 0 },
+    { OP_ADD,     3, 2, 0 },
+    { OP_STORE,   3, 2, 0 },
+    { OP_ADD,     2, 3, 0 },
+    { OP_DEC_JNZ, 1, 0, 3 },
+    { OP_HALT,    0, 0, 0 },
+};
+
+static uint32_t mem[MEM_SIZE];
+
+static uint64_t run(const Insn *code)
+{
+    uint32_t r[8] = { 0 };
+    uint64_t count = 0;
+    unsigned pc = 0;
+
+    for (;;) {
+        const Insn *i = &code[pc++];
+
+        count++;
+        switch (i->op) {
+        case OP_LOADI:
+            r[i->a] = i->imm;
+            break;
+        case OP_MOV:
+            r[i->a] = r[i->b];
+            break;
+        case OP_ADD:
+            r[i->a] += r[i->b];
+            break;
+        case OP_XOR:
+            r[i->a] ^= r[i->b];
+            break;
+        case OP_SHL:
+            r[i->a] <<= i->imm;
+            break;
+        case OP_SHR:
+            r[i->a] >>= i->imm;
+            break;
+        case OP_LOAD:
+            r[i->a] = mem[r[i->b] % MEM_SIZE];
+            break;
+        case OP_STORE:
+            mem[r[i->b] % MEM_SIZE] = r[i->a];
+            break;
+        case OP_DEC_JNZ:
+            if (--r[i->a]) {
+                pc = i->imm;
+            }
+            break;
+        case OP_HALT:
+            return count;
+        default:
+            abort();
+        }
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+    uint64_t insns = 0;
+    uint32_t sum = 0;
+    double start, elapsed;
+    int i;
+
+    for (i = 0; i < MEM_SIZE; i++) {
+        mem[i] = i * 0x9e3779b9u;
+    }
+
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        insns += run(program);
+    }
+    elapsed = now() - start;
+
+    for (i = 0; i < MEM_SIZE; i++) {
+        sum = (sum << 1 | sum >> 31) ^ mem[i];
+    }
+
+    printf("%llu bytecode insns in %.3f s, %.2f M insns/s, checksum %08x\n",
+           (unsigned long long)insns, elapsed,
+           elapsed > 0 ? insns / elapsed / 1e6 : 0.0, sum);
+
+    if (sum != EXPECTED_SUM) {
+        fprintf(stderr, "checksum mismatch: expected %08x\n", EXPECTED_SUM);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
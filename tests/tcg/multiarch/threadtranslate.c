@@ -0,0 +1,128 @@
+/*
+ * Concurrent translation exerciser
+ *
+ * Run a growing number of threads, each one calling its own set of
+ * functions that have never been executed before, so that the time of
+ * each phase is dominated by translation.  Report the translation
+ * throughput of each phase, and check that the functions compute the
+ * same results once translated.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef uint64_t (*FnPtr)(uint64_t);
+
+#define FN(n)                                                   \
+static __attribute__((noinline)) uint64_t fn_##n(uint64_t x)    \
+{                                                               \
+    x ^= (uint64_t)n * 0x9e3779b97f4a7c15ull;                   \
+    x = (x << (n % 13 + 1)) | (x >> (63 - n % 13));             \
+    if (x & n) {                                                \
+        x += n * 7;                                             \
+    } else {                                                    \
+        x -= n * 3;                                             \
+    }                                                           \
+    x *= 0xff51afd7ed558ccdull + n;                             \
+    return x ^ (x >> 33);                                       \
+}
+
+#define PTR(n) fn_##n,
+
+#define REP8(M, n) \
+    M(n##0) M(n##1) M(n##2) M(n##3) M(n##4) M(n##5) M(n##6) M(n##7)
+#define REP64(M, n) \
+    REP8(M, n##0) REP8(M, n##1) REP8(M, n##2) REP8(M, n##3) \
+    REP8(M, n##4) REP8(M, n##5) REP8(M, n##6) REP8(M, n##7)
+#define REP512(M, n) \
+    REP64(M, n##0) REP64(M, n##1) REP64(M, n##2) REP64(M, n##3) \
+    REP64(M, n##4) REP64(M, n##5) REP64(M, n##6) REP64(M, n##7)
+#define FUNCS(M) \
+    REP512(M, 1) REP512(M, 2) REP512(M, 3) REP512(M, 4) \
+    REP512(M, 5) REP512(M, 6) REP512(M, 7) REP512(M, 8)
+
+FUNCS(FN)
+
+static const FnPtr fns[] = { FUNCS(PTR) };
+
+#define NUM_FNS (sizeof(fns) / sizeof(fns[0]))
+#define NUM_PHASES 4
+
+typedef struct {
+    const FnPtr *fns;
+    size_t n;
+    uint64_t first, second;
+} ThreadArg;
+
+static void *thread_fn(void *varg)
+{
+    ThreadArg *arg = varg;
+    size_t i;
+
+    /* The first pass translates, the second one runs the cached code */
+    for (i = 0; i < arg->n; i++) {
+        arg->first += arg->fns[i](i);
+    }
+    for (i = 0; i < arg->n; i++) {
+        arg->second += arg->fns[i](i);
+    }
+    return NULL;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    size_t per_phase = NUM_FNS / NUM_PHASES;
+    double base = 0;
+    int phase;
+
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        int nthreads = 1 << phase;
+        size_t per_thread = per_phase / nthreads;
+        pthread_t threads[1 << (NUM_PHASES - 1)];
+        ThreadArg args[1 << (NUM_PHASES - 1)];
+        double start, elapsed;
+        int i;
+
+        start = now_ms();
+        for (i = 0; i < nthreads; i++) {
+            args[i].fns = &fns[phase * per_phase + i * per_thread];
+            args[i].n = per_thread;
+            args[i].first = args[i].second = 0;
+            if (pthread_create(&threads[i], NULL, thread_fn, &args[i])) {
+                perror("pthread_create");
+                return EXIT_FAILURE;
+            }
+        }
+        for (i = 0; i < nthreads; i++) {
+            pthread_join(threads[i], NULL);
+            if (args[i].first != args[i].second) {
+                fprintf(stderr, "thread %d of %d: mismatch %#llx != %#llx\n",
+                        i, nthreads, (unsigned long long)args[i].first,
+                        (unsigned long long)args[i].second);
+                return EXIT_FAILURE;
+            }
+        }
+        elapsed = now_ms() - start;
+        if (phase == 0) {
+            base = elapsed;
+        }
+        printf("%d thread(s): %zu fresh functions in %.2f ms, "
+               "%.1f functions/ms, speedup %.2fx\n",
+               nthreads, per_phase, elapsed, per_phase / elapsed,
+               base / elapsed);
+    }
+    return EXIT_SUCCESS;
+}